@@ -271,6 +271,10 @@ int adaptived_farray_linear_regression(float * const array, int array_len, int i
  * @param value Long long value to write into the setting file
  * @param flags Optional flags.  See ADAPTIVED_CGROUP_FLAGS_* for supported options
  * @param validate If true, validate that the value was successfully written
+ *
+ * When called from an effect during adaptived_loop(), the write is deferred until all of the
+ * rules in the loop have run.  Only the last value written to a setting in a loop is applied,
+ * and validation and errors are reported by adaptived_loop()
  */
 int adaptived_cgroup_set_ll(const char * const setting, long long value, uint32_t flags);
 
@@ -293,6 +297,8 @@ int adaptived_cgroup_get_float(const char * const setting, float * const value);
  * @param setting Complete path to the cgroup setting being modified
  * @param value String value to write into the setting file
  * @param flags Optional flags.  See ADAPTIVED_CGROUP_FLAGS_* for supported options
+ *
+ * Writes from effects are deferred just as with adaptived_cgroup_set_ll()
  */
 int adaptived_cgroup_set_str(const char * const setting, const char * const value, uint32_t flags);
 
@@ -332,7 +338,7 @@ bool adaptived_cgroup_setting_is_max(const char * const setting);
 /**
  * Read and return the requested memory.stat field value.
  * @param memorystat_file Path to the cgroup's memory.stat file
- * @param field The field in memory.stat file to parse
+ * @param field The field in memory.stat file to parse.  Must exactly match the field name
  * @param ll_valuep Output pointer for storing the value
  *
  * @Note All data is returned in bytes
@@ -345,7 +351,8 @@ int adaptived_cgroup_get_memorystat_field(const char * const memorystat_file,
  * Read and return the /proc/meminfo field value.
  * @param meminfo_file Path to the meminfo file to be parsed (optional).  If NULL, /proc/meminfo
  * is used
- * @param field The field in the meminfo file to parse
+ * @param field The field in the meminfo file to parse, without the trailing colon.  Must
+ * exactly match the field name, e.g. "Cached" will not match "SwapCached"
  * @param ll_valuep Output pointer for storing the value
  *
  * @Note For fields that are in bytes, kilobytes, etc., adaptived_get_meminfo_field() will return
@@ -445,9 +452,10 @@ enum cg_setting_enum {
  *
  * @return Returns 0 on success or a negative number on failure
  *
- * Note that this function invokes the sd_bus_get_property() call for the systemd1 DBus listener.
- * Currently it returns results immediately to the caller, but in the future, it may block (or
- * provide a callback) if the operation takes too much time
+ * Note that the write is queued rather than sent immediately.  adaptived_loop() sends the queued
+ * writes once per loop, one SetUnitProperties call per target, and logs any errors reported by
+ * systemd when the replies arrive.  Reads of the target send the queued writes first and thus
+ * always see them.  ADAPTIVED_CGROUP_FLAGS_VALIDATE reads the value back and waits on systemd
  */
 int adaptived_sd_bus_set_ll(const char * const target, const char * const property, long long value,
 			 uint32_t flags);
@@ -476,9 +484,10 @@ int adaptived_sd_bus_get_ll(const char * const target, const char * const proper
  *
  * @return Returns 0 on success or a negative number on failure
  *
- * Note that this function invokes the sd_bus_get_property() call for the systemd1 DBus listener.
- * Currently it returns results immediately to the caller, but in the future, it may block (or
- * provide a callback) if the operation takes too much time
+ * Note that the write is queued rather than sent immediately.  adaptived_loop() sends the queued
+ * writes once per loop, one SetUnitProperties call per target, and logs any errors reported by
+ * systemd when the replies arrive.  Reads of the target send the queued writes first and thus
+ * always see them.  ADAPTIVED_CGROUP_FLAGS_VALIDATE reads the value back and waits on systemd
  */
 int adaptived_sd_bus_set_str(const char * const target, const char * const property,
 			  const char * const value, uint32_t flags);
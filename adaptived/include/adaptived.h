@@ -59,6 +59,7 @@ enum adaptived_attr {
 	ADAPTIVED_ATTR_DAEMON_MODE, /* run as daemon */
 	ADAPTIVED_ATTR_DAEMON_NOCHDIR,
 	ADAPTIVED_ATTR_DAEMON_NOCLOSE,
+	ADAPTIVED_ATTR_WORKER_THREADS, /* threads used to evaluate causes.  0 or 1 is serial */
 
 	ADAPTIVED_ATTR_CNT
 };
@@ -33,10 +33,12 @@ extern "C" {
 #endif
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <pthread.h>
 #include <syslog.h>
 #include <stdio.h>
 
+#include <adaptived-utils.h>
 #include <adaptived.h>
 
 #include "cause.h"
@@ -70,6 +72,14 @@ struct adaptived_rule {
 	struct adaptived_effect *effects;
 	struct json_object *json; /* only used when building a rule at runtime */
 	struct adaptived_rule_stats stats;
+	int causes_ret; /* result of rule_run_causes() when run by the worker pool */
+
+	/* scheduling.  times are on adaptived_loop()'s clock, in milliseconds */
+	int interval; /* 0 means run every ctx->interval */
+	long long next_run;
+	long long last_run;
+	int time_since_last_run;
+	bool due; /* run this rule in the current loop */
 
 	struct adaptived_rule *next;
 };
@@ -89,8 +99,37 @@ struct adaptived_ctx {
 	int daemon_nochdir;
 	int daemon_noclose;
 	bool daemon_mode;
+	int worker_threads; /* threads used to evaluate causes.  <= 1 is serial */
+};
+
+/*
+ * binlog_utils.c functions
+ */
+
+/*
+ * A buffer of binary log records.  The records are stamped with the timestamps
+ * from the most recent binlog_buf_stamp()
+ */
+struct binlog_buf {
+	char *buf;
+	size_t len;
+	size_t size;
+
+	uint64_t realtime_ns;
+	uint64_t monotonic_ns;
 };
 
+void binlog_buf_stamp(struct binlog_buf * const bb);
+int binlog_header(struct binlog_buf * const bb);
+int binlog_check_header(int fd);
+int binlog_raw(struct binlog_buf * const bb, const char * const path,
+	       const char * const data, size_t data_len);
+int binlog_schedstat(struct binlog_buf * const bb,
+		     const struct adaptived_schedstat_snapshot * const ss);
+int binlog_pressure(struct binlog_buf * const bb, const char * const path,
+		    const struct adaptived_pressure_snapshot * const ps);
+int binlog_meminfo(struct binlog_buf * const bb, const char * const buf);
+
 /*
  * cause.c functions
  */
@@ -100,6 +139,20 @@ void cause_destroy(struct adaptived_cause ** cse);
 void causes_init(void);
 void causes_cleanup(void);
 
+/*
+ * cgroup_utils.c functions
+ */
+
+struct file_reader;
+int reader_get_cgroup_value(struct file_reader * const reader,
+			    struct adaptived_cgroup_value * const value);
+int cgroup_kill(const char * const cgroup_path);
+int cgroup_signal_procs(const char * const cgroup_path, int signal, int max_cnt,
+			int * const signaled_cnt);
+void cgroup_journal_start(void);
+void cgroup_journal_stop(void);
+int cgroup_journal_flush(void);
+
 /*
  * effect.c functions
  */
@@ -115,6 +168,21 @@ void effects_cleanup(void);
 
 int get_ll_field_in_file(const char * const file, const char * const field,
 			 const char * const separator, long long * const ll_valuep);
+void snapshot_cache_start(void);
+void snapshot_cache_invalidate(void);
+void snapshot_cache_stop(void);
+FILE *snapshot_fopen(const char * const path);
+
+/*
+ * The file is a setting that can be written while adaptived is running, e.g. by an
+ * effect.  Always read it rather than serving it from the snapshot cache
+ */
+#define FILE_READER_NO_CACHE	0x1
+
+int file_reader_open(const char * const path, uint32_t flags,
+		     struct file_reader ** const readerp);
+int file_reader_read(struct file_reader * const reader, char ** const bufp, size_t * const lenp);
+void file_reader_close(struct file_reader ** const readerp);
 
 /*
  * log.c functions
@@ -135,10 +203,43 @@ long long adaptived_parse_human_readable(const char * const input);
 int parse_cause_operation(struct json_object * const args_obj, const char * const name,
 			  enum cause_op_enum * const op);
 
+/*
+ * path_utils.c functions
+ */
+
+void path_walk_cache_cleanup(void);
+
+/*
+ * pressure_utils.c functions
+ */
+
+int reader_get_pressure(struct file_reader * const reader,
+			struct adaptived_pressure_snapshot * const ps);
+int reader_get_pressure_avg(struct file_reader * const reader,
+			    enum adaptived_pressure_meas_enum meas, float * const avg);
+int reader_get_pressure_total(struct file_reader * const reader,
+			      enum adaptived_pressure_meas_enum meas, long long * const total);
+
 /*
  * proc_pid_stat_utils.c functions
  */
 
+struct proc_pid_stat {
+	pid_t pid;
+	const char *comm;
+	char state;
+	unsigned long long starttime;
+	long long vsize;
+	long long rss;
+};
+
+struct proc_scanner;
+typedef int (*proc_scanner_cb)(const struct proc_pid_stat * const stat, void * const data);
+
+int proc_scanner_open(const char * const proc_path, struct proc_scanner ** const scannerp);
+int proc_scanner_scan(struct proc_scanner * const scanner, proc_scanner_cb cb,
+		      void * const data);
+void proc_scanner_close(struct proc_scanner ** const scannerp);
 int _sort_pid_list(const void *p1, const void *p2);
 
 /*
@@ -147,6 +248,19 @@ int _sort_pid_list(const void *p1, const void *p2);
 
 struct adaptived_rule *rule_init(const char * const name);
 void rule_destroy(struct adaptived_rule ** rule);
+int rule_run_causes(struct adaptived_rule * const rule, int time_since_last_run);
+
+/*
+ * sd_bus_utils.c functions
+ */
+
+struct pollfd;
+int bus_conn_flush(void);
+int bus_conn_get_pollfd(struct pollfd * const pfd);
+void bus_conn_process(void);
+void bus_conn_start(void);
+void bus_conn_stop(void);
+void bus_conn_cleanup(void);
 
 /*
  * shared_data.c functions
@@ -158,6 +272,15 @@ int write_sdata_cgroup_setting_value(struct adaptived_cause * const cse,
 				     const struct adaptived_cgroup_value * const value,
 				     uint32_t flags);
 
+/*
+ * worker_pool.c functions
+ */
+
+struct worker_pool;
+int worker_pool_create(int thread_cnt, struct worker_pool ** const poolp);
+void worker_pool_destroy(struct worker_pool ** const poolp);
+int worker_pool_run(struct worker_pool * const pool, struct adaptived_rule * const rules);
+
 /*
  * mem_utils defines
  */
@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2025, Oracle and/or its affiliates.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * You should have received a copy of the GNU General Public License version
+ * 2 along with this work; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Please contact Oracle, 500 Oracle Parkway, Redwood Shores, CA 94065 USA
+ * or visit www.oracle.com if you need additional information or have any
+ * questions.
+ */
+/**
+ * Binary snapshot log format
+ *
+ * The logger and print_schedstat effects can write their snapshots as binary
+ * records rather than text.  A binary log is a struct binlog_header followed by
+ * any number of records.  Every record starts with a struct binlog_record and is
+ * padded to a multiple of BINLOG_ALIGN bytes, so a log can be mmap()ed and its
+ * records read in place.  All fields are fixed width and in the byte order of the
+ * machine that wrote them, which is recorded in the header.
+ *
+ * Readers must skip record types they don't know, using binlog_record.len.  New
+ * fields may only be added to the end of a record in a new version.
+ */
+
+#ifndef __ADAPTIVED_BINLOG_H
+#define __ADAPTIVED_BINLOG_H
+
+#include <stdint.h>
+
+#define BINLOG_MAGIC		"ADPTVLOG"
+#define BINLOG_MAGIC_LEN	8
+#define BINLOG_VERSION		1
+#define BINLOG_BYTE_ORDER	0x01020304
+#define BINLOG_ALIGN		8
+
+#define BINLOG_PAD(len)		(((len) + BINLOG_ALIGN - 1) & ~((uint64_t)BINLOG_ALIGN - 1))
+
+struct binlog_header {
+	char magic[BINLOG_MAGIC_LEN];
+	uint32_t version;
+	uint32_t byte_order;	/* BINLOG_BYTE_ORDER */
+};
+
+enum binlog_record_type {
+	BINLOG_RAW = 1,
+	BINLOG_SCHEDSTAT,
+	BINLOG_PRESSURE,
+	BINLOG_MEMINFO,
+};
+
+struct binlog_record {
+	uint32_t type;		/* enum binlog_record_type */
+	uint32_t len;		/* length of the record, including this header and padding */
+	uint64_t realtime_ns;	/* CLOCK_REALTIME when the record was captured */
+	uint64_t monotonic_ns;	/* CLOCK_MONOTONIC when the record was captured */
+};
+
+/*
+ * BINLOG_RAW - the contents of a file that has no binary encoding.  Followed by
+ * the NUL-terminated path and then data_len bytes of the file
+ */
+struct binlog_raw {
+	uint32_t path_len;	/* including the NUL */
+	uint32_t data_len;
+};
+
+/*
+ * BINLOG_SCHEDSTAT - an adaptived_schedstat_snapshot.  Followed by nr_cpus
+ * struct binlog_schedstat_cpu and then nr_domains struct binlog_schedstat_domain.
+ * Only the cpus and domains that are present on the system are stored
+ */
+struct binlog_schedstat {
+	uint64_t timestamp;	/* jiffies */
+	uint32_t nr_cpus;
+	uint32_t nr_domains;	/* total across all cpus */
+};
+
+struct binlog_schedstat_cpu {
+	uint64_t run_time;
+	uint64_t run_delay;
+	uint64_t nr_timeslices;
+	uint32_t ttwu;
+	uint32_t ttwu_local;
+	uint32_t first_domain;	/* index of this cpu's first domain */
+	uint32_t nr_domains;
+};
+
+#define BINLOG_IDLE_TYPES	3
+#define BINLOG_LB_FIELDS	8
+
+struct binlog_schedstat_domain {
+	uint32_t cpumask;
+	/*
+	 * per idle type: lb_called, lb_balanced, lb_failed, lb_imbal, lb_gained,
+	 * lb_not_gained, lb_nobusy_rq, lb_nobusy_grp
+	 */
+	uint32_t lb[BINLOG_IDLE_TYPES][BINLOG_LB_FIELDS];
+	uint32_t alb_called;
+	uint32_t alb_failed;
+	uint32_t alb_pushed;
+	uint32_t ttwu_remote;
+	uint32_t ttwu_move_affine;
+};
+
+/*
+ * BINLOG_PRESSURE - an adaptived_pressure_snapshot.  Followed by the NUL-terminated
+ * path of the PSI file
+ */
+struct binlog_pressure_avgs {
+	uint32_t avg10;		/* hundredths of a percent */
+	uint32_t avg60;
+	uint32_t avg300;
+	uint32_t pad;
+	uint64_t total;		/* microseconds */
+};
+
+struct binlog_pressure {
+	struct binlog_pressure_avgs some;
+	struct binlog_pressure_avgs full;
+};
+
+/*
+ * BINLOG_MEMINFO - /proc/meminfo.  Followed by nr_fields uint64_t values, in the
+ * order of binlog_meminfo_fields[], as they are reported by the kernel (i.e. most
+ * are in kB).  Fields that the kernel doesn't report are BINLOG_MEMINFO_MISSING
+ */
+struct binlog_meminfo {
+	uint32_t nr_fields;
+	uint32_t pad;
+};
+
+#define BINLOG_MEMINFO_MISSING	UINT64_MAX
+
+/* only ever append to this list */
+static const char * const binlog_meminfo_fields[] = {
+	"MemTotal", "MemFree", "MemAvailable", "Buffers", "Cached", "SwapCached",
+	"Active", "Inactive", "Active(anon)", "Inactive(anon)", "Active(file)",
+	"Inactive(file)", "Unevictable", "Mlocked", "SwapTotal", "SwapFree", "Zswap",
+	"Zswapped", "Dirty", "Writeback", "AnonPages", "Mapped", "Shmem", "KReclaimable",
+	"Slab", "SReclaimable", "SUnreclaim", "KernelStack", "PageTables",
+	"SecPageTables", "NFS_Unstable", "Bounce", "WritebackTmp", "CommitLimit",
+	"Committed_AS", "VmallocTotal", "VmallocUsed", "VmallocChunk", "Percpu",
+	"HardwareCorrupted", "AnonHugePages", "ShmemHugePages", "ShmemPmdMapped",
+	"FileHugePages", "FilePmdMapped", "CmaTotal", "CmaFree", "Unaccepted",
+	"HugePages_Total", "HugePages_Free", "HugePages_Rsvd", "HugePages_Surp",
+	"Hugepagesize", "Hugetlb", "DirectMap4k", "DirectMap2M", "DirectMap1G",
+};
+
+#define BINLOG_MEMINFO_CNT	(sizeof(binlog_meminfo_fields) / sizeof(binlog_meminfo_fields[0]))
+
+#endif /* __ADAPTIVED_BINLOG_H */
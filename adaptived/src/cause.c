@@ -283,6 +283,7 @@ struct adaptived_cause *cause_init(const char * const name)
 		goto error;
 
 	strcpy(cse->name, name);
+	cse->poll_fd = -1;
 
 	return cse;
 error:
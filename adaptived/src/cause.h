@@ -82,6 +82,15 @@ struct adaptived_cause {
 	 */
 	struct shared_data *sdata;
 
+	/*
+	 * Optional file descriptor that adaptived_loop() will poll() on rather than
+	 * sleeping for the entire interval, e.g. a PSI trigger.  Set to -1 if the
+	 * cause doesn't support event notification.  The events returned by the most
+	 * recent poll() are stored in poll_revents prior to invoking the cause's main()
+	 */
+	int poll_fd;
+	short poll_revents;
+
 	/* private data store for each cause plugin */
 	void *data;
 };
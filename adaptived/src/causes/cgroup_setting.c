@@ -41,6 +41,8 @@ struct cgset_opts {
 	char *setting;
 	struct adaptived_cgroup_value threshold;
 	enum cg_setting_enum cg_setting_type;
+
+	struct file_reader *reader; /* persistent handle on the setting file */
 };
 
 static void free_opts(struct cgset_opts * const opts)
@@ -48,6 +50,7 @@ static void free_opts(struct cgset_opts * const opts)
 	if (!opts)
 		return;
 
+	file_reader_close(&opts->reader);
 	if (opts->setting)
 		free(opts->setting);
 
@@ -92,6 +95,10 @@ int _cgset_init(struct adaptived_cause * const cse, struct json_object *args_obj
 	if (ret)
 		goto error;
 
+	ret = file_reader_open(opts->setting, FILE_READER_NO_CACHE, &opts->reader);
+	if (ret)
+		goto error;
+
 	ret = adaptived_cause_set_data(cse, (void *)opts);
 	if (ret)
 		goto error;
@@ -124,7 +131,7 @@ int _cgset_main(struct adaptived_cause * const cse, int time_since_last_run)
 
 	val.type = opts->threshold.type;
 
-	ret = adaptived_cgroup_get_value(opts->setting, &val);
+	ret = reader_get_cgroup_value(opts->reader, &val);
 	if (ret)
 		return ret;
 
@@ -150,11 +150,11 @@ error:
 int days_of_the_week_main(struct adaptived_cause * const cse, int time_since_last_run)
 {
 	struct days_of_the_week_opts *opts = (struct days_of_the_week_opts *)cse->data;
-	struct tm *cur_tm;
+	struct tm tm_buf, *cur_tm;
 	time_t cur_time;
 
 	time(&cur_time);
-	cur_tm = localtime(&cur_time);
+	cur_tm = localtime_r(&cur_time, &tm_buf);
 
 	switch (cur_tm->tm_wday) {
 		case 0: /* Sunday */
@@ -29,7 +29,11 @@
 #include <stdbool.h>
 #include <assert.h>
 #include <string.h>
+#include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <poll.h>
 
 #include <adaptived-utils.h>
 #include <adaptived.h>
@@ -62,17 +66,99 @@ const char * const meas_names[] = {
 static_assert(ARRAY_SIZE(meas_names) == PRESSURE_MEAS_CNT,
 	      "meas_names[] must be same length as PRESSURE_MEAS_CNT");
 
+/* PSI trigger window limits enforced by the kernel, in microseconds */
+static const long long min_trigger_window = 500000LL;
+static const long long max_trigger_window = 10000000LL;
+
 static void free_opts(struct pressure_opts * const opts)
 {
 	if (!opts)
 		return;
 
+	if (opts->trigger_fd >= 0)
+		close(opts->trigger_fd);
+	file_reader_close(&opts->common.reader);
 	if (opts->common.pressure_file)
 		free(opts->common.pressure_file);
 
 	free(opts);
 }
 
+/*
+ * Register a PSI trigger with the kernel.  The kernel will signal POLLPRI on the
+ * file descriptor when the stall time exceeds the trigger threshold within the
+ * trigger window.  adaptived_loop() polls on cse->poll_fd, so this cause is
+ * evaluated as soon as the trigger fires rather than on the next interval
+ */
+static int register_trigger(struct adaptived_cause * const cse, struct pressure_opts * const opts,
+			    struct json_object * const args_obj)
+{
+	char trigger[FILENAME_MAX];
+	const char *type;
+	ssize_t bytes;
+	int ret;
+
+	ret = adaptived_parse_long_long(args_obj, "trigger_window", &opts->trigger_window);
+	if (ret) {
+		adaptived_err("A trigger_window is required when trigger_threshold is provided\n");
+		if (ret == -ENOENT)
+			ret = -EINVAL;
+		return ret;
+	}
+
+	if (opts->trigger_window < min_trigger_window ||
+	    opts->trigger_window > max_trigger_window) {
+		adaptived_err("Invalid trigger_window %lld.  Must be between %lld and %lld us\n",
+			      opts->trigger_window, min_trigger_window, max_trigger_window);
+		return -EINVAL;
+	}
+
+	if (opts->trigger_threshold <= 0 || opts->trigger_threshold > opts->trigger_window) {
+		adaptived_err("Invalid trigger_threshold %lld.  Must be between 1 and %lld us\n",
+			      opts->trigger_threshold, opts->trigger_window);
+		return -EINVAL;
+	}
+
+	ret = adaptived_parse_int(args_obj, "duration", &opts->duration);
+	if (ret == 0) {
+		adaptived_err("Duration is not supported with a PSI trigger\n");
+		return -EINVAL;
+	}
+	opts->duration = -1;
+
+	if (opts->common.meas < PRESSURE_FULL_AVG10)
+		type = "some";
+	else
+		type = "full";
+
+	ret = snprintf(trigger, FILENAME_MAX, "%s %lld %lld", type, opts->trigger_threshold,
+		       opts->trigger_window);
+	if (ret < 0 || ret >= FILENAME_MAX)
+		return -EOVERFLOW;
+
+	opts->trigger_fd = open(opts->common.pressure_file, O_RDWR | O_NONBLOCK);
+	if (opts->trigger_fd < 0) {
+		ret = -errno;
+		adaptived_err("Failed to open %s: %d\n", opts->common.pressure_file, ret);
+		return ret;
+	}
+
+	/* the kernel requires the trailing NULL be included in the write */
+	bytes = write(opts->trigger_fd, trigger, strlen(trigger) + 1);
+	if (bytes < 0) {
+		ret = -errno;
+		adaptived_err("Failed to write trigger \"%s\" to %s: %d\n", trigger,
+			      opts->common.pressure_file, ret);
+		return ret;
+	}
+
+	adaptived_info("Registered PSI trigger \"%s\" on %s\n", trigger,
+		       opts->common.pressure_file);
+	cse->poll_fd = opts->trigger_fd;
+
+	return 0;
+}
+
 int pressure_init(struct adaptived_cause * const cse, struct json_object *args_obj, int interval)
 {
 	const char *meas_str, *press_str;
@@ -87,6 +173,7 @@ int pressure_init(struct adaptived_cause * const cse, struct json_object *args_o
 	}
 
 	memset(opts, 0, sizeof( struct pressure_opts));
+	opts->trigger_fd = -1;
 
 	ret = adaptived_parse_string(args_obj, "pressure_file", &press_str);
 	if (ret) {
@@ -120,6 +207,20 @@ int pressure_init(struct adaptived_cause * const cse, struct json_object *args_o
 		goto error;
 	}
 
+	ret = adaptived_parse_long_long(args_obj, "trigger_threshold", &opts->trigger_threshold);
+	if (ret == -ENOENT) {
+		/* the user didn't request a PSI trigger.  poll the pressure file */
+		ret = 0;
+	} else if (ret) {
+		goto error;
+	} else {
+		ret = register_trigger(cse, opts, args_obj);
+		if (ret)
+			goto error;
+
+		goto set_data;
+	}
+
 	if (opts->common.meas == PRESSURE_FULL_TOTAL || opts->common.meas == PRESSURE_SOME_TOTAL) {
 		ret = adaptived_parse_long_long(args_obj, "threshold", &opts->common.threshold.total);
 		if (ret)
@@ -159,6 +260,11 @@ int pressure_init(struct adaptived_cause * const cse, struct json_object *args_o
 	if (ret)
 		goto error;
 
+	ret = file_reader_open(opts->common.pressure_file, 0, &opts->common.reader);
+	if (ret)
+		goto error;
+
+set_data:
 	ret = adaptived_cause_set_data(cse, (void *)opts);
 	if (ret)
 		goto error;
@@ -166,6 +272,7 @@ int pressure_init(struct adaptived_cause * const cse, struct json_object *args_o
 	return ret;
 
 error:
+	cse->poll_fd = -1;
 	free_opts(opts);
 	return ret;
 }
@@ -177,9 +284,21 @@ int pressure_main(struct adaptived_cause * const cse, int time_since_last_run)
 	float float_press;
 	int ret;
 
+	if (opts->trigger_fd >= 0) {
+		if (cse->poll_revents & (POLLERR | POLLNVAL)) {
+			adaptived_err("PSI trigger on %s is no longer valid\n",
+				      opts->common.pressure_file);
+			return -ENODEV;
+		}
+
+		if (cse->poll_revents & POLLPRI)
+			return 1;
+
+		return 0;
+	}
+
 	if (opts->common.meas == PRESSURE_SOME_TOTAL || opts->common.meas == PRESSURE_FULL_TOTAL) {
-		ret = adaptived_get_pressure_total(opts->common.pressure_file, opts->common.meas,
-						&int_press);
+		ret = reader_get_pressure_total(opts->common.reader, opts->common.meas, &int_press);
 		if (ret)
 			return -EINVAL;
 
@@ -206,8 +325,7 @@ int pressure_main(struct adaptived_cause * const cse, int time_since_last_run)
 			return -EINVAL;
 		}
 	} else {
-		ret = adaptived_get_pressure_avg(opts->common.pressure_file, opts->common.meas,
-					      &float_press);
+		ret = reader_get_pressure_avg(opts->common.reader, opts->common.meas, &float_press);
 		if (ret)
 			return -EINVAL;
 
@@ -255,5 +373,6 @@ void pressure_exit(struct adaptived_cause * const cse)
 {
 	struct pressure_opts *opts = (struct pressure_opts *)adaptived_cause_get_data(cse);
 
+	cse->poll_fd = -1;
 	free_opts(opts);
 }
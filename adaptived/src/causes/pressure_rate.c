@@ -62,6 +62,7 @@ static void free_opts(struct pressure_rate_opts * const opts)
 	if (opts->data)
 		free(opts->data);
 
+	file_reader_close(&opts->common.reader);
 	if (opts->common.pressure_file)
 		free(opts->common.pressure_file);
 
@@ -189,6 +190,10 @@ int pressure_rate_init(struct adaptived_cause * const cse, struct json_object *a
 		goto error;
 	}
 
+	ret = file_reader_open(opts->common.pressure_file, 0, &opts->common.reader);
+	if (ret)
+		goto error;
+
 	ret = adaptived_cause_set_data(cse, (void *)opts);
 	if (ret)
 		goto error;
@@ -210,8 +215,7 @@ int pressure_rate_main(struct adaptived_cause * const cse, int time_since_last_r
 		/* Currently unsupported */
 		return -EINVAL;
 	} else {
-		ret = adaptived_get_pressure_avg(opts->common.pressure_file, opts->common.meas,
-					      &float_press);
+		ret = reader_get_pressure_avg(opts->common.reader, opts->common.meas, &float_press);
 		if (ret)
 			return ret;
 
@@ -118,12 +118,12 @@ error:
 int time_of_day_main(struct adaptived_cause * const cse, int time_since_last_run)
 {
 	struct time_of_day_opts *opts = (struct time_of_day_opts *)cse->data;
-	struct tm *cur_tm;
+	struct tm tm_buf, *cur_tm;
 	time_t cur_time;
 	int ret = 0;
 
 	time(&cur_time);
-	cur_tm = localtime(&cur_time);
+	cur_tm = localtime_r(&cur_time, &tm_buf);
 
 	switch (opts->op) {
 		case COP_GREATER_THAN:
@@ -102,6 +102,7 @@ enum top_field_enum {
 struct top_opts {
         enum cause_op_enum op;
         char *stat_file;
+        struct file_reader *stat_reader; /* persistent handle on stat_file */
         char *meminfo_file;
         enum top_field_enum field;
         struct adaptived_cgroup_value threshold;
@@ -120,6 +121,7 @@ static void free_opts(struct top_opts * const opts)
 	if (!opts)
 		return;
 
+	file_reader_close(&opts->stat_reader);
 	if (opts->stat_file)
 		free(opts->stat_file);
 	if (opts->meminfo_file)
@@ -139,28 +141,17 @@ static int get_proc_stat_total(struct top_opts *opts)
 {
 	int items = 0;
 	char *bp;
-	FILE *fp;
-	char *line = NULL;
-	size_t len = 0;
-	ssize_t read;
+	int ret;
 	struct proc_stat prev_proc_stat;
 	long long user_tics, nice_tics, system_tics, idle_tics;
 	long long iowait_tics, hw_irq_time_tics, sw_irq_time_tics, vm_steal_time_tics;
 	long long total;
 
-	fp = fopen(opts->stat_file, "r");
-	if (fp == NULL) {
-		adaptived_err("get_proc_stat_total: can't open top file %s\n", opts->stat_file);
-		return -errno;
-	}
-	read = getline(&line, &len, fp);
-	fclose(fp);
-	if (read < 0 || !line) {
-		adaptived_err("get_proc_stat_total: read of %s failed.\n", opts->stat_file);
-		return -errno;
+	ret = file_reader_read(opts->stat_reader, &bp, NULL);
+	if (ret) {
+		adaptived_err("get_proc_stat_total: read of %s failed: %d\n", opts->stat_file, ret);
+		return ret;
 	}
-	line[strcspn(line, "\n")] = '\0';
-	bp = line;
 	
 	memcpy(&prev_proc_stat, &opts->proc_stat, sizeof(struct proc_stat));
 
@@ -168,7 +159,6 @@ static int get_proc_stat_total(struct top_opts *opts)
 	    &opts->proc_stat.user, &opts->proc_stat.nice, &opts->proc_stat.system,
 	    &opts->proc_stat.idle, &opts->proc_stat.iowait, &opts->proc_stat.hw_irq_time,
 	    &opts->proc_stat.sw_irq_time, &opts->proc_stat.vm_steal_time);
-	free(line);
 	if (items != 8) {
 		adaptived_err("get_proc_stat_total: sscanf error. Items should be 8, but got %d\n", items);
 		return -EINVAL;
@@ -324,6 +314,10 @@ int top_init(struct adaptived_cause * const cse, struct json_object *args_obj, i
 		opts->stat_file[strlen(stat_file_str)] = '\0';
 		adaptived_dbg("opts->stat_file: %s\n", opts->stat_file);
 
+		ret = file_reader_open(opts->stat_file, 0, &opts->stat_reader);
+		if (ret)
+			goto error;
+
 		if (strncmp(field_str, "us", 2) == 0)
 			opts->field = TOP_CPU_USER;
 		else if (strncmp(field_str, "sy", 2) == 0)
@@ -0,0 +1,335 @@
+/*
+ * Copyright (c) 2025, Oracle and/or its affiliates.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * You should have received a copy of the GNU General Public License version
+ * 2 along with this work; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Please contact Oracle, 500 Oracle Parkway, Redwood Shores, CA 94065 USA
+ * or visit www.oracle.com if you need additional information or have any
+ * questions.
+ */
+/**
+ * Offline decoder for the binary logs written by the logger and print_schedstat
+ * effects
+ *
+ * The log is mmap()ed and its records are printed as text in place.  Schedstat
+ * records are printed in the same format as the print_schedstat effect's text
+ * output unless --all is specified
+ */
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <errno.h>
+#include <time.h>
+
+#include "binlog.h"
+
+static bool print_all;
+
+static void usage(FILE *fd)
+{
+	fprintf(fd, "\nadaptived-decode: print adaptived binary logs as text\n\n");
+	fprintf(fd, "Usage: adaptived-decode [options] LOG...\n\n");
+	fprintf(fd, "Optional arguments:\n");
+	fprintf(fd, "  -a --all                  Print every schedstat field\n");
+	fprintf(fd, "  -h --help                 Show this help message\n");
+}
+
+static void print_record_header(const struct binlog_record * const rec, const char * const name)
+{
+	char date[64] = "";
+	struct tm tm;
+	time_t secs;
+
+	secs = rec->realtime_ns / 1000000000ULL;
+	if (localtime_r(&secs, &tm))
+		strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", &tm);
+
+	printf("\n%s record at %s.%09llu (monotonic %llu.%09llu)\n", name, date,
+	       (unsigned long long)(rec->realtime_ns % 1000000000ULL),
+	       (unsigned long long)(rec->monotonic_ns / 1000000000ULL),
+	       (unsigned long long)(rec->monotonic_ns % 1000000000ULL));
+}
+
+static int decode_raw(const struct binlog_record * const rec, size_t payload_len)
+{
+	const struct binlog_raw *raw = (const struct binlog_raw *)&rec[1];
+	const char *path = (const char *)&raw[1];
+
+	if (payload_len < sizeof(*raw) ||
+	    payload_len - sizeof(*raw) < (size_t)raw->path_len + raw->data_len ||
+	    raw->path_len == 0 || path[raw->path_len - 1] != '\0')
+		return -EINVAL;
+
+	print_record_header(rec, "raw");
+	printf("%s\n", path);
+	fwrite(&path[raw->path_len], 1, raw->data_len, stdout);
+	printf("\n");
+
+	return 0;
+}
+
+static int decode_schedstat(const struct binlog_record * const rec, size_t payload_len)
+{
+	const struct binlog_schedstat *ss = (const struct binlog_schedstat *)&rec[1];
+	const struct binlog_schedstat_domain *domains, *domain;
+	const struct binlog_schedstat_cpu *cpus, *cpu;
+	int c, d, i;
+
+	if (payload_len < sizeof(*ss) ||
+	    (payload_len - sizeof(*ss)) / sizeof(*cpu) < ss->nr_cpus ||
+	    (payload_len - sizeof(*ss) - sizeof(*cpu) * ss->nr_cpus) / sizeof(*domain) <
+	    ss->nr_domains)
+		return -EINVAL;
+
+	cpus = (const struct binlog_schedstat_cpu *)&ss[1];
+	domains = (const struct binlog_schedstat_domain *)&cpus[ss->nr_cpus];
+
+	print_record_header(rec, "schedstat");
+	printf("Timestamp (jiffies/ticks): %llu:\n", (unsigned long long)ss->timestamp);
+	for (c = 0; c < ss->nr_cpus; c++) {
+		cpu = &cpus[c];
+		if ((uint64_t)cpu->first_domain + cpu->nr_domains > ss->nr_domains)
+			return -EINVAL;
+
+		printf("CPU%d:\n", c);
+		printf("\tNumber of wakeups from this CPU: %u\n", cpu->ttwu);
+		printf("\tNumber of wakeups to this CPU:  %u\n", cpu->ttwu_local);
+		printf("\tTotal task run time (nanoseconds):  %llu\n",
+		       (unsigned long long)cpu->run_time);
+		printf("\tTotal task wait time (nanoseconds):  %llu\n",
+		       (unsigned long long)cpu->run_delay);
+		printf("\tNumber of timeslices on this CPU:  %llu\n",
+		       (unsigned long long)cpu->nr_timeslices);
+
+		for (d = 0; d < cpu->nr_domains; d++) {
+			domain = &domains[cpu->first_domain + d];
+			printf("Domain%d:\n", d);
+			printf("\tNumber of remote wakeups: %u\n", domain->ttwu_remote);
+			printf("\tNumber of affine wakeups: %u\n", domain->ttwu_move_affine);
+
+			if (!print_all)
+				continue;
+
+			printf("\tCPU mask: %x\n", domain->cpumask);
+			for (i = 0; i < BINLOG_IDLE_TYPES; i++)
+				printf("\tLoad balance (idle type %d): called %u balanced %u "
+				       "failed %u imbalance %u gained %u not gained %u "
+				       "no busy rq %u no busy group %u\n", i,
+				       domain->lb[i][0], domain->lb[i][1], domain->lb[i][2],
+				       domain->lb[i][3], domain->lb[i][4], domain->lb[i][5],
+				       domain->lb[i][6], domain->lb[i][7]);
+			printf("\tActive load balance: called %u failed %u pushed %u\n",
+			       domain->alb_called, domain->alb_failed, domain->alb_pushed);
+		}
+	}
+
+	return 0;
+}
+
+static void print_pressure_avgs(const char * const name,
+				const struct binlog_pressure_avgs * const avgs)
+{
+	printf("%s avg10=%u.%02u avg60=%u.%02u avg300=%u.%02u total=%llu\n", name,
+	       avgs->avg10 / 100, avgs->avg10 % 100, avgs->avg60 / 100, avgs->avg60 % 100,
+	       avgs->avg300 / 100, avgs->avg300 % 100, (unsigned long long)avgs->total);
+}
+
+static int decode_pressure(const struct binlog_record * const rec, size_t payload_len)
+{
+	const struct binlog_pressure *pressure = (const struct binlog_pressure *)&rec[1];
+	const char *path = (const char *)&pressure[1];
+
+	if (payload_len <= sizeof(*pressure) ||
+	    !memchr(path, '\0', payload_len - sizeof(*pressure)))
+		return -EINVAL;
+
+	print_record_header(rec, "pressure");
+	printf("%s\n", path);
+	print_pressure_avgs("some", &pressure->some);
+	print_pressure_avgs("full", &pressure->full);
+
+	return 0;
+}
+
+static int decode_meminfo(const struct binlog_record * const rec, size_t payload_len)
+{
+	const struct binlog_meminfo *meminfo = (const struct binlog_meminfo *)&rec[1];
+	const uint64_t *values = (const uint64_t *)&meminfo[1];
+	uint32_t i;
+
+	if (payload_len < sizeof(*meminfo) ||
+	    (payload_len - sizeof(*meminfo)) / sizeof(uint64_t) < meminfo->nr_fields)
+		return -EINVAL;
+
+	print_record_header(rec, "meminfo");
+	for (i = 0; i < meminfo->nr_fields; i++) {
+		if (values[i] == BINLOG_MEMINFO_MISSING)
+			continue;
+
+		/* a newer adaptived may know about more fields than we do */
+		if (i < BINLOG_MEMINFO_CNT)
+			printf("%s: %llu\n", binlog_meminfo_fields[i],
+			       (unsigned long long)values[i]);
+		else
+			printf("field%u: %llu\n", i, (unsigned long long)values[i]);
+	}
+
+	return 0;
+}
+
+static int decode(const char * const path, const char * const map, size_t map_len)
+{
+	const struct binlog_header *hdr = (const struct binlog_header *)map;
+	const struct binlog_record *rec;
+	size_t offset, payload_len;
+	int ret;
+
+	if (map_len < sizeof(*hdr) || memcmp(hdr->magic, BINLOG_MAGIC, BINLOG_MAGIC_LEN) != 0) {
+		fprintf(stderr, "%s is not an adaptived binary log\n", path);
+		return -EINVAL;
+	}
+	if (hdr->byte_order != BINLOG_BYTE_ORDER) {
+		fprintf(stderr, "%s was written on a machine with a different byte order\n", path);
+		return -EINVAL;
+	}
+	if (hdr->version > BINLOG_VERSION)
+		fprintf(stderr, "%s is version %u.  Only the version %d fields are decoded\n",
+			path, hdr->version, BINLOG_VERSION);
+
+	for (offset = BINLOG_PAD(sizeof(*hdr)); offset < map_len; offset += rec->len) {
+		rec = (const struct binlog_record *)&map[offset];
+
+		/* the log may have been copied while a record was being written */
+		if (map_len - offset < sizeof(*rec) || rec->len < sizeof(*rec) ||
+		    rec->len > map_len - offset || rec->len % BINLOG_ALIGN) {
+			fprintf(stderr, "%s: truncated record at offset %zu\n", path, offset);
+			return -EINVAL;
+		}
+		payload_len = rec->len - sizeof(*rec);
+
+		switch (rec->type) {
+		case BINLOG_RAW:
+			ret = decode_raw(rec, payload_len);
+			break;
+		case BINLOG_SCHEDSTAT:
+			ret = decode_schedstat(rec, payload_len);
+			break;
+		case BINLOG_PRESSURE:
+			ret = decode_pressure(rec, payload_len);
+			break;
+		case BINLOG_MEMINFO:
+			ret = decode_meminfo(rec, payload_len);
+			break;
+		default:
+			/* written by a newer adaptived.  skip it */
+			ret = 0;
+			break;
+		}
+
+		if (ret) {
+			fprintf(stderr, "%s: corrupt record at offset %zu\n", path, offset);
+			return ret;
+		}
+	}
+
+	return 0;
+}
+
+static int decode_file(const char * const path)
+{
+	struct stat statbuf;
+	char *map;
+	int fd, ret;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		fprintf(stderr, "Failed to open %s: %s\n", path, strerror(errno));
+		return -errno;
+	}
+
+	if (fstat(fd, &statbuf)) {
+		ret = -errno;
+		fprintf(stderr, "Failed to stat %s: %s\n", path, strerror(errno));
+		goto out;
+	}
+
+	if (statbuf.st_size == 0) {
+		fprintf(stderr, "%s is empty\n", path);
+		ret = -EINVAL;
+		goto out;
+	}
+
+	map = mmap(NULL, statbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED) {
+		ret = -errno;
+		fprintf(stderr, "Failed to mmap %s: %s\n", path, strerror(errno));
+		goto out;
+	}
+
+	ret = decode(path, map, statbuf.st_size);
+	munmap(map, statbuf.st_size);
+
+out:
+	close(fd);
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	const char * const short_options = "ah";
+	struct option long_options[] = {
+		{"all",		no_argument, NULL, 'a'},
+		{"help",	no_argument, NULL, 'h'},
+		{NULL, 0, NULL, 0}
+	};
+	int c, i, ret = 0;
+
+	while (1) {
+		c = getopt_long(argc, argv, short_options, long_options, NULL);
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'a':
+			print_all = true;
+			break;
+		case 'h':
+			usage(stdout);
+			exit(0);
+		default:
+			usage(stderr);
+			exit(1);
+		}
+	}
+
+	if (optind >= argc) {
+		usage(stderr);
+		exit(1);
+	}
+
+	for (i = optind; i < argc; i++) {
+		if (decode_file(argv[i]))
+			ret = 1;
+	}
+
+	return ret;
+}
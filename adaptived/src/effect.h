@@ -132,6 +132,7 @@ int logger_init(struct adaptived_effect * const eff, struct json_object *args_ob
 	       const struct adaptived_cause * const cse);
 int logger_main(struct adaptived_effect * const eff);
 void logger_exit(struct adaptived_effect * const eff);
+void logger_drain(struct adaptived_effect * const eff);
 
 int print_schedstat_init(struct adaptived_effect * const eff, struct json_object *args_obj,
 	       const struct adaptived_cause * const cse);
@@ -25,7 +25,6 @@
  *
  */
 
-#include <sys/param.h>
 #include <string.h>
 #include <signal.h>
 #include <errno.h>
@@ -43,6 +42,12 @@ struct kill_cg_opts {
 	int signal; /* optional */
 	int count; /* optional */
 	int max_depth; /* optional */
+
+	/*
+	 * When every process in the hierarchy is to be killed, a write to cgroup.kill
+	 * does it atomically and in a single syscall
+	 */
+	bool use_cgroup_kill;
 };
 
 int kill_cgroup_init(struct adaptived_effect * const eff, struct json_object *args_obj,
@@ -97,6 +102,9 @@ int kill_cgroup_init(struct adaptived_effect * const eff, struct json_object *ar
 		goto error;
 	}
 
+	opts->use_cgroup_kill = opts->signal == SIGKILL && opts->count <= 0 &&
+				opts->max_depth < 0;
+
 	eff->data = (void *)opts;
 
 	return ret;
@@ -115,37 +123,60 @@ error:
 static int kill_cgroup(struct kill_cg_opts * const opts, const char * const cgroup_path,
 		       int * const killed_cnt)
 {
-	int ret, pid_count, i, max_count;
-	pid_t *pids = NULL;
+	adaptived_dbg("kill_cgroup: Killing processes in %s\n", cgroup_path);
+
+	return cgroup_signal_procs(cgroup_path, opts->signal, opts->count, killed_cnt);
+}
 
-	ret = adaptived_cgroup_get_procs(cgroup_path, &pids, &pid_count);
+/*
+ * Kill the whole hierarchy via cgroup.kill.  The walk is limited to the top cgroup
+ * and its children, since cgroup.kill also kills the descendants.  (The top cgroup
+ * isn't in the walk if the path ends in a wildcard.)
+ */
+static int kill_cgroup_tree(const struct kill_cg_opts * const opts)
+{
+	struct adaptived_path_walk_handle *handle = NULL;
+	char *cgroup_path = NULL, *top_path = NULL;
+	int ret;
+
+	ret = adaptived_path_walk_start(opts->cgroup_path, &handle, ADAPTIVED_PATH_WALK_LIST_DIRS,
+					0);
 	if (ret)
 		goto error;
 
-	if (opts->count > 0)
-		max_count = MIN(opts->count, pid_count);
-	else
-		max_count = pid_count;
-
-	adaptived_dbg("kill_cgroup: Killing %d processes in %s\n", max_count, cgroup_path);
-
-	for (i = 0; i < max_count; i++) {
-		ret = kill(pids[i], opts->signal);
-		(*killed_cnt)++;
-		if (ret < 0) {
-			/*
-			 * Processes are transient, and the inability to kill one is not
-			 * a significant enough error to propagate up to the user.
-			 */
-			adaptived_info("kill_cgroup: failed to kill process %d, errno = %d\n",
-				    pids[i], errno);
-			ret = 0;
+	do {
+		ret = adaptived_path_walk_next(&handle, &cgroup_path);
+		if (ret)
+			goto error;
+		if (!cgroup_path)
+			break;
+
+		if (top_path && strncmp(cgroup_path, top_path, strlen(top_path)) == 0 &&
+		    cgroup_path[strlen(top_path)] == '/') {
+			/* this cgroup was killed along with its parent */
+			free(cgroup_path);
+			continue;
 		}
-	}
+
+		adaptived_dbg("kill_cgroup: Killing all processes in %s\n", cgroup_path);
+
+		ret = cgroup_kill(cgroup_path);
+		if (ret)
+			goto error;
+
+		if (!top_path)
+			top_path = cgroup_path;
+		else
+			free(cgroup_path);
+	} while (true);
 
 error:
-	if (pids)
-		free(pids);
+	adaptived_path_walk_end(&handle);
+
+	if (cgroup_path && cgroup_path != top_path)
+		free(cgroup_path);
+	if (top_path)
+		free(top_path);
 
 	return ret;
 }
@@ -157,6 +188,16 @@ int kill_cgroup_main(struct adaptived_effect * const eff)
 	char *cgroup_path = NULL;
 	int ret, killed = 0;
 
+	if (opts->use_cgroup_kill) {
+		ret = kill_cgroup_tree(opts);
+		if (ret != -ENOTSUP)
+			return ret;
+
+		adaptived_info("kill_cgroup: cgroup.kill is not supported.  Killing processes "
+			       "individually\n");
+		opts->use_cgroup_kill = false;
+	}
+
 	ret = adaptived_path_walk_start(opts->cgroup_path, &handle, ADAPTIVED_PATH_WALK_LIST_DIRS,
 				     opts->max_depth);
 	if (ret)
@@ -174,7 +215,7 @@ int kill_cgroup_main(struct adaptived_effect * const eff)
 			goto error;
 		free(cgroup_path);
 
-		if (killed >= opts->count)
+		if (opts->count > 0 && killed >= opts->count)
 			break;
 	} while (true);
 
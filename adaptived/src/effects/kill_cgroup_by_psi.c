@@ -25,7 +25,6 @@
  *
  */
 
-#include <sys/param.h>
 #include <string.h>
 #include <signal.h>
 #include <errno.h>
@@ -46,6 +45,8 @@ struct kill_cg_opts {
 
 	int signal; /* optional */
 	int max_depth; /* optional */
+
+	bool cgroup_kill_unsupported;
 };
 
 int kill_cgroup_psi_init(struct adaptived_effect * const eff, struct json_object *args_obj,
@@ -60,7 +61,7 @@ int kill_cgroup_psi_init(struct adaptived_effect * const eff, struct json_object
 		ret = -ENOMEM;
 		goto error;
 	}
-	opts->cgroup_path = NULL;
+	memset(opts, 0, sizeof(struct kill_cg_opts));
 
 	ret = adaptived_parse_string(args_obj, "cgroup", &cgroup_path_str);
 	if (ret)
@@ -141,33 +142,59 @@ error:
 	return ret;
 }
 
-static int kill_cgroup(struct kill_cg_opts * const opts, const char * const cgroup_path)
+static bool has_child_cgroups(const char * const cgroup_path)
 {
-	int ret, pid_count, i;
-	pid_t *pids = NULL;
+	struct adaptived_path_walk_handle *handle = NULL;
+	char children_path[FILENAME_MAX];
+	char *child_path = NULL;
+	int ret;
+
+	snprintf(children_path, sizeof(children_path), "%s/*", cgroup_path);
 
-	ret = adaptived_cgroup_get_procs(cgroup_path, &pids, &pid_count);
+	ret = adaptived_path_walk_start(children_path, &handle, ADAPTIVED_PATH_WALK_LIST_DIRS, 0);
 	if (ret)
-		goto error;
+		/* assume the worst */
+		return true;
 
-	adaptived_dbg("kill_cgroup_by_psi: Killing %d processes in %s\n", pid_count, cgroup_path);
+	ret = adaptived_path_walk_next(&handle, &child_path);
+	adaptived_path_walk_end(&handle);
 
-	for (i = 0; i < pid_count; i++) {
-		ret = kill(pids[i], opts->signal);
-		if (ret < 0) {
-			/*
-			 * Processes are transient, and the inability to kill one is not
-			 * a significant enough error to propagate up to the user.
-			 */
-			adaptived_info("kill_cgroup_by_psi: failed to kill process %d, errno = %d\n",
-				    pids[i], errno);
-			ret = 0;
-		}
+	if (ret)
+		return true;
+	if (!child_path)
+		return false;
+
+	free(child_path);
+	return true;
+}
+
+static int kill_cgroup(struct kill_cg_opts * const opts, const char * const cgroup_path)
+{
+	int ret, killed_cnt = 0;
+
+	if (!cgroup_path)
+		return -EINVAL;
+
+	/*
+	 * cgroup.kill would also kill the processes in the child cgroups, so it can
+	 * only be used on a leaf cgroup
+	 */
+	if (opts->signal == SIGKILL && !opts->cgroup_kill_unsupported &&
+	    !has_child_cgroups(cgroup_path)) {
+		adaptived_dbg("kill_cgroup_by_psi: Killing all processes in %s\n", cgroup_path);
+
+		ret = cgroup_kill(cgroup_path);
+		if (ret != -ENOTSUP)
+			return ret;
+
+		adaptived_info("kill_cgroup_by_psi: cgroup.kill is not supported.  Killing "
+			       "processes individually\n");
+		opts->cgroup_kill_unsupported = true;
 	}
 
-error:
-	if (pids)
-		free(pids);
+	ret = cgroup_signal_procs(cgroup_path, opts->signal, -1, &killed_cnt);
+
+	adaptived_dbg("kill_cgroup_by_psi: Killed %d processes in %s\n", killed_cnt, cgroup_path);
 
 	return ret;
 }
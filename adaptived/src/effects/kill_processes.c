@@ -31,7 +31,6 @@
 
 #include <assert.h>
 #include <string.h>
-#include <dirent.h>
 #include <signal.h>
 #include <errno.h>
 #include <time.h>
@@ -54,6 +53,8 @@ struct kill_processes_opts {
 	long long count; /* optional */
 	int signal; /* optional */
 	enum field fld; /* optional */
+
+	struct proc_scanner *scanner;
 };
 
 struct pid_info {
@@ -68,6 +69,7 @@ static void free_opts(struct kill_processes_opts * const opts)
 	for (i = 0; i < opts->proc_name_cnt; i++)
 		free(opts->proc_names[i]);
 	free(opts->proc_names);
+	proc_scanner_close(&opts->scanner);
 	free(opts);
 }
 
@@ -160,6 +162,12 @@ static int _kill_processes_init(struct adaptived_effect * const eff, struct json
 		}
 	}
 
+	ret = proc_scanner_open(NULL, &opts->scanner);
+	if (ret) {
+		adaptived_err("Failed to open /proc: %d\n", ret);
+		goto error;
+	}
+
 	eff->data = (void *)opts;
 
 	return ret;
@@ -171,90 +179,6 @@ error:
 	return ret;
 }
 
-static int get_cmd(char * const buf, char **cmd)
-{
-	char *left, *right;
-	size_t cmd_len;
-
-	left = strchr(buf, '(');
-	right = strchr(buf, ')');
-	cmd_len = right - left - 1;
-
-	*cmd = strndup(left + 1, cmd_len);
-	if ((*cmd) == NULL)
-		return -ENOMEM;
-
-	return 0;
-}
-
-static int get_vsize(char * const buf, long long * const vsize)
-{
-	char *copy, *end_paren, *token, *saveptr = NULL;
-	int i;
-
-	copy = strdup(buf);
-	if (!copy)
-		return -ENOMEM;
-
-	/*
-	 * It's possible to have spaces in the program's name.  Let's start the
-	 * tokenization after the closing parenthesis character in the second field
-	 * in the /proc/{pid}/stat output
-	 */
-	end_paren = strchr(buf, ')');
-	token = strtok_r(end_paren + 1, " ", &saveptr);
-
-	/*
-	 * vsize is the 23rd entry in the stat field per the man page.  (note that numbering
-	 * in the man page starts at field 1 rather than 0 in C arrays.)  we've already
-	 * skipped 2 fields, so we need to jump past 19 more fields
-	 *
-	 * https://man7.org/linux/man-pages/man5/proc_pid_stat.5.html
-	 */
-	for (i = 0; i <= 19; i++)
-		token = strtok_r(NULL, " ", &saveptr);
-
-	sscanf(token, "%lld", vsize);
-
-	free(copy);
-
-	return 0;
-}
-
-static int get_rss(char * const buf, long long * const rss)
-{
-	char *copy, *end_paren, *token, *saveptr = NULL;
-	int i;
-
-	copy = strdup(buf);
-	if (!copy)
-		return -ENOMEM;
-
-	/*
-	 * It's possible to have spaces in the program's name.  Let's start the
-	 * tokenization after the closing parenthesis character in the second field
-	 * in the /proc/{pid}/stat output
-	 */
-	end_paren = strchr(buf, ')');
-	token = strtok_r(end_paren + 1, " ", &saveptr);
-
-	/*
-	 * rss is the 24th entry in the stat field per the man page.  (note that numbering
-	 * in the man page starts at field 1 rather than 0 in C arrays.)  we've already
-	 * skipped 2 fields, so we need to jump past 19 more fields
-	 *
-	 * https://man7.org/linux/man-pages/man5/proc_pid_stat.5.html
-	 */
-	for (i = 0; i <= 20; i++)
-		token = strtok_r(NULL, " ", &saveptr);
-
-	sscanf(token, "%lld", rss);
-
-	free(copy);
-
-	return 0;
-}
-
 /*
  * Arbitrarily pick an initial size of 64 entries for the pid list.  If/When the list grows to
  * this size, then another 64 entries will be added.
@@ -278,117 +202,130 @@ static int insert(struct pid_info **list, int * const list_len, pid_t new_entry,
 	return 0;
 }
 
-static int find_processes(struct kill_processes_opts * const opts,
-			  struct pid_info ** match_list, int * const match_cnt)
+/*
+ * When only the top count processes will be signaled, the matches are kept in a
+ * min-heap of at most count entries.  The root is the smallest of the current top
+ * entries, so each new process only needs to be compared against it
+ */
+static void heap_sift_up(struct pid_info * const heap, int idx)
 {
-	char path[FILENAME_MAX], buf[FILENAME_MAX];
-	struct dirent *pid_dir = NULL;
-	int ret = 0, pid, i;
-	char *cmd = NULL;
-	long long value;
-	FILE *fp = NULL;
-	DIR *dir;
+	struct pid_info tmp;
+	int parent;
+
+	while (idx > 0) {
+		parent = (idx - 1) / 2;
+		if (heap[parent].value <= heap[idx].value)
+			break;
+
+		tmp = heap[parent];
+		heap[parent] = heap[idx];
+		heap[idx] = tmp;
+		idx = parent;
+	}
+}
 
-	dir = opendir("/proc/");
-	if (!dir)
-		return -EINVAL;
+static void heap_sift_down(struct pid_info * const heap, int heap_cnt, int idx)
+{
+	struct pid_info tmp;
+	int child;
+
+	while (1) {
+		child = idx * 2 + 1;
+		if (child >= heap_cnt)
+			break;
+		if (child + 1 < heap_cnt && heap[child + 1].value < heap[child].value)
+			child++;
+		if (heap[idx].value <= heap[child].value)
+			break;
+
+		tmp = heap[child];
+		heap[child] = heap[idx];
+		heap[idx] = tmp;
+		idx = child;
+	}
+}
 
-	while ((pid_dir = readdir(dir)) != NULL) {
-		ret = sscanf(pid_dir->d_name, "%i", &pid);
-		if (ret < 1) {
-			/*
-			 * This directory isn't an integer, and thus isn't a PID directory.
-			 * Move on
-			 */
-			ret = 0;
-			continue;
-		}
+static int heap_insert(struct pid_info **heap, int * const heap_cnt, long long max_cnt,
+		       pid_t new_entry, long long value)
+{
+	int ret;
 
-		ret = snprintf(path, FILENAME_MAX, "/proc/%d/stat", pid);
-		if (ret <= 0) {
-			adaptived_err("snprintf pid %d, error %d, errno = %d\n", pid, ret, errno);
-			goto error;
-		}
-		if (ret >= FILENAME_MAX) {
-			adaptived_wrn("snprintf returned %d for pid %d\n", ret, pid);
-			goto error;
-		}
+	if ((*heap_cnt) < max_cnt) {
+		ret = insert(heap, heap_cnt, new_entry, value);
+		if (ret)
+			return ret;
 
-		fp = fopen(path, "r");
-		if (!fp) {
-			/*
-			 * This process may have completed between reading the directory and
-			 * trying to open the stat file.  Move on
-			 */
-			ret = 0;
-			continue;
-		}
+		heap_sift_up(*heap, (*heap_cnt) - 1);
+		return 0;
+	}
 
-		memset(buf, 0, sizeof(buf));
-		ret = fread(buf, sizeof(char), FILENAME_MAX, fp);
-		if (ret < 0) {
-			adaptived_err("fread pid %d, error %d, errno = %d\n", pid, ret, errno);
-			goto error;
-		}
-		if (ret >= FILENAME_MAX) {
-			adaptived_wrn("fread returned %d for pid %d\n", ret, pid);
-			goto error;
-		}
+	if (value <= (*heap)[0].value)
+		return 0;
 
-		ret = get_cmd(buf, &cmd);
-		if (ret)
-			goto error;
+	(*heap)[0].pid = new_entry;
+	(*heap)[0].value = value;
+	heap_sift_down(*heap, *heap_cnt, 0);
+
+	return 0;
+}
+
+struct find_processes_args {
+	const struct kill_processes_opts *opts;
+	struct pid_info **match_list;
+	int *match_cnt;
+};
+
+static int find_processes_cb(const struct proc_pid_stat * const stat, void * const data)
+{
+	struct find_processes_args *args = data;
+	const struct kill_processes_opts *opts = args->opts;
+	long long value;
+	int i, ret;
+
+	for (i = 0; i < opts->proc_name_cnt; i++) {
+		if (strcmp(stat->comm, opts->proc_names[i]) != 0)
+			continue;
 
 		if (opts->count > 0) {
 			switch (opts->fld) {
 			case FLD_VSIZE:
-				ret = get_vsize(buf, &value);
-				if (ret)
-					goto error;
+				value = stat->vsize;
 				break;
 			case FLD_RSS:
-				ret = get_rss(buf, &value);
-				if (ret)
-					goto error;
+				value = stat->rss;
 				break;
 			default:
 				adaptived_err("Invalid field: %d\n", opts->fld);
-				goto error;
+				return -EINVAL;
 			}
+
+			ret = heap_insert(args->match_list, args->match_cnt, opts->count,
+					  stat->pid, value);
 		} else {
 			/*
 			 * The user has specified that we will send a signal to every process
 			 * we find.  Thus, there's no need to populate the value field with a
 			 * meaningful value as we will signal all found processes.
 			 */
-			value = 1;
+			ret = insert(args->match_list, args->match_cnt, stat->pid, 1);
 		}
-
-		for (i = 0; i < opts->proc_name_cnt; i++) {
-			if (strcmp(cmd, opts->proc_names[i]) == 0) {
-				ret = insert(match_list, match_cnt, pid, value);
-				if (ret)
-					goto error;
-			}
-		}
-
-		free(cmd);
-		cmd = NULL;
-
-		fclose(fp);
-		fp = NULL;
-		ret = 0;
+		if (ret)
+			return ret;
 	}
 
-error:
-	if (cmd)
-		free(cmd);
-	if (fp)
-		fclose(fp);
+	return 0;
+}
 
-	closedir(dir);
+static int find_processes(struct kill_processes_opts * const opts,
+			  struct pid_info ** match_list, int * const match_cnt)
+{
+	struct find_processes_args args = {
+		.opts = opts,
+		.match_list = match_list,
+		.match_cnt = match_cnt,
+	};
 
-	return ret;
+	return proc_scanner_scan(opts->scanner, find_processes_cb, &args);
 }
 
 /*
@@ -417,17 +354,23 @@ static int _kill_processes_main(struct adaptived_effect * const eff)
 	if (ret)
 		goto error;
 
-	qsort(pid_list, pid_cnt, sizeof(struct pid_info), _sort_pid_list);
-
-	if (opts->count > 0)
+	if (opts->count > 0) {
+		/*
+		 * find_processes() has already selected the top count processes.  Sort
+		 * them so that the largest is signaled first
+		 */
+		qsort(pid_list, pid_cnt, sizeof(struct pid_info), _sort_pid_list);
 		kill_cnt = min(opts->count, pid_cnt);
-	else
+	} else {
 		kill_cnt = pid_cnt;
+	}
 
 	for (i = 0; i < kill_cnt; i++) {
 		adaptived_wrn("%s: Sending signal %d to PID %d\n", __func__, opts->signal,
 			   pid_list[i].pid);
-		(void)kill(pid_list[i].pid, opts->signal);
+		if (kill(pid_list[i].pid, opts->signal))
+			adaptived_err("%s: Failed to send signal %d to PID %d: %d\n", __func__,
+				      opts->signal, pid_list[i].pid, -errno);
 	}
 
 error:
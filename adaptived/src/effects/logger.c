@@ -25,35 +25,149 @@
  *
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* splice(), pipe2() and F_SETPIPE_SZ */
+#endif
+
+#include <pthread.h>
 #include <assert.h>
 #include <string.h>
+#include <spawn.h>
+#include <fcntl.h>
 #include <errno.h>
 #include <time.h>
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/vfs.h>
+#include <sys/wait.h>
+#include <linux/magic.h>
 #include <unistd.h>
 
+#include <adaptived-utils.h>
+
 #include "adaptived-internal.h"
 #include "defines.h"
+#include "binlog.h"
+
+/*
+ * How a file is encoded in a binary log.  Text logs always copy the file as is
+ */
+enum file_type {
+	FILE_TYPE_RAW = 0,
+	FILE_TYPE_SCHEDSTAT,
+	FILE_TYPE_PRESSURE,
+	FILE_TYPE_MEMINFO,
+
+	FILE_TYPE_CNT
+};
+
+static const char * const file_type_names[] = {
+	"raw",
+	"schedstat",
+	"pressure",
+	"meminfo",
+};
+static_assert(ARRAY_SIZE(file_type_names) == FILE_TYPE_CNT,
+	      "file_type_names[] must be same length as FILE_TYPE_CNT");
 
 struct files {
 	char *filename;
+	enum file_type type;
+	struct file_reader *reader;	/* binary logs only */
+	bool splice;			/* the file can be spliced into a snapshot's pipe */
 	struct files *next;
 };
 
+/*
+ * A snapshot of the files, formatted and ready to be appended to the log.  The
+ * snapshot is either in buf, or if buf is NULL, it's waiting in the pipe.  Each
+ * slot in the ring keeps its pipe for the life of the writer.  A record with a
+ * len of 0 was abandoned by logger_main() and is skipped
+ */
+struct log_record {
+	char *buf;
+	size_t len;
+	int pipe_fd[2];
+	int pipe_size;
+	bool ready;	/* logger_main() has finished capturing the snapshot */
+};
+
+/*
+ * logger_main() captures the files on the main loop thread and hands the
+ * snapshot to a writer thread via a bounded ring.  The writer keeps the log
+ * open and rotates it, so writing and compressing the log never stall the
+ * rules.  If the writer falls behind and the ring fills, snapshots are dropped.
+ *
+ * There is one writer per logfile, shared by every logger effect that logs to
+ * it, so that their records are appended one at a time and a rotation is seen
+ * by all of them.  The first effect to open the logfile sets the rotation
+ * settings and the queue depth.  The writer reopens the log if it's renamed or
+ * removed from under it, e.g. by logrotate
+ */
+struct log_writer {
+	char *logfile;
+	int refcnt;			/* protected by writers_mutex */
+	struct log_writer *next;	/* protected by writers_mutex */
+
+	int rotate_size;		/* rotate the log when it reaches this size.  0 disables */
+	int rotate_count;		/* number of rotated logs to keep */
+	bool compress;			/* gzip the rotated logs */
+	bool binary;
+
+	pthread_t thread;
+	bool thread_running;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t work_cond;
+	pthread_cond_t done_cond;
+
+	/* protected by mutex */
+	struct log_record *ring;
+	int ring_len;
+	int head; /* index of the oldest record.  it stays in the ring until it's written */
+	int cnt;
+	bool shutdown;
+	unsigned long dropped;
+
+	/* only used by the writer thread once it's running */
+	int fd;
+	long long size;
+
+	/* written at the start of every binary log */
+	char *header;
+	size_t header_len;
+};
+
+static struct log_writer *writers;
+static pthread_mutex_t writers_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 struct logger_opts {
 	char *logfile;
 	int max_file_size;
+	int rotate_size;
+	int rotate_count;
+	bool compress;
+	int queue_depth;		/* max snapshots waiting on the writer */
 	char *separator_prefix;		/* i.e. "<<<<<" */
 	char *separator_postfix;	/* i.e. ">>>>>" */
 	char *date_format;		/* i.e. "+%Y-%m-%d-%H:%M:%S" */
 	char *file_separator;
 	bool utc;			/* default: false */
 	struct files *file_list;
+
+	bool splice;			/* capture the files into a pipe rather than a buffer */
+	int pipe_size;
+
+	bool binary;			/* write binlog.h records rather than text */
+	struct adaptived_schedstat_snapshot *ss;
+
+	struct log_writer *writer;
 };
 
 #define MAX_COPY	(32 * 1024)
+#define DEFAULT_ROTATE_COUNT	5
+#define DEFAULT_QUEUE_DEPTH	16
 
 static void free_list(struct files *fp)
 {
@@ -62,31 +176,600 @@ static void free_list(struct files *fp)
 	while (fp) {
 		if (fp->filename)
 			free(fp->filename);
+		file_reader_close(&fp->reader);
 		tmp = fp;
 		fp = fp->next;
 		free(tmp);
 	}
 }
 
+static void close_pipe(struct log_record * const rec)
+{
+	if (rec->pipe_fd[0] >= 0)
+		close(rec->pipe_fd[0]);
+	if (rec->pipe_fd[1] >= 0)
+		close(rec->pipe_fd[1]);
+
+	rec->pipe_fd[0] = -1;
+	rec->pipe_fd[1] = -1;
+	rec->pipe_size = 0;
+}
+
+static void writer_destroy(struct log_writer * const writer)
+{
+	int i;
+
+	if (writer->thread_running) {
+		/* the writer empties the ring before it exits */
+		pthread_mutex_lock(&writer->mutex);
+		writer->shutdown = true;
+		pthread_cond_signal(&writer->work_cond);
+		pthread_mutex_unlock(&writer->mutex);
+
+		pthread_join(writer->thread, NULL);
+		writer->thread_running = false;
+	}
+
+	if (writer->ring) {
+		for (i = 0; i < writer->ring_len; i++) {
+			if (writer->ring[i].buf)
+				free(writer->ring[i].buf);
+			close_pipe(&writer->ring[i]);
+		}
+		free(writer->ring);
+	}
+
+	if (writer->dropped)
+		adaptived_wrn("logger: dropped %lu snapshots\n", writer->dropped);
+
+	if (writer->fd >= 0)
+		close(writer->fd);
+
+	if (writer->header)
+		free(writer->header);
+	if (writer->logfile)
+		free(writer->logfile);
+
+	pthread_cond_destroy(&writer->done_cond);
+	pthread_cond_destroy(&writer->work_cond);
+	pthread_mutex_destroy(&writer->mutex);
+
+	free(writer);
+}
+
+/*
+ * Drop a reference to the writer.  The last one flushes the ring and closes the log
+ */
+static void writer_put(struct log_writer * const writer)
+{
+	struct log_writer **wp;
+
+	if (!writer)
+		return;
+
+	pthread_mutex_lock(&writers_mutex);
+
+	if (--writer->refcnt > 0) {
+		pthread_mutex_unlock(&writers_mutex);
+		return;
+	}
+
+	for (wp = &writers; *wp; wp = &(*wp)->next) {
+		if (*wp == writer) {
+			*wp = writer->next;
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&writers_mutex);
+
+	writer_destroy(writer);
+}
+
 static void free_opts(struct logger_opts *opts)
 {
 	if (!opts)
 		return;
 
+	writer_put(opts->writer);
+
 	if (opts->separator_prefix)
 		free(opts->separator_prefix);
 	if (opts->separator_postfix)
 		free(opts->separator_postfix);
 	if (opts->date_format)
 		free(opts->date_format);
+	if (opts->file_separator)
+		free(opts->file_separator);
 	if (opts->logfile)
 		free(opts->logfile);
+	if (opts->ss)
+		free(opts->ss);
 
 	free_list(opts->file_list);
 
 	free(opts);
 }
 
+/*
+ * splice() refuses to write to an O_APPEND file, so the writer seeks to the end
+ * of the log before each record instead.  The writer is the only one in this
+ * process that writes to the log, so its records can't interleave
+ */
+static int open_log(struct log_writer * const writer)
+{
+	/* O_RDWR so that an existing binary log's header can be checked */
+	writer->fd = open(writer->logfile, O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+	if (writer->fd < 0) {
+		adaptived_err("logger: can't open log file %s\n", writer->logfile);
+		return -errno;
+	}
+
+	writer->size = lseek(writer->fd, 0, SEEK_END);
+	if (writer->size < 0)
+		writer->size = 0;
+
+	/* binary records can't be appended to a text log or another binlog version */
+	if (writer->binary && writer->size > 0 && binlog_check_header(writer->fd)) {
+		adaptived_err("logger: %s is not a version %d binary log\n", writer->logfile,
+			      BINLOG_VERSION);
+		close(writer->fd);
+		writer->fd = -1;
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+/*
+ * Has the log been renamed or removed since the writer opened it?
+ */
+static bool log_moved(const struct log_writer * const writer)
+{
+	struct stat path_st, fd_st;
+
+	if (fstat(writer->fd, &fd_st))
+		return true;
+	if (stat(writer->logfile, &path_st))
+		return true;
+
+	return path_st.st_ino != fd_st.st_ino || path_st.st_dev != fd_st.st_dev;
+}
+
+static int write_all(int fd, const char *buf, size_t len)
+{
+	ssize_t bytes;
+
+	while (len > 0) {
+		bytes = write(fd, buf, len);
+		if (bytes < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+
+		buf += bytes;
+		len -= bytes;
+	}
+
+	return 0;
+}
+
+/*
+ * Move up to len bytes from in_fd to out_fd, stopping early if in_fd reaches EOF.
+ * One of them must be a pipe.  The data is spliced so that it never passes through
+ * userspace, unless copy is set or in_fd or out_fd don't support splice(), in
+ * which case it's read and written.  Returns the number of bytes moved
+ */
+static ssize_t move_fd(int in_fd, int out_fd, size_t len, bool copy)
+{
+	char buf[4096];
+	size_t total = 0;
+	ssize_t bytes;
+	int ret;
+
+	while (total < len) {
+		if (!copy) {
+			bytes = splice(in_fd, NULL, out_fd, NULL, len - total,
+				       SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+			if (bytes < 0 && errno == EINVAL) {
+				copy = true;
+				continue;
+			}
+		} else {
+			bytes = read(in_fd, buf, min(sizeof(buf), len - total));
+			if (bytes > 0) {
+				ret = write_all(out_fd, buf, bytes);
+				if (ret)
+					return ret;
+			}
+		}
+
+		if (bytes < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		if (bytes == 0)
+			break;
+
+		total += bytes;
+	}
+
+	return total;
+}
+
+static int write_record(struct log_writer * const writer, struct log_record * const rec)
+{
+	ssize_t bytes;
+	off_t end;
+	int ret;
+
+	/* pick up anyone else that has appended to or truncated the log */
+	end = lseek(writer->fd, 0, SEEK_END);
+	if (end >= 0)
+		writer->size = end;
+
+	if (writer->header && writer->size == 0) {
+		ret = write_all(writer->fd, writer->header, writer->header_len);
+		if (ret)
+			return ret;
+		writer->size += writer->header_len;
+	}
+
+	if (rec->buf) {
+		ret = write_all(writer->fd, rec->buf, rec->len);
+		if (ret)
+			return ret;
+	} else {
+		bytes = move_fd(rec->pipe_fd[0], writer->fd, rec->len, false);
+		if (bytes < 0)
+			return bytes;
+		if (bytes != rec->len)
+			return -EIO;
+	}
+
+	writer->size += rec->len;
+
+	return 0;
+}
+
+static void rotated_name(const struct log_writer * const writer, int idx, char * const name,
+			 size_t len)
+{
+	snprintf(name, len, "%s.%d%s", writer->logfile, idx, writer->compress ? ".gz" : "");
+}
+
+static void compress_log(const char * const path)
+{
+	char *argv[] = { "gzip", "-f", (char *)path, NULL };
+	extern char **environ;
+	int ret, status;
+	pid_t pid;
+
+	ret = posix_spawnp(&pid, "gzip", NULL, NULL, argv, environ);
+	if (ret) {
+		adaptived_err("logger: failed to run gzip on %s: %d\n", path, ret);
+		return;
+	}
+
+	while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+		;
+
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		adaptived_err("logger: gzip of %s failed: %d\n", path, status);
+}
+
+/*
+ * log -> log.1 -> log.2 ... -> log.<rotate_count>, which is discarded.  Only
+ * called from the writer thread
+ */
+static void rotate_log(struct log_writer * const writer)
+{
+	char from[FILENAME_MAX], to[FILENAME_MAX];
+	int i;
+
+	adaptived_dbg("logger: rotating %s at %lld bytes\n", writer->logfile, writer->size);
+
+	close(writer->fd);
+	writer->fd = -1;
+
+	if (writer->rotate_count == 0) {
+		if (truncate(writer->logfile, 0))
+			adaptived_err("logger: failed to truncate %s: %d\n", writer->logfile,
+				      -errno);
+	} else {
+		for (i = writer->rotate_count - 1; i > 0; i--) {
+			rotated_name(writer, i, from, sizeof(from));
+			rotated_name(writer, i + 1, to, sizeof(to));
+			if (rename(from, to) && errno != ENOENT)
+				adaptived_err("logger: failed to rename %s: %d\n", from, -errno);
+		}
+
+		snprintf(to, sizeof(to), "%s.1", writer->logfile);
+		if (rename(writer->logfile, to))
+			adaptived_err("logger: failed to rename %s: %d\n", writer->logfile,
+				      -errno);
+		else if (writer->compress)
+			compress_log(to);
+	}
+
+	open_log(writer);
+}
+
+static void *writer_main(void *arg)
+{
+	struct log_writer *writer = arg;
+	struct log_record *rec;
+	int ret;
+
+	pthread_mutex_lock(&writer->mutex);
+
+	while (1) {
+		while (!writer->shutdown &&
+		       (writer->cnt == 0 || !writer->ring[writer->head].ready))
+			pthread_cond_wait(&writer->work_cond, &writer->mutex);
+
+		if (writer->cnt == 0 || !writer->ring[writer->head].ready)
+			break; /* shutdown, and there's nothing left to write */
+
+		/* logger_main() doesn't touch a record until it leaves the ring */
+		rec = &writer->ring[writer->head];
+		pthread_mutex_unlock(&writer->mutex);
+
+		ret = 0;
+		if (rec->len > 0) {
+			if (writer->fd >= 0 && log_moved(writer)) {
+				adaptived_dbg("logger: %s was moved, reopening it\n",
+					      writer->logfile);
+				close(writer->fd);
+				writer->fd = -1;
+			}
+			if (writer->fd < 0)
+				open_log(writer);
+
+			ret = -EBADF;
+			if (writer->fd >= 0) {
+				ret = write_record(writer, rec);
+				if (ret)
+					adaptived_err("logger: failed to write to %s: %d\n",
+						      writer->logfile, ret);
+
+				if (writer->rotate_size > 0 && writer->size >= writer->rotate_size)
+					rotate_log(writer);
+			}
+		}
+
+		/* don't leave part of this snapshot in the pipe for the next one */
+		if (ret && !rec->buf)
+			close_pipe(rec);
+		if (rec->buf)
+			free(rec->buf);
+		rec->buf = NULL;
+
+		pthread_mutex_lock(&writer->mutex);
+		rec->ready = false;
+		writer->head = (writer->head + 1) % writer->ring_len;
+		writer->cnt--;
+		if (writer->cnt == 0)
+			pthread_cond_broadcast(&writer->done_cond);
+	}
+
+	pthread_mutex_unlock(&writer->mutex);
+
+	return NULL;
+}
+
+/*
+ * Find the writer for opts->logfile, or create it.  Must be called after the rest
+ * of opts has been parsed
+ */
+static int writer_get(struct logger_opts * const opts)
+{
+	struct log_writer *writer;
+	struct binlog_buf bb;
+	int i, ret = 0;
+
+	pthread_mutex_lock(&writers_mutex);
+
+	for (writer = writers; writer; writer = writer->next) {
+		if (strcmp(writer->logfile, opts->logfile) == 0)
+			break;
+	}
+
+	if (writer) {
+		if (writer->binary != opts->binary) {
+			adaptived_err("logger: %s can't hold both text and binary logs\n",
+				      opts->logfile);
+			ret = -EINVAL;
+			goto out;
+		}
+
+		if (writer->rotate_size != opts->rotate_size ||
+		    writer->rotate_count != opts->rotate_count ||
+		    writer->compress != opts->compress ||
+		    writer->ring_len != opts->queue_depth)
+			adaptived_wrn("logger: %s is shared with another logger.  Using the "
+				      "first logger's rotate and queue settings\n", opts->logfile);
+
+		writer->refcnt++;
+		opts->writer = writer;
+		goto out;
+	}
+
+	writer = malloc(sizeof(struct log_writer));
+	if (!writer) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	memset(writer, 0, sizeof(struct log_writer));
+
+	writer->fd = -1;
+	pthread_mutex_init(&writer->mutex, NULL);
+	pthread_cond_init(&writer->work_cond, NULL);
+	pthread_cond_init(&writer->done_cond, NULL);
+
+	writer->rotate_size = opts->rotate_size;
+	writer->rotate_count = opts->rotate_count;
+	writer->compress = opts->compress;
+	writer->binary = opts->binary;
+
+	writer->logfile = strdup(opts->logfile);
+	if (!writer->logfile) {
+		ret = -ENOMEM;
+		goto error;
+	}
+
+	if (opts->binary) {
+		memset(&bb, 0, sizeof(bb));
+		ret = binlog_header(&bb);
+		if (ret)
+			goto error;
+
+		writer->header = bb.buf;
+		writer->header_len = bb.len;
+	}
+
+	writer->ring = malloc(sizeof(struct log_record) * opts->queue_depth);
+	if (!writer->ring) {
+		ret = -ENOMEM;
+		goto error;
+	}
+	memset(writer->ring, 0, sizeof(struct log_record) * opts->queue_depth);
+	writer->ring_len = opts->queue_depth;
+	for (i = 0; i < writer->ring_len; i++) {
+		writer->ring[i].pipe_fd[0] = -1;
+		writer->ring[i].pipe_fd[1] = -1;
+	}
+
+	/*
+	 * The log stays open for the life of the writer.  The writer thread is
+	 * started by the first logger_main(), after adaptived_loop() has had a
+	 * chance to daemonize, since fork() doesn't copy threads
+	 */
+	ret = open_log(writer);
+	if (ret)
+		goto error;
+
+	writer->refcnt = 1;
+	writer->next = writers;
+	writers = writer;
+	opts->writer = writer;
+
+out:
+	pthread_mutex_unlock(&writers_mutex);
+	return ret;
+
+error:
+	pthread_mutex_unlock(&writers_mutex);
+	writer_destroy(writer);
+	return ret;
+}
+
+/*
+ * Get the next free record in the ring, or NULL if the writer is behind and the
+ * snapshot has to be dropped.  Never blocks on the writer.  The record belongs to
+ * the caller until writer_queue()
+ */
+static struct log_record *writer_reserve(struct logger_opts * const opts, int * const ret)
+{
+	struct log_writer *writer = opts->writer;
+	struct log_record *rec = NULL;
+
+	*ret = 0;
+
+	pthread_mutex_lock(&writer->mutex);
+
+	if (!writer->thread_running) {
+		*ret = pthread_create(&writer->thread, NULL, writer_main, writer);
+		if (*ret) {
+			pthread_mutex_unlock(&writer->mutex);
+			adaptived_err("logger: failed to create the writer thread: %d\n", *ret);
+			*ret = -(*ret);
+			return NULL;
+		}
+		writer->thread_running = true;
+	}
+
+	if (writer->cnt == writer->ring_len) {
+		/* complain about the first drop.  the total is logged at exit */
+		if (writer->dropped++ == 0)
+			adaptived_wrn("logger: writer for %s is behind, dropping snapshots\n",
+				      opts->logfile);
+	} else {
+		/*
+		 * Claim the slot now so that another logger sharing this writer can't,
+		 * but the writer won't touch it until writer_queue() marks it ready
+		 */
+		rec = &writer->ring[(writer->head + writer->cnt) % writer->ring_len];
+		rec->ready = false;
+		rec->len = 0;
+		writer->cnt++;
+	}
+
+	pthread_mutex_unlock(&writer->mutex);
+
+	return rec;
+}
+
+/*
+ * Hand the record from writer_reserve() to the writer thread.  A record with a
+ * len of 0 releases the slot without writing anything
+ */
+static void writer_queue(struct logger_opts * const opts, struct log_record * const rec)
+{
+	struct log_writer *writer = opts->writer;
+
+	pthread_mutex_lock(&writer->mutex);
+	rec->ready = true;
+	pthread_cond_signal(&writer->work_cond);
+	pthread_mutex_unlock(&writer->mutex);
+}
+
+/*
+ * Wait for the writer thread to write every queued snapshot to the log
+ */
+void logger_drain(struct adaptived_effect * const eff)
+{
+	struct logger_opts *opts = (struct logger_opts *)eff->data;
+	struct log_writer *writer;
+
+	if (!opts || !opts->writer)
+		return;
+
+	writer = opts->writer;
+
+	pthread_mutex_lock(&writer->mutex);
+	while (writer->thread_running && writer->cnt > 0)
+		pthread_cond_wait(&writer->done_cond, &writer->mutex);
+	pthread_mutex_unlock(&writer->mutex);
+}
+
+/*
+ * Splicing a file into a pipe only takes references to its pages, so the snapshot
+ * would pick up any change made to a regular file before the writer drains the
+ * pipe.  procfs, sysfs and cgroupfs files are generated into fresh pages when
+ * they're read, and those are the files worth splicing anyway.  Everything else
+ * is copied into the pipe when the snapshot is taken
+ */
+static bool can_splice(const char * const filename)
+{
+	struct statfs sfs;
+
+	if (statfs(filename, &sfs))
+		return false;
+
+	switch (sfs.f_type) {
+	case PROC_SUPER_MAGIC:
+	case SYSFS_MAGIC:
+	case CGROUP_SUPER_MAGIC:
+	case CGROUP2_SUPER_MAGIC:
+		return true;
+	default:
+		return false;
+	}
+}
+
 int logger_init(struct adaptived_effect * const eff, struct json_object *args_obj,
 		const struct adaptived_cause * const cse)
 {
@@ -95,8 +778,8 @@ int logger_init(struct adaptived_effect * const eff, struct json_object *args_ob
 	struct files *filep = NULL, *fp = NULL;
 	struct logger_opts *opts;
 	const char *logfile_str, *file_str, *separator_prefix_str, *separator_postfix_str;
-	const char *file_separator_str, *date_format_str;
-	int i;
+	const char *file_separator_str, *date_format_str, *format_str, *type_str;
+	int i, j;
 	int file_cnt;
 	int ret = 0;
 
@@ -196,6 +879,23 @@ int logger_init(struct adaptived_effect * const eff, struct json_object *args_ob
 	}
 	adaptived_dbg("%s: utc = %d\n", __func__, opts->utc);
 
+	ret = adaptived_parse_string(args_obj, "format", &format_str);
+	if (ret == -ENOENT) {
+		opts->binary = false;
+		ret = 0;
+	} else if (ret) {
+		goto error;
+	} else if (strcmp(format_str, "binary") == 0) {
+		opts->binary = true;
+	} else if (strcmp(format_str, "text") == 0) {
+		opts->binary = false;
+	} else {
+		adaptived_err("%s: invalid format: %s\n", __func__, format_str);
+		ret = -EINVAL;
+		goto error;
+	}
+	adaptived_dbg("%s: binary = %d\n", __func__, opts->binary);
+
 
 	ret = adaptived_parse_int(args_obj, "max_file_size", &opts->max_file_size);
 	if (ret == -ENOENT) {
@@ -204,6 +904,50 @@ int logger_init(struct adaptived_effect * const eff, struct json_object *args_ob
 		goto error;
 	}
 
+	ret = adaptived_parse_int(args_obj, "rotate_size", &opts->rotate_size);
+	if (ret == -ENOENT) {
+		opts->rotate_size = 0;
+	} else if (ret) {
+		goto error;
+	} else if (opts->rotate_size < 0) {
+		adaptived_err("%s: invalid rotate_size: %d\n", __func__, opts->rotate_size);
+		ret = -EINVAL;
+		goto error;
+	}
+
+	ret = adaptived_parse_int(args_obj, "rotate_count", &opts->rotate_count);
+	if (ret == -ENOENT) {
+		opts->rotate_count = DEFAULT_ROTATE_COUNT;
+	} else if (ret) {
+		goto error;
+	} else if (opts->rotate_count < 0) {
+		adaptived_err("%s: invalid rotate_count: %d\n", __func__, opts->rotate_count);
+		ret = -EINVAL;
+		goto error;
+	}
+
+	ret = adaptived_parse_bool(args_obj, "compress", &opts->compress);
+	if (ret == -ENOENT) {
+		opts->compress = false;
+	} else if (ret) {
+		adaptived_err("%s: compress arg: %d\n", __func__, ret);
+		goto error;
+	}
+
+	ret = adaptived_parse_int(args_obj, "queue_depth", &opts->queue_depth);
+	if (ret == -ENOENT) {
+		opts->queue_depth = DEFAULT_QUEUE_DEPTH;
+	} else if (ret) {
+		goto error;
+	} else if (opts->queue_depth <= 0) {
+		adaptived_err("%s: invalid queue_depth: %d\n", __func__, opts->queue_depth);
+		ret = -EINVAL;
+		goto error;
+	}
+	adaptived_dbg("%s: rotate_size = %d, rotate_count = %d, compress = %d, queue_depth = %d\n",
+		      __func__, opts->rotate_size, opts->rotate_count, opts->compress,
+		      opts->queue_depth);
+
 	exists = json_object_object_get_ex(args_obj, "files", &files_obj);
 	if (!exists || !files_obj) {
 		adaptived_err("logger_init: can't find 'files'\n");
@@ -243,6 +987,9 @@ int logger_init(struct adaptived_effect * const eff, struct json_object *args_ob
 		strcpy(fp->filename, file_str);
 		fp->filename[strlen(file_str)] = '\0';
 
+		fp->type = FILE_TYPE_RAW;
+		fp->reader = NULL;
+		fp->splice = can_splice(fp->filename);
 		fp->next = NULL;
 		if (i == 0) {
 			opts->file_list = fp;
@@ -251,8 +998,48 @@ int logger_init(struct adaptived_effect * const eff, struct json_object *args_ob
 			filep->next = fp;
 			filep = fp;
 		}
+
+		ret = adaptived_parse_string(file_obj, "type", &type_str);
+		if (ret == -ENOENT) {
+			ret = 0;
+		} else if (ret) {
+			goto error;
+		} else {
+			for (j = 0; j < FILE_TYPE_CNT; j++) {
+				if (strcmp(type_str, file_type_names[j]) == 0)
+					break;
+			}
+			if (j == FILE_TYPE_CNT) {
+				adaptived_err("logger_init: file %d has an invalid type: %s\n", i,
+					      type_str);
+				ret = -EINVAL;
+				goto error;
+			}
+			fp->type = j;
+		}
+
+		if (opts->binary && fp->type != FILE_TYPE_SCHEDSTAT) {
+			/* the logged files may be settings the effects change */
+			ret = file_reader_open(fp->filename, FILE_READER_NO_CACHE,
+					       &fp->reader);
+			if (ret)
+				goto error;
+		}
 	}
 
+	/*
+	 * Size the pipes to hold a whole snapshot.  Allow a page for the separator, a
+	 * page for each file's header, and a page for each file's partially filled
+	 * last page.  If a snapshot doesn't fit anyway, logger_main() falls back to
+	 * capturing into a buffer
+	 */
+	opts->splice = !opts->binary;
+	opts->pipe_size = getpagesize() * (1 + 2 * file_cnt) + opts->max_file_size * file_cnt;
+
+	ret = writer_get(opts);
+	if (ret)
+		goto error;
+
 	/* we have successfully setup the logger effect */
 	eff->data = (void *)opts;
 
@@ -264,24 +1051,288 @@ error:
 	return ret;
 }
 
+static int append(char ** const bufp, size_t * const lenp, size_t * const sizep,
+		  const char * const str, size_t str_len)
+{
+	size_t new_size;
+	char *tmp;
+
+	if (*lenp + str_len > *sizep) {
+		new_size = max(*sizep * 2, *lenp + str_len);
+		tmp = realloc(*bufp, new_size);
+		if (!tmp)
+			return -ENOMEM;
+
+		*bufp = tmp;
+		*sizep = new_size;
+	}
+
+	memcpy(&(*bufp)[*lenp], str, str_len);
+	*lenp += str_len;
+
+	return 0;
+}
+
+/*
+ * Where logger_main() is capturing the snapshot.  Into the write end of the
+ * record's pipe if pipe_fd is valid, otherwise into buf
+ */
+struct capture {
+	int pipe_fd;
+	char *buf;
+	size_t len;
+	size_t size;
+};
+
+static int capture_str(struct capture * const cap, const char * const str)
+{
+	size_t str_len = strlen(str);
+	int ret;
+
+	if (cap->pipe_fd < 0)
+		return append(&cap->buf, &cap->len, &cap->size, str, str_len);
+
+	/* the pipe is non-blocking.  -EAGAIN means the snapshot doesn't fit */
+	ret = write_all(cap->pipe_fd, str, str_len);
+	if (ret)
+		return ret;
+
+	cap->len += str_len;
+
+	return 0;
+}
+
+/*
+ * Capture up to max_file_size bytes of the file
+ */
+static int capture_file(const struct logger_opts * const opts, struct capture * const cap,
+			const struct files * const filep)
+{
+	const char * const filename = filep->filename;
+	size_t max_size = opts->max_file_size;
+	size_t total = 0;
+	ssize_t bytes;
+	char *start;
+	int fd, ret;
+
+	fd = open(filename, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		adaptived_err("logger_main: can't open file %s for logging.\n", filename);
+		return -errno;
+	}
+
+	if (cap->pipe_fd >= 0) {
+		bytes = move_fd(fd, cap->pipe_fd, max_size, !filep->splice);
+		close(fd);
+		if (bytes < 0) {
+			if (bytes != -EAGAIN)
+				adaptived_err("logger_main: failed to read %s: %ld\n", filename,
+					      bytes);
+			return bytes;
+		}
+
+		total = bytes;
+		goto out;
+	}
+
+	/* read straight into the end of the record */
+	if (cap->size - cap->len < max_size) {
+		start = realloc(cap->buf, cap->len + max_size);
+		if (!start) {
+			close(fd);
+			return -ENOMEM;
+		}
+		cap->buf = start;
+		cap->size = cap->len + max_size;
+	}
+	start = &cap->buf[cap->len];
+
+	while (total < max_size) {
+		bytes = read(fd, &start[total], max_size - total);
+		if (bytes < 0) {
+			if (errno == EINTR)
+				continue;
+			ret = -errno;
+			adaptived_err("logger_main: failed to read %s: %d\n", filename, ret);
+			close(fd);
+			return ret;
+		}
+		if (bytes == 0)
+			break;
+
+		total += bytes;
+	}
+	close(fd);
+
+out:
+	if (total == 0) {
+		adaptived_err("logger_main: nothing was read from %s\n", filename);
+		return -EINVAL;
+	}
+
+	cap->len += total;
+
+	return 0;
+}
+
+/*
+ * Create the record's pipe if it doesn't have one yet.  Returns false if a pipe
+ * big enough for the snapshot can't be had
+ */
+static bool get_pipe(struct logger_opts * const opts, struct log_record * const rec)
+{
+	/* the ring is shared with other loggers, whose snapshots may be smaller */
+	if (rec->pipe_fd[0] >= 0 && rec->pipe_size >= opts->pipe_size)
+		return true;
+
+	if (rec->pipe_fd[0] < 0 && pipe2(rec->pipe_fd, O_CLOEXEC | O_NONBLOCK)) {
+		rec->pipe_fd[0] = -1;
+		rec->pipe_fd[1] = -1;
+		adaptived_wrn("logger: failed to create a pipe: %d\n", -errno);
+		return false;
+	}
+
+	if (fcntl(rec->pipe_fd[1], F_SETPIPE_SZ, opts->pipe_size) < 0) {
+		adaptived_wrn("logger: can't grow a pipe to %d bytes: %d.  Copying snapshots "
+			      "instead\n", opts->pipe_size, -errno);
+		close_pipe(rec);
+		opts->splice = false;
+		return false;
+	}
+	rec->pipe_size = opts->pipe_size;
+
+	return true;
+}
+
+static int capture(const struct logger_opts * const opts, struct capture * const cap,
+		   const char * const separator)
+{
+	struct files *filep = NULL;
+	char file_header[FILENAME_MAX];
+	int ret;
+
+	ret = capture_str(cap, separator);
+	if (ret)
+		return ret;
+
+	filep = opts->file_list;
+	do {
+		memset(file_header, 0, FILENAME_MAX);
+
+		if (opts->file_separator) {
+			ret = snprintf(file_header, FILENAME_MAX - 1,
+				"\n%s\n%s\n", opts->file_separator, filep->filename);
+		} else {
+			ret = snprintf(file_header, FILENAME_MAX - 1,
+				"\n%s\n", filep->filename);
+		}
+		if (ret < 0)
+			return ret;
+
+		ret = capture_str(cap, file_header);
+		if (ret)
+			return ret;
+
+		ret = capture_file(opts, cap, filep);
+		if (ret)
+			return ret;
+
+		filep = filep->next;
+	} while (filep);
+
+	return 0;
+}
+
+/*
+ * Capture every file as a binlog.h record
+ */
+static int capture_binary(struct logger_opts * const opts, struct binlog_buf * const bb)
+{
+	struct adaptived_pressure_snapshot ps;
+	struct files *filep;
+	size_t len;
+	char *buf;
+	int ret;
+
+	binlog_buf_stamp(bb);
+
+	for (filep = opts->file_list; filep; filep = filep->next) {
+		switch (filep->type) {
+		case FILE_TYPE_SCHEDSTAT:
+			/* this is several megabytes.  don't put it on the stack */
+			if (!opts->ss) {
+				opts->ss = malloc(sizeof(struct adaptived_schedstat_snapshot));
+				if (!opts->ss)
+					return -ENOMEM;
+			}
+
+			ret = adaptived_get_schedstat(filep->filename, opts->ss);
+			if (ret)
+				return ret;
+			ret = binlog_schedstat(bb, opts->ss);
+			break;
+		case FILE_TYPE_PRESSURE:
+			ret = reader_get_pressure(filep->reader, &ps);
+			if (ret)
+				return ret;
+			ret = binlog_pressure(bb, filep->filename, &ps);
+			break;
+		case FILE_TYPE_MEMINFO:
+			ret = file_reader_read(filep->reader, &buf, NULL);
+			if (ret)
+				return ret;
+			ret = binlog_meminfo(bb, buf);
+			break;
+		case FILE_TYPE_RAW:
+		default:
+			ret = file_reader_read(filep->reader, &buf, &len);
+			if (ret)
+				return ret;
+			ret = binlog_raw(bb, filep->filename, buf, min(len, (size_t)opts->max_file_size));
+			break;
+		}
+
+		if (ret) {
+			adaptived_err("logger_main: failed to encode %s: %d\n", filep->filename, ret);
+			return ret;
+		}
+	}
+
+	return 0;
+}
+
 int logger_main(struct adaptived_effect * const eff)
 {
 	struct logger_opts *opts = (struct logger_opts *)eff->data;
-	struct files *filep = NULL;
 	char separator[FILENAME_MAX];
 	char dateline[FILENAME_MAX];
-	FILE *log = NULL;
-	FILE *fnp = NULL;
-	size_t read, write;
-	int ret = 0;
 	time_t now = time(NULL);
-	char *buf = NULL;
+	struct log_record *rec;
+	struct binlog_buf bb;
+	struct capture cap;
+	int ret = 0;
 
-	log = fopen(opts->logfile, "a");
-	if (log == NULL) {
-		adaptived_err("logger_main: can't open log file %s\n", opts->logfile);
-		return -errno;
+	if (opts->binary) {
+		rec = writer_reserve(opts, &ret);
+		if (!rec)
+			return ret;
+
+		memset(&bb, 0, sizeof(bb));
+		ret = capture_binary(opts, &bb);
+		if (ret) {
+			if (bb.buf)
+				free(bb.buf);
+			writer_queue(opts, rec);
+			return ret;
+		}
+
+		rec->buf = bb.buf;
+		rec->len = bb.len;
+		writer_queue(opts, rec);
+
+		return 0;
 	}
+
 	memset(dateline, 0, FILENAME_MAX);
 	memset(separator, 0, FILENAME_MAX);
 
@@ -290,7 +1341,7 @@ int logger_main(struct adaptived_effect * const eff)
 	if (opts->separator_prefix) {
 		ret = snprintf(separator, FILENAME_MAX - 1, "\n%s", opts->separator_prefix);
 		if (ret < 0)
-			goto error;
+			return ret;
 	}
 	if (opts->date_format) {
 		if (opts->utc)
@@ -298,103 +1349,61 @@ int logger_main(struct adaptived_effect * const eff)
 		else
 			strftime(dateline, FILENAME_MAX, opts->date_format, localtime(&now));
 		strcpy(&separator[strlen(separator)], dateline);
-		}
+	}
 
-		if (opts->separator_postfix)
-			strcpy(&separator[strlen(separator)], opts->separator_postfix);
+	if (opts->separator_postfix)
+		strcpy(&separator[strlen(separator)], opts->separator_postfix);
 
-		adaptived_dbg("%s: separator = %s\n", __func__, separator);
+	adaptived_dbg("%s: separator = %s\n", __func__, separator);
 
-		write = fwrite(separator, 1, strlen(separator), log);
-		if (write != strlen(separator)) {
-			adaptived_err("logger_main: amount written (%ld) != strlen(separator) (%ld)\n",
-				write, strlen(separator));
-			ret = -EINVAL;
-			goto error;
-		}
-		filep = opts->file_list;
-		do {
-			struct stat statbuf;
-			long size;
-
-			fnp = fopen(filep->filename, "r");
-			if (fnp == NULL)
-			{
-				adaptived_err("logger_main: can't open file %s for logging.\n",
-					filep->filename);
-				ret = -errno;
-				goto error;
-			}
-			if (stat(filep->filename, &statbuf) == -1) {
-				adaptived_err("logger_main: stat() filed for %s.\n", filep->filename);
-				ret = -errno;
-				goto error;
-			}
-			size = statbuf.st_size;
-			if (size == 0 || size >= opts->max_file_size)
-				size = opts->max_file_size;
-			buf = malloc(size + 1);
-			if (!buf) {
-				ret = -ENOMEM;
-				goto error;
-			}
-			memset(buf, 0, size + 1);
-			memset(separator, 0, FILENAME_MAX);
-
-			if (opts->file_separator) {
-				ret = snprintf(separator, FILENAME_MAX - 1,
-					"\n%s\n%s\n", opts->file_separator, filep->filename);
-			} else {
-				ret = snprintf(separator, FILENAME_MAX - 1,
-					"\n%s\n", filep->filename);
-			}
-			if (ret < 0)
-				goto error;
+	rec = writer_reserve(opts, &ret);
+	if (!rec)
+		return ret;
 
-			read = fread(&buf[strlen(buf)], 1,
-				     min(opts->max_file_size, size), fnp);
-			fclose(fnp);
-			fnp = NULL;
-			if (read <= 0) {
-				adaptived_err("logger_main: amount read from %s (%ld) != size (%ld)\n",
-					filep->filename, read, size);
-				ret = -EINVAL;
-				goto error;
-			}
-			write = fwrite(separator, 1, strlen(separator), log);
-			if (write != strlen(separator)) {
-				adaptived_err("logger_main: amount written (%ld) != "
-				    "strlen(separator) (%ld)\n", write, strlen(separator));
-				ret = -EINVAL;
-				goto error;
-			}
-			write = fwrite(buf, 1, strlen(buf), log);
-			if (write != strlen(buf)) {
-				adaptived_err("logger_main: amount written (%ld) != "
-				    "strlen(buf) (%ld) of %s\n",
-					write, strlen(buf), filep->filename);
-				ret = -EINVAL;
-				goto error;
-			}
-			filep = filep->next;
-			free(buf);
-			buf = NULL;
-		} while (filep);
+	/*
+	 * Capture every file now, and leave writing the snapshot to the log to the
+	 * writer thread.  Splicing the files into the record's pipe means the
+	 * contents of procfs, sysfs and cgroupfs files are never copied through
+	 * userspace.  See can_splice()
+	 */
+	memset(&cap, 0, sizeof(cap));
+	cap.pipe_fd = -1;
+	if (opts->splice && get_pipe(opts, rec))
+		cap.pipe_fd = rec->pipe_fd[1];
 
-		fclose(log);
+	ret = capture(opts, &cap, separator);
+	if (ret && cap.pipe_fd >= 0) {
+		close_pipe(rec);
 
-		return 0;
+		if (ret != -EAGAIN)
+			goto error;
 
-	error:
-		if (buf)
-			free(buf);
-		if (fnp)
-			fclose(fnp);
-		if (log)
-			fclose(log);
+		adaptived_wrn("logger: snapshot for %s doesn't fit in a pipe.  Copying snapshots "
+			      "instead\n", opts->logfile);
+		opts->splice = false;
 
-		return ret;
+		memset(&cap, 0, sizeof(cap));
+		cap.pipe_fd = -1;
+		ret = capture(opts, &cap, separator);
 	}
+	if (ret)
+		goto error;
+
+	rec->buf = cap.buf;
+	rec->len = cap.len;
+	writer_queue(opts, rec);
+
+	return 0;
+
+error:
+	if (cap.buf)
+		free(cap.buf);
+
+	/* give the slot back */
+	writer_queue(opts, rec);
+
+	return ret;
+}
 
 void logger_exit(struct adaptived_effect * const eff)
 {
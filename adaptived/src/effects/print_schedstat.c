@@ -35,6 +35,7 @@
 
 #include "adaptived-internal.h"
 #include "defines.h"
+#include "binlog.h"
 
 enum file_enum {
 	FILE_STDOUT = 0,
@@ -45,7 +46,10 @@ enum file_enum {
 
 struct print_opts {
 	FILE *file;
+	bool close_file;	/* file is a path rather than stdout or stderr */
 	char *schedstat_file;
+	bool binary;		/* write binlog.h records rather than text */
+	bool need_header;
 
 	const struct adaptived_cause *cse;
 };
@@ -55,7 +59,7 @@ static const char * const default_schedstat_file = "/proc/schedstat";
 int print_schedstat_init(struct adaptived_effect * const eff, struct json_object *args_obj,
 	       const struct adaptived_cause * const cse)
 {
-	const char *file_str, *schedstat_file_str;
+	const char *file_str, *schedstat_file_str, *format_str;
 	struct print_opts *opts;
 	int ret = 0;
 
@@ -76,10 +80,53 @@ int print_schedstat_init(struct adaptived_effect * const eff, struct json_object
 	} else if (strncmp(file_str, "stdout", strlen("stdout")) == 0) {
 		opts->file = stdout;
 	} else {
+		/* a+ so that an existing binary log's header can be checked */
+		opts->file = fopen(file_str, "a+");
+		if (!opts->file) {
+			adaptived_err("print_schedstat: can't open %s\n", file_str);
+			ret = -errno;
+			goto error;
+		}
+		opts->close_file = true;
+	}
+
+	ret = adaptived_parse_string(args_obj, "format", &format_str);
+	if (ret == -ENOENT) {
+		opts->binary = false;
+	} else if (ret) {
+		goto error;
+	} else if (strcmp(format_str, "binary") == 0) {
+		opts->binary = true;
+	} else if (strcmp(format_str, "text") == 0) {
+		opts->binary = false;
+	} else {
+		adaptived_err("print_schedstat: invalid format: %s\n", format_str);
 		ret = -EINVAL;
 		goto error;
 	}
 
+	if (opts->binary) {
+		if (!opts->close_file) {
+			adaptived_err("print_schedstat: the binary format must be written to a file\n");
+			ret = -EINVAL;
+			goto error;
+		}
+
+		/* a binary log starts with a header.  don't repeat it when appending */
+		fseek(opts->file, 0, SEEK_END);
+		opts->need_header = (ftell(opts->file) == 0);
+
+		if (!opts->need_header) {
+			ret = binlog_check_header(fileno(opts->file));
+			if (ret) {
+				adaptived_err("print_schedstat: %s is not a version %d binary log\n",
+					      file_str, BINLOG_VERSION);
+				ret = -EINVAL;
+				goto error;
+			}
+		}
+	}
+
 	ret = adaptived_parse_string(args_obj, "schedstat_file", &schedstat_file_str);
 	if (ret == -ENOENT) {
 		opts->schedstat_file = malloc(sizeof(char) * (strlen(default_schedstat_file) + 1));
@@ -108,8 +155,47 @@ int print_schedstat_init(struct adaptived_effect * const eff, struct json_object
 	return ret;
 
 error:
-	if (opts)
+	if (opts) {
+		if (opts->close_file)
+			fclose(opts->file);
+		if (opts->schedstat_file)
+			free(opts->schedstat_file);
 		free(opts);
+	}
+
+	return ret;
+}
+
+static int write_binary(struct print_opts * const opts,
+			const struct adaptived_schedstat_snapshot * const ss)
+{
+	struct binlog_buf bb;
+	int ret;
+
+	memset(&bb, 0, sizeof(bb));
+	binlog_buf_stamp(&bb);
+
+	if (opts->need_header) {
+		ret = binlog_header(&bb);
+		if (ret)
+			goto out;
+	}
+
+	ret = binlog_schedstat(&bb, ss);
+	if (ret)
+		goto out;
+
+	if (fwrite(bb.buf, 1, bb.len, opts->file) != bb.len || fflush(opts->file)) {
+		adaptived_err("print_schedstat: failed to write the snapshot\n");
+		ret = -EIO;
+		goto out;
+	}
+
+	opts->need_header = false;
+
+out:
+	if (bb.buf)
+		free(bb.buf);
 
 	return ret;
 }
@@ -129,6 +215,9 @@ int print_schedstat_main(struct adaptived_effect * const eff)
 		return -errno;
 	}
 
+	if (opts->binary)
+		return write_binary(opts, &ss);
+
 	cse = opts->cse;
 	while (cse) {
 		fprintf(opts->file, "Timestamp (jiffies/ticks): %lu:\n", ss.timestamp);
@@ -159,6 +248,8 @@ void print_schedstat_exit(struct adaptived_effect * const eff)
 
 	if (opts->schedstat_file)
 		free(opts->schedstat_file);
+	if (opts->close_file)
+		fclose(opts->file);
 
 	free(opts);
 }
@@ -34,6 +34,7 @@
 #include <assert.h>
 #include <stdio.h>
 #include <errno.h>
+#include <poll.h>
 #include <time.h>
 
 #include <adaptived.h>
@@ -55,6 +56,7 @@ static_assert(ARRAY_SIZE(log_files) == LOG_LOC_CNT,
 
 static const char * const default_config_file = "/etc/adaptived.json";
 static const int default_interval = 5000; /* milliseconds */
+static const int max_worker_threads = 256;
 
 static void usage(FILE *fd)
 {
@@ -71,6 +73,8 @@ static void usage(FILE *fd)
 	fprintf(fd, "  -m --maxloops=COUNT       Maximum number of loops to run."
 						 "Useful for testing\n");
 	fprintf(fd, "  -d --daemon_mode          Run as a daemon\n");
+	fprintf(fd, "  -t --threads=COUNT        Number of threads used to evaluate the rules' "
+						 "causes (default: 1)\n");
 }
 
 static int _adaptived_init(struct adaptived_ctx * const ctx)
@@ -184,6 +188,13 @@ API int adaptived_set_attr(struct adaptived_ctx * const ctx, enum adaptived_attr
 		else
 			ctx->daemon_noclose = 1;
 		break;
+	case ADAPTIVED_ATTR_WORKER_THREADS:
+		if ((int)value < 0 || (int)value > max_worker_threads) {
+			ret = -EINVAL;
+			break;
+		}
+		ctx->worker_threads = (int)value;
+		break;
 	case ADAPTIVED_ATTR_RULE_CNT:
 	default:
 		ret = -EINVAL;
@@ -232,6 +243,9 @@ API int adaptived_get_attr(struct adaptived_ctx * const ctx, enum adaptived_attr
 	case ADAPTIVED_ATTR_DAEMON_NOCLOSE:
 		*value = ctx->daemon_noclose;
 		break;
+	case ADAPTIVED_ATTR_WORKER_THREADS:
+		*value = (uint32_t)ctx->worker_threads;
+		break;
 	case ADAPTIVED_ATTR_RULE_CNT:
 		i = 0;
 		rule = ctx->rules;
@@ -295,9 +309,10 @@ int parse_opts(int argc, char *argv[], struct adaptived_ctx * const ctx)
 		{"loglevel",	  required_argument, NULL, 'l'},
 		{"maxloops",	  required_argument, NULL, 'm'},
 		{"daemon_mode",		no_argument, NULL, 'd'},
+		{"threads",	  required_argument, NULL, 't'},
 		{NULL, 0, NULL, 0}
 	};
-	const char *short_options = "c:hi:L:l:m:d";
+	const char *short_options = "c:hi:L:l:m:dt:";
 
 	int ret = 0, i;
 	int tmp_level;
@@ -372,6 +387,14 @@ int parse_opts(int argc, char *argv[], struct adaptived_ctx * const ctx)
 		case 'd':
 			ctx->daemon_mode = true;
 			break;
+		case 't':
+			ctx->worker_threads = atoi(optarg);
+			if (ctx->worker_threads < 1 || ctx->worker_threads > max_worker_threads) {
+				adaptived_err("Invalid thread count: %s\n", optarg);
+				ret = 1;
+				goto err;
+			}
+			break;
 
 		default:
 			ret = 1;
@@ -409,6 +432,8 @@ void cleanup(struct adaptived_ctx *ctx)
 	 */
 	causes_cleanup();
 	effects_cleanup();
+	path_walk_cache_cleanup();
+	bus_conn_cleanup();
 
 	pthread_mutex_unlock(&ctx->ctx_mutex);
 	pthread_mutex_destroy(&ctx->ctx_mutex);
@@ -439,14 +464,227 @@ static void free_rule_shared_data(struct adaptived_rule * const rule, bool force
 	}
 }
 
+/*
+ * Build the list of file descriptors that causes have asked adaptived_loop() to poll()
+ * on, e.g. PSI triggers.  Must be called with the ctx mutex held
+ */
+static int build_poll_fds(struct adaptived_ctx * const ctx, struct pollfd ** const fds,
+			  int * const fd_cnt, int * const fd_len)
+{
+	struct adaptived_rule *rule;
+	struct adaptived_cause *cse;
+	struct pollfd *tmp_fds;
+	int cnt = 0;
+
+	rule = ctx->rules;
+	while (rule) {
+		cse = rule->causes;
+		while (cse) {
+			if (cse->poll_fd >= 0)
+				cnt++;
+			cse = cse->next;
+		}
+		rule = rule->next;
+	}
+
+	/* one more for the sd_bus connection, if it's waiting on replies */
+	cnt++;
+
+	if (cnt > *fd_len) {
+		tmp_fds = realloc(*fds, sizeof(struct pollfd) * cnt);
+		if (!tmp_fds)
+			return -ENOMEM;
+
+		*fds = tmp_fds;
+		*fd_len = cnt;
+	}
+
+	cnt = 0;
+	rule = ctx->rules;
+	while (rule) {
+		cse = rule->causes;
+		while (cse) {
+			if (cse->poll_fd >= 0) {
+				(*fds)[cnt].fd = cse->poll_fd;
+				(*fds)[cnt].events = POLLPRI;
+				(*fds)[cnt].revents = 0;
+				cnt++;
+			}
+			cse = cse->next;
+		}
+		rule = rule->next;
+	}
+
+	cnt += bus_conn_get_pollfd(&(*fds)[cnt]);
+
+	*fd_cnt = cnt;
+
+	return 0;
+}
+
+/*
+ * Hand the events returned by poll() to the causes that own the file descriptors.
+ * Must be called with the ctx mutex held
+ */
+static void dispatch_poll_events(struct adaptived_ctx * const ctx,
+				 const struct pollfd * const fds, int fd_cnt)
+{
+	struct adaptived_rule *rule;
+	struct adaptived_cause *cse;
+	int i;
+
+	rule = ctx->rules;
+	while (rule) {
+		cse = rule->causes;
+		while (cse) {
+			cse->poll_revents = 0;
+
+			for (i = 0; cse->poll_fd >= 0 && i < fd_cnt; i++) {
+				if (fds[i].fd == cse->poll_fd) {
+					cse->poll_revents = fds[i].revents;
+					break;
+				}
+			}
+
+			cse = cse->next;
+		}
+		rule = rule->next;
+	}
+}
+
+/*
+ * Wait for effects that write from their own threads, e.g. the logger, to finish
+ * the work handed to them.  Must be called with the ctx mutex held
+ */
+static void drain_effects(struct adaptived_ctx * const ctx)
+{
+	struct adaptived_rule *rule;
+	struct adaptived_effect *eff;
+
+	rule = ctx->rules;
+	while (rule) {
+		eff = rule->effects;
+		while (eff) {
+			if (eff->idx == EFFECT_LOGGER)
+				logger_drain(eff);
+			eff = eff->next;
+		}
+		rule = rule->next;
+	}
+}
+
+/*
+ * Milliseconds on adaptived_loop()'s clock.  CLOCK_MONOTONIC so that the schedule
+ * isn't disturbed by changes to the wall clock
+ */
+static long long loop_clock(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (long long)now.tv_sec * 1000LL + now.tv_nsec / 1000000LL;
+}
+
+static int rule_interval(const struct adaptived_ctx * const ctx,
+			 const struct adaptived_rule * const rule)
+{
+	if (rule->interval > 0)
+		return rule->interval;
+
+	return ctx->interval;
+}
+
+static bool rule_has_poll_event(const struct adaptived_rule * const rule)
+{
+	struct adaptived_cause *cse;
+
+	cse = rule->causes;
+	while (cse) {
+		if (cse->poll_revents)
+			return true;
+		cse = cse->next;
+	}
+
+	return false;
+}
+
+/*
+ * Mark the rules that should run in this loop and advance their schedules.  A
+ * rule runs when its interval has expired or when poll() reported an event on one
+ * of its causes' file descriptors.  Rules that have never run, e.g. rules loaded
+ * at runtime, have a next_run of zero and are always due.
+ *
+ * Rules that run on schedule are told that their interval has passed, just as
+ * when every rule ran each ctx->interval.  Rules woken early by poll() are told
+ * how long it's actually been.  Returns the number of rules that are due.  Must be
+ * called with the ctx mutex held
+ */
+static int schedule_rules(struct adaptived_ctx * const ctx, long long now)
+{
+	struct adaptived_rule *rule;
+	int interval, cnt = 0;
+
+	rule = ctx->rules;
+	while (rule) {
+		interval = rule_interval(ctx, rule);
+		rule->due = false;
+
+		if (rule->next_run <= now) {
+			rule->time_since_last_run = interval;
+			rule->next_run += interval;
+		} else if (rule_has_poll_event(rule)) {
+			rule->time_since_last_run = (int)(now - rule->last_run);
+			rule->next_run = now + interval;
+		} else {
+			rule = rule->next;
+			continue;
+		}
+
+		/* if we've fallen behind, don't try to catch up */
+		if (rule->next_run <= now)
+			rule->next_run = now + interval;
+
+		rule->due = true;
+		rule->last_run = now;
+		cnt++;
+		rule = rule->next;
+	}
+
+	return cnt;
+}
+
+/*
+ * Returns the loop clock time at which the next rule is due.  Must be called with
+ * the ctx mutex held
+ */
+static long long next_wakeup(const struct adaptived_ctx * const ctx, long long now)
+{
+	struct adaptived_rule *rule;
+	long long wakeup;
+
+	wakeup = now + ctx->interval;
+
+	rule = ctx->rules;
+	while (rule) {
+		if (rule->next_run < wakeup)
+			wakeup = rule->next_run;
+		rule = rule->next;
+	}
+
+	return wakeup;
+}
+
 API int adaptived_loop(struct adaptived_ctx * const ctx, bool parse)
 {
+	int fd_cnt = 0, fd_len = 0, due_cnt, poll_ret, flush_ret, ret = 0;
+	long long now, wakeup, timeout;
+	struct timespec sleep;
 	struct adaptived_effect *eff;
 	struct adaptived_rule *rule;
-	struct adaptived_cause *cse;
+	struct worker_pool *pool = NULL;
+	struct pollfd *fds = NULL;
 	bool triggered = true;
-	int interval, ret = 0;
-	struct timespec sleep;
 	bool skip_sleep;
 
 	if (parse) {
@@ -476,46 +714,108 @@ API int adaptived_loop(struct adaptived_ctx * const ctx, bool parse)
 		adaptived_dbg("adaptived_loop: Debug mode. Skip running as daemon.\n");
 	}
 
+	/* create the worker threads after daemon() since fork() doesn't copy them */
+	if (ctx->worker_threads > 1) {
+		ret = worker_pool_create(ctx->worker_threads, &pool);
+		if (ret) {
+			pthread_mutex_unlock(&ctx->ctx_mutex);
+			return ret;
+		}
+	}
+
 	ctx->loop_cnt = 0;
+	skip_sleep = ctx->skip_sleep;
 	pthread_mutex_unlock(&ctx->ctx_mutex);
 
+	/* batch the effects' sd_bus property writes until the loop exits */
+	bus_conn_start();
+
+	now = loop_clock();
+	wakeup = now;
+
 	while (1) {
 		pthread_mutex_lock(&ctx->ctx_mutex);
-		rule = ctx->rules;
+		dispatch_poll_events(ctx, fds, fd_cnt);
+
+		/* handle systemd's replies to the sd_bus property writes sent last loop */
+		bus_conn_process();
+
+		/*
+		 * When skipping sleeps, the loop clock jumps straight to the next
+		 * wakeup so that rules with different intervals still run in the
+		 * same relative order
+		 */
+		if (!skip_sleep)
+			now = loop_clock();
+		due_cnt = schedule_rules(ctx, now);
+
+		/*
+		 * Every cause that reads the same /proc or cgroup file during this loop
+		 * will share a single read of it
+		 */
+		snapshot_cache_start();
+
+		if (pool) {
+			/*
+			 * Run the injection function once per due rule, just as the
+			 * serial path does, but before any of the causes are evaluated
+			 */
+			rule = ctx->rules;
+			while (rule && ctx->inject_fn) {
+				if (rule->due) {
+					ret = (*ctx->inject_fn)(ctx);
+					if (ret)
+						goto out;
+
+					snapshot_cache_invalidate();
+				}
+				rule = rule->next;
+			}
 
-		while (rule) {
 			/*
-			 * Intentionally undocumented API that allows a user to modify
-			 * values/settings during each loop.  This feature is targeted at
-			 * automated testing where it's difficult to force certain
-			 * behaviors, e.g. PSI thresholds
+			 * Evaluate every due rule's causes concurrently.  The effects
+			 * are applied below, in rule order, from this thread
 			 */
-			if (ctx->inject_fn) {
-				ret = (*ctx->inject_fn)(ctx);
-				if (ret)
-					goto out;
+			ret = worker_pool_run(pool, ctx->rules);
+			if (ret)
+				goto out;
+		}
+
+		rule = ctx->rules;
+
+		while (rule) {
+			if (!rule->due) {
+				rule = rule->next;
+				continue;
 			}
 
-			adaptived_dbg("Running rule %s\n", rule->name);
-			rule->stats.loops_run_cnt++;
-			cse = rule->causes;
-
-			triggered = true;
-			while (cse) {
-				ret = (*cse->fns->main)(cse, ctx->interval);
-				if (ret < 0) {
-					adaptived_dbg("%s raised error %d\n", cse->name, ret);
-					goto out;
-				} else if (ret == 0) {
-					adaptived_dbg("%s did not trigger\n", cse->name);
-					triggered = false;
-				} else if (ret > 0) {
-					adaptived_dbg("%s triggered\n", cse->name);
+			if (pool) {
+				ret = rule->causes_ret;
+			} else {
+				/*
+				 * Intentionally undocumented API that allows a user to
+				 * modify values/settings during each loop.  This feature is
+				 * targeted at automated testing where it's difficult to force
+				 * certain behaviors, e.g. PSI thresholds
+				 */
+				if (ctx->inject_fn) {
+					ret = (*ctx->inject_fn)(ctx);
+					if (ret)
+						goto out;
+
+					/* the injection function may have modified the files */
+					snapshot_cache_invalidate();
 				}
 
-				cse = cse->next;
+				ret = rule_run_causes(rule, rule->time_since_last_run);
 			}
 
+			if (ret < 0)
+				goto out;
+
+			triggered = (ret > 0);
+			ret = 0;
+
 			if (triggered) {
 				rule->stats.trigger_cnt++;
 
@@ -525,6 +825,14 @@ API int adaptived_loop(struct adaptived_ctx * const ctx, bool parse)
 				 */
 				eff = rule->effects;
 
+				/*
+				 * Collect the effects' cgroup writes and apply them once
+				 * all of the rules have run, so each setting is written at
+				 * most once per loop.  The causes keep reading and writing
+				 * the files directly
+				 */
+				cgroup_journal_start();
+
 				while (eff) {
 					adaptived_dbg("Running effect %s\n", eff->name);
 					ret = (*eff->fns->main)(eff);
@@ -545,13 +853,21 @@ API int adaptived_loop(struct adaptived_ctx * const ctx, bool parse)
 
 					eff = eff->next;
 				}
+
+				cgroup_journal_stop();
 			}
 
 			free_rule_shared_data(rule, false);
 			rule = rule->next;
 		}
 
-		ctx->loop_cnt++;
+		ret = cgroup_journal_flush();
+		if (ret)
+			goto out;
+
+		/* don't count a loop where we were woken early, e.g. by a signal */
+		if (due_cnt > 0 || now >= wakeup)
+			ctx->loop_cnt++;
 		if (ctx->max_loops > 0 && ctx->loop_cnt >= ctx->max_loops) {
 			adaptived_dbg("adaptived main loop exceeded max loops\n");
 			ret = -ETIME;
@@ -562,14 +878,46 @@ API int adaptived_loop(struct adaptived_ctx * const ctx, bool parse)
 		 * Once we've unlocked the ctx mutex, we can't safely access any variables
 		 * within ctx.  Make a stack copy before unlocking
 		 */
-		interval = ctx->interval;
+		wakeup = next_wakeup(ctx, now);
 		skip_sleep = ctx->skip_sleep;
 
+		/*
+		 * The effects queue their sd_bus property writes.  Send them now, one
+		 * SetUnitProperties call per unit, without waiting for the replies
+		 */
+		bus_conn_flush();
+
+		ret = build_poll_fds(ctx, &fds, &fd_cnt, &fd_len);
+		if (ret)
+			goto out;
+
+		snapshot_cache_stop();
 		pthread_mutex_unlock(&ctx->ctx_mutex);
 
-		if (!skip_sleep) {
-			sleep.tv_sec = interval / 1000;
-			sleep.tv_nsec = (interval % 1000) * 1000000LL;
+		if (skip_sleep) {
+			now = wakeup;
+			continue;
+		}
+
+		timeout = wakeup - loop_clock();
+		if (timeout < 0)
+			timeout = 0;
+
+		if (fd_cnt > 0) {
+			/*
+			 * One or more causes have registered a file descriptor, e.g. a PSI
+			 * trigger.  Wait for an event on them or for the next rule to be
+			 * due, whichever comes first
+			 */
+			adaptived_dbg("polling %d fds for up to %lld milliseconds\n", fd_cnt,
+				      timeout);
+
+			poll_ret = poll(fds, fd_cnt, (int)timeout);
+			if (poll_ret < 0 && errno != EINTR)
+				adaptived_wrn("poll returned %d\n", -errno);
+		} else {
+			sleep.tv_sec = timeout / 1000;
+			sleep.tv_nsec = (timeout % 1000) * 1000000LL;
 			adaptived_dbg("sleeping for %ld seconds and %ld nanoseconds\n",
 				      sleep.tv_sec, sleep.tv_nsec);
 
@@ -580,14 +928,30 @@ API int adaptived_loop(struct adaptived_ctx * const ctx, bool parse)
 	}
 
 out:
+	/* apply the writes made by the effects that ran before an error */
+	flush_ret = cgroup_journal_flush();
+	if (!ret)
+		ret = flush_ret;
+	snapshot_cache_stop();
+
 	rule = ctx->rules;
 	while (rule) {
 		free_rule_shared_data(rule, true);
 		rule = rule->next;
 	}
 
+	/* don't return until the logs are on disk */
+	drain_effects(ctx);
+
 	pthread_mutex_unlock(&ctx->ctx_mutex);
 
+	/* don't return until systemd has applied the effects' property writes */
+	bus_conn_stop();
+
+	worker_pool_destroy(&pool);
+	if (fds)
+		free(fds);
+
 	return ret;
 }
 
@@ -292,9 +292,16 @@ static int parse_cause(struct adaptived_ctx * const ctx, struct adaptived_rule *
 	bool found_cause = false;
 	const char *name;
 	json_bool exists;
+	int interval;
 	int ret = 0;
 	int i;
 
+	/* causes are evaluated at the rule's interval, if it has one */
+	if (rule->interval > 0)
+		interval = rule->interval;
+	else
+		interval = ctx->interval;
+
 	ret = adaptived_parse_string(cause_obj, "name", &name);
 	if (ret )
 		goto error;
@@ -321,7 +328,7 @@ static int parse_cause(struct adaptived_ctx * const ctx, struct adaptived_rule *
 			cse->fns = &cause_fns[i];
 
 			adaptived_dbg("Initializing cause %s\n", cse->name);
-			ret = (*cse->fns->init)(cse, args_obj, ctx->interval);
+			ret = (*cse->fns->init)(cse, args_obj, interval);
 			if (ret)
 				goto error;
 
@@ -355,7 +362,7 @@ static int parse_cause(struct adaptived_ctx * const ctx, struct adaptived_rule *
 				cse->next = NULL;
 
 				adaptived_dbg("Initializing cause %s\n", cse->name);
-				ret = (*cse->fns->init)(cse, args_obj, ctx->interval);
+				ret = (*cse->fns->init)(cse, args_obj, interval);
 				if (ret)
 					goto error;
 
@@ -544,6 +551,19 @@ int parse_rule(struct adaptived_ctx * const ctx, struct json_object * const rule
 		tmp_rule = tmp_rule->next;
 	}
 
+	ret = adaptived_parse_int(rule_obj, "interval", &rule->interval);
+	if (ret == -ENOENT) {
+		/* the user didn't provide an interval.  run this rule every ctx->interval */
+		rule->interval = 0;
+		ret = 0;
+	} else if (ret) {
+		goto error;
+	} else if (rule->interval <= 0) {
+		adaptived_err("Invalid interval for rule %s: %d\n", name, rule->interval);
+		ret = -EINVAL;
+		goto error;
+	}
+
 	/*
 	 * Parse the causes
 	 */
@@ -76,6 +76,9 @@ struct pressure_common_opts {
 		float avg;
 		long long total;
 	} threshold;
+
+	/* internal variables */
+	struct file_reader *reader; /* persistent handle on pressure_file */
 };
 
 struct pressure_opts {
@@ -98,8 +101,30 @@ struct pressure_opts {
 	 */
 	enum cause_op_enum op;
 
+	/*
+	 * JSON tag: trigger_threshold
+	 * Description: Register a kernel PSI trigger that fires when the stall time
+	 *		exceeds this many microseconds within trigger_window
+	 * Required: No
+	 * Note: When provided, trigger_window must also be provided.  In trigger mode,
+	 *	 the kernel performs the threshold comparison and adaptived_loop() is
+	 *	 woken up as soon as the trigger fires.  The some/full portion of the
+	 *	 measurement selects the trigger type, the threshold and operator
+	 *	 settings are not used, and duration is not supported
+	 */
+	long long trigger_threshold;
+
+	/*
+	 * JSON tag: trigger_window
+	 * Description: PSI trigger tracking window in microseconds
+	 * Required: Only if trigger_threshold is provided
+	 * Note: The kernel requires a window between 500ms and 10s
+	 */
+	long long trigger_window;
+
 	/* internal variables */
 	int current_duration; /* how long PSI has currently exceeded the threshold */
+	int trigger_fd; /* PSI trigger file descriptor, -1 if not in trigger mode */
 };
 
 enum action_enum {
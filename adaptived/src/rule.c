@@ -93,6 +93,40 @@ void rule_destroy(struct adaptived_rule ** rule)
 	(*rule) = NULL;
 }
 
+/*
+ * Evaluate every cause in a rule.  Returns a negative error code if a cause raised
+ * an error, 1 if all of the causes triggered, and 0 otherwise.
+ *
+ * This may run on a worker pool thread, so it must only touch this rule's data
+ */
+int rule_run_causes(struct adaptived_rule * const rule, int time_since_last_run)
+{
+	struct adaptived_cause *cse;
+	bool triggered = true;
+	int ret;
+
+	adaptived_dbg("Running rule %s\n", rule->name);
+	rule->stats.loops_run_cnt++;
+	cse = rule->causes;
+
+	while (cse) {
+		ret = (*cse->fns->main)(cse, time_since_last_run);
+		if (ret < 0) {
+			adaptived_dbg("%s raised error %d\n", cse->name, ret);
+			return ret;
+		} else if (ret == 0) {
+			adaptived_dbg("%s did not trigger\n", cse->name);
+			triggered = false;
+		} else if (ret > 0) {
+			adaptived_dbg("%s triggered\n", cse->name);
+		}
+
+		cse = cse->next;
+	}
+
+	return triggered ? 1 : 0;
+}
+
 API struct adaptived_rule *adaptived_build_rule(const char * const name)
 {
 	struct json_object *name_obj, *cse_obj, *eff_obj;
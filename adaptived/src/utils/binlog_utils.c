@@ -0,0 +1,318 @@
+/*
+ * Copyright (c) 2025, Oracle and/or its affiliates.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * You should have received a copy of the GNU General Public License version
+ * 2 along with this work; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Please contact Oracle, 500 Oracle Parkway, Redwood Shores, CA 94065 USA
+ * or visit www.oracle.com if you need additional information or have any
+ * questions.
+ */
+/**
+ * Encode snapshots in the binary log format
+ *
+ * See binlog.h for the format itself
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+
+#include <adaptived-utils.h>
+#include <adaptived.h>
+
+#include "adaptived-internal.h"
+#include "binlog.h"
+#include "defines.h"
+
+/*
+ * Reserve len bytes, rounded up to BINLOG_ALIGN, at the end of the buffer.  The
+ * reserved bytes are zeroed so that padding never leaks old data into the log
+ */
+static void *binlog_reserve(struct binlog_buf * const bb, size_t len)
+{
+	size_t new_size;
+	void *start;
+	char *tmp;
+
+	len = BINLOG_PAD(len);
+
+	if (bb->len + len > bb->size) {
+		new_size = max(bb->size * 2, bb->len + len);
+		tmp = realloc(bb->buf, new_size);
+		if (!tmp)
+			return NULL;
+
+		bb->buf = tmp;
+		bb->size = new_size;
+	}
+
+	start = &bb->buf[bb->len];
+	memset(start, 0, len);
+	bb->len += len;
+
+	return start;
+}
+
+/*
+ * Start a record of the given type with a payload of payload_len bytes.  Returns a
+ * pointer to the payload.  The caller must not hold onto pointers into the buffer
+ * across calls that may grow it
+ */
+static void *binlog_record_start(struct binlog_buf * const bb, enum binlog_record_type type,
+				 size_t payload_len)
+{
+	struct binlog_record *rec;
+	size_t len;
+
+	len = BINLOG_PAD(sizeof(struct binlog_record) + payload_len);
+	if (len > UINT32_MAX)
+		return NULL;
+
+	rec = binlog_reserve(bb, len);
+	if (!rec)
+		return NULL;
+
+	rec->type = type;
+	rec->len = len;
+	rec->realtime_ns = bb->realtime_ns;
+	rec->monotonic_ns = bb->monotonic_ns;
+
+	return &rec[1];
+}
+
+static uint64_t timespec_to_ns(const struct timespec * const ts)
+{
+	return (uint64_t)ts->tv_sec * 1000000000ULL + ts->tv_nsec;
+}
+
+API void binlog_buf_stamp(struct binlog_buf * const bb)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	bb->realtime_ns = timespec_to_ns(&ts);
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	bb->monotonic_ns = timespec_to_ns(&ts);
+}
+
+API int binlog_header(struct binlog_buf * const bb)
+{
+	struct binlog_header *hdr;
+
+	hdr = binlog_reserve(bb, sizeof(struct binlog_header));
+	if (!hdr)
+		return -ENOMEM;
+
+	memcpy(hdr->magic, BINLOG_MAGIC, BINLOG_MAGIC_LEN);
+	hdr->version = BINLOG_VERSION;
+	hdr->byte_order = BINLOG_BYTE_ORDER;
+
+	return 0;
+}
+
+/*
+ * Records can only be appended to a log that starts with a header matching the
+ * one binlog_header() writes.  Returns -EINVAL for any other file, e.g. a text log
+ */
+API int binlog_check_header(int fd)
+{
+	struct binlog_header hdr;
+	ssize_t bytes;
+
+	bytes = pread(fd, &hdr, sizeof(hdr), 0);
+	if (bytes < 0)
+		return -errno;
+
+	if (bytes != sizeof(hdr) || memcmp(hdr.magic, BINLOG_MAGIC, BINLOG_MAGIC_LEN) != 0 ||
+	    hdr.version != BINLOG_VERSION || hdr.byte_order != BINLOG_BYTE_ORDER)
+		return -EINVAL;
+
+	return 0;
+}
+
+API int binlog_raw(struct binlog_buf * const bb, const char * const path,
+		   const char * const data, size_t data_len)
+{
+	size_t path_len = strlen(path) + 1;
+	struct binlog_raw *raw;
+
+	if (data_len > UINT32_MAX)
+		return -EINVAL;
+
+	raw = binlog_record_start(bb, BINLOG_RAW, sizeof(struct binlog_raw) + path_len + data_len);
+	if (!raw)
+		return -ENOMEM;
+
+	raw->path_len = path_len;
+	raw->data_len = data_len;
+	memcpy(&raw[1], path, path_len);
+	memcpy((char *)&raw[1] + path_len, data, data_len);
+
+	return 0;
+}
+
+API int binlog_schedstat(struct binlog_buf * const bb,
+			 const struct adaptived_schedstat_snapshot * const ss)
+{
+	const struct adaptived_schedstat_domain *ss_domain;
+	const struct adaptived_schedstat_cpu *ss_cpu;
+	struct binlog_schedstat_domain *domain;
+	struct binlog_schedstat_cpu *cpu;
+	struct binlog_schedstat *hdr;
+	int c, d, i, nr_domains = 0;
+	size_t len;
+
+	if (ss->nr_cpus < 0 || ss->nr_cpus > MAX_NR_CPUS)
+		return -EINVAL;
+
+	for (c = 0; c < ss->nr_cpus; c++) {
+		if (ss->schedstat_cpus[c].nr_domains < 0 ||
+		    ss->schedstat_cpus[c].nr_domains > MAX_DOMAIN_LEVELS)
+			return -EINVAL;
+		nr_domains += ss->schedstat_cpus[c].nr_domains;
+	}
+
+	len = sizeof(struct binlog_schedstat) +
+	      sizeof(struct binlog_schedstat_cpu) * ss->nr_cpus +
+	      sizeof(struct binlog_schedstat_domain) * nr_domains;
+
+	hdr = binlog_record_start(bb, BINLOG_SCHEDSTAT, len);
+	if (!hdr)
+		return -ENOMEM;
+
+	hdr->timestamp = ss->timestamp;
+	hdr->nr_cpus = ss->nr_cpus;
+	hdr->nr_domains = nr_domains;
+
+	cpu = (struct binlog_schedstat_cpu *)&hdr[1];
+	domain = (struct binlog_schedstat_domain *)&cpu[ss->nr_cpus];
+	nr_domains = 0;
+
+	for (c = 0; c < ss->nr_cpus; c++, cpu++) {
+		ss_cpu = &ss->schedstat_cpus[c];
+
+		cpu->run_time = ss_cpu->run_time;
+		cpu->run_delay = ss_cpu->run_delay;
+		cpu->nr_timeslices = ss_cpu->nr_timeslices;
+		cpu->ttwu = ss_cpu->ttwu;
+		cpu->ttwu_local = ss_cpu->ttwu_local;
+		cpu->first_domain = nr_domains;
+		cpu->nr_domains = ss_cpu->nr_domains;
+
+		for (d = 0; d < ss_cpu->nr_domains; d++, domain++) {
+			ss_domain = &ss_cpu->schedstat_domains[d];
+
+			domain->cpumask = ss_domain->cpumask;
+			for (i = 0; i < BINLOG_IDLE_TYPES; i++) {
+				domain->lb[i][0] = ss_domain->lb[i].lb_called;
+				domain->lb[i][1] = ss_domain->lb[i].lb_balanced;
+				domain->lb[i][2] = ss_domain->lb[i].lb_failed;
+				domain->lb[i][3] = ss_domain->lb[i].lb_imbal;
+				domain->lb[i][4] = ss_domain->lb[i].lb_gained;
+				domain->lb[i][5] = ss_domain->lb[i].lb_not_gained;
+				domain->lb[i][6] = ss_domain->lb[i].lb_nobusy_rq;
+				domain->lb[i][7] = ss_domain->lb[i].lb_nobusy_grp;
+			}
+			domain->alb_called = ss_domain->alb_called;
+			domain->alb_failed = ss_domain->alb_failed;
+			domain->alb_pushed = ss_domain->alb_pushed;
+			domain->ttwu_remote = ss_domain->ttwu_remote;
+			domain->ttwu_move_affine = ss_domain->ttwu_move_affine;
+		}
+		nr_domains += ss_cpu->nr_domains;
+	}
+
+	return 0;
+}
+
+static void binlog_pressure_avgs(struct binlog_pressure_avgs * const dst,
+				 const struct adaptived_pressure_avgs * const src)
+{
+	/* the kernel reports the averages with two decimal places */
+	dst->avg10 = (uint32_t)(src->avg10 * 100.0f + 0.5f);
+	dst->avg60 = (uint32_t)(src->avg60 * 100.0f + 0.5f);
+	dst->avg300 = (uint32_t)(src->avg300 * 100.0f + 0.5f);
+	dst->total = src->total;
+}
+
+API int binlog_pressure(struct binlog_buf * const bb, const char * const path,
+			const struct adaptived_pressure_snapshot * const ps)
+{
+	size_t path_len = strlen(path) + 1;
+	struct binlog_pressure *pressure;
+
+	pressure = binlog_record_start(bb, BINLOG_PRESSURE,
+				       sizeof(struct binlog_pressure) + path_len);
+	if (!pressure)
+		return -ENOMEM;
+
+	binlog_pressure_avgs(&pressure->some, &ps->some);
+	binlog_pressure_avgs(&pressure->full, &ps->full);
+	memcpy(&pressure[1], path, path_len);
+
+	return 0;
+}
+
+/*
+ * Encode the contents of /proc/meminfo.  buf must be NUL terminated
+ */
+API int binlog_meminfo(struct binlog_buf * const bb, const char * const buf)
+{
+	struct binlog_meminfo *meminfo;
+	const char *line, *colon;
+	uint64_t *values;
+	size_t name_len;
+	int i, field = 0;
+
+	meminfo = binlog_record_start(bb, BINLOG_MEMINFO, sizeof(struct binlog_meminfo) +
+				      sizeof(uint64_t) * BINLOG_MEMINFO_CNT);
+	if (!meminfo)
+		return -ENOMEM;
+
+	meminfo->nr_fields = BINLOG_MEMINFO_CNT;
+	values = (uint64_t *)&meminfo[1];
+	for (i = 0; i < BINLOG_MEMINFO_CNT; i++)
+		values[i] = BINLOG_MEMINFO_MISSING;
+
+	line = buf;
+	while (line && line[0] != '\0') {
+		colon = strchr(line, ':');
+		if (!colon)
+			break;
+		name_len = colon - line;
+
+		/*
+		 * The kernel reports the fields in the same order as the table, so
+		 * start looking where the last field was found
+		 */
+		for (i = 0; i < BINLOG_MEMINFO_CNT; i++) {
+			if (strlen(binlog_meminfo_fields[field]) == name_len &&
+			    strncmp(binlog_meminfo_fields[field], line, name_len) == 0) {
+				values[field] = strtoull(&colon[1], NULL, 10);
+				break;
+			}
+			field = (field + 1) % BINLOG_MEMINFO_CNT;
+		}
+
+		line = strchr(colon, '\n');
+		if (line)
+			line++;
+	}
+
+	return 0;
+}
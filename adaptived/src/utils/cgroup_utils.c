@@ -25,7 +25,9 @@
  *
  */
 
+#include <sys/syscall.h>
 #include <stdbool.h>
+#include <signal.h>
 #include <string.h>
 #include <limits.h>
 #include <unistd.h>
@@ -41,7 +43,206 @@
 
 #define LL_MAX 8192
 
-API int adaptived_cgroup_set_ll(const char * const setting, long long value, uint32_t flags)
+static int parse_ll(const char * const buf, long long * const value)
+{
+	char *endptr;
+
+	errno = 0;
+	*value = strtoll(buf, &endptr, 10);
+	if (errno != 0)
+		return -errno;
+	if (endptr[0] != '\0' && endptr[0] != '\n')
+		/* There was unparsable data in the string */
+		return -EINVAL;
+	if (endptr == buf)
+		/* There was unparsable data in the string */
+		return -EINVAL;
+	if (*value == LLONG_MIN || *value == LLONG_MAX)
+		return -ERANGE;
+
+	return 0;
+}
+
+static int parse_float(const char * const buf, float * const value)
+{
+	char *endptr;
+
+	errno = 0;
+	*value = strtof(buf, &endptr);
+	if (errno != 0)
+		return -errno;
+	if (endptr[0] != '\0' && endptr[0] != '\n')
+		/* There was unparsable data in the string */
+		return -EINVAL;
+	if (endptr == buf)
+		/* There was unparsable data in the string */
+		return -EINVAL;
+
+	return 0;
+}
+
+/*
+ * The cgroup write journal defers writes made via adaptived_cgroup_set_ll() and
+ * adaptived_cgroup_set_str() until cgroup_journal_flush().  adaptived_loop() keeps
+ * it active while its rules run, so that when several effects write the same
+ * setting in one loop only the last value is written, and a value the setting
+ * already holds when the journal is flushed isn't written at all.  While the
+ * journal is active, reads of a setting with a pending write return the pending
+ * value.
+ *
+ * Like the snapshot cache, the journal is thread local.  It is only active between
+ * cgroup_journal_start() and cgroup_journal_stop() or cgroup_journal_flush()
+ */
+struct journal_entry {
+	char *setting;
+
+	bool pending; /* a write is waiting for cgroup_journal_flush() */
+	enum adaptived_cgroup_value_type type; /* LONG_LONG or STR */
+	long long ll_value;
+	char *str_value;
+	uint32_t flags;
+
+	char *read_value; /* contents of the setting as last read this loop, or NULL */
+
+	struct journal_entry *next;
+};
+
+static __thread struct journal_entry *journal;
+static __thread struct journal_entry *journal_last;
+static __thread bool journal_active;
+
+static void journal_entry_free(struct journal_entry * const entry)
+{
+	if (entry->setting)
+		free(entry->setting);
+	if (entry->str_value)
+		free(entry->str_value);
+	if (entry->read_value)
+		free(entry->read_value);
+
+	free(entry);
+}
+
+static struct journal_entry *journal_find(const char * const setting)
+{
+	struct journal_entry *entry;
+
+	entry = journal;
+	while (entry) {
+		if (strcmp(entry->setting, setting) == 0)
+			return entry;
+
+		entry = entry->next;
+	}
+
+	return NULL;
+}
+
+static struct journal_entry *journal_get(const char * const setting)
+{
+	struct journal_entry *entry;
+
+	entry = journal_find(setting);
+	if (entry)
+		return entry;
+
+	entry = malloc(sizeof(struct journal_entry));
+	if (!entry)
+		return NULL;
+
+	memset(entry, 0, sizeof(struct journal_entry));
+
+	entry->setting = strdup(setting);
+	if (!entry->setting) {
+		free(entry);
+		return NULL;
+	}
+
+	/* keep the entries in order so that the writes are flushed in order */
+	if (journal_last)
+		journal_last->next = entry;
+	else
+		journal = entry;
+	journal_last = entry;
+
+	return entry;
+}
+
+static int journal_write(const char * const setting, enum adaptived_cgroup_value_type type,
+			 long long ll_value, const char * const str_value, uint32_t flags)
+{
+	struct journal_entry *entry;
+	char *tmp = NULL;
+
+	entry = journal_get(setting);
+	if (!entry)
+		return -ENOMEM;
+
+	if (str_value) {
+		tmp = strdup(str_value);
+		if (!tmp)
+			return -ENOMEM;
+	}
+
+	if (entry->pending)
+		adaptived_dbg("cgroup journal: coalescing writes to %s\n", setting);
+
+	if (entry->str_value)
+		free(entry->str_value);
+
+	entry->pending = true;
+	entry->type = type;
+	entry->ll_value = ll_value;
+	entry->str_value = tmp;
+	/* a request to validate an earlier value now applies to the final one */
+	entry->flags |= flags;
+
+	return 0;
+}
+
+/*
+ * Remember what was read from a setting so that cgroup_journal_flush() can skip
+ * writing the same value back
+ */
+static void journal_note_read(const char * const setting, const char * const buf)
+{
+	struct journal_entry *entry;
+	char *tmp;
+
+	entry = journal_get(setting);
+	if (!entry)
+		return;
+
+	tmp = strdup(buf);
+	if (!tmp)
+		return;
+
+	if (entry->read_value)
+		free(entry->read_value);
+	entry->read_value = tmp;
+}
+
+/*
+ * Copy the pending value for setting, if any, into buf as it would be read back
+ * from the file.  Returns true if there was a pending value
+ */
+static bool journal_read(const char * const setting, char * const buf, size_t len)
+{
+	struct journal_entry *entry;
+
+	entry = journal_find(setting);
+	if (!entry || !entry->pending)
+		return false;
+
+	if (entry->type == ADAPTIVED_CGVAL_LONG_LONG)
+		snprintf(buf, len, "%lld", entry->ll_value);
+	else
+		snprintf(buf, len, "%s", entry->str_value);
+
+	return true;
+}
+
+static int write_ll(const char * const setting, long long value, uint32_t flags)
 {
 	long long validate_value;
 	ssize_t bytes_written;
@@ -91,17 +292,31 @@ out:
 	return ret;
 }
 
+API int adaptived_cgroup_set_ll(const char * const setting, long long value, uint32_t flags)
+{
+	if (!setting)
+		return -EINVAL;
+
+	if (journal_active)
+		return journal_write(setting, ADAPTIVED_CGVAL_LONG_LONG, value, NULL, flags);
+
+	return write_ll(setting, value, flags);
+}
+
 API int adaptived_cgroup_get_ll(const char * const setting, long long * const value)
 {
 	size_t bytes_read;
 	char buf[LL_MAX];
-	char *endptr;
 	int ret = 0;
 	FILE *f;
 
 	if (!setting || !value)
 		return -EINVAL;
 
+	/* a write to the setting is pending in the journal */
+	if (journal_active && journal_read(setting, buf, sizeof(buf)))
+		return parse_ll(buf, value);
+
 	f = fopen(setting, "r");
 	if (!f)
 		return -errno;
@@ -117,29 +332,10 @@ API int adaptived_cgroup_get_ll(const char * const setting, long long * const va
 	}
 
 	buf[bytes_read] = '\0';
+	if (journal_active)
+		journal_note_read(setting, buf);
 
-	errno = 0;
-	*value = strtoll(buf, &endptr, 10);
-	if (errno != 0) {
-		ret = -errno;
-		goto out;
-	}
-	if (endptr[0] != '\0' && endptr[0] != '\n') {
-		/* There was unparsable data in the string */
-		ret = -EINVAL;
-		goto out;
-	}
-	if (endptr == buf) {
-		/* There was unparsable data in the string */
-		ret = -EINVAL;
-		goto out;
-	}
-	if (*value == LLONG_MIN || *value == LLONG_MAX) {
-		ret = -ERANGE;
-		goto out;
-	}
-
-	ret = 0;
+	ret = parse_ll(buf, value);
 
 out:
 	(void)fclose(f);
@@ -151,13 +347,16 @@ API int adaptived_cgroup_get_float(const char * const setting, float * const val
 {
 	size_t bytes_read;
 	char buf[LL_MAX];
-	char *endptr;
 	int ret = 0;
 	FILE *f;
 
 	if (!setting || !value)
 		return -EINVAL;
 
+	/* a write to the setting is pending in the journal */
+	if (journal_active && journal_read(setting, buf, sizeof(buf)))
+		return parse_float(buf, value);
+
 	f = fopen(setting, "r");
 	if (!f)
 		return -errno;
@@ -173,25 +372,10 @@ API int adaptived_cgroup_get_float(const char * const setting, float * const val
 	}
 
 	buf[bytes_read] = '\0';
+	if (journal_active)
+		journal_note_read(setting, buf);
 
-	errno = 0;
-	*value = strtof(buf, &endptr);
-	if (errno != 0) {
-		ret = -errno;
-		goto out;
-	}
-	if (endptr[0] != '\0' && endptr[0] != '\n') {
-		/* There was unparsable data in the string */
-		ret = -EINVAL;
-		goto out;
-	}
-	if (endptr == buf) {
-		/* There was unparsable data in the string */
-		ret = -EINVAL;
-		goto out;
-	}
-
-	ret = 0;
+	ret = parse_float(buf, value);
 
 out:
 	(void)fclose(f);
@@ -199,7 +383,7 @@ out:
 	return ret;
 }
 
-API int adaptived_cgroup_set_str(const char * const setting, const char * const value, uint32_t flags)
+static int write_str(const char * const setting, const char * const value, uint32_t flags)
 {
 	char *validate_value;
 	ssize_t bytes_written;
@@ -248,6 +432,17 @@ out:
 	return ret;
 }
 
+API int adaptived_cgroup_set_str(const char * const setting, const char * const value, uint32_t flags)
+{
+	if (!setting || !value)
+		return -EINVAL;
+
+	if (journal_active)
+		return journal_write(setting, ADAPTIVED_CGVAL_STR, 0, value, flags);
+
+	return write_str(setting, value, flags);
+}
+
 API int adaptived_cgroup_get_str(const char * const setting, char ** value)
 {
 	size_t bytes_read;
@@ -260,6 +455,12 @@ API int adaptived_cgroup_get_str(const char * const setting, char ** value)
 
 	*value = NULL;
 
+	/* a write to the setting is pending in the journal */
+	if (journal_active && journal_read(setting, buf, sizeof(buf))) {
+		*value = strdup(buf);
+		return *value ? 0 : -ENOMEM;
+	}
+
 	f = fopen(setting, "r");
 	if (!f)
 		return -errno;
@@ -275,6 +476,8 @@ API int adaptived_cgroup_get_str(const char * const setting, char ** value)
 	}
 
 	buf[bytes_read] = '\0';
+	if (journal_active)
+		journal_note_read(setting, buf);
 
 	*value = strdup(buf);
 	if (!(*value)) {
@@ -288,6 +491,109 @@ out:
 	return ret;
 }
 
+/*
+ * Returns true if buf, as read from the setting, holds the entry's pending value
+ */
+static bool journal_matches(const struct journal_entry * const entry, const char * const buf)
+{
+	long long read_ll;
+	size_t len;
+
+	if (entry->type == ADAPTIVED_CGVAL_LONG_LONG)
+		return parse_ll(buf, &read_ll) == 0 && read_ll == entry->ll_value;
+
+	len = strlen(entry->str_value);
+	return strncmp(buf, entry->str_value, len) == 0 &&
+	       (buf[len] == '\0' || (buf[len] == '\n' && buf[len + 1] == '\0'));
+}
+
+/*
+ * Returns true if the setting already holds the entry's pending value.  The value
+ * read earlier in the loop only tells us whether it's worth checking; the setting
+ * may have changed since, so it's read again before the write is skipped
+ */
+static bool journal_unchanged(const struct journal_entry * const entry)
+{
+	ssize_t bytes_read;
+	char buf[LL_MAX];
+	int fd;
+
+	if (!entry->read_value || !journal_matches(entry, entry->read_value))
+		return false;
+
+	fd = open(entry->setting, O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	bytes_read = read(fd, buf, sizeof(buf));
+	close(fd);
+	if (bytes_read <= 0 || bytes_read >= sizeof(buf))
+		return false;
+
+	buf[bytes_read] = '\0';
+	return journal_matches(entry, buf);
+}
+
+/*
+ * Journal writes until cgroup_journal_stop().  Entries are kept until the next
+ * cgroup_journal_flush(), so a journal can be started and stopped several times
+ * before it's flushed
+ */
+API void cgroup_journal_start(void)
+{
+	journal_active = true;
+}
+
+API void cgroup_journal_stop(void)
+{
+	journal_active = false;
+}
+
+/*
+ * Write out every pending value and stop journaling.  All of the writes are
+ * attempted, and the first error encountered is returned
+ */
+API int cgroup_journal_flush(void)
+{
+	struct journal_entry *entry, *next;
+	int ret = 0, wret;
+
+	/* the writes below must go to the files */
+	journal_active = false;
+
+	entry = journal;
+	journal = NULL;
+	journal_last = NULL;
+
+	while (entry) {
+		next = entry->next;
+
+		if (!entry->pending) {
+			wret = 0;
+		} else if (journal_unchanged(entry)) {
+			adaptived_dbg("cgroup journal: %s is unchanged, skipping the write\n",
+				      entry->setting);
+			wret = 0;
+		} else if (entry->type == ADAPTIVED_CGVAL_LONG_LONG) {
+			wret = write_ll(entry->setting, entry->ll_value, entry->flags);
+		} else {
+			wret = write_str(entry->setting, entry->str_value, entry->flags);
+		}
+
+		if (wret) {
+			adaptived_err("cgroup journal: failed to write %s: %d\n", entry->setting,
+				      wret);
+			if (!ret)
+				ret = wret;
+		}
+
+		journal_entry_free(entry);
+		entry = next;
+	}
+
+	return ret;
+}
+
 API int adaptived_cgroup_get_procs(const char * const cgroup_path, pid_t ** pids,
 				int * const pid_count)
 {
@@ -483,6 +789,47 @@ API int adaptived_cgroup_get_value(const char * const setting,
 	return ret;
 }
 
+/*
+ * Read a cgroup setting via a persistent file_reader handle.  Unlike
+ * adaptived_cgroup_get_value(), the value type must be known in advance
+ */
+API int reader_get_cgroup_value(struct file_reader * const reader,
+			    struct adaptived_cgroup_value * const value)
+{
+	size_t len;
+	char *buf;
+	int ret;
+
+	if (!reader || !value)
+		return -EINVAL;
+
+	ret = file_reader_read(reader, &buf, &len);
+	if (ret)
+		return ret;
+	if (len == 0)
+		return -EINVAL;
+
+	switch (value->type) {
+	case ADAPTIVED_CGVAL_STR:
+		value->value.str_value = strdup(buf);
+		if (!value->value.str_value)
+			ret = -ENOMEM;
+		break;
+	case ADAPTIVED_CGVAL_LONG_LONG:
+		ret = parse_ll(buf, &value->value.ll_value);
+		break;
+	case ADAPTIVED_CGVAL_FLOAT:
+		ret = parse_float(buf, &value->value.float_value);
+		break;
+	default:
+		adaptived_err("Invalid cgroup value type: %d\n", value->type);
+		ret = -EINVAL;
+		break;
+	}
+
+	return ret;
+}
+
 API bool adaptived_cgroup_setting_is_max(const char * const setting)
 {
 	struct adaptived_cgroup_value val;
@@ -503,3 +850,158 @@ API int adaptived_cgroup_get_memorystat_field(const char * const memorystat_file
 {
 	return get_ll_field_in_file(memorystat_file, field, " ", ll_valuep);
 }
+
+/*
+ * Kill every process in the cgroup and its descendants with a single write to
+ * cgroup.kill.  Returns -ENOTSUP if the kernel doesn't support cgroup.kill (added
+ * in 5.14)
+ */
+int cgroup_kill(const char * const cgroup_path)
+{
+	char kill_path[FILENAME_MAX];
+	int ret;
+
+	if (!cgroup_path)
+		return -EINVAL;
+
+	snprintf(kill_path, sizeof(kill_path), "%s/cgroup.kill", cgroup_path);
+
+	/* killing can't wait for the journal to be flushed */
+	ret = write_str(kill_path, "1", 0);
+	if (ret == -ENOENT && access(cgroup_path, F_OK) == 0)
+		ret = -ENOTSUP;
+
+	return ret;
+}
+
+static int open_pidfd(pid_t pid)
+{
+#ifdef SYS_pidfd_open
+	return syscall(SYS_pidfd_open, pid, 0);
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+static int send_pidfd_signal(int pidfd, int signal)
+{
+#ifdef SYS_pidfd_send_signal
+	return syscall(SYS_pidfd_send_signal, pidfd, signal, NULL, 0);
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+static int cmp_pid(const void *p1, const void *p2)
+{
+	const pid_t *pid1 = p1, *pid2 = p2;
+
+	if (*pid1 < *pid2)
+		return -1;
+	if (*pid1 > *pid2)
+		return 1;
+	return 0;
+}
+
+/*
+ * Send a signal to up to max_cnt processes in the cgroup (all of them if max_cnt
+ * is negative).  signaled_cnt is incremented for each process that was targeted.
+ *
+ * A pid read from cgroup.procs could exit and be reused by an unrelated process
+ * before it's signaled.  To avoid that, a pidfd is opened for each pid, and then
+ * cgroup.procs is read again.  Only the pidfds whose pids are still in the cgroup
+ * are signaled; a pidfd always refers to the process it was opened for.  If the
+ * kernel doesn't support pidfds (added in 5.3), the processes are signaled with
+ * kill()
+ */
+int cgroup_signal_procs(const char * const cgroup_path, int signal, int max_cnt,
+			int * const signaled_cnt)
+{
+	int ret, pid_cnt, recheck_cnt, i, cnt;
+	pid_t *pids = NULL, *recheck_pids = NULL;
+	bool use_pidfd = true;
+	int *pidfds = NULL;
+
+	if (!cgroup_path || !signaled_cnt)
+		return -EINVAL;
+
+	ret = adaptived_cgroup_get_procs(cgroup_path, &pids, &pid_cnt);
+	if (ret)
+		return ret;
+
+	if (max_cnt >= 0 && max_cnt < pid_cnt)
+		cnt = max_cnt;
+	else
+		cnt = pid_cnt;
+
+	if (cnt == 0)
+		goto out;
+
+	pidfds = malloc(sizeof(int) * cnt);
+	if (!pidfds) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < cnt; i++)
+		pidfds[i] = -1;
+
+	for (i = 0; i < cnt; i++) {
+		pidfds[i] = open_pidfd(pids[i]);
+		if (pidfds[i] < 0 && errno == ENOSYS) {
+			use_pidfd = false;
+			break;
+		}
+		/* the process has already exited if this fails */
+	}
+
+	if (use_pidfd) {
+		ret = adaptived_cgroup_get_procs(cgroup_path, &recheck_pids, &recheck_cnt);
+		if (ret)
+			goto out;
+
+		qsort(recheck_pids, recheck_cnt, sizeof(pid_t), cmp_pid);
+	}
+
+	for (i = 0; i < cnt; i++) {
+		(*signaled_cnt)++;
+
+		if (use_pidfd) {
+			if (pidfds[i] < 0 ||
+			    !bsearch(&pids[i], recheck_pids, recheck_cnt, sizeof(pid_t), cmp_pid))
+				continue;
+
+			ret = send_pidfd_signal(pidfds[i], signal);
+		} else {
+			ret = kill(pids[i], signal);
+		}
+
+		if (ret < 0) {
+			/*
+			 * Processes are transient, and the inability to signal one is not
+			 * a significant enough error to propagate up to the user.
+			 */
+			adaptived_info("Failed to signal process %d, errno = %d\n", pids[i],
+				       errno);
+		}
+	}
+
+	ret = 0;
+
+out:
+	if (pidfds) {
+		for (i = 0; i < cnt; i++) {
+			if (pidfds[i] >= 0)
+				close(pidfds[i]);
+		}
+		free(pidfds);
+	}
+	if (recheck_pids)
+		free(recheck_pids);
+	if (pids)
+		free(pids);
+
+	return ret;
+}
@@ -28,10 +28,253 @@
 #include <stdbool.h>
 #include <string.h>
 #include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
 #include <errno.h>
 
 #include "adaptived-internal.h"
 
+#define SNAPSHOT_BUCKETS	64
+#define SNAPSHOT_BUF_SIZE	4096
+
+struct field_entry {
+	const char *key;
+	long long value;
+	int ret; /* result of parsing the value, e.g. -EINVAL for unparsable data */
+};
+
+/*
+ * A "key<separator>value" file (e.g. /proc/meminfo or memory.stat) parsed in a
+ * single pass into a table sorted by key
+ */
+struct field_table {
+	char *separator;
+	char *strings; /* copy of the file contents.  keys point into this buffer */
+	struct field_entry *entries;
+	int cnt;
+};
+
+struct snapshot {
+	char *path;
+	char *buf;
+	size_t len;
+
+	struct field_table *table;
+
+	struct snapshot *next;
+};
+
+/*
+ * The snapshot cache is thread local so that each adaptived_loop() (and any
+ * library user calling the utils from another thread) has its own view.  It is
+ * only active between snapshot_cache_start() and snapshot_cache_stop()
+ */
+static __thread struct snapshot *snapshots[SNAPSHOT_BUCKETS];
+static __thread bool snapshot_cache_active;
+
+static unsigned int snapshot_hash(const char * const path)
+{
+	unsigned int hash = 5381;
+	const char *c;
+
+	for (c = path; *c; c++)
+		hash = ((hash << 5) + hash) + (unsigned char)*c;
+
+	return hash % SNAPSHOT_BUCKETS;
+}
+
+static void field_table_free(struct field_table * const table)
+{
+	if (!table)
+		return;
+
+	if (table->separator)
+		free(table->separator);
+	if (table->strings)
+		free(table->strings);
+	if (table->entries)
+		free(table->entries);
+
+	free(table);
+}
+
+static void snapshot_free(struct snapshot * const snap)
+{
+	if (!snap)
+		return;
+
+	field_table_free(snap->table);
+	if (snap->path)
+		free(snap->path);
+	if (snap->buf)
+		free(snap->buf);
+
+	free(snap);
+}
+
+static int snapshot_read(const char * const path, struct snapshot ** const snapp)
+{
+	struct snapshot *snap;
+	size_t buf_len;
+	ssize_t bytes;
+	char *tmp;
+	int fd, ret;
+
+	snap = malloc(sizeof(struct snapshot));
+	if (!snap)
+		return -ENOMEM;
+
+	memset(snap, 0, sizeof(struct snapshot));
+
+	snap->path = malloc(strlen(path) + 1);
+	if (!snap->path) {
+		ret = -ENOMEM;
+		goto error;
+	}
+	strcpy(snap->path, path);
+
+	buf_len = SNAPSHOT_BUF_SIZE;
+	snap->buf = malloc(buf_len);
+	if (!snap->buf) {
+		ret = -ENOMEM;
+		goto error;
+	}
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		ret = -errno;
+		goto error;
+	}
+
+	/*
+	 * Files in /proc and cgroupfs report a size of zero, so read until EOF and
+	 * grow the buffer as needed
+	 */
+	while (1) {
+		if (snap->len == buf_len) {
+			tmp = realloc(snap->buf, buf_len * 2);
+			if (!tmp) {
+				close(fd);
+				ret = -ENOMEM;
+				goto error;
+			}
+
+			snap->buf = tmp;
+			buf_len *= 2;
+		}
+
+		bytes = read(fd, &snap->buf[snap->len], buf_len - snap->len);
+		if (bytes < 0) {
+			ret = -errno;
+			close(fd);
+			goto error;
+		} else if (bytes == 0) {
+			break;
+		}
+
+		snap->len += bytes;
+	}
+
+	close(fd);
+
+	*snapp = snap;
+	return 0;
+
+error:
+	snapshot_free(snap);
+	return ret;
+}
+
+/*
+ * Start caching the contents of files read via snapshot_fopen().  Each file is read
+ * at most once until snapshot_cache_invalidate() or snapshot_cache_stop() is called
+ */
+API void snapshot_cache_start(void)
+{
+	snapshot_cache_invalidate();
+	snapshot_cache_active = true;
+}
+
+API void snapshot_cache_invalidate(void)
+{
+	struct snapshot *snap, *next;
+	int i;
+
+	for (i = 0; i < SNAPSHOT_BUCKETS; i++) {
+		snap = snapshots[i];
+
+		while (snap) {
+			next = snap->next;
+			snapshot_free(snap);
+			snap = next;
+		}
+
+		snapshots[i] = NULL;
+	}
+}
+
+API void snapshot_cache_stop(void)
+{
+	snapshot_cache_invalidate();
+	snapshot_cache_active = false;
+}
+
+static struct snapshot *snapshot_find(const char * const path)
+{
+	struct snapshot *snap;
+
+	snap = snapshots[snapshot_hash(path)];
+	while (snap) {
+		if (strcmp(snap->path, path) == 0)
+			return snap;
+
+		snap = snap->next;
+	}
+
+	return NULL;
+}
+
+static void snapshot_insert(struct snapshot * const snap)
+{
+	unsigned int bucket;
+
+	bucket = snapshot_hash(snap->path);
+
+	snap->next = snapshots[bucket];
+	snapshots[bucket] = snap;
+}
+
+/*
+ * Open a read-only stream of a file.  When the snapshot cache is active, the file
+ * is read once per snapshot and subsequent opens are served from memory.  The
+ * returned stream must be closed with fclose()
+ */
+API FILE *snapshot_fopen(const char * const path)
+{
+	struct snapshot *snap;
+	int ret;
+
+	if (!snapshot_cache_active)
+		return fopen(path, "r");
+
+	snap = snapshot_find(path);
+	if (!snap) {
+		ret = snapshot_read(path, &snap);
+		if (ret) {
+			errno = -ret;
+			return NULL;
+		}
+
+		snapshot_insert(snap);
+	}
+
+	/* fmemopen() doesn't support zero-length buffers on all glibc versions */
+	if (snap->len == 0)
+		return fopen(path, "r");
+
+	return fmemopen(snap->buf, snap->len, "r");
+}
+
 static bool ends_with(const char * const line, const char * const suffix)
 {
 	size_t line_len, suffix_len;
@@ -66,68 +309,439 @@ static int parse_suffix(char * const line, long long * const multiplier)
 	return 0;
 }
 
+static int parse_ll_value(char * const str, long long * const ll_valuep)
+{
+	long long multiplier = 0;
+	char *endptr;
+	int ret;
+
+	ret = parse_suffix(str, &multiplier);
+	if (ret)
+		return ret;
+
+	*ll_valuep = strtoll(str, &endptr, 10);
+	if (endptr[0] != '\0' && endptr[0] != '\n' && endptr[0] != ' ')
+		/* There was unparsable data in the string */
+		return -EINVAL;
+	if (endptr == str)
+		/* There was unparsable data in the string */
+		return -EINVAL;
+	if (*ll_valuep == LLONG_MIN || *ll_valuep == LLONG_MAX)
+		return -ERANGE;
+
+	*ll_valuep *= multiplier;
+
+	return 0;
+}
+
+static int field_key_cmp(const void *p1, const void *p2)
+{
+	const struct field_entry *e1 = p1, *e2 = p2;
+
+	return strcmp(e1->key, e2->key);
+}
+
+static int field_entry_cmp(const void *p1, const void *p2)
+{
+	const struct field_entry *e1 = p1, *e2 = p2;
+	int ret;
+
+	ret = strcmp(e1->key, e2->key);
+	if (ret)
+		return ret;
+
+	/*
+	 * Keys are unique in the files we parse, but if there are duplicates, keep
+	 * them in file order so that the first occurrence wins
+	 */
+	if (e1->key < e2->key)
+		return -1;
+	else if (e1->key > e2->key)
+		return 1;
+
+	return 0;
+}
+
+static int field_table_build(const char * const buf, size_t len, const char * const separator,
+			     struct field_table ** const tablep)
+{
+	struct field_table *table;
+	char *line, *line_end, *sep;
+	int ret, i, j, lines = 0;
+
+	table = malloc(sizeof(struct field_table));
+	if (!table)
+		return -ENOMEM;
+
+	memset(table, 0, sizeof(struct field_table));
+
+	table->separator = malloc(strlen(separator) + 1);
+	if (!table->separator) {
+		ret = -ENOMEM;
+		goto error;
+	}
+	strcpy(table->separator, separator);
+
+	table->strings = malloc(len + 1);
+	if (!table->strings) {
+		ret = -ENOMEM;
+		goto error;
+	}
+	memcpy(table->strings, buf, len);
+	table->strings[len] = '\0';
+
+	for (i = 0; i < len; i++) {
+		if (table->strings[i] == '\n')
+			lines++;
+	}
+	/* the last line may not be newline terminated */
+	lines++;
+
+	table->entries = malloc(sizeof(struct field_entry) * lines);
+	if (!table->entries) {
+		ret = -ENOMEM;
+		goto error;
+	}
+
+	line = table->strings;
+	while (line && *line != '\0') {
+		line_end = strchr(line, '\n');
+		if (line_end)
+			*line_end = '\0';
+
+		sep = strstr(line, separator);
+		if (sep && sep != line) {
+			/*
+			 * Terminate the key at the separator.  The value starts after the
+			 * first character of the separator, just like the original
+			 * strstr()-based parser
+			 */
+			*sep = '\0';
+
+			table->entries[table->cnt].key = line;
+			table->entries[table->cnt].ret =
+				parse_ll_value(&sep[1], &table->entries[table->cnt].value);
+			table->cnt++;
+		}
+
+		line = line_end ? &line_end[1] : NULL;
+	}
+
+	qsort(table->entries, table->cnt, sizeof(struct field_entry), field_entry_cmp);
+
+	/* remove duplicate keys, keeping the first occurrence in the file */
+	for (i = 1, j = 0; i < table->cnt; i++) {
+		if (strcmp(table->entries[i].key, table->entries[j].key) == 0)
+			continue;
+
+		table->entries[++j] = table->entries[i];
+	}
+	if (table->cnt)
+		table->cnt = j + 1;
+
+	*tablep = table;
+	return 0;
+
+error:
+	field_table_free(table);
+	return ret;
+}
+
+static int field_table_lookup(const struct field_table * const table, const char * const field,
+			      long long * const ll_valuep)
+{
+	const struct field_entry *entry;
+	struct field_entry key;
+
+	key.key = field;
+
+	entry = bsearch(&key, table->entries, table->cnt, sizeof(struct field_entry),
+			field_key_cmp);
+	if (!entry)
+		return -ENOENT;
+
+	if (entry->ret)
+		return entry->ret;
+
+	*ll_valuep = entry->value;
+
+	return 0;
+}
+
+/*
+ * Get the value of a "key<separator>value" field in a file, e.g. /proc/meminfo or
+ * memory.stat.  The file is parsed in a single pass into a table sorted by key, and
+ * the field must exactly match a key, e.g. "Cached" will not match "SwapCached".
+ * When the snapshot cache is active, the table is cached along with the file
+ * contents, so subsequent lookups in the same file don't reparse it
+ */
 int get_ll_field_in_file(const char * const file, const char * const field,
 			 const char * const separator, long long * const ll_valuep)
 {
-	char *subp, *subp2, *str;
-	long long multiplier = 0;
-	char * line = NULL;
-	int ret = -ENOENT;
-	size_t len = 0;
-	ssize_t read;
-	FILE * fp;
+	struct snapshot *snap = NULL;
+	struct field_table *table;
+	bool cached = false;
+	int ret;
 
 	if (!file || !field || !separator || !ll_valuep)
 		return -EINVAL;
 
-	fp = fopen(file, "r");
-	if (fp == NULL) {
-		adaptived_err("Failed to open %s: errno = %d\n", file, errno);
-		return -errno;
+	if (snapshot_cache_active) {
+		snap = snapshot_find(file);
+		if (snap)
+			cached = true;
 	}
 
-	while ((read = getline(&line, &len, fp)) != -1) {
-		line[strcspn(line, "\n")] = '\0';
-		subp = strstr(line, field);
-		if (subp) {
-			subp2 = strstr(subp, separator);
-			if (subp2) {
-				char *endptr;
-
-				str = &subp2[1];
-
-				ret = parse_suffix(str, &multiplier);
-				if (ret)
-					goto out;
-
-				*ll_valuep = strtoll(str, &endptr, 10);
-				if (endptr[0] != '\0' && endptr[0] != '\n' && endptr[0] != ' ') {
-					/* There was unparsable data in the string */
-					ret = -EINVAL;
-					goto out;
-				}
-				if (endptr == str) {
-					/* There was unparsable data in the string */
-					ret = -EINVAL;
-					goto out;
-				}
-				if (*ll_valuep == LLONG_MIN || *ll_valuep == LLONG_MAX) {
-					ret = -ERANGE;
-					goto out;
-				}
-
-				ret = 0;
-			}
-			break;
+	if (!snap) {
+		ret = snapshot_read(file, &snap);
+		if (ret) {
+			adaptived_err("Failed to open %s: errno = %d\n", file, -ret);
+			return ret;
 		}
 	}
+
+	if (!snap->table || strcmp(snap->table->separator, separator) != 0) {
+		ret = field_table_build(snap->buf, snap->len, separator, &table);
+		if (ret)
+			goto out;
+
+		field_table_free(snap->table);
+		snap->table = table;
+	}
+
+	ret = field_table_lookup(snap->table, field, ll_valuep);
+
 out:
-	fclose(fp);
-	if (line)
-		free(line);
+	if (snapshot_cache_active && !cached)
+		snapshot_insert(snap);
+	else if (!cached)
+		snapshot_free(snap);
+
+	return ret;
+}
+
+/*
+ * A file reader keeps the file descriptor open across reads and re-reads the file
+ * from offset zero with pread().  This avoids an open()/close() pair and, for
+ * seq_file backed files in /proc and cgroupfs, the per-open setup cost on every
+ * cause evaluation.  The file is not opened until the first read so that causes
+ * can acquire a reader in their init routine even if the file doesn't exist yet
+ */
+struct file_reader {
+	char *path;
+	uint32_t flags;
+	int fd;
+	char *buf;
+	size_t buf_len;
+};
+
+API int file_reader_open(const char * const path, uint32_t flags,
+			 struct file_reader ** const readerp)
+{
+	struct file_reader *reader;
+	int ret;
 
-	if (ret == 0)
-		*ll_valuep *= multiplier;
+	if (!path || !readerp)
+		return -EINVAL;
 
+	reader = malloc(sizeof(struct file_reader));
+	if (!reader)
+		return -ENOMEM;
+
+	memset(reader, 0, sizeof(struct file_reader));
+	reader->flags = flags;
+	reader->fd = -1;
+
+	reader->path = malloc(strlen(path) + 1);
+	if (!reader->path) {
+		ret = -ENOMEM;
+		goto error;
+	}
+	strcpy(reader->path, path);
+
+	reader->buf_len = SNAPSHOT_BUF_SIZE;
+	reader->buf = malloc(reader->buf_len);
+	if (!reader->buf) {
+		ret = -ENOMEM;
+		goto error;
+	}
+
+	*readerp = reader;
+	return 0;
+
+error:
+	file_reader_close(&reader);
 	return ret;
 }
+
+API void file_reader_close(struct file_reader ** const readerp)
+{
+	struct file_reader *reader;
+
+	if (!readerp || !(*readerp))
+		return;
+
+	reader = *readerp;
+
+	if (reader->fd >= 0)
+		close(reader->fd);
+	if (reader->path)
+		free(reader->path);
+	if (reader->buf)
+		free(reader->buf);
+
+	free(reader);
+	*readerp = NULL;
+}
+
+static int file_reader_pread(struct file_reader * const reader, size_t * const lenp)
+{
+	size_t len = 0;
+	ssize_t bytes;
+	char *tmp;
+
+	while (1) {
+		/* leave room for the NULL terminator */
+		if (len + 1 >= reader->buf_len) {
+			tmp = realloc(reader->buf, reader->buf_len * 2);
+			if (!tmp)
+				return -ENOMEM;
+
+			reader->buf = tmp;
+			reader->buf_len *= 2;
+		}
+
+		bytes = pread(reader->fd, &reader->buf[len], reader->buf_len - len - 1, len);
+		if (bytes < 0)
+			return -errno;
+		else if (bytes == 0)
+			break;
+
+		len += bytes;
+	}
+
+	reader->buf[len] = '\0';
+	*lenp = len;
+
+	return 0;
+}
+
+/*
+ * Copy a snapshot into the reader's buffer
+ */
+static int file_reader_copy(struct file_reader * const reader,
+			    const struct snapshot * const snap, size_t * const lenp)
+{
+	size_t buf_len = reader->buf_len;
+	char *tmp;
+
+	while (snap->len + 1 > buf_len)
+		buf_len *= 2;
+
+	if (buf_len != reader->buf_len) {
+		tmp = realloc(reader->buf, buf_len);
+		if (!tmp)
+			return -ENOMEM;
+
+		reader->buf = tmp;
+		reader->buf_len = buf_len;
+	}
+
+	memcpy(reader->buf, snap->buf, snap->len);
+	reader->buf[snap->len] = '\0';
+	*lenp = snap->len;
+
+	return 0;
+}
+
+/*
+ * Add the contents just read by the reader to the snapshot cache.  Failing to cache
+ * them isn't an error, the next reader of the file just reads it again
+ */
+static void file_reader_cache(const struct file_reader * const reader, size_t len)
+{
+	struct snapshot *snap;
+
+	snap = malloc(sizeof(struct snapshot));
+	if (!snap)
+		return;
+
+	memset(snap, 0, sizeof(struct snapshot));
+
+	snap->path = malloc(strlen(reader->path) + 1);
+	snap->buf = malloc(len + 1);
+	if (!snap->path || !snap->buf) {
+		snapshot_free(snap);
+		return;
+	}
+
+	strcpy(snap->path, reader->path);
+	memcpy(snap->buf, reader->buf, len);
+	snap->len = len;
+
+	snapshot_insert(snap);
+}
+
+/*
+ * Read the entire file into the reader's buffer.  The buffer is NULL terminated and
+ * is owned by the reader; it is only valid until the next file_reader_read() or
+ * file_reader_close() call.
+ *
+ * When the snapshot cache is active, the file is served from and added to it, so
+ * several causes watching the same file still read it once per loop.  Readers
+ * opened with FILE_READER_NO_CACHE always read the file, so they see the writes
+ * made earlier in the same loop.
+ *
+ * If the file has been removed out from under us (e.g. the cgroup was deleted and
+ * recreated), the kernel returns ENODEV or ESTALE.  In that case the file is
+ * reopened by path and the read is retried once
+ */
+API int file_reader_read(struct file_reader * const reader, char ** const bufp,
+			 size_t * const lenp)
+{
+	struct snapshot *snap = NULL;
+	bool cached;
+	size_t len;
+	int ret;
+
+	if (!reader || !bufp)
+		return -EINVAL;
+
+	cached = snapshot_cache_active && !(reader->flags & FILE_READER_NO_CACHE);
+	if (cached) {
+		snap = snapshot_find(reader->path);
+		if (snap) {
+			ret = file_reader_copy(reader, snap, &len);
+			goto out;
+		}
+	}
+
+	if (reader->fd >= 0) {
+		ret = file_reader_pread(reader, &len);
+		if (ret != -ENODEV && ret != -ESTALE)
+			goto out;
+
+		adaptived_dbg("Reopening %s: %d\n", reader->path, ret);
+		close(reader->fd);
+		reader->fd = -1;
+	}
+
+	reader->fd = open(reader->path, O_RDONLY | O_CLOEXEC);
+	if (reader->fd < 0)
+		return -errno;
+
+	ret = file_reader_pread(reader, &len);
+
+out:
+	if (ret)
+		return ret;
+
+	if (cached && !snap)
+		file_reader_cache(reader, len);
+
+	*bufp = reader->buf;
+	if (lenp)
+		*lenp = len;
+
+	return 0;
+}
@@ -79,9 +79,9 @@ API int adaptived_get_slabinfo_field(const char * const slabinfo_file,
 		return -EINVAL;
 
 	if (slabinfo_file)
-		fp = fopen(slabinfo_file, "r");
+		fp = snapshot_fopen(slabinfo_file);
 	else
-		fp = fopen(PROC_SLABINFO, "r");
+		fp = snapshot_fopen(PROC_SLABINFO);
 	if (fp == NULL) {
 		adaptived_err("adaptived_get_slabinfo_field: can't open slabinfo file.\n");
 		return -errno;
@@ -25,11 +25,16 @@
  *
  */
 
+#include <sys/inotify.h>
 #include <sys/types.h>
 #include <stdbool.h>
+#include <pthread.h>
 #include <dirent.h>
 #include <string.h>
+#include <unistd.h>
+#include <limits.h>
 #include <errno.h>
+#include <time.h>
 
 #include <adaptived-utils.h>
 #include <adaptived.h>
@@ -44,11 +49,572 @@ struct adaptived_path_walk_handle {
 	int max_depth;
 	int cur_depth;
 
+	/*
+	 * When the walk is served from the cgroup tree cache, the paths are copied
+	 * into this buffer (NULL separated) at start and handed out by next()
+	 */
+	char *cached_paths;
+	size_t cached_len;
+	size_t cached_pos;
+
 	struct adaptived_path_walk_handle *child;
 };
 
-API int adaptived_path_walk_start(const char * const path, struct adaptived_path_walk_handle **handle,
-			       int flags, int max_depth)
+/*
+ * Cached directory tree.
+ *
+ * Walking a large cgroup hierarchy every loop (kill_cgroup_by_psi, cgroup_data,
+ * etc.) costs an opendir()/readdir()/closedir() per cgroup.  Instead, the
+ * directory tree under an absolute path is read once and kept up to date with
+ * inotify.  Each directory in the tree has an inotify watch, and the watch
+ * descriptor is the node's key.  Pending events are applied at the start of each
+ * walk, so a walk sees every directory created or removed before it started.
+ *
+ * If a watch can't be added (e.g. fs.inotify.max_user_watches is exhausted) or
+ * the inotify queue overflows, the tree is discarded.  The next walk rebuilds it,
+ * or falls back to reading the directories directly.  A failed build is remembered
+ * for TREE_RETRY_SECS so that the walks in the meantime go straight to reading
+ * the directories rather than adding (and failing) every watch again
+ */
+#define TREE_WATCH_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR | \
+			 IN_DELETE_SELF | IN_MOVE_SELF)
+#define TREE_EVENT_BUF_SIZE 16384
+#define TREE_WD_SLACK 1024
+#define TREE_RETRY_SECS 60
+
+struct tree_node {
+	char *name; /* the full path for the root node */
+	int wd;
+
+	struct tree_node *parent;
+	struct tree_node **children; /* in readdir() order, then creation order */
+	int child_cnt;
+	int child_len;
+};
+
+struct dir_tree {
+	char *path;
+	int inotify_fd;
+	struct tree_node *root;
+
+	struct tree_node **wd_nodes; /* indexed by inotify watch descriptor */
+	int wd_len;
+	int node_cnt;
+
+	/* the last build failed, don't try again until then (CLOCK_MONOTONIC seconds) */
+	time_t retry_after;
+
+	struct dir_tree *next;
+};
+
+static struct dir_tree *dir_trees;
+static pthread_mutex_t dir_trees_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int tree_node_path(const struct tree_node * const node, char * const path, size_t len)
+{
+	int ret;
+
+	if (!node->parent) {
+		ret = snprintf(path, len, "%s", node->name);
+	} else {
+		ret = tree_node_path(node->parent, path, len);
+		if (ret < 0)
+			return ret;
+
+		ret = snprintf(&path[ret], len - ret, "/%s", node->name) + ret;
+	}
+
+	if (ret < 0 || ret >= len)
+		return -ENAMETOOLONG;
+
+	return ret;
+}
+
+static void tree_node_free(struct dir_tree * const tree, struct tree_node * const node,
+			   bool rm_watch)
+{
+	int i;
+
+	for (i = 0; i < node->child_cnt; i++)
+		tree_node_free(tree, node->children[i], rm_watch);
+
+	if (node->wd >= 0 && node->wd < tree->wd_len && tree->wd_nodes[node->wd] == node) {
+		tree->wd_nodes[node->wd] = NULL;
+		tree->node_cnt--;
+	}
+	/* the kernel has already removed the watch if the directory was deleted */
+	if (node->wd >= 0 && rm_watch)
+		(void)inotify_rm_watch(tree->inotify_fd, node->wd);
+
+	if (node->children)
+		free(node->children);
+	if (node->name)
+		free(node->name);
+
+	free(node);
+}
+
+static struct tree_node *tree_node_find_child(const struct tree_node * const node,
+					      const char * const name, int * const idx)
+{
+	int i;
+
+	for (i = 0; i < node->child_cnt; i++) {
+		if (strcmp(node->children[i]->name, name) == 0) {
+			if (idx)
+				*idx = i;
+			return node->children[i];
+		}
+	}
+
+	return NULL;
+}
+
+static int tree_node_add_child(struct tree_node * const parent, struct tree_node * const child)
+{
+	struct tree_node **tmp;
+
+	if (parent->child_cnt == parent->child_len) {
+		tmp = realloc(parent->children,
+			      sizeof(struct tree_node *) * (parent->child_len + 8));
+		if (!tmp)
+			return -ENOMEM;
+
+		parent->children = tmp;
+		parent->child_len += 8;
+	}
+
+	parent->children[parent->child_cnt] = child;
+	parent->child_cnt++;
+
+	return 0;
+}
+
+static void tree_node_remove_child(struct dir_tree * const tree, struct tree_node * const parent,
+				   const char * const name)
+{
+	struct tree_node *child;
+	int idx;
+
+	child = tree_node_find_child(parent, name, &idx);
+	if (!child)
+		return;
+
+	memmove(&parent->children[idx], &parent->children[idx + 1],
+		sizeof(struct tree_node *) * (parent->child_cnt - idx - 1));
+	parent->child_cnt--;
+
+	tree_node_free(tree, child, true);
+}
+
+/*
+ * Watch a directory, then read its subdirectories.  The watch is added first so
+ * that a subdirectory created while we're reading can't be missed.  It may be
+ * reported twice, though, so IN_CREATE events for known children are ignored
+ */
+static int tree_node_build(struct dir_tree * const tree, struct tree_node * const parent,
+			   const char * const name, struct tree_node ** const nodep)
+{
+	char path[FILENAME_MAX];
+	struct tree_node **tmp;
+	struct tree_node *node;
+	struct dirent *de;
+	DIR *dirp;
+	int ret;
+
+	node = malloc(sizeof(struct tree_node));
+	if (!node)
+		return -ENOMEM;
+
+	memset(node, 0, sizeof(struct tree_node));
+	node->wd = -1;
+	node->parent = parent;
+
+	node->name = strdup(name);
+	if (!node->name) {
+		ret = -ENOMEM;
+		goto error;
+	}
+
+	ret = tree_node_path(node, path, sizeof(path));
+	if (ret < 0)
+		goto error;
+
+	node->wd = inotify_add_watch(tree->inotify_fd, path, TREE_WATCH_MASK);
+	if (node->wd < 0) {
+		ret = -errno;
+		goto error;
+	}
+
+	if (node->wd >= tree->wd_len) {
+		tmp = realloc(tree->wd_nodes, sizeof(struct tree_node *) * (node->wd + 64));
+		if (!tmp) {
+			ret = -ENOMEM;
+			goto error;
+		}
+
+		memset(&tmp[tree->wd_len], 0,
+		       sizeof(struct tree_node *) * (node->wd + 64 - tree->wd_len));
+		tree->wd_nodes = tmp;
+		tree->wd_len = node->wd + 64;
+	}
+	tree->wd_nodes[node->wd] = node;
+	tree->node_cnt++;
+
+	dirp = opendir(path);
+	if (!dirp) {
+		ret = -errno;
+		goto error;
+	}
+
+	while (1) {
+		errno = 0;
+		de = readdir(dirp);
+		if (!de) {
+			ret = -errno;
+			break;
+		}
+
+		if (de->d_type != DT_DIR || strcmp(".", de->d_name) == 0 ||
+		    strcmp("..", de->d_name) == 0)
+			continue;
+
+		ret = tree_node_build(tree, node, de->d_name, NULL);
+		if (ret == -ENOENT)
+			/* the directory was removed while we were reading it */
+			continue;
+		if (ret)
+			break;
+	}
+
+	closedir(dirp);
+	if (ret)
+		goto error;
+
+	if (parent) {
+		ret = tree_node_add_child(parent, node);
+		if (ret)
+			goto error;
+	}
+
+	if (nodep)
+		*nodep = node;
+
+	return 0;
+
+error:
+	tree_node_free(tree, node, true);
+	return ret;
+}
+
+/*
+ * Release the directory nodes and the inotify fd, but keep the tree in the list
+ */
+static void dir_tree_reset(struct dir_tree * const tree)
+{
+	/* closing the inotify fd removes all of the watches */
+	if (tree->root)
+		tree_node_free(tree, tree->root, false);
+	tree->root = NULL;
+	if (tree->inotify_fd >= 0)
+		close(tree->inotify_fd);
+	tree->inotify_fd = -1;
+	if (tree->wd_nodes)
+		free(tree->wd_nodes);
+	tree->wd_nodes = NULL;
+	tree->wd_len = 0;
+	tree->node_cnt = 0;
+}
+
+static void dir_tree_free(struct dir_tree * const tree)
+{
+	if (!tree)
+		return;
+
+	dir_tree_reset(tree);
+	if (tree->path)
+		free(tree->path);
+
+	free(tree);
+}
+
+static time_t dir_tree_now(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return now.tv_sec;
+}
+
+static int dir_tree_build(struct dir_tree * const tree)
+{
+	tree->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (tree->inotify_fd < 0)
+		return -errno;
+
+	return tree_node_build(tree, NULL, tree->path, &tree->root);
+}
+
+/*
+ * Apply the pending inotify events to the tree.  Returns -ESTALE if the tree can
+ * no longer be trusted and must be rebuilt
+ */
+static int dir_tree_update(struct dir_tree * const tree)
+{
+	char buf[TREE_EVENT_BUF_SIZE] __attribute__((aligned(__alignof__(struct inotify_event))));
+	const struct inotify_event *event;
+	struct tree_node *node;
+	ssize_t bytes;
+	char *ptr;
+	int ret;
+
+	while (1) {
+		bytes = read(tree->inotify_fd, buf, sizeof(buf));
+		if (bytes < 0 && errno == EAGAIN)
+			return 0;
+		if (bytes < 0)
+			return -errno;
+
+		for (ptr = buf; ptr < buf + bytes; ptr += sizeof(struct inotify_event) + event->len) {
+			event = (const struct inotify_event *)ptr;
+
+			if (event->mask & IN_Q_OVERFLOW)
+				return -ESTALE;
+
+			if (event->wd < 0 || event->wd >= tree->wd_len)
+				continue;
+
+			node = tree->wd_nodes[event->wd];
+			if (!node)
+				continue;
+
+			if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+				/*
+				 * Subdirectories are removed via their parent's IN_DELETE
+				 * or IN_MOVED_FROM event.  Only the root needs handling
+				 */
+				if (node == tree->root)
+					return -ESTALE;
+				continue;
+			}
+
+			if (!(event->mask & IN_ISDIR) || event->len == 0)
+				continue;
+
+			if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+				if (tree_node_find_child(node, event->name, NULL))
+					continue;
+
+				ret = tree_node_build(tree, node, event->name, NULL);
+				if (ret == -ENOENT)
+					/* it has already been removed again */
+					continue;
+				if (ret)
+					return -ESTALE;
+			} else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+				tree_node_remove_child(tree, node, event->name);
+			}
+		}
+	}
+}
+
+/*
+ * Find (or build) the cached tree for path and bring it up to date.  Must be
+ * called with dir_trees_mutex held.  Returns -EAGAIN while a previous failure
+ * is being backed off
+ */
+static int dir_tree_get(const char * const path, struct dir_tree ** const treep)
+{
+	struct dir_tree *tree, *prev = NULL;
+	int ret;
+
+	for (tree = dir_trees; tree; prev = tree, tree = tree->next) {
+		if (strcmp(tree->path, path) == 0)
+			break;
+	}
+
+	if (tree && tree->root) {
+		ret = dir_tree_update(tree);
+		/*
+		 * The kernel doesn't reuse watch descriptors, so wd_nodes grows as
+		 * cgroups come and go.  Start over once it's mostly empty
+		 */
+		if (ret == 0 && tree->wd_len > TREE_WD_SLACK + tree->node_cnt * 4)
+			ret = -ESTALE;
+		if (ret == 0) {
+			*treep = tree;
+			return 0;
+		}
+
+		adaptived_dbg("Rebuilding the cached tree for %s: %d\n", path, ret);
+		dir_tree_reset(tree);
+	} else if (tree) {
+		if (dir_tree_now() < tree->retry_after)
+			return -EAGAIN;
+	} else {
+		tree = malloc(sizeof(struct dir_tree));
+		if (!tree)
+			return -ENOMEM;
+
+		memset(tree, 0, sizeof(struct dir_tree));
+		tree->inotify_fd = -1;
+
+		tree->path = strdup(path);
+		if (!tree->path) {
+			free(tree);
+			return -ENOMEM;
+		}
+
+		tree->next = dir_trees;
+		dir_trees = tree;
+		prev = NULL;
+	}
+
+	ret = dir_tree_build(tree);
+	if (ret == 0) {
+		tree->retry_after = 0;
+		*treep = tree;
+		return 0;
+	}
+
+	dir_tree_reset(tree);
+
+	if (ret == -ENOENT || ret == -ENOTDIR || ret == -EACCES) {
+		/* nothing to back off from; the walk will fail the same way */
+		if (prev)
+			prev->next = tree->next;
+		else
+			dir_trees = tree->next;
+		dir_tree_free(tree);
+		return ret;
+	}
+
+	adaptived_dbg("Not caching the tree for %s for %d seconds: %d\n", path,
+		      TREE_RETRY_SECS, ret);
+	tree->retry_after = dir_tree_now() + TREE_RETRY_SECS;
+
+	return ret;
+}
+
+static void tree_paths_len(const struct tree_node * const node, size_t path_len, int depth,
+			   int max_depth, size_t * const len)
+{
+	int i;
+
+	for (i = 0; i < node->child_cnt; i++) {
+		*len += path_len + 1 + strlen(node->children[i]->name) + 1;
+
+		if (max_depth < 0 || depth < max_depth)
+			tree_paths_len(node->children[i],
+				       path_len + 1 + strlen(node->children[i]->name),
+				       depth + 1, max_depth, len);
+	}
+}
+
+/*
+ * Copy the paths of node's descendants into buf in the same pre-order the
+ * readdir() based walk produces.  path holds node's path and has room to append
+ */
+static void tree_paths_copy(const struct tree_node * const node, char * const path,
+			    size_t path_len, int depth, int max_depth, char * const buf,
+			    size_t * const pos)
+{
+	size_t child_len;
+	int i;
+
+	for (i = 0; i < node->child_cnt; i++) {
+		child_len = path_len + 1 + strlen(node->children[i]->name);
+
+		sprintf(&path[path_len], "/%s", node->children[i]->name);
+		memcpy(&buf[*pos], path, child_len + 1);
+		*pos += child_len + 1;
+
+		if (max_depth < 0 || depth < max_depth)
+			tree_paths_copy(node->children[i], path, child_len, depth + 1,
+					max_depth, buf, pos);
+
+		path[path_len] = '\0';
+	}
+}
+
+/*
+ * Serve a directory-only walk from the cached tree.  Returns -ENOTSUP if the tree
+ * can't be cached, in which case the caller walks the directories directly
+ */
+static int path_walk_start_cached(struct adaptived_path_walk_handle * const whandle)
+{
+	char path[PATH_MAX];
+	struct dir_tree *tree;
+	size_t len, pos = 0;
+	int ret;
+
+	/* relative paths would go stale if the working directory changed */
+	if (whandle->path[0] != '/')
+		return -ENOTSUP;
+
+	pthread_mutex_lock(&dir_trees_mutex);
+
+	ret = dir_tree_get(whandle->path, &tree);
+	if (ret) {
+		pthread_mutex_unlock(&dir_trees_mutex);
+		if (ret == -ENOENT || ret == -ENOTDIR || ret == -EACCES)
+			return ret;
+
+		if (ret != -EAGAIN)
+			adaptived_dbg("Unable to cache the tree for %s: %d\n", whandle->path,
+				      ret);
+		return -ENOTSUP;
+	}
+
+	len = 0;
+	if (whandle->list_top_dir)
+		len += strlen(whandle->path) + 1;
+	tree_paths_len(tree->root, strlen(whandle->path), 0, whandle->max_depth, &len);
+
+	whandle->cached_paths = malloc(len + 1);
+	if (!whandle->cached_paths) {
+		pthread_mutex_unlock(&dir_trees_mutex);
+		return -ENOMEM;
+	}
+
+	if (whandle->list_top_dir) {
+		strcpy(whandle->cached_paths, whandle->path);
+		pos = strlen(whandle->path) + 1;
+	}
+
+	strcpy(path, whandle->path);
+	tree_paths_copy(tree->root, path, strlen(path), 0, whandle->max_depth,
+			whandle->cached_paths, &pos);
+
+	pthread_mutex_unlock(&dir_trees_mutex);
+
+	whandle->cached_len = pos;
+	whandle->cached_pos = 0;
+	whandle->list_top_dir = false;
+
+	return 0;
+}
+
+API void path_walk_cache_cleanup(void)
+{
+	struct dir_tree *tree, *next;
+
+	pthread_mutex_lock(&dir_trees_mutex);
+
+	tree = dir_trees;
+	while (tree) {
+		next = tree->next;
+		dir_tree_free(tree);
+		tree = next;
+	}
+	dir_trees = NULL;
+
+	pthread_mutex_unlock(&dir_trees_mutex);
+}
+
+static int path_walk_start(const char * const path, struct adaptived_path_walk_handle **handle,
+			   int flags, int max_depth, bool use_cache)
 {
 	struct adaptived_path_walk_handle *whandle;
 	int ret = 0;
@@ -63,6 +629,8 @@ API int adaptived_path_walk_start(const char * const path, struct adaptived_path
 	if (!whandle)
 		return -ENOMEM;
 
+	memset(whandle, 0, sizeof(struct adaptived_path_walk_handle));
+
 	whandle->path = strdup(path);
 	if (!whandle->path) {
 		ret = -ENOMEM;
@@ -108,15 +676,30 @@ API int adaptived_path_walk_start(const char * const path, struct adaptived_path
 	if (whandle->path[strlen(whandle->path) - 1] == '/')
 		whandle->path[strlen(whandle->path) - 1] = '\0';
 
+	whandle->flags = flags;
+	whandle->child = NULL;
+
+	/*
+	 * Only directory walks are cached.  The cgroup tree walks in adaptived only
+	 * care about directories, and caching every file would cost far more memory
+	 */
+	if (use_cache && flags == ADAPTIVED_PATH_WALK_LIST_DIRS) {
+		ret = path_walk_start_cached(whandle);
+		if (ret == 0)
+			goto out;
+		if (ret != -ENOTSUP)
+			goto error;
+
+		ret = 0;
+	}
+
 	whandle->dirp = opendir(whandle->path);
 	if (whandle->dirp == NULL) {
 		ret = -errno;
 		goto error;
 	}
 
-	whandle->flags = flags;
-	whandle->child = NULL;
-
+out:
 	*handle = whandle;
 
 	return ret;
@@ -132,6 +715,12 @@ error:
 	return ret;
 }
 
+API int adaptived_path_walk_start(const char * const path, struct adaptived_path_walk_handle **handle,
+			       int flags, int max_depth)
+{
+	return path_walk_start(path, handle, flags, max_depth, true);
+}
+
 static int recurse(struct adaptived_path_walk_handle * const whandle, const char * const child_dir)
 {
 	char path[FILENAME_MAX] = { '\0' };
@@ -152,7 +741,9 @@ static int recurse(struct adaptived_path_walk_handle * const whandle, const char
 
 	sprintf(path, "%s/%s", whandle->path, child_dir);
 
-	ret = adaptived_path_walk_start(path, &whandle->child, whandle->flags, child_max_depth);
+	ret = path_walk_start(path, &whandle->child, whandle->flags, child_max_depth, false);
+	if (ret)
+		return ret;
 
 	/*
 	 * We never need to enumerate the parent directory in the child in the recursive
@@ -181,6 +772,20 @@ API int adaptived_path_walk_next(struct adaptived_path_walk_handle **handle, cha
 		return 0;
 	}
 
+	if (whandle->cached_paths) {
+		if (whandle->cached_pos >= whandle->cached_len) {
+			*path = NULL;
+			return 0;
+		}
+
+		*path = strdup(&whandle->cached_paths[whandle->cached_pos]);
+		if (!(*path))
+			return -ENOMEM;
+
+		whandle->cached_pos += strlen(*path) + 1;
+		return 0;
+	}
+
 	do {
 		if (whandle->child != NULL) {
 			ret = adaptived_path_walk_next(&whandle->child, path);
@@ -263,8 +868,13 @@ API void adaptived_path_walk_end(struct adaptived_path_walk_handle **handle)
 
 	whandle = *handle;
 
+	if (whandle->child)
+		adaptived_path_walk_end(&whandle->child);
+	if (whandle->cached_paths)
+		free(whandle->cached_paths);
+	if (whandle->dirp)
+		closedir(whandle->dirp);
 	free(whandle->path);
-	closedir(whandle->dirp);
 	free(whandle);
 
 	*handle = NULL;
@@ -68,7 +68,7 @@ API int adaptived_get_pressure(const char * const pressure_file,
 	if (!pressure_file || !ps)
 		return -EINVAL;
 
-        fp = fopen(pressure_file, "r");
+        fp = snapshot_fopen(pressure_file);
         if (fp == NULL) {
 		adaptived_err("Failed to open pressure file: %s\n", pressure_file);
 		return -EINVAL;
@@ -87,37 +87,45 @@ API int adaptived_get_pressure(const char * const pressure_file,
 	return 0;
 }
 
-API int adaptived_get_pressure_avg(const char * const pressure_file,
-				enum adaptived_pressure_meas_enum meas, float * const avg)
+static void parse_pressure(char * const buf, struct adaptived_pressure_snapshot * const ps)
 {
-	struct adaptived_pressure_snapshot ps;
-	int ret;
+	char *line, *next;
 
-	if (!pressure_file || !avg)
-		return -EINVAL;
+	for (line = buf; line && line[0] != '\0'; line = next) {
+		next = strchr(line, '\n');
+		if (next) {
+			next[0] = '\0';
+			next++;
+		}
 
-	ret = adaptived_get_pressure(pressure_file, &ps);
-	if (ret)
-		return ret;
+		if (strncmp(line, "some", 4) == 0)
+			get_avgs(line, &ps->some);
+		if (strncmp(line, "full", 4) == 0)
+			get_avgs(line, &ps->full);
+	}
+}
 
+static int pressure_avg(const struct adaptived_pressure_snapshot * const ps,
+			enum adaptived_pressure_meas_enum meas, float * const avg)
+{
 	switch (meas) {
 	case PRESSURE_SOME_AVG10:
-		*avg = ps.some.avg10;
+		*avg = ps->some.avg10;
 		break;
 	case PRESSURE_SOME_AVG60:
-		*avg = ps.some.avg60;
+		*avg = ps->some.avg60;
 		break;
 	case PRESSURE_SOME_AVG300:
-		*avg = ps.some.avg300;
+		*avg = ps->some.avg300;
 		break;
 	case PRESSURE_FULL_AVG10:
-		*avg = ps.full.avg10;
+		*avg = ps->full.avg10;
 		break;
 	case PRESSURE_FULL_AVG60:
-		*avg = ps.full.avg60;
+		*avg = ps->full.avg60;
 		break;
 	case PRESSURE_FULL_AVG300:
-		*avg = ps.full.avg300;
+		*avg = ps->full.avg300;
 		break;
 	default:
 		return -EINVAL;
@@ -126,6 +134,39 @@ API int adaptived_get_pressure_avg(const char * const pressure_file,
 	return 0;
 }
 
+static int pressure_total(const struct adaptived_pressure_snapshot * const ps,
+			  enum adaptived_pressure_meas_enum meas, long long * const total)
+{
+	switch (meas) {
+	case PRESSURE_SOME_TOTAL:
+		(*total) = ps->some.total;
+		break;
+	case PRESSURE_FULL_TOTAL:
+		(*total) = ps->full.total;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+API int adaptived_get_pressure_avg(const char * const pressure_file,
+				enum adaptived_pressure_meas_enum meas, float * const avg)
+{
+	struct adaptived_pressure_snapshot ps;
+	int ret;
+
+	if (!pressure_file || !avg)
+		return -EINVAL;
+
+	ret = adaptived_get_pressure(pressure_file, &ps);
+	if (ret)
+		return ret;
+
+	return pressure_avg(&ps, meas, avg);
+}
+
 API int adaptived_get_pressure_total(const char * const pressure_file,
 				  enum adaptived_pressure_meas_enum meas, long long * const total)
 {
@@ -139,16 +180,62 @@ API int adaptived_get_pressure_total(const char * const pressure_file,
 	if (ret)
 		return ret;
 
-	switch (meas) {
-	case PRESSURE_SOME_TOTAL:
-		(*total) = ps.some.total;
-		break;
-	case PRESSURE_FULL_TOTAL:
-		(*total) = ps.full.total;
-		break;
-	default:
+	return pressure_total(&ps, meas, total);
+}
+
+/*
+ * Variants of the above that read the pressure file via a persistent file_reader
+ * handle.  Causes open the reader in their init routine and close it in exit
+ */
+API int reader_get_pressure(struct file_reader * const reader,
+			struct adaptived_pressure_snapshot * const ps)
+{
+	char *buf;
+	int ret;
+
+	if (!reader || !ps)
 		return -EINVAL;
+
+	ret = file_reader_read(reader, &buf, NULL);
+	if (ret) {
+		adaptived_err("Failed to read pressure file: %d\n", ret);
+		return ret;
 	}
 
+	memset(ps, 0, sizeof(struct adaptived_pressure_snapshot));
+	parse_pressure(buf, ps);
+
 	return 0;
 }
+
+API int reader_get_pressure_avg(struct file_reader * const reader,
+			    enum adaptived_pressure_meas_enum meas, float * const avg)
+{
+	struct adaptived_pressure_snapshot ps;
+	int ret;
+
+	if (!reader || !avg)
+		return -EINVAL;
+
+	ret = reader_get_pressure(reader, &ps);
+	if (ret)
+		return ret;
+
+	return pressure_avg(&ps, meas, avg);
+}
+
+API int reader_get_pressure_total(struct file_reader * const reader,
+			      enum adaptived_pressure_meas_enum meas, long long * const total)
+{
+	struct adaptived_pressure_snapshot ps;
+	int ret;
+
+	if (!reader || !total)
+		return -EINVAL;
+
+	ret = reader_get_pressure(reader, &ps);
+	if (ret)
+		return ret;
+
+	return pressure_total(&ps, meas, total);
+}
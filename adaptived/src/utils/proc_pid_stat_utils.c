@@ -0,0 +1,523 @@
+/*
+ * Copyright (c) 2024, Oracle and/or its affiliates.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * You should have received a copy of the GNU General Public License version
+ * 2 along with this work; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Please contact Oracle, 500 Oracle Parkway, Redwood Shores, CA 94065 USA
+ * or visit www.oracle.com if you need additional information or have any
+ * questions.
+ */
+/**
+ * Utilities for scanning /proc/{pid}/stat
+ *
+ * A scan of /proc touches every process on the system, so the scanner avoids
+ * per-process allocations.  The /proc directory stays open across scans, each
+ * stat file is opened relative to it and read into a single reusable buffer, and
+ * only the fields adaptived uses are parsed.  The command name is kept in a
+ * cache keyed by (pid, starttime) so that it's only copied when a process is
+ * new or has changed its name.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdbool.h>
+#include <dirent.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include <adaptived-utils.h>
+#include <adaptived.h>
+
+#include "adaptived-internal.h"
+
+#define PROC_SCANNER_BUF_SIZE 1024
+#define PROC_SCANNER_INIT_BUCKETS 1024
+
+struct comm_entry {
+	pid_t pid;
+	unsigned long long starttime;
+	char *comm;
+
+	unsigned long generation; /* the last scan that saw this process */
+	struct comm_entry *next;
+};
+
+struct proc_scanner {
+	DIR *dirp;
+
+	char *buf;
+	size_t buf_len;
+
+	struct comm_entry **buckets;
+	int bucket_cnt; /* always a power of two */
+	int entry_cnt;
+	unsigned long generation;
+};
+
+static void comm_cache_free(struct proc_scanner * const scanner)
+{
+	struct comm_entry *entry, *next;
+	int i;
+
+	if (!scanner->buckets)
+		return;
+
+	for (i = 0; i < scanner->bucket_cnt; i++) {
+		entry = scanner->buckets[i];
+		while (entry) {
+			next = entry->next;
+			free(entry->comm);
+			free(entry);
+			entry = next;
+		}
+	}
+
+	free(scanner->buckets);
+	scanner->buckets = NULL;
+	scanner->entry_cnt = 0;
+}
+
+static int comm_cache_grow(struct proc_scanner * const scanner)
+{
+	struct comm_entry **buckets, *entry, *next;
+	int bucket_cnt, i, idx;
+
+	bucket_cnt = scanner->bucket_cnt * 2;
+	buckets = calloc(bucket_cnt, sizeof(struct comm_entry *));
+	if (!buckets)
+		return -ENOMEM;
+
+	for (i = 0; i < scanner->bucket_cnt; i++) {
+		entry = scanner->buckets[i];
+		while (entry) {
+			next = entry->next;
+			idx = entry->pid & (bucket_cnt - 1);
+			entry->next = buckets[idx];
+			buckets[idx] = entry;
+			entry = next;
+		}
+	}
+
+	free(scanner->buckets);
+	scanner->buckets = buckets;
+	scanner->bucket_cnt = bucket_cnt;
+
+	return 0;
+}
+
+/*
+ * Find the cached command name for this process, or add it.  A pid that's been
+ * reused by a new process has a different starttime, so its stale entry is
+ * replaced
+ */
+static int comm_cache_get(struct proc_scanner * const scanner, pid_t pid,
+			  unsigned long long starttime, const char * const comm, size_t comm_len,
+			  const char ** const commp)
+{
+	struct comm_entry *entry;
+	char *new_comm;
+	int idx;
+
+	idx = pid & (scanner->bucket_cnt - 1);
+
+	for (entry = scanner->buckets[idx]; entry; entry = entry->next) {
+		if (entry->pid == pid)
+			break;
+	}
+
+	/*
+	 * exec() and PR_SET_NAME change the name without changing the starttime,
+	 * so compare the name too.  That's far cheaper than allocating a copy
+	 */
+	if (entry && entry->starttime == starttime &&
+	    strncmp(entry->comm, comm, comm_len) == 0 && entry->comm[comm_len] == '\0') {
+		entry->generation = scanner->generation;
+		*commp = entry->comm;
+		return 0;
+	}
+
+	new_comm = strndup(comm, comm_len);
+	if (!new_comm)
+		return -ENOMEM;
+
+	if (entry) {
+		free(entry->comm);
+	} else {
+		entry = malloc(sizeof(struct comm_entry));
+		if (!entry) {
+			free(new_comm);
+			return -ENOMEM;
+		}
+
+		entry->pid = pid;
+		entry->next = scanner->buckets[idx];
+		scanner->buckets[idx] = entry;
+		scanner->entry_cnt++;
+	}
+
+	entry->starttime = starttime;
+	entry->comm = new_comm;
+	entry->generation = scanner->generation;
+	*commp = entry->comm;
+
+	return 0;
+}
+
+/*
+ * Drop the processes that weren't seen in the latest scan
+ */
+static void comm_cache_prune(struct proc_scanner * const scanner)
+{
+	struct comm_entry **prev, *entry;
+	int i;
+
+	for (i = 0; i < scanner->bucket_cnt; i++) {
+		prev = &scanner->buckets[i];
+		entry = *prev;
+
+		while (entry) {
+			if (entry->generation != scanner->generation) {
+				*prev = entry->next;
+				free(entry->comm);
+				free(entry);
+				scanner->entry_cnt--;
+			} else {
+				prev = &entry->next;
+			}
+
+			entry = *prev;
+		}
+	}
+}
+
+/*
+ * Open a scanner for the processes in proc_path.  proc_path may be NULL, in which
+ * case /proc is scanned
+ */
+API int proc_scanner_open(const char * const proc_path, struct proc_scanner ** const scannerp)
+{
+	struct proc_scanner *scanner;
+	int ret;
+
+	if (!scannerp)
+		return -EINVAL;
+
+	scanner = malloc(sizeof(struct proc_scanner));
+	if (!scanner)
+		return -ENOMEM;
+
+	memset(scanner, 0, sizeof(struct proc_scanner));
+
+	scanner->dirp = opendir(proc_path ? proc_path : "/proc");
+	if (!scanner->dirp) {
+		ret = -errno;
+		goto error;
+	}
+
+	scanner->buf_len = PROC_SCANNER_BUF_SIZE;
+	scanner->buf = malloc(scanner->buf_len);
+	if (!scanner->buf) {
+		ret = -ENOMEM;
+		goto error;
+	}
+
+	scanner->bucket_cnt = PROC_SCANNER_INIT_BUCKETS;
+	scanner->buckets = calloc(scanner->bucket_cnt, sizeof(struct comm_entry *));
+	if (!scanner->buckets) {
+		ret = -ENOMEM;
+		goto error;
+	}
+
+	*scannerp = scanner;
+
+	return 0;
+
+error:
+	proc_scanner_close(&scanner);
+
+	return ret;
+}
+
+API void proc_scanner_close(struct proc_scanner ** const scannerp)
+{
+	struct proc_scanner *scanner;
+
+	if (!scannerp || !(*scannerp))
+		return;
+
+	scanner = *scannerp;
+
+	comm_cache_free(scanner);
+	if (scanner->buf)
+		free(scanner->buf);
+	if (scanner->dirp)
+		closedir(scanner->dirp);
+
+	free(scanner);
+	*scannerp = NULL;
+}
+
+/*
+ * Parse a directory name as a pid.  Returns 0 if it isn't a pid
+ */
+static pid_t parse_pid(const char *name)
+{
+	pid_t pid = 0;
+
+	if (*name == '\0')
+		return 0;
+
+	for (; *name; name++) {
+		if (*name < '0' || *name > '9')
+			return 0;
+
+		pid = pid * 10 + (*name - '0');
+	}
+
+	return pid;
+}
+
+/*
+ * Read /proc/{pid}/stat into the scanner's buffer.  Returns the length read,
+ * or a negative errno.  -ENOENT and -ESRCH indicate the process has exited
+ */
+static ssize_t read_stat(struct proc_scanner * const scanner, const char * const pid_str)
+{
+	char path[FILENAME_MAX];
+	ssize_t bytes, len = 0;
+	char *tmp;
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/stat", pid_str);
+
+	fd = openat(dirfd(scanner->dirp), path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+
+	while (1) {
+		bytes = read(fd, &scanner->buf[len], scanner->buf_len - len - 1);
+		if (bytes < 0) {
+			len = -errno;
+			break;
+		}
+		if (bytes == 0)
+			break;
+
+		len += bytes;
+
+		if (len == scanner->buf_len - 1) {
+			tmp = realloc(scanner->buf, scanner->buf_len * 2);
+			if (!tmp) {
+				len = -ENOMEM;
+				break;
+			}
+
+			scanner->buf = tmp;
+			scanner->buf_len *= 2;
+		}
+	}
+
+	close(fd);
+
+	if (len >= 0)
+		scanner->buf[len] = '\0';
+
+	return len;
+}
+
+/*
+ * Skip cnt space-separated fields.  Returns NULL if the line ends first
+ */
+static const char *skip_fields(const char *ptr, int cnt)
+{
+	while (cnt > 0) {
+		while (*ptr == ' ')
+			ptr++;
+		if (*ptr == '\0' || *ptr == '\n')
+			return NULL;
+		while (*ptr != ' ' && *ptr != '\0' && *ptr != '\n')
+			ptr++;
+
+		cnt--;
+	}
+
+	while (*ptr == ' ')
+		ptr++;
+	if (*ptr == '\0' || *ptr == '\n')
+		return NULL;
+
+	return ptr;
+}
+
+static const char *parse_ull(const char *ptr, unsigned long long * const value)
+{
+	unsigned long long v = 0;
+
+	if (*ptr < '0' || *ptr > '9')
+		return NULL;
+
+	for (; *ptr >= '0' && *ptr <= '9'; ptr++)
+		v = v * 10 + (*ptr - '0');
+
+	*value = v;
+
+	return ptr;
+}
+
+/*
+ * Parse the fields we need from a /proc/{pid}/stat line.  The fields are numbered
+ * as in proc_pid_stat(5), starting at 1
+ *
+ * https://man7.org/linux/man-pages/man5/proc_pid_stat.5.html
+ */
+#define STAT_FLD_STATE		3
+#define STAT_FLD_STARTTIME	22
+#define STAT_FLD_VSIZE		23
+#define STAT_FLD_RSS		24
+
+static int parse_stat(const char * const buf, size_t len, const char ** const comm,
+		      size_t * const comm_len, struct proc_pid_stat * const stat)
+{
+	unsigned long long value;
+	const char *left, *right, *ptr;
+
+	/*
+	 * The command name may contain spaces and parentheses.  It runs from the
+	 * first '(' to the last ')'
+	 */
+	left = memchr(buf, '(', len);
+	if (!left)
+		return -EINVAL;
+
+	for (right = &buf[len - 1]; right > left && *right != ')'; right--)
+		;
+	if (right == left)
+		return -EINVAL;
+
+	*comm = left + 1;
+	*comm_len = right - left - 1;
+
+	ptr = skip_fields(right + 1, 0);
+	if (!ptr)
+		return -EINVAL;
+	stat->state = *ptr;
+
+	ptr = skip_fields(ptr, STAT_FLD_STARTTIME - STAT_FLD_STATE);
+	if (!ptr || !(ptr = parse_ull(ptr, &stat->starttime)))
+		return -EINVAL;
+
+	ptr = skip_fields(ptr, STAT_FLD_VSIZE - STAT_FLD_STARTTIME - 1);
+	if (!ptr || !(ptr = parse_ull(ptr, &value)))
+		return -EINVAL;
+	stat->vsize = (long long)value;
+
+	ptr = skip_fields(ptr, STAT_FLD_RSS - STAT_FLD_VSIZE - 1);
+	if (!ptr)
+		return -EINVAL;
+	/* rss can be negative for some kernel threads */
+	if (*ptr == '-') {
+		if (!parse_ull(ptr + 1, &value))
+			return -EINVAL;
+		stat->rss = -(long long)value;
+	} else {
+		if (!parse_ull(ptr, &value))
+			return -EINVAL;
+		stat->rss = (long long)value;
+	}
+
+	return 0;
+}
+
+/*
+ * Scan every process in /proc and invoke cb for each.  Processes that exit
+ * during the scan are silently skipped.  If cb returns non-zero, the scan stops
+ * and that value is returned.
+ *
+ * The comm pointer passed to cb remains valid until the next scan
+ */
+API int proc_scanner_scan(struct proc_scanner * const scanner, proc_scanner_cb cb,
+			  void * const data)
+{
+	struct proc_pid_stat stat;
+	const char *comm;
+	struct dirent *de;
+	size_t comm_len;
+	ssize_t len;
+	int ret = 0;
+
+	if (!scanner || !cb)
+		return -EINVAL;
+
+	scanner->generation++;
+	rewinddir(scanner->dirp);
+
+	while (1) {
+		errno = 0;
+		de = readdir(scanner->dirp);
+		if (!de) {
+			ret = -errno;
+			break;
+		}
+
+		memset(&stat, 0, sizeof(stat));
+		stat.pid = parse_pid(de->d_name);
+		if (stat.pid == 0)
+			/* This directory isn't a PID directory.  Move on */
+			continue;
+
+		len = read_stat(scanner, de->d_name);
+		if (len == -ENOENT || len == -ESRCH)
+			/*
+			 * This process may have completed between reading the directory
+			 * and trying to read the stat file.  Move on
+			 */
+			continue;
+		if (len < 0) {
+			ret = len;
+			adaptived_err("Failed to read stat for pid %d: %d\n", stat.pid, ret);
+			break;
+		}
+
+		ret = parse_stat(scanner->buf, len, &comm, &comm_len, &stat);
+		if (ret) {
+			adaptived_wrn("Failed to parse stat for pid %d: %d\n", stat.pid, ret);
+			ret = 0;
+			continue;
+		}
+
+		ret = comm_cache_get(scanner, stat.pid, stat.starttime, comm, comm_len,
+				     &stat.comm);
+		if (ret)
+			break;
+
+		ret = cb(&stat, data);
+		if (ret)
+			break;
+	}
+
+	/* a partial scan didn't see every process, so only prune after a full one */
+	if (ret == 0) {
+		comm_cache_prune(scanner);
+
+		if (scanner->entry_cnt > scanner->bucket_cnt)
+			/* not fatal.  the chains will just be longer */
+			(void)comm_cache_grow(scanner);
+	}
+
+	return ret;
+}
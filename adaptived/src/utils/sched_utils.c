@@ -49,7 +49,7 @@ static unsigned long cpumask_to_hex(char * p) {
 	}
 	*dst = 0;
 
-	return strtoul(dst, NULL, 16);
+	return strtoul(p, NULL, 16);
 }
 
 static int adaptived_get_schedstat_cpu(char * token, struct adaptived_schedstat_cpu * const ss_cpu)
@@ -26,6 +26,7 @@
  */
 
 #include <stdbool.h>
+#include <pthread.h>
 #include <string.h>
 #include <limits.h>
 #include <unistd.h>
@@ -33,6 +34,8 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <ctype.h>
+#include <poll.h>
+#include <time.h>
 #include <systemd/sd-bus.h>
 
 #include <adaptived-utils.h>
@@ -233,23 +236,179 @@ static int property_assignment(sd_bus_message *m, cgroupType t, const char *prop
 	return r;
 }
 
-static int set_property(const char *name, const char *property,
-			const struct adaptived_cgroup_value * const value, bool arg_runtime)
-{
-	sd_bus_error error = SD_BUS_ERROR_NULL;
-	sd_bus_message *m = NULL;
+/*
+ * One connection to the system bus is shared by every sd_bus utility.  While
+ * adaptived_loop() is running, writes are queued rather than sent immediately, and
+ * all of the writes to the same unit are batched into a single SetUnitProperties
+ * call when bus_conn_flush() is invoked.  adaptived_loop() flushes the queue once
+ * per loop and handles the replies as they arrive via poll(), so a busy PID1 no
+ * longer stalls the loop.  Outside of adaptived_loop(), each write is sent as soon
+ * as it is made.
+ *
+ * D-Bus delivers the messages on a connection in order.  Reads flush the queue
+ * before they are sent, so a read always sees the writes that preceded it
+ */
+#define BUS_CALL_TIMEOUT_USEC (10 * USEC_PER_SEC)
+
+struct bus_prop {
+	char *property;
+	struct adaptived_cgroup_value value;
+
+	struct bus_prop *next;
+};
+
+struct bus_batch {
+	char *name;
+	bool runtime;
+	cgroupType type;
+	struct bus_prop *props; /* one per property.  the last value written wins */
+	struct bus_prop *props_tail;
+	int prop_cnt;
+
+	struct bus_batch *next;
+};
+
+static struct bus_conn {
+	pthread_mutex_t mutex;
 	sd_bus *bus;
+	struct bus_batch *batches; /* in the order they were created */
+	int inflight; /* SetUnitProperties calls awaiting a reply */
+	int loops; /* running adaptived_loop()s.  writes are only batched while > 0 */
+} conn = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static void free_prop(struct bus_prop *prop)
+{
+	if (prop->property)
+		free(prop->property);
+	adaptived_free_cgroup_value(&prop->value);
+	free(prop);
+}
+
+static void free_batch(struct bus_batch **batch)
+{
+	struct bus_prop *prop, *next;
+
+	prop = (*batch)->props;
+	while (prop) {
+		next = prop->next;
+		free_prop(prop);
+		prop = next;
+	}
+
+	if ((*batch)->name)
+		free((*batch)->name);
+	free(*batch);
+	*batch = NULL;
+}
+
+/*
+ * Return the shared bus, (re)connecting if necessary.  Must be called with the
+ * conn mutex held
+ */
+static int get_bus(sd_bus **busp)
+{
 	int r;
-	cgroupType t;
 
-	adaptived_dbg("set_property: name=%s, property=%s, arg_runtime=%d\n", name, property, arg_runtime);
+	if (conn.bus) {
+		/* sd_bus_is_open() fails with -ECHILD if we've forked, e.g. daemon() */
+		r = sd_bus_is_open(conn.bus);
+		if (r > 0) {
+			*busp = conn.bus;
+			return 0;
+		}
 
-	r = sd_bus_default_system(&bus);
+		/*
+		 * The queued writes haven't been built into messages yet, so they're
+		 * sent on the new connection.  Replies to the calls already sent on the
+		 * old connection are lost
+		 */
+		adaptived_wrn("get_bus: bus connection lost, r=%d.  Reconnecting\n", r);
+		if (conn.inflight > 0)
+			adaptived_wrn("get_bus: lost the replies to %d property writes\n",
+				      conn.inflight);
+		sd_bus_unref(conn.bus);
+		conn.bus = NULL;
+		conn.inflight = 0;
+	}
+
+	r = sd_bus_open_system(&conn.bus);
 	if (r < 0) {
-		adaptived_err("set_property: Can't get bus, r=%d\n", r);
+		adaptived_err("get_bus: Can't get bus, r=%d\n", r);
+		conn.bus = NULL;
 		return r;
 	}
 
+	r = sd_bus_set_method_call_timeout(conn.bus, BUS_CALL_TIMEOUT_USEC);
+	if (r < 0)
+		adaptived_wrn("get_bus: failed to set the method call timeout, r=%d\n", r);
+
+	*busp = conn.bus;
+	return 0;
+}
+
+static int set_property_reply(sd_bus_message *reply, void *userdata, sd_bus_error *ret_error)
+{
+	const sd_bus_error *error;
+	const char *name = userdata;
+
+	conn.inflight--;
+
+	error = sd_bus_message_get_error(reply);
+	if (error) {
+		adaptived_err("set_property: SetUnitProperties(%s) failed: %s: %s\n", name,
+			      error->name, error->message ? error->message : "");
+		return 0;
+	}
+
+	adaptived_dbg("set_property: SetUnitProperties(%s) complete\n", name);
+	return 0;
+}
+
+/*
+ * Dispatch any replies that have been received.  Must be called with the conn mutex
+ * held
+ */
+static void process_bus(void)
+{
+	int r;
+
+	if (!conn.bus)
+		return;
+
+	do {
+		r = sd_bus_process(conn.bus, NULL);
+	} while (r > 0);
+
+	if (r < 0)
+		adaptived_err("process_bus: sd_bus_process() failed, r=%d\n", r);
+}
+
+static int copy_value(struct adaptived_cgroup_value * const dst,
+		      const struct adaptived_cgroup_value * const src)
+{
+	*dst = *src;
+
+	if (src->type == ADAPTIVED_CGVAL_STR) {
+		dst->value.str_value = strdup(src->value.str_value);
+		if (!dst->value.str_value)
+			return -ENOMEM;
+	}
+
+	return 0;
+}
+
+/*
+ * Build a SetUnitProperties call for the batch, starting with prop.  If one is
+ * true, only prop is added to the call
+ */
+static int build_message(sd_bus *bus, const struct bus_batch * const batch,
+			 const struct bus_prop *prop, bool one, sd_bus_message **mp)
+{
+	sd_bus_message *m = NULL;
+	int r;
+
 	r = sd_bus_message_new_method_call(bus, &m, "org.freedesktop.systemd1",
 		"/org/freedesktop/systemd1", "org.freedesktop.systemd1.Manager",
 		"SetUnitProperties");
@@ -258,43 +417,380 @@ static int set_property(const char *name, const char *property,
 		return r;
 	}
 
-	t = get_type_from_string(name);
-	if (t < 0) {
-		adaptived_err("set_property: get_type_from_string(), failed, t=%d\n", t);
-		return t;
-	}
-
-	r = sd_bus_message_append(m, "sb", name, arg_runtime);
+	r = sd_bus_message_append(m, "sb", batch->name, batch->runtime);
 	if (r < 0) {
 		adaptived_err("set_property: sd_bus_message_append() failed, r=%d\n", r);
-		return r;
+		goto err;
 	}
 
 	r = sd_bus_message_open_container(m, SD_BUS_TYPE_ARRAY, "(sv)");
 	if (r < 0) {
 		adaptived_err("set_property: sd_bus_message_open_container() failed, r=%d\n", r);
-		return r;
+		goto err;
 	}
 
-	r = property_assignment(m, t, property, value);
-	if (r < 0) {
-		adaptived_err("set_property: property_assignment() failed, r=%d\n", r);
-		return r;
+	while (prop) {
+		r = property_assignment(m, batch->type, prop->property, &prop->value);
+		if (r < 0) {
+			adaptived_err("set_property: property_assignment() failed, r=%d\n", r);
+			goto err;
+		}
+		if (one)
+			break;
+		prop = prop->next;
 	}
 
 	r = sd_bus_message_close_container(m);
 	if (r < 0) {
 		adaptived_err("set_property: sd_bus_message_close_container() failed, r=%d\n", r);
-		return r;
+		goto err;
 	}
 
-	r = sd_bus_call(bus, m, 0, &error, NULL);
+	*mp = m;
+	return 0;
+
+err:
+	sd_bus_message_unref(m);
+	return r;
+}
+
+/*
+ * Send a SetUnitProperties call without waiting for the reply.  Consumes m
+ */
+static int send_message(sd_bus *bus, const struct bus_batch * const batch, sd_bus_message *m,
+			int prop_cnt)
+{
+	sd_bus_slot *slot;
+	char *name;
+	int r;
+
+	name = strdup(batch->name);
+	if (!name) {
+		r = -ENOMEM;
+		goto out;
+	}
+
+	r = sd_bus_call_async(bus, &slot, m, set_property_reply, name, 0);
 	if (r < 0) {
-		adaptived_err("set_property: sd_bus_call() failed, r=%d\n", r);
+		adaptived_err("flush_batches: sd_bus_call_async(%s) failed, r=%d\n",
+			      batch->name, r);
+		free(name);
+		goto out;
+	}
+
+	/* the slot is owned by the bus and frees the unit name when it's done */
+	sd_bus_slot_set_floating(slot, 1);
+	sd_bus_slot_set_destroy_callback(slot, free);
+	sd_bus_slot_unref(slot);
+
+	adaptived_dbg("flush_batches: sent %d properties in one SetUnitProperties call\n",
+		      prop_cnt);
+	conn.inflight++;
+
+out:
+	sd_bus_message_unref(m);
+	return r;
+}
+
+/*
+ * Send every queued batch.  The batches stay queued if the bus can't be reached.
+ * Must be called with the conn mutex held
+ */
+static int flush_batches(void)
+{
+	struct bus_batch *batch, *next;
+	struct bus_prop *prop;
+	sd_bus_message *m;
+	int r, ret = 0;
+	sd_bus *bus;
+
+	if (!conn.batches)
+		return 0;
+
+	ret = get_bus(&bus);
+	if (ret < 0)
+		return ret;
+
+	batch = conn.batches;
+	conn.batches = NULL;
+
+	while (batch) {
+		next = batch->next;
+		if (!batch->props)
+			goto next;
+
+		r = build_message(bus, batch, batch->props, false, &m);
+		if (r == 0) {
+			r = send_message(bus, batch, m, batch->prop_cnt);
+			if (r < 0)
+				ret = r;
+			goto next;
+		}
+
+		/* one bad value shouldn't cost the unit the rest of its writes */
+		adaptived_wrn("flush_batches: sending the %d writes to %s one at a time\n",
+			      batch->prop_cnt, batch->name);
+		ret = r;
+		prop = batch->props;
+		while (prop) {
+			r = build_message(bus, batch, prop, true, &m);
+			if (r == 0)
+				r = send_message(bus, batch, m, 1);
+			if (r < 0)
+				ret = r;
+			prop = prop->next;
+		}
+next:
+		free_batch(&batch);
+		batch = next;
+	}
+
+	return ret;
+}
+
+/*
+ * Send the queued property writes and wait for systemd to reply to all of them,
+ * or for the method call timeout to expire.  Must be called with the conn mutex
+ * held
+ */
+static void drain_bus(void)
+{
+	struct timespec now;
+	uint64_t start, elapsed;
+	int r;
+
+	flush_batches();
+	if (conn.batches)
+		adaptived_err("drain_bus: failed to send the queued property writes\n");
+	if (!conn.bus)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	start = now.tv_sec * USEC_PER_SEC + now.tv_nsec / 1000;
+
+	while (1) {
+		process_bus();
+		if (conn.inflight <= 0)
+			break;
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		elapsed = now.tv_sec * USEC_PER_SEC + now.tv_nsec / 1000 - start;
+		if (elapsed >= BUS_CALL_TIMEOUT_USEC) {
+			adaptived_err("drain_bus: timed out waiting on %d replies\n",
+				      conn.inflight);
+			break;
+		}
+
+		r = sd_bus_wait(conn.bus, BUS_CALL_TIMEOUT_USEC - elapsed);
+		if (r < 0) {
+			adaptived_err("drain_bus: sd_bus_wait() failed, r=%d\n", r);
+			break;
+		}
+	}
+}
+
+/*
+ * Queue a property write.  The SetUnitProperties call is built when the queue is
+ * flushed, which is right away if adaptived_loop() isn't running
+ */
+static int set_property(const char *name, const char *property,
+			const struct adaptived_cgroup_value * const value, bool arg_runtime)
+{
+	struct adaptived_cgroup_value new_value;
+	struct bus_batch *batch, **tail;
+	struct bus_prop *prop, **prop_tail;
+	sd_bus *bus;
+	cgroupType t;
+	int r;
+
+	adaptived_dbg("set_property: name=%s, property=%s, arg_runtime=%d\n", name, property, arg_runtime);
+
+	t = get_type_from_string(name);
+	if (t < 0) {
+		adaptived_err("set_property: get_type_from_string(), failed, t=%d\n", t);
+		return t;
+	}
+
+	memset(&new_value, 0, sizeof(new_value));
+	r = copy_value(&new_value, value);
+	if (r < 0)
 		return r;
+
+	pthread_mutex_lock(&conn.mutex);
+
+	r = get_bus(&bus);
+	if (r < 0)
+		goto err;
+
+	tail = &conn.batches;
+	batch = conn.batches;
+	while (batch) {
+		if (batch->runtime == arg_runtime && strcmp(batch->name, name) == 0)
+			break;
+		tail = &batch->next;
+		batch = batch->next;
 	}
 
-	return 0;
+	if (!batch) {
+		batch = malloc(sizeof(struct bus_batch));
+		if (!batch) {
+			r = -ENOMEM;
+			goto err;
+		}
+		memset(batch, 0, sizeof(struct bus_batch));
+		batch->runtime = arg_runtime;
+		batch->type = t;
+
+		batch->name = strdup(name);
+		if (!batch->name) {
+			free_batch(&batch);
+			r = -ENOMEM;
+			goto err;
+		}
+		*tail = batch;
+	}
+
+	prop_tail = &batch->props;
+	prop = batch->props;
+	while (prop) {
+		if (strcmp(prop->property, property) == 0)
+			break;
+		prop_tail = &prop->next;
+		prop = prop->next;
+	}
+
+	if (prop) {
+		/* this property was already written this loop.  only send the last value */
+		adaptived_dbg("set_property: coalescing writes to %s %s\n", name, property);
+		adaptived_free_cgroup_value(&prop->value);
+	} else {
+		prop = malloc(sizeof(struct bus_prop));
+		if (!prop) {
+			r = -ENOMEM;
+			goto err;
+		}
+		memset(prop, 0, sizeof(struct bus_prop));
+
+		prop->property = strdup(property);
+		if (!prop->property) {
+			free(prop);
+			r = -ENOMEM;
+			goto err;
+		}
+		*prop_tail = prop;
+		batch->prop_cnt++;
+	}
+	prop->value = new_value;
+
+	if (conn.loops == 0) {
+		r = flush_batches();
+		process_bus();
+	}
+
+	pthread_mutex_unlock(&conn.mutex);
+	return r;
+
+err:
+	/* an empty batch is harmless.  it's freed when the queue is flushed */
+	adaptived_free_cgroup_value(&new_value);
+	pthread_mutex_unlock(&conn.mutex);
+	return r;
+}
+
+/*
+ * Queue the sd_bus property writes until the matching bus_conn_stop()
+ */
+void bus_conn_start(void)
+{
+	pthread_mutex_lock(&conn.mutex);
+	conn.loops++;
+	pthread_mutex_unlock(&conn.mutex);
+}
+
+/*
+ * Send the queued property writes and wait for systemd to apply them.  Later
+ * writes are sent immediately unless another adaptived_loop() is running
+ */
+void bus_conn_stop(void)
+{
+	pthread_mutex_lock(&conn.mutex);
+	if (conn.loops > 0)
+		conn.loops--;
+	drain_bus();
+	pthread_mutex_unlock(&conn.mutex);
+}
+
+/*
+ * Send the queued property writes
+ */
+int bus_conn_flush(void)
+{
+	int ret;
+
+	pthread_mutex_lock(&conn.mutex);
+	ret = flush_batches();
+	process_bus();
+	pthread_mutex_unlock(&conn.mutex);
+
+	return ret;
+}
+
+/*
+ * Fill in pfd if there are replies outstanding that adaptived_loop() should poll()
+ * for.  Returns 1 if pfd was filled in and 0 otherwise
+ */
+int bus_conn_get_pollfd(struct pollfd * const pfd)
+{
+	int events, ret = 0;
+
+	pthread_mutex_lock(&conn.mutex);
+	if (!conn.bus || conn.inflight <= 0)
+		goto out;
+
+	pfd->fd = sd_bus_get_fd(conn.bus);
+	events = sd_bus_get_events(conn.bus);
+	if (pfd->fd < 0 || events < 0)
+		goto out;
+
+	pfd->events = events;
+	pfd->revents = 0;
+	ret = 1;
+
+out:
+	pthread_mutex_unlock(&conn.mutex);
+	return ret;
+}
+
+void bus_conn_process(void)
+{
+	pthread_mutex_lock(&conn.mutex);
+	process_bus();
+	pthread_mutex_unlock(&conn.mutex);
+}
+
+void bus_conn_cleanup(void)
+{
+	struct bus_batch *batch, *next;
+
+	pthread_mutex_lock(&conn.mutex);
+	if (conn.bus || conn.batches)
+		drain_bus();
+
+	/* only left over if the bus couldn't be reached */
+	batch = conn.batches;
+	while (batch) {
+		next = batch->next;
+		free_batch(&batch);
+		batch = next;
+	}
+	conn.batches = NULL;
+
+	if (conn.bus) {
+		sd_bus_flush_close_unref(conn.bus);
+		conn.bus = NULL;
+	}
+	conn.inflight = 0;
+	pthread_mutex_unlock(&conn.mutex);
 }
 
 static int get_property(char *path, char *interface, const char *prop, char *type,
@@ -310,18 +806,29 @@ static int get_property(char *path, char *interface, const char *prop, char *typ
 	adaptived_dbg("%s: path=%s, interface=%s, prop=%s, type=%s\n", __func__, path, interface,
 		   prop, type);
 
-	r = sd_bus_default_system(&bus);
+	memset(ret_val, 0, sizeof(struct adaptived_cgroup_value));
+
+	pthread_mutex_lock(&conn.mutex);
+
+	r = get_bus(&bus);
 	if (r < 0) {
-		adaptived_err("get_property: Can't get bus, r=%d\n", r);
+		pthread_mutex_unlock(&conn.mutex);
 		return r;
 	}
 
-	memset(ret_val, 0, sizeof(struct adaptived_cgroup_value));
+	/* send the queued writes first so that this read sees them */
+	flush_batches();
 
 	r = sd_bus_get_property(bus, "org.freedesktop.systemd1", path, interface, prop, &err,
 				&reply,	type);
+
+	/* sd_bus_get_property() may have read replies to the queued writes */
+	process_bus();
+	pthread_mutex_unlock(&conn.mutex);
+
 	if (r < 0) {
 		adaptived_err("get_property: sd_bus_get_property() failed, r=%d\n", r);
+		sd_bus_error_free(&err);
 		return r;
 	}
 
@@ -345,6 +852,7 @@ static int get_property(char *path, char *interface, const char *prop, char *typ
 		r = -ENOTSUP;
 	}
 
+	sd_bus_message_unref(reply);
 	sd_bus_error_free(&err);
 	if (r < 0) {
 		adaptived_err("get_property: sd_bus_message_read() failed, r=%d\n", r);
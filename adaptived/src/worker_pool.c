@@ -0,0 +1,262 @@
+/*
+ * Copyright (c) 2025, Oracle and/or its affiliates.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * You should have received a copy of the GNU General Public License version
+ * 2 along with this work; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Please contact Oracle, 500 Oracle Parkway, Redwood Shores, CA 94065 USA
+ * or visit www.oracle.com if you need additional information or have any
+ * questions.
+ */
+/**
+ * adaptived worker pool for evaluating rules' causes concurrently
+ *
+ * Each rule is evaluated by exactly one thread per loop, so a rule's causes
+ * still run in order and its stats can be updated without additional locking.
+ * Only the causes are run by the pool.  adaptived_loop() applies the effects
+ * afterward, in rule order, from its own thread.
+ */
+
+#include <pthread.h>
+#include <string.h>
+#include <errno.h>
+
+#include <adaptived.h>
+
+#include "adaptived-internal.h"
+
+struct worker_pool {
+	pthread_t *threads;
+	int thread_cnt;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t work_cond;
+	pthread_cond_t done_cond;
+
+	/* work for the current loop.  protected by mutex */
+	struct adaptived_rule **rules;
+	int rules_len;
+	int rule_cnt;
+	int next_rule; /* index of the next rule that hasn't been claimed */
+	int done_cnt;
+	unsigned long generation; /* incremented each time new work is posted */
+	bool shutdown;
+};
+
+/*
+ * Claim and evaluate rules until there are none left.  Called with the pool mutex
+ * held.  The mutex is dropped while a rule's causes are running
+ */
+static void worker_pool_drain(struct worker_pool * const pool)
+{
+	struct adaptived_rule *rule;
+
+	while (pool->next_rule < pool->rule_cnt) {
+		rule = pool->rules[pool->next_rule];
+		pool->next_rule++;
+
+		pthread_mutex_unlock(&pool->mutex);
+		rule->causes_ret = rule_run_causes(rule, rule->time_since_last_run);
+		pthread_mutex_lock(&pool->mutex);
+
+		pool->done_cnt++;
+		if (pool->done_cnt == pool->rule_cnt)
+			pthread_cond_signal(&pool->done_cond);
+	}
+}
+
+static void *worker_main(void *arg)
+{
+	struct worker_pool *pool = arg;
+	unsigned long generation = 0;
+
+	pthread_mutex_lock(&pool->mutex);
+
+	while (1) {
+		while (!pool->shutdown && pool->generation == generation)
+			pthread_cond_wait(&pool->work_cond, &pool->mutex);
+
+		if (pool->shutdown)
+			break;
+
+		generation = pool->generation;
+
+		/* the snapshot cache is thread local.  give each worker its own view */
+		snapshot_cache_start();
+		worker_pool_drain(pool);
+		snapshot_cache_stop();
+	}
+
+	pthread_mutex_unlock(&pool->mutex);
+
+	return NULL;
+}
+
+/*
+ * Create a pool of thread_cnt - 1 worker threads.  The thread calling
+ * worker_pool_run() also evaluates rules, for a total of thread_cnt threads
+ */
+int worker_pool_create(int thread_cnt, struct worker_pool ** const poolp)
+{
+	struct worker_pool *pool;
+	int ret, i;
+
+	if (thread_cnt < 2 || !poolp)
+		return -EINVAL;
+
+	pool = malloc(sizeof(struct worker_pool));
+	if (!pool)
+		return -ENOMEM;
+
+	memset(pool, 0, sizeof(struct worker_pool));
+
+	ret = pthread_mutex_init(&pool->mutex, NULL);
+	if (ret)
+		goto mutex_err;
+	ret = pthread_cond_init(&pool->work_cond, NULL);
+	if (ret)
+		goto work_cond_err;
+	ret = pthread_cond_init(&pool->done_cond, NULL);
+	if (ret)
+		goto done_cond_err;
+
+	pool->threads = malloc(sizeof(pthread_t) * (thread_cnt - 1));
+	if (!pool->threads) {
+		ret = ENOMEM;
+		goto threads_err;
+	}
+
+	for (i = 0; i < thread_cnt - 1; i++) {
+		ret = pthread_create(&pool->threads[i], NULL, worker_main, pool);
+		if (ret) {
+			adaptived_err("Failed to create worker thread %d: %d\n", i, ret);
+			*poolp = pool;
+			worker_pool_destroy(poolp);
+			return -ret;
+		}
+
+		pool->thread_cnt++;
+	}
+
+	adaptived_info("Created a worker pool with %d threads\n", thread_cnt);
+	*poolp = pool;
+
+	return 0;
+
+threads_err:
+	pthread_cond_destroy(&pool->done_cond);
+done_cond_err:
+	pthread_cond_destroy(&pool->work_cond);
+work_cond_err:
+	pthread_mutex_destroy(&pool->mutex);
+mutex_err:
+	free(pool);
+	return -ret;
+}
+
+void worker_pool_destroy(struct worker_pool ** const poolp)
+{
+	struct worker_pool *pool;
+	int i;
+
+	if (!poolp || !(*poolp))
+		return;
+
+	pool = *poolp;
+
+	pthread_mutex_lock(&pool->mutex);
+	pool->shutdown = true;
+	pthread_cond_broadcast(&pool->work_cond);
+	pthread_mutex_unlock(&pool->mutex);
+
+	for (i = 0; i < pool->thread_cnt; i++)
+		pthread_join(pool->threads[i], NULL);
+
+	pthread_cond_destroy(&pool->done_cond);
+	pthread_cond_destroy(&pool->work_cond);
+	pthread_mutex_destroy(&pool->mutex);
+
+	if (pool->threads)
+		free(pool->threads);
+	if (pool->rules)
+		free(pool->rules);
+
+	free(pool);
+	*poolp = NULL;
+}
+
+/*
+ * Evaluate the causes of every due rule in the list and store the result in each
+ * rule's causes_ret.  Returns once all of the due rules have been evaluated
+ */
+int worker_pool_run(struct worker_pool * const pool, struct adaptived_rule * const rules)
+{
+	struct adaptived_rule **tmp_rules;
+	struct adaptived_rule *rule;
+	int cnt = 0;
+
+	if (!pool)
+		return -EINVAL;
+
+	rule = rules;
+	while (rule) {
+		if (rule->due)
+			cnt++;
+		rule = rule->next;
+	}
+
+	if (cnt == 0)
+		return 0;
+
+	pthread_mutex_lock(&pool->mutex);
+
+	/* rules can be loaded and unloaded at runtime, so rebuild the list each loop */
+	if (cnt > pool->rules_len) {
+		tmp_rules = realloc(pool->rules, sizeof(struct adaptived_rule *) * cnt);
+		if (!tmp_rules) {
+			pthread_mutex_unlock(&pool->mutex);
+			return -ENOMEM;
+		}
+
+		pool->rules = tmp_rules;
+		pool->rules_len = cnt;
+	}
+
+	cnt = 0;
+	rule = rules;
+	while (rule) {
+		if (rule->due) {
+			pool->rules[cnt] = rule;
+			cnt++;
+		}
+		rule = rule->next;
+	}
+
+	pool->rule_cnt = cnt;
+	pool->next_rule = 0;
+	pool->done_cnt = 0;
+	pool->generation++;
+	pthread_cond_broadcast(&pool->work_cond);
+
+	/* lend a hand rather than sit idle */
+	worker_pool_drain(pool);
+
+	while (pool->done_cnt < pool->rule_cnt)
+		pthread_cond_wait(&pool->done_cond, &pool->mutex);
+
+	pthread_mutex_unlock(&pool->mutex);
+
+	return 0;
+}
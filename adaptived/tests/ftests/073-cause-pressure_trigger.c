@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2025, Oracle and/or its affiliates.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * You should have received a copy of the GNU General Public License version
+ * 2 along with this work; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Please contact Oracle, 500 Oracle Parkway, Redwood Shores, CA 94065 USA
+ * or visit www.oracle.com if you need additional information or have any
+ * questions.
+ */
+/**
+ * Test to verify the pressure cause registers a PSI trigger
+ *
+ * A regular file never raises POLLPRI, so the trigger should be written to the file
+ * and the rule should never fire
+ */
+
+#include <syslog.h>
+#include <errno.h>
+
+#include <adaptived.h>
+
+#include "ftests.h"
+
+static const char * const rule_name = "pressure trigger test";
+static const char * const pressure_file = "073-cause-pressure_trigger.pressure";
+static const char * const expected_trigger = "some 150000 1000000";
+
+int main(int argc, char *argv[])
+{
+	struct adaptived_rule_stats stats;
+	char config_path[FILENAME_MAX];
+	struct adaptived_ctx *ctx;
+	int ret;
+
+	snprintf(config_path, FILENAME_MAX - 1, "%s/073-cause-pressure_trigger.json", argv[1]);
+	config_path[FILENAME_MAX - 1] = '\0';
+
+	write_file(pressure_file, "");
+
+	ctx = adaptived_init(config_path);
+	if (!ctx)
+		goto err;
+
+	ret = adaptived_set_attr(ctx, ADAPTIVED_ATTR_LOG_LEVEL, LOG_DEBUG);
+	if (ret)
+		goto err;
+	ret = adaptived_set_attr(ctx, ADAPTIVED_ATTR_INTERVAL, 100);
+	if (ret)
+		goto err;
+	ret = adaptived_set_attr(ctx, ADAPTIVED_ATTR_MAX_LOOPS, 3);
+	if (ret)
+		goto err;
+
+	ret = adaptived_loop(ctx, true);
+	if (ret != -ETIME)
+		goto err;
+
+	ret = verify_char_file(pressure_file, expected_trigger);
+	if (ret)
+		goto err;
+
+	ret = adaptived_get_rule_stats(ctx, rule_name, &stats);
+	if (ret)
+		goto err;
+	if (stats.loops_run_cnt != 3)
+		goto err;
+	if (stats.trigger_cnt != 0)
+		goto err;
+
+	adaptived_release(&ctx);
+	delete_file(pressure_file);
+
+	return AUTOMAKE_PASSED;
+
+err:
+	if (ctx)
+		adaptived_release(&ctx);
+	delete_file(pressure_file);
+
+	return AUTOMAKE_HARD_ERROR;
+}
@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2025, Oracle and/or its affiliates.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * You should have received a copy of the GNU General Public License version
+ * 2 along with this work; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Please contact Oracle, 500 Oracle Parkway, Redwood Shores, CA 94065 USA
+ * or visit www.oracle.com if you need additional information or have any
+ * questions.
+ */
+/**
+ * Test to evaluate the causes of several rules concurrently via the worker pool
+ * and verify that the effects are still applied in rule order
+ *
+ */
+
+#include <json-c/json.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+
+#include <adaptived.h>
+
+#include "ftests.h"
+
+#define RULE_CNT 4
+#define LOOP_CNT 2
+#define CAUSE_SLEEP_MS 250
+
+/*
+ * If the causes were evaluated serially, the loops would take
+ * RULE_CNT * LOOP_CNT * CAUSE_SLEEP_MS = 2000 ms
+ */
+#define MAX_ELAPSED_MS 1500
+
+static const char * const rule_names[] = {
+	"rule 1",
+	"rule 2",
+	"rule 3",
+	"rule 4",
+};
+
+static int effect_order[RULE_CNT * LOOP_CNT];
+static int effect_cnt;
+
+static int slow_cause_init(struct adaptived_cause * const cse, struct json_object *args_obj,
+			   int interval)
+{
+	return 0;
+}
+
+static int slow_cause_main(struct adaptived_cause * const cse, int time_since_last_run)
+{
+	usleep(CAUSE_SLEEP_MS * 1000);
+
+	return 1;
+}
+
+static void slow_cause_exit(struct adaptived_cause * const cse)
+{
+}
+
+static const struct adaptived_cause_functions slow_cause_fns = {
+	slow_cause_init,
+	slow_cause_main,
+	slow_cause_exit,
+};
+
+static int record_effect_init(struct adaptived_effect * const eff, struct json_object *args_obj,
+			      const struct adaptived_cause * const cse)
+{
+	int *id;
+	int ret;
+
+	id = malloc(sizeof(int));
+	if (!id)
+		return -ENOMEM;
+
+	ret = adaptived_parse_int(args_obj, "id", id);
+	if (ret) {
+		free(id);
+		return ret;
+	}
+
+	return adaptived_effect_set_data(eff, id);
+}
+
+static int record_effect_main(struct adaptived_effect * const eff)
+{
+	int *id = adaptived_effect_get_data(eff);
+
+	if (effect_cnt >= RULE_CNT * LOOP_CNT)
+		return -E2BIG;
+
+	effect_order[effect_cnt] = *id;
+	effect_cnt++;
+
+	return 0;
+}
+
+static void record_effect_exit(struct adaptived_effect * const eff)
+{
+	free(adaptived_effect_get_data(eff));
+}
+
+static const struct adaptived_effect_functions record_effect_fns = {
+	record_effect_init,
+	record_effect_main,
+	record_effect_exit,
+};
+
+int main(int argc, char *argv[])
+{
+	struct adaptived_rule_stats stats;
+	char config_path[FILENAME_MAX];
+	struct timespec start, end;
+	struct adaptived_ctx *ctx;
+	uint32_t threads;
+	long elapsed;
+	int ret, i;
+
+	snprintf(config_path, FILENAME_MAX - 1, "%s/074-rule-worker_threads.json", argv[1]);
+	config_path[FILENAME_MAX - 1] = '\0';
+
+	ctx = adaptived_init(config_path);
+	if (!ctx)
+		return AUTOMAKE_HARD_ERROR;
+
+	ret = adaptived_set_attr(ctx, ADAPTIVED_ATTR_LOG_LEVEL, LOG_DEBUG);
+	if (ret)
+		goto err;
+	ret = adaptived_set_attr(ctx, ADAPTIVED_ATTR_MAX_LOOPS, LOOP_CNT);
+	if (ret)
+		goto err;
+	ret = adaptived_set_attr(ctx, ADAPTIVED_ATTR_INTERVAL, 1000);
+	if (ret)
+		goto err;
+	ret = adaptived_set_attr(ctx, ADAPTIVED_ATTR_SKIP_SLEEP, 1);
+	if (ret)
+		goto err;
+	ret = adaptived_set_attr(ctx, ADAPTIVED_ATTR_WORKER_THREADS, RULE_CNT);
+	if (ret)
+		goto err;
+
+	ret = adaptived_get_attr(ctx, ADAPTIVED_ATTR_WORKER_THREADS, &threads);
+	if (ret)
+		goto err;
+	if (threads != RULE_CNT)
+		goto err;
+
+	ret = adaptived_register_cause(ctx, "slow_cause", &slow_cause_fns);
+	if (ret)
+		goto err;
+	ret = adaptived_register_effect(ctx, "record_effect", &record_effect_fns);
+	if (ret)
+		goto err;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	ret = adaptived_loop(ctx, true);
+	if (ret != -ETIME)
+		goto err;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	elapsed = (end.tv_sec - start.tv_sec) * 1000 + (end.tv_nsec - start.tv_nsec) / 1000000;
+	if (elapsed >= MAX_ELAPSED_MS) {
+		adaptived_err("The loops took %ld ms.  Were the causes run serially?\n", elapsed);
+		goto err;
+	}
+
+	if (effect_cnt != RULE_CNT * LOOP_CNT)
+		goto err;
+
+	for (i = 0; i < RULE_CNT * LOOP_CNT; i++) {
+		if (effect_order[i] != (i % RULE_CNT) + 1) {
+			adaptived_err("Effect %d was applied by rule %d\n", i, effect_order[i]);
+			goto err;
+		}
+	}
+
+	for (i = 0; i < RULE_CNT; i++) {
+		ret = adaptived_get_rule_stats(ctx, rule_names[i], &stats);
+		if (ret)
+			goto err;
+
+		if (stats.loops_run_cnt != LOOP_CNT)
+			goto err;
+		if (stats.trigger_cnt != LOOP_CNT)
+			goto err;
+	}
+
+	adaptived_release(&ctx);
+	return AUTOMAKE_PASSED;
+
+err:
+	adaptived_release(&ctx);
+	return AUTOMAKE_HARD_ERROR;
+}
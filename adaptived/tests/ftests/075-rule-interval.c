@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2025, Oracle and/or its affiliates.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * You should have received a copy of the GNU General Public License version
+ * 2 along with this work; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Please contact Oracle, 500 Oracle Parkway, Redwood Shores, CA 94065 USA
+ * or visit www.oracle.com if you need additional information or have any
+ * questions.
+ */
+/**
+ * Test to run rules at their own intervals
+ *
+ */
+
+#include <json-c/json.h>
+#include <syslog.h>
+#include <errno.h>
+
+#include <adaptived.h>
+
+#include "ftests.h"
+
+/*
+ * Relative to the first loop, the rules are due at these times (ms):
+ *	0     - fast, default, slow
+ *	500   - fast
+ *	1000  - fast, default
+ *	1500  - fast
+ *	2000  - fast, default
+ *	2500  - fast
+ *	3000  - fast, default, slow
+ */
+#define LOOP_CNT 7
+
+struct expected_stats {
+	const char * const name;
+	int loops_run_cnt;
+};
+
+static const struct expected_stats expected[] = {
+	{ "fast", 7 },
+	{ "default", 4 },
+	{ "slow", 2 },
+};
+
+static int interval_cause_init(struct adaptived_cause * const cse, struct json_object *args_obj,
+			       int interval)
+{
+	int *expected_interval;
+	int ret;
+
+	expected_interval = malloc(sizeof(int));
+	if (!expected_interval)
+		return -ENOMEM;
+
+	ret = adaptived_parse_int(args_obj, "interval", expected_interval);
+	if (ret) {
+		free(expected_interval);
+		return ret;
+	}
+
+	/* the cause should be initialized with its rule's interval */
+	if (interval != *expected_interval) {
+		free(expected_interval);
+		return -EINVAL;
+	}
+
+	return adaptived_cause_set_data(cse, expected_interval);
+}
+
+static int interval_cause_main(struct adaptived_cause * const cse, int time_since_last_run)
+{
+	int *expected_interval = adaptived_cause_get_data(cse);
+
+	if (time_since_last_run != *expected_interval) {
+		adaptived_err("Expected %d ms since the last run but got %d\n",
+			      *expected_interval, time_since_last_run);
+		return -EINVAL;
+	}
+
+	return 1;
+}
+
+static void interval_cause_exit(struct adaptived_cause * const cse)
+{
+	free(adaptived_cause_get_data(cse));
+}
+
+static const struct adaptived_cause_functions interval_cause_fns = {
+	interval_cause_init,
+	interval_cause_main,
+	interval_cause_exit,
+};
+
+int main(int argc, char *argv[])
+{
+	struct adaptived_rule_stats stats;
+	char config_path[FILENAME_MAX];
+	struct adaptived_ctx *ctx;
+	int ret, i;
+
+	snprintf(config_path, FILENAME_MAX - 1, "%s/075-rule-interval.json", argv[1]);
+	config_path[FILENAME_MAX - 1] = '\0';
+
+	ctx = adaptived_init(config_path);
+	if (!ctx)
+		return AUTOMAKE_HARD_ERROR;
+
+	ret = adaptived_set_attr(ctx, ADAPTIVED_ATTR_LOG_LEVEL, LOG_DEBUG);
+	if (ret)
+		goto err;
+	ret = adaptived_set_attr(ctx, ADAPTIVED_ATTR_MAX_LOOPS, LOOP_CNT);
+	if (ret)
+		goto err;
+	ret = adaptived_set_attr(ctx, ADAPTIVED_ATTR_INTERVAL, 1000);
+	if (ret)
+		goto err;
+	ret = adaptived_set_attr(ctx, ADAPTIVED_ATTR_SKIP_SLEEP, 1);
+	if (ret)
+		goto err;
+
+	ret = adaptived_register_cause(ctx, "interval_cause", &interval_cause_fns);
+	if (ret)
+		goto err;
+
+	ret = adaptived_loop(ctx, true);
+	if (ret != -ETIME)
+		goto err;
+
+	for (i = 0; i < ARRAY_SIZE(expected); i++) {
+		ret = adaptived_get_rule_stats(ctx, expected[i].name, &stats);
+		if (ret)
+			goto err;
+
+		if (stats.loops_run_cnt != expected[i].loops_run_cnt) {
+			adaptived_err("Rule %s ran %lld times.  Expected %d\n", expected[i].name,
+				      stats.loops_run_cnt, expected[i].loops_run_cnt);
+			goto err;
+		}
+		if (stats.trigger_cnt != expected[i].loops_run_cnt)
+			goto err;
+	}
+
+	adaptived_release(&ctx);
+	return AUTOMAKE_PASSED;
+
+err:
+	adaptived_release(&ctx);
+	return AUTOMAKE_HARD_ERROR;
+}
@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2024, Oracle and/or its affiliates.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * You should have received a copy of the GNU General Public License version
+ * 2 along with this work; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Please contact Oracle, 500 Oracle Parkway, Redwood Shores, CA 94065 USA
+ * or visit www.oracle.com if you need additional information or have any
+ * questions.
+ */
+/**
+ * Test that the kill cgroup effect uses cgroup.kill when it's available
+ *
+ * Note that this test creates a fake cgroup hierarchy directly in the
+ * current directory.  Writing to the fake cgroup.kill files won't kill
+ * anything, so the processes should still be alive when the effect is done
+ */
+
+#include <sys/wait.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <syslog.h>
+#include <string.h>
+#include <signal.h>
+#include <errno.h>
+
+#include <adaptived.h>
+
+#include "ftests.h"
+
+#define EXPECTED_RET -ETIME
+
+static const char * const cgroup_dirs[] = {
+	"./test076cgroup",
+	"./test076cgroup/child1",
+};
+static const int cgroup_dirs_cnt = ARRAY_SIZE(cgroup_dirs);
+
+static const char * const cgroup_files[] = {
+	"./test076cgroup/cgroup.procs",
+	"./test076cgroup/cgroup.kill",
+	"./test076cgroup/child1/cgroup.procs",
+	"./test076cgroup/child1/cgroup.kill",
+};
+static const int cgroup_files_cnt = ARRAY_SIZE(cgroup_files);
+
+#define PID_COUNT 4
+static pid_t pids[PID_COUNT];
+
+static void write_cgroup_files(void)
+{
+	char buf[1024] = { '\0' };
+	char pid[16];
+	int i;
+
+	for (i = 0; i < PID_COUNT; i++) {
+		memset(pid, 0, sizeof(pid));
+		sprintf(pid, "%d\n", pids[i]);
+		strcat(buf, pid);
+	}
+
+	write_file(cgroup_files[0], "");
+	write_file(cgroup_files[1], "");
+	write_file(cgroup_files[2], buf);
+	write_file(cgroup_files[3], "");
+}
+
+int main(int argc, char *argv[])
+{
+	char config_path[FILENAME_MAX];
+	struct adaptived_ctx *ctx = NULL;
+	int ret, i;
+
+	snprintf(config_path, FILENAME_MAX - 1, "%s/076-effect-kill_cgroup-cgroup_kill.json",
+		 argv[1]);
+	config_path[FILENAME_MAX - 1] = '\0';
+
+	ctx = adaptived_init(config_path);
+	if (!ctx)
+		return AUTOMAKE_HARD_ERROR;
+
+	ret = create_dirs(cgroup_dirs, cgroup_dirs_cnt);
+	if (ret)
+		goto err;
+	ret = create_pids(pids, PID_COUNT, DEFAULT_SLEEP);
+	if (ret)
+		goto err;
+	write_cgroup_files();
+
+	ret = adaptived_set_attr(ctx, ADAPTIVED_ATTR_MAX_LOOPS, 2);
+	if (ret)
+		goto err;
+	ret = adaptived_set_attr(ctx, ADAPTIVED_ATTR_INTERVAL, 7000);
+	if (ret)
+		goto err;
+	ret = adaptived_set_attr(ctx, ADAPTIVED_ATTR_SKIP_SLEEP, 1);
+	if (ret)
+		goto err;
+	ret = adaptived_set_attr(ctx, ADAPTIVED_ATTR_LOG_LEVEL, LOG_DEBUG);
+	if (ret)
+		goto err;
+
+	ret = adaptived_loop(ctx, true);
+	if (ret != EXPECTED_RET) {
+		adaptived_err("Test 076 returned: %d, expected: %d\n", ret, EXPECTED_RET);
+		goto err;
+	}
+
+	/* the whole hierarchy is killed via the top cgroup's cgroup.kill */
+	ret = verify_char_file(cgroup_files[1], "1");
+	if (ret)
+		goto err;
+
+	/* write_file() writes a newline for empty contents */
+	ret = verify_char_file(cgroup_files[3], "\n");
+	if (ret) {
+		adaptived_err("The child's cgroup.kill was unexpectedly written\n");
+		goto err;
+	}
+
+	/* the processes weren't signaled individually */
+	for (i = 0; i < PID_COUNT; i++) {
+		if (kill(pids[i], 0) < 0) {
+			adaptived_err("pid %d was unexpectedly killed\n", pids[i]);
+			goto err;
+		}
+	}
+
+	kill_pids(pids, PID_COUNT);
+	wait_for_pids(pids, PID_COUNT);
+
+	delete_files(cgroup_files, cgroup_files_cnt);
+	delete_dirs(cgroup_dirs, cgroup_dirs_cnt);
+	adaptived_release(&ctx);
+
+	return AUTOMAKE_PASSED;
+
+err:
+	kill_pids(pids, PID_COUNT);
+	delete_files(cgroup_files, cgroup_files_cnt);
+	delete_dirs(cgroup_dirs, cgroup_dirs_cnt);
+	adaptived_release(&ctx);
+
+	return AUTOMAKE_HARD_ERROR;
+}
@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2025, Oracle and/or its affiliates.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * You should have received a copy of the GNU General Public License version
+ * 2 along with this work; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Please contact Oracle, 500 Oracle Parkway, Redwood Shores, CA 94065 USA
+ * or visit www.oracle.com if you need additional information or have any
+ * questions.
+ */
+/**
+ * Test that the logger effect rotates its log once it reaches rotate_size
+ */
+
+#include <sys/stat.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <syslog.h>
+#include <string.h>
+#include <errno.h>
+
+#include <adaptived.h>
+
+#include "ftests.h"
+
+#define EXPECTED_RET -ETIME
+
+static const char * const test_file = "test077_test_file.txt";
+static const char * const log_file = "test077.log";
+static const char * const log_file1 = "test077.log.1";
+static const char * const log_file2 = "test077.log.2";
+static const char * const log_file3 = "test077.log.3";
+static const char * const test_contents = "This file is larger than the rotate_size of the log";
+/* each snapshot is an empty separator line, the file name, and the file's contents */
+static const char * const expected_contents =
+	"\n\ntest077_test_file.txt\nThis file is larger than the rotate_size of the log";
+
+static void cleanup(void)
+{
+	delete_file(test_file);
+	delete_file(log_file);
+	delete_file(log_file1);
+	delete_file(log_file2);
+	delete_file(log_file3);
+}
+
+int main(int argc, char *argv[])
+{
+	char config_path[FILENAME_MAX];
+	struct adaptived_ctx *ctx = NULL;
+	struct stat statbuf;
+	int ret;
+
+	snprintf(config_path, FILENAME_MAX - 1, "%s/077-effect-logger-rotate.json", argv[1]);
+	config_path[FILENAME_MAX - 1] = '\0';
+
+	cleanup();
+	write_file(test_file, test_contents);
+
+	ctx = adaptived_init(config_path);
+	if (!ctx)
+		goto err;
+
+	ret = adaptived_set_attr(ctx, ADAPTIVED_ATTR_MAX_LOOPS, 4);
+	if (ret)
+		goto err;
+	ret = adaptived_set_attr(ctx, ADAPTIVED_ATTR_INTERVAL, 1000);
+	if (ret)
+		goto err;
+	ret = adaptived_set_attr(ctx, ADAPTIVED_ATTR_SKIP_SLEEP, 1);
+	if (ret)
+		goto err;
+	ret = adaptived_set_attr(ctx, ADAPTIVED_ATTR_LOG_LEVEL, LOG_DEBUG);
+	if (ret)
+		goto err;
+
+	ret = adaptived_loop(ctx, true);
+	if (ret != EXPECTED_RET) {
+		adaptived_err("Test 077 returned: %d, expected: %d\n", ret, EXPECTED_RET);
+		goto err;
+	}
+
+	/*
+	 * Every snapshot is larger than the rotate_size, so the log is rotated after
+	 * each one.  Only the two most recent snapshots are kept
+	 */
+	if (stat(log_file, &statbuf) || statbuf.st_size != 0) {
+		adaptived_err("%s should be empty\n", log_file);
+		goto err;
+	}
+
+	ret = verify_char_file(log_file1, expected_contents);
+	if (ret)
+		goto err;
+	ret = verify_char_file(log_file2, expected_contents);
+	if (ret)
+		goto err;
+
+	if (access(log_file3, F_OK) == 0) {
+		adaptived_err("%s should have been discarded\n", log_file3);
+		goto err;
+	}
+
+	adaptived_release(&ctx);
+	cleanup();
+
+	return AUTOMAKE_PASSED;
+
+err:
+	if (ctx)
+		adaptived_release(&ctx);
+	cleanup();
+
+	return AUTOMAKE_HARD_ERROR;
+}
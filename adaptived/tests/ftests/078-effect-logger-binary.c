@@ -0,0 +1,253 @@
+/*
+ * Copyright (c) 2025, Oracle and/or its affiliates.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * You should have received a copy of the GNU General Public License version
+ * 2 along with this work; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Please contact Oracle, 500 Oracle Parkway, Redwood Shores, CA 94065 USA
+ * or visit www.oracle.com if you need additional information or have any
+ * questions.
+ */
+/**
+ * Test the logger effect's binary format
+ */
+
+#include <sys/stat.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <syslog.h>
+#include <string.h>
+#include <errno.h>
+
+#include <adaptived.h>
+
+#include "binlog.h"
+#include "ftests.h"
+
+#define EXPECTED_RET -ETIME
+#define LOOPS 2
+
+static const char * const pressure_file = "test078_pressure";
+static const char * const meminfo_file = "test078_meminfo";
+static const char * const raw_file = "test078_raw.txt";
+static const char * const log_file = "test078.log";
+
+static const char * const pressure_contents =
+	"some avg10=1.23 avg60=4.56 avg300=7.89 total=1000\n"
+	"full avg10=0.50 avg60=0.00 avg300=0.00 total=20\n";
+static const char * const meminfo_contents =
+	"MemTotal:        1000 kB\n"
+	"MemFree:          500 kB\n";
+static const char * const raw_contents = "These bytes are logged as is";
+
+static const enum binlog_record_type expected_types[] = {
+	BINLOG_PRESSURE,
+	BINLOG_MEMINFO,
+	BINLOG_RAW,
+};
+
+static void cleanup(void)
+{
+	delete_file(pressure_file);
+	delete_file(meminfo_file);
+	delete_file(raw_file);
+	delete_file(log_file);
+}
+
+static int read_log(char ** const bufp, size_t * const lenp)
+{
+	struct stat statbuf;
+	FILE *f;
+
+	if (stat(log_file, &statbuf))
+		return -errno;
+
+	*bufp = malloc(statbuf.st_size);
+	if (!*bufp)
+		return -ENOMEM;
+
+	f = fopen(log_file, "r");
+	if (!f)
+		return -errno;
+
+	*lenp = fread(*bufp, 1, statbuf.st_size, f);
+	fclose(f);
+
+	if (*lenp != statbuf.st_size)
+		return -EIO;
+
+	return 0;
+}
+
+static int verify_record(const struct binlog_record * const rec)
+{
+	const struct binlog_pressure *pressure;
+	const struct binlog_meminfo *meminfo;
+	const struct binlog_raw *raw;
+	const uint64_t *values;
+
+	switch (rec->type) {
+	case BINLOG_PRESSURE:
+		pressure = (const struct binlog_pressure *)&rec[1];
+		if (pressure->some.avg10 != 123 || pressure->some.avg60 != 456 ||
+		    pressure->some.avg300 != 789 || pressure->some.total != 1000 ||
+		    pressure->full.avg10 != 50 || pressure->full.total != 20 ||
+		    strcmp((const char *)&pressure[1], pressure_file) != 0) {
+			adaptived_err("Unexpected pressure record\n");
+			return -EINVAL;
+		}
+		break;
+	case BINLOG_MEMINFO:
+		meminfo = (const struct binlog_meminfo *)&rec[1];
+		values = (const uint64_t *)&meminfo[1];
+		if (meminfo->nr_fields != BINLOG_MEMINFO_CNT || values[0] != 1000 ||
+		    values[1] != 500 || values[2] != BINLOG_MEMINFO_MISSING) {
+			adaptived_err("Unexpected meminfo record\n");
+			return -EINVAL;
+		}
+		break;
+	case BINLOG_RAW:
+		raw = (const struct binlog_raw *)&rec[1];
+		if (raw->data_len != strlen(raw_contents) ||
+		    strcmp((const char *)&raw[1], raw_file) != 0 ||
+		    memcmp((const char *)&raw[1] + raw->path_len, raw_contents,
+			   raw->data_len) != 0) {
+			adaptived_err("Unexpected raw record\n");
+			return -EINVAL;
+		}
+		break;
+	default:
+		adaptived_err("Unexpected record type %u\n", rec->type);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int verify_log(void)
+{
+	const struct binlog_header *hdr;
+	const struct binlog_record *rec;
+	uint64_t realtime_ns = 0;
+	size_t len, offset;
+	char *buf = NULL;
+	int ret, cnt = 0;
+
+	ret = read_log(&buf, &len);
+	if (ret)
+		goto out;
+
+	ret = -EINVAL;
+
+	hdr = (const struct binlog_header *)buf;
+	if (len < sizeof(*hdr) || memcmp(hdr->magic, BINLOG_MAGIC, BINLOG_MAGIC_LEN) != 0 ||
+	    hdr->version != BINLOG_VERSION || hdr->byte_order != BINLOG_BYTE_ORDER) {
+		adaptived_err("Invalid binary log header\n");
+		goto out;
+	}
+
+	for (offset = sizeof(*hdr); offset < len; offset += rec->len, cnt++) {
+		rec = (const struct binlog_record *)&buf[offset];
+		if (len - offset < sizeof(*rec) || rec->len > len - offset ||
+		    rec->len % BINLOG_ALIGN) {
+			adaptived_err("Truncated record at offset %zu\n", offset);
+			goto out;
+		}
+
+		if (rec->type != expected_types[cnt % ARRAY_SIZE(expected_types)]) {
+			adaptived_err("Record %d is type %u\n", cnt, rec->type);
+			goto out;
+		}
+
+		/* every record in a snapshot has the same timestamp */
+		if (cnt % ARRAY_SIZE(expected_types) == 0)
+			realtime_ns = rec->realtime_ns;
+		else if (rec->realtime_ns != realtime_ns) {
+			adaptived_err("Record %d has a different timestamp\n", cnt);
+			goto out;
+		}
+
+		if (verify_record(rec))
+			goto out;
+	}
+
+	if (cnt != LOOPS * ARRAY_SIZE(expected_types)) {
+		adaptived_err("Expected %ld records but found %d\n",
+			      LOOPS * ARRAY_SIZE(expected_types), cnt);
+		goto out;
+	}
+
+	ret = 0;
+
+out:
+	if (buf)
+		free(buf);
+
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	char config_path[FILENAME_MAX];
+	struct adaptived_ctx *ctx = NULL;
+	int ret;
+
+	snprintf(config_path, FILENAME_MAX - 1, "%s/078-effect-logger-binary.json", argv[1]);
+	config_path[FILENAME_MAX - 1] = '\0';
+
+	cleanup();
+	write_file(pressure_file, pressure_contents);
+	write_file(meminfo_file, meminfo_contents);
+	write_file(raw_file, raw_contents);
+
+	ctx = adaptived_init(config_path);
+	if (!ctx)
+		goto err;
+
+	ret = adaptived_set_attr(ctx, ADAPTIVED_ATTR_MAX_LOOPS, LOOPS);
+	if (ret)
+		goto err;
+	ret = adaptived_set_attr(ctx, ADAPTIVED_ATTR_INTERVAL, 1000);
+	if (ret)
+		goto err;
+	ret = adaptived_set_attr(ctx, ADAPTIVED_ATTR_SKIP_SLEEP, 1);
+	if (ret)
+		goto err;
+	ret = adaptived_set_attr(ctx, ADAPTIVED_ATTR_LOG_LEVEL, LOG_DEBUG);
+	if (ret)
+		goto err;
+
+	ret = adaptived_loop(ctx, true);
+	if (ret != EXPECTED_RET) {
+		adaptived_err("Test 078 returned: %d, expected: %d\n", ret, EXPECTED_RET);
+		goto err;
+	}
+
+	ret = verify_log();
+	if (ret)
+		goto err;
+
+	adaptived_release(&ctx);
+	cleanup();
+
+	return AUTOMAKE_PASSED;
+
+err:
+	if (ctx)
+		adaptived_release(&ctx);
+	cleanup();
+
+	return AUTOMAKE_HARD_ERROR;
+}
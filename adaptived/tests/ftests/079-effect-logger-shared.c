@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2025, Oracle and/or its affiliates.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * You should have received a copy of the GNU General Public License version
+ * 2 along with this work; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Please contact Oracle, 500 Oracle Parkway, Redwood Shores, CA 94065 USA
+ * or visit www.oracle.com if you need additional information or have any
+ * questions.
+ */
+/**
+ * Test that logger effects sharing a logfile append whole snapshots, in the order
+ * they were taken
+ */
+
+#include <stdbool.h>
+#include <unistd.h>
+#include <syslog.h>
+#include <string.h>
+#include <errno.h>
+
+#include <adaptived.h>
+
+#include "ftests.h"
+
+#define EXPECTED_RET -ETIME
+
+static const char * const file_a = "test079_file_a.txt";
+static const char * const file_b = "test079_file_b.txt";
+static const char * const log_file = "test079.log";
+static const char * const contents_a = "The first rule logs this file";
+static const char * const contents_b = "The second rule logs this one";
+/* each rule runs twice, and each snapshot is a separator, the file name, and the file */
+static const char * const expected_contents =
+	"\n\ntest079_file_a.txt\nThe first rule logs this file"
+	"\n\ntest079_file_b.txt\nThe second rule logs this one"
+	"\n\ntest079_file_a.txt\nThe first rule logs this file"
+	"\n\ntest079_file_b.txt\nThe second rule logs this one";
+
+static void cleanup(void)
+{
+	delete_file(file_a);
+	delete_file(file_b);
+	delete_file(log_file);
+}
+
+int main(int argc, char *argv[])
+{
+	char config_path[FILENAME_MAX];
+	struct adaptived_ctx *ctx = NULL;
+	int ret;
+
+	snprintf(config_path, FILENAME_MAX - 1, "%s/079-effect-logger-shared.json", argv[1]);
+	config_path[FILENAME_MAX - 1] = '\0';
+
+	cleanup();
+	write_file(file_a, contents_a);
+	write_file(file_b, contents_b);
+
+	ctx = adaptived_init(config_path);
+	if (!ctx)
+		goto err;
+
+	ret = adaptived_set_attr(ctx, ADAPTIVED_ATTR_MAX_LOOPS, 2);
+	if (ret)
+		goto err;
+	ret = adaptived_set_attr(ctx, ADAPTIVED_ATTR_INTERVAL, 1000);
+	if (ret)
+		goto err;
+	ret = adaptived_set_attr(ctx, ADAPTIVED_ATTR_SKIP_SLEEP, 1);
+	if (ret)
+		goto err;
+	ret = adaptived_set_attr(ctx, ADAPTIVED_ATTR_LOG_LEVEL, LOG_DEBUG);
+	if (ret)
+		goto err;
+
+	ret = adaptived_loop(ctx, true);
+	if (ret != EXPECTED_RET) {
+		adaptived_err("Test 079 returned: %d, expected: %d\n", ret, EXPECTED_RET);
+		goto err;
+	}
+
+	ret = verify_char_file(log_file, expected_contents);
+	if (ret)
+		goto err;
+
+	adaptived_release(&ctx);
+	cleanup();
+
+	return AUTOMAKE_PASSED;
+
+err:
+	if (ctx)
+		adaptived_release(&ctx);
+	cleanup();
+
+	return AUTOMAKE_HARD_ERROR;
+}
@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2025, Oracle and/or its affiliates.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * You should have received a copy of the GNU General Public License version
+ * 2 along with this work; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Please contact Oracle, 500 Oracle Parkway, Redwood Shores, CA 94065 USA
+ * or visit www.oracle.com if you need additional information or have any
+ * questions.
+ */
+/**
+ * Test that a PSI trigger wakes adaptived_loop() and fires the pressure cause
+ *
+ * More threads than CPUs spin so that runnable tasks stall on the CPU, which raises
+ * POLLPRI on the trigger well before the rule's interval expires.  The trigger
+ * window is 2 seconds, since without CAP_SYS_RESOURCE the kernel only accepts
+ * windows that are a multiple of 2 seconds
+ */
+
+#include <stdbool.h>
+#include <pthread.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+
+#include <adaptived.h>
+
+#include "ftests.h"
+
+#define EXPECTED_RET -1008
+/* the rule would next run on its own after this many milliseconds */
+#define INTERVAL 10000
+
+static volatile bool spin = true;
+
+static void *spinner(void *arg)
+{
+	while (spin)
+		;
+
+	return NULL;
+}
+
+static long long now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+int main(int argc, char *argv[])
+{
+	pthread_t *threads = NULL;
+	char config_path[FILENAME_MAX];
+	struct adaptived_ctx *ctx = NULL;
+	int ret, i, thread_cnt = 0;
+	long long start, elapsed;
+
+	snprintf(config_path, FILENAME_MAX - 1, "%s/1008-sudo-cause-pressure_trigger.json",
+		 argv[1]);
+	config_path[FILENAME_MAX - 1] = '\0';
+
+	ctx = adaptived_init(config_path);
+	if (!ctx)
+		return AUTOMAKE_HARD_ERROR;
+
+	ret = adaptived_set_attr(ctx, ADAPTIVED_ATTR_MAX_LOOPS, 3);
+	if (ret)
+		goto err;
+	ret = adaptived_set_attr(ctx, ADAPTIVED_ATTR_INTERVAL, INTERVAL);
+	if (ret)
+		goto err;
+	ret = adaptived_set_attr(ctx, ADAPTIVED_ATTR_LOG_LEVEL, LOG_DEBUG);
+	if (ret)
+		goto err;
+
+	threads = malloc(sizeof(pthread_t) * (sysconf(_SC_NPROCESSORS_ONLN) * 2 + 1));
+	if (!threads)
+		goto err;
+
+	for (i = 0; i < sysconf(_SC_NPROCESSORS_ONLN) * 2 + 1; i++) {
+		ret = pthread_create(&threads[i], NULL, spinner, NULL);
+		if (ret)
+			goto err;
+		thread_cnt++;
+	}
+
+	/*
+	 * The rule runs once at startup without an event.  The loop must then be
+	 * woken by POLLPRI, rather than the interval, for the cause to fire
+	 */
+	start = now_ms();
+	ret = adaptived_loop(ctx, true);
+	elapsed = now_ms() - start;
+	if (ret != EXPECTED_RET) {
+		adaptived_err("Test 1008 returned: %d, expected: %d\n", ret, EXPECTED_RET);
+		goto err;
+	}
+	if (elapsed >= INTERVAL) {
+		adaptived_err("Test 1008 took %lld ms.  The trigger didn't wake the loop\n",
+			      elapsed);
+		goto err;
+	}
+
+	spin = false;
+	for (i = 0; i < thread_cnt; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+	adaptived_release(&ctx);
+
+	return AUTOMAKE_PASSED;
+
+err:
+	spin = false;
+	for (i = 0; i < thread_cnt; i++)
+		pthread_join(threads[i], NULL);
+	if (threads)
+		free(threads);
+	if (ctx)
+		adaptived_release(&ctx);
+
+	return AUTOMAKE_HARD_ERROR;
+}
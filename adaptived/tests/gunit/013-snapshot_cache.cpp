@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2024, Oracle and/or its affiliates.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * You should have received a copy of the GNU General Public License version
+ * 2 along with this work; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Please contact Oracle, 500 Oracle Parkway, Redwood Shores, CA 94065 USA
+ * or visit www.oracle.com if you need additional information or have any
+ * questions.
+ */
+/**
+ * adaptived googletest for the snapshot cache in src/utils/file_utils.c
+ */
+
+#include <adaptived-utils.h>
+#include <adaptived.h>
+
+#include "adaptived-internal.h"
+#include "gtest/gtest.h"
+
+static const char * const meminfo_file = "./test013.meminfo";
+
+static void CreateFile(const char * const filename, const char * const contents)
+{
+	FILE *f;
+
+	f = fopen(filename, "w");
+	ASSERT_NE(f, nullptr);
+
+	fprintf(f, "%s", contents);
+	fclose(f);
+}
+
+class SnapshotCacheTest : public ::testing::Test {
+	protected:
+
+	void SetUp() override {
+		CreateFile(meminfo_file, "MemTotal:       1000 kB\nMemFree:         500 kB\n");
+	}
+
+	void TearDown() override {
+		snapshot_cache_stop();
+		remove(meminfo_file);
+	}
+};
+
+TEST_F(SnapshotCacheTest, Inactive)
+{
+	long long value;
+	int ret;
+
+	ret = adaptived_get_meminfo_field(meminfo_file, "MemFree", &value);
+	ASSERT_EQ(ret, 0);
+	ASSERT_EQ(value, 500 * 1024);
+
+	CreateFile(meminfo_file, "MemTotal:       1000 kB\nMemFree:         250 kB\n");
+
+	ret = adaptived_get_meminfo_field(meminfo_file, "MemFree", &value);
+	ASSERT_EQ(ret, 0);
+	ASSERT_EQ(value, 250 * 1024);
+}
+
+TEST_F(SnapshotCacheTest, CachedUntilInvalidated)
+{
+	long long value;
+	int ret;
+
+	snapshot_cache_start();
+
+	ret = adaptived_get_meminfo_field(meminfo_file, "MemFree", &value);
+	ASSERT_EQ(ret, 0);
+	ASSERT_EQ(value, 500 * 1024);
+
+	CreateFile(meminfo_file, "MemTotal:       1000 kB\nMemFree:         250 kB\n");
+
+	/* the snapshot is still valid, so the old contents are returned */
+	ret = adaptived_get_meminfo_field(meminfo_file, "MemFree", &value);
+	ASSERT_EQ(ret, 0);
+	ASSERT_EQ(value, 500 * 1024);
+	ret = adaptived_get_meminfo_field(meminfo_file, "MemTotal", &value);
+	ASSERT_EQ(ret, 0);
+	ASSERT_EQ(value, 1000 * 1024);
+
+	snapshot_cache_invalidate();
+
+	ret = adaptived_get_meminfo_field(meminfo_file, "MemFree", &value);
+	ASSERT_EQ(ret, 0);
+	ASSERT_EQ(value, 250 * 1024);
+}
+
+TEST_F(SnapshotCacheTest, MissingFile)
+{
+	long long value;
+	int ret;
+
+	snapshot_cache_start();
+
+	ret = adaptived_get_meminfo_field("./test013.does_not_exist", "MemFree", &value);
+	ASSERT_EQ(ret, -ENOENT);
+}
+
+TEST_F(SnapshotCacheTest, LargeFile)
+{
+	char line[64];
+	long long value;
+	FILE *f;
+	int i;
+
+	f = fopen(meminfo_file, "w");
+	ASSERT_NE(f, nullptr);
+
+	/* exceed the initial snapshot buffer size to exercise the realloc path */
+	for (i = 0; i < 1000; i++) {
+		snprintf(line, sizeof(line), "Field%04d:       %d kB\n", i, i);
+		fprintf(f, "%s", line);
+	}
+	fclose(f);
+
+	snapshot_cache_start();
+
+	ASSERT_EQ(adaptived_get_meminfo_field(meminfo_file, "Field0999", &value), 0);
+	ASSERT_EQ(value, 999 * 1024);
+	ASSERT_EQ(adaptived_get_meminfo_field(meminfo_file, "Field0000", &value), 0);
+	ASSERT_EQ(value, 0);
+}
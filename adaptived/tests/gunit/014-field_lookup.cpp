@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2024, Oracle and/or its affiliates.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * You should have received a copy of the GNU General Public License version
+ * 2 along with this work; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Please contact Oracle, 500 Oracle Parkway, Redwood Shores, CA 94065 USA
+ * or visit www.oracle.com if you need additional information or have any
+ * questions.
+ */
+/**
+ * adaptived googletest for the keyed field lookups in src/utils/file_utils.c
+ */
+
+#include <adaptived-utils.h>
+#include <adaptived.h>
+
+#include "adaptived-internal.h"
+#include "gtest/gtest.h"
+
+static const char * const meminfo_file = "./test014.meminfo";
+static const char * const memorystat_file = "./test014.memory.stat";
+
+static const char * const meminfo_contents =
+	"MemTotal:       1000 kB\n"
+	"SwapCached:       10 kB\n"
+	"Cached:          200 kB\n"
+	"Active(anon):     30 kB\n"
+	"HugePages_Total:   4\n"
+	"Bogus:          abcd kB\n"
+	"Hugepagesize:      2 MB\n"
+	"DirectMap1G:       1 gb";
+
+static const char * const memorystat_contents =
+	"anon 4096\n"
+	"file 8192\n"
+	"file_mapped 1024\n"
+	"anon_thp 0\n";
+
+static void CreateFile(const char * const filename, const char * const contents)
+{
+	FILE *f;
+
+	f = fopen(filename, "w");
+	ASSERT_NE(f, nullptr);
+
+	fprintf(f, "%s", contents);
+	fclose(f);
+}
+
+class FieldLookupTest : public ::testing::Test {
+	protected:
+
+	void SetUp() override {
+		CreateFile(meminfo_file, meminfo_contents);
+		CreateFile(memorystat_file, memorystat_contents);
+	}
+
+	void TearDown() override {
+		snapshot_cache_stop();
+		remove(meminfo_file);
+		remove(memorystat_file);
+	}
+};
+
+static void VerifyMeminfo(void)
+{
+	long long value;
+
+	ASSERT_EQ(adaptived_get_meminfo_field(meminfo_file, "MemTotal", &value), 0);
+	ASSERT_EQ(value, 1000 * 1024);
+	ASSERT_EQ(adaptived_get_meminfo_field(meminfo_file, "Cached", &value), 0);
+	ASSERT_EQ(value, 200 * 1024);
+	ASSERT_EQ(adaptived_get_meminfo_field(meminfo_file, "SwapCached", &value), 0);
+	ASSERT_EQ(value, 10 * 1024);
+	ASSERT_EQ(adaptived_get_meminfo_field(meminfo_file, "Active(anon)", &value), 0);
+	ASSERT_EQ(value, 30 * 1024);
+	ASSERT_EQ(adaptived_get_meminfo_field(meminfo_file, "HugePages_Total", &value), 0);
+	ASSERT_EQ(value, 4);
+	ASSERT_EQ(adaptived_get_meminfo_field(meminfo_file, "DirectMap1G", &value), 0);
+	ASSERT_EQ(value, 1024 * 1024 * 1024);
+
+	ASSERT_EQ(adaptived_get_meminfo_field(meminfo_file, "Bogus", &value), -EINVAL);
+	ASSERT_EQ(adaptived_get_meminfo_field(meminfo_file, "Mem", &value), -ENOENT);
+	ASSERT_EQ(adaptived_get_meminfo_field(meminfo_file, "MemTotal:", &value), -ENOENT);
+}
+
+TEST_F(FieldLookupTest, Meminfo)
+{
+	VerifyMeminfo();
+}
+
+TEST_F(FieldLookupTest, MeminfoCached)
+{
+	snapshot_cache_start();
+	VerifyMeminfo();
+}
+
+TEST_F(FieldLookupTest, MemoryStat)
+{
+	long long value;
+
+	ASSERT_EQ(adaptived_cgroup_get_memorystat_field(memorystat_file, "file_mapped", &value), 0);
+	ASSERT_EQ(value, 1024);
+	ASSERT_EQ(adaptived_cgroup_get_memorystat_field(memorystat_file, "file", &value), 0);
+	ASSERT_EQ(value, 8192);
+	ASSERT_EQ(adaptived_cgroup_get_memorystat_field(memorystat_file, "anon_thp", &value), 0);
+	ASSERT_EQ(value, 0);
+	ASSERT_EQ(adaptived_cgroup_get_memorystat_field(memorystat_file, "anon", &value), 0);
+	ASSERT_EQ(value, 4096);
+	ASSERT_EQ(adaptived_cgroup_get_memorystat_field(memorystat_file, "shmem", &value),
+		  -ENOENT);
+}
+
+TEST_F(FieldLookupTest, MissingFile)
+{
+	long long value;
+
+	ASSERT_EQ(adaptived_get_meminfo_field("./test014.does_not_exist", "MemTotal", &value),
+		  -ENOENT);
+}
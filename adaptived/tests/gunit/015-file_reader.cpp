@@ -0,0 +1,260 @@
+/*
+ * Copyright (c) 2024, Oracle and/or its affiliates.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * You should have received a copy of the GNU General Public License version
+ * 2 along with this work; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Please contact Oracle, 500 Oracle Parkway, Redwood Shores, CA 94065 USA
+ * or visit www.oracle.com if you need additional information or have any
+ * questions.
+ */
+/**
+ * adaptived googletest for the persistent file reader in src/utils/file_utils.c
+ */
+
+#include <string.h>
+
+#include <adaptived-utils.h>
+#include <adaptived.h>
+
+#include "adaptived-internal.h"
+#include "gtest/gtest.h"
+
+static const char * const reader_file = "./test015.file";
+
+static void CreateFile(const char * const filename, const char * const contents)
+{
+	FILE *f;
+
+	f = fopen(filename, "w");
+	ASSERT_NE(f, nullptr);
+
+	fprintf(f, "%s", contents);
+	fclose(f);
+}
+
+class FileReaderTest : public ::testing::Test {
+	protected:
+
+	void SetUp() override {
+		reader = NULL;
+	}
+
+	void TearDown() override {
+		file_reader_close(&reader);
+		remove(reader_file);
+	}
+
+	struct file_reader *reader;
+};
+
+TEST_F(FileReaderTest, RereadsFile)
+{
+	size_t len;
+	char *buf;
+	int ret;
+
+	CreateFile(reader_file, "first\n");
+
+	ret = file_reader_open(reader_file, 0, &reader);
+	ASSERT_EQ(ret, 0);
+
+	ret = file_reader_read(reader, &buf, &len);
+	ASSERT_EQ(ret, 0);
+	ASSERT_EQ(len, strlen("first\n"));
+	ASSERT_STREQ(buf, "first\n");
+
+	/* fopen("w") truncates the same inode, so the open descriptor sees the update */
+	CreateFile(reader_file, "2nd\n");
+
+	ret = file_reader_read(reader, &buf, &len);
+	ASSERT_EQ(ret, 0);
+	ASSERT_EQ(len, strlen("2nd\n"));
+	ASSERT_STREQ(buf, "2nd\n");
+}
+
+TEST_F(FileReaderTest, MissingFile)
+{
+	char *buf;
+	int ret;
+
+	/* the file is not opened until the first read */
+	ret = file_reader_open(reader_file, 0, &reader);
+	ASSERT_EQ(ret, 0);
+
+	ret = file_reader_read(reader, &buf, NULL);
+	ASSERT_EQ(ret, -ENOENT);
+
+	CreateFile(reader_file, "exists\n");
+
+	ret = file_reader_read(reader, &buf, NULL);
+	ASSERT_EQ(ret, 0);
+	ASSERT_STREQ(buf, "exists\n");
+}
+
+TEST_F(FileReaderTest, LargeFile)
+{
+	std::string contents(3 * 4096 + 17, 'a');
+	size_t len;
+	char *buf;
+	int ret;
+
+	CreateFile(reader_file, contents.c_str());
+
+	ret = file_reader_open(reader_file, 0, &reader);
+	ASSERT_EQ(ret, 0);
+
+	ret = file_reader_read(reader, &buf, &len);
+	ASSERT_EQ(ret, 0);
+	ASSERT_EQ(len, contents.length());
+	ASSERT_STREQ(buf, contents.c_str());
+}
+
+TEST_F(FileReaderTest, SnapshotCache)
+{
+	struct file_reader *reader2 = NULL;
+	size_t len;
+	char *buf;
+	int ret;
+
+	CreateFile(reader_file, "first\n");
+
+	ret = file_reader_open(reader_file, 0, &reader);
+	ASSERT_EQ(ret, 0);
+	ret = file_reader_open(reader_file, 0, &reader2);
+	ASSERT_EQ(ret, 0);
+
+	snapshot_cache_start();
+
+	ret = file_reader_read(reader, &buf, &len);
+	ASSERT_EQ(ret, 0);
+	ASSERT_STREQ(buf, "first\n");
+
+	/* the second reader is served from the snapshot taken by the first */
+	CreateFile(reader_file, "2nd\n");
+
+	ret = file_reader_read(reader2, &buf, &len);
+	ASSERT_EQ(ret, 0);
+	ASSERT_EQ(len, strlen("first\n"));
+	ASSERT_STREQ(buf, "first\n");
+
+	snapshot_cache_invalidate();
+
+	ret = file_reader_read(reader2, &buf, &len);
+	ASSERT_EQ(ret, 0);
+	ASSERT_EQ(len, strlen("2nd\n"));
+	ASSERT_STREQ(buf, "2nd\n");
+
+	snapshot_cache_stop();
+	file_reader_close(&reader2);
+}
+
+TEST_F(FileReaderTest, NoCacheSetting)
+{
+	struct file_reader *setting = NULL;
+	size_t len;
+	char *buf;
+	int ret;
+
+	CreateFile(reader_file, "100\n");
+
+	ret = file_reader_open(reader_file, 0, &reader);
+	ASSERT_EQ(ret, 0);
+	ret = file_reader_open(reader_file, FILE_READER_NO_CACHE, &setting);
+	ASSERT_EQ(ret, 0);
+
+	snapshot_cache_start();
+
+	ret = file_reader_read(reader, &buf, &len);
+	ASSERT_EQ(ret, 0);
+	ASSERT_STREQ(buf, "100\n");
+
+	/* an effect changes the setting later in the same loop */
+	CreateFile(reader_file, "200\n");
+
+	ret = file_reader_read(setting, &buf, &len);
+	ASSERT_EQ(ret, 0);
+	ASSERT_EQ(len, strlen("200\n"));
+	ASSERT_STREQ(buf, "200\n");
+
+	/* and the setting reader doesn't add its read to the cache either */
+	snapshot_cache_invalidate();
+	ret = file_reader_read(setting, &buf, &len);
+	ASSERT_EQ(ret, 0);
+	CreateFile(reader_file, "300\n");
+
+	ret = file_reader_read(reader, &buf, &len);
+	ASSERT_EQ(ret, 0);
+	ASSERT_STREQ(buf, "300\n");
+
+	snapshot_cache_stop();
+	file_reader_close(&setting);
+}
+
+TEST_F(FileReaderTest, Pressure)
+{
+	float avg;
+	long long total;
+	int ret;
+
+	CreateFile(reader_file,
+		   "some avg10=1.50 avg60=2.50 avg300=3.50 total=1234\n"
+		   "full avg10=0.50 avg60=0.75 avg300=0.25 total=567\n");
+
+	ret = file_reader_open(reader_file, 0, &reader);
+	ASSERT_EQ(ret, 0);
+
+	ret = reader_get_pressure_avg(reader, PRESSURE_SOME_AVG60, &avg);
+	ASSERT_EQ(ret, 0);
+	ASSERT_FLOAT_EQ(avg, 2.50);
+
+	ret = reader_get_pressure_avg(reader, PRESSURE_FULL_AVG300, &avg);
+	ASSERT_EQ(ret, 0);
+	ASSERT_FLOAT_EQ(avg, 0.25);
+
+	ret = reader_get_pressure_total(reader, PRESSURE_FULL_TOTAL, &total);
+	ASSERT_EQ(ret, 0);
+	ASSERT_EQ(total, 567);
+
+	ret = reader_get_pressure_total(reader, PRESSURE_SOME_AVG10, &total);
+	ASSERT_EQ(ret, -EINVAL);
+}
+
+TEST_F(FileReaderTest, CgroupValue)
+{
+	struct adaptived_cgroup_value val;
+	int ret;
+
+	CreateFile(reader_file, "123456\n");
+
+	ret = file_reader_open(reader_file, 0, &reader);
+	ASSERT_EQ(ret, 0);
+
+	val.type = ADAPTIVED_CGVAL_LONG_LONG;
+	ret = reader_get_cgroup_value(reader, &val);
+	ASSERT_EQ(ret, 0);
+	ASSERT_EQ(val.value.ll_value, 123456);
+
+	CreateFile(reader_file, "3.25\n");
+
+	val.type = ADAPTIVED_CGVAL_FLOAT;
+	ret = reader_get_cgroup_value(reader, &val);
+	ASSERT_EQ(ret, 0);
+	ASSERT_FLOAT_EQ(val.value.float_value, 3.25);
+
+	val.type = ADAPTIVED_CGVAL_LONG_LONG;
+	ret = reader_get_cgroup_value(reader, &val);
+	ASSERT_EQ(ret, -EINVAL);
+}
@@ -0,0 +1,229 @@
+/*
+ * Copyright (c) 2024, Oracle and/or its affiliates.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * You should have received a copy of the GNU General Public License version
+ * 2 along with this work; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Please contact Oracle, 500 Oracle Parkway, Redwood Shores, CA 94065 USA
+ * or visit www.oracle.com if you need additional information or have any
+ * questions.
+ */
+/**
+ * adaptived googletest for the cached directory walk in src/utils/path_utils.c
+ */
+
+#include <sys/stat.h>
+#include <unistd.h>
+#include <limits.h>
+#include <string.h>
+#include <ftw.h>
+
+#include <adaptived-utils.h>
+#include <adaptived.h>
+
+#include "adaptived-internal.h"
+#include "gtest/gtest.h"
+#include "defines.h"
+
+#include <set>
+#include <string>
+
+static const char *dirs[] = {
+	"test016",
+
+	"test016/child1",
+	"test016/child2",
+
+	"test016/child1/grandchild1-1",
+	"test016/child1/grandchild1-2",
+
+	"test016/child1/grandchild1-2/greatgrandchild1-2-1",
+};
+
+class PathWalkCacheTest : public ::testing::Test {
+	protected:
+
+	void SetUp() override {
+		int ret, i;
+		FILE *f;
+
+		for (i = 0; i < (int)ARRAY_SIZE(dirs); i++) {
+			ret = mkdir(dirs[i], S_IRWXU | S_IRWXG | S_IRWXO);
+			ASSERT_EQ(ret, 0);
+		}
+
+		/* files are never returned by a directory walk */
+		f = fopen("test016/child1/cgroup.procs", "w");
+		ASSERT_NE(f, nullptr);
+		fclose(f);
+
+		ASSERT_NE(getcwd(cwd, sizeof(cwd)), nullptr);
+		snprintf(root, sizeof(root), "%s/%s", cwd, dirs[0]);
+	}
+
+	static int unlink_cb(const char *fpath, const struct stat *sb, int typeflag,
+		      struct FTW *ftwbuf) {
+		return remove(fpath);
+	}
+
+	void TearDown() override {
+		int ret;
+
+		path_walk_cache_cleanup();
+
+		ret = nftw(dirs[0], unlink_cb, 64, FTW_DEPTH | FTW_PHYS);
+		ASSERT_EQ(ret, 0);
+	}
+
+	std::string abs_path(const char * const rel) {
+		return std::string(cwd) + "/" + rel;
+	}
+
+	char cwd[PATH_MAX];
+	char root[PATH_MAX + 16];
+};
+
+static void Walk(const char * const path, int max_depth, std::set<std::string> &found)
+{
+	struct adaptived_path_walk_handle *handle = NULL;
+	char *next = NULL;
+	int ret;
+
+	found.clear();
+
+	ret = adaptived_path_walk_start(path, &handle, ADAPTIVED_PATH_WALK_LIST_DIRS, max_depth);
+	ASSERT_EQ(ret, 0);
+
+	do {
+		ret = adaptived_path_walk_next(&handle, &next);
+		ASSERT_EQ(ret, 0);
+
+		if (next) {
+			/* every path should be reported exactly once */
+			ASSERT_TRUE(found.insert(next).second);
+			free(next);
+		}
+	} while (next);
+
+	adaptived_path_walk_end(&handle);
+}
+
+TEST_F(PathWalkCacheTest, MatchesUncachedWalk)
+{
+	std::set<std::string> cached, uncached, expected;
+	int i;
+
+	for (i = 0; i < (int)ARRAY_SIZE(dirs); i++)
+		expected.insert(abs_path(dirs[i]));
+
+	Walk(root, ADAPTIVED_PATH_WALK_UNLIMITED_DEPTH, cached);
+	ASSERT_EQ(cached, expected);
+
+	/* relative paths are never cached */
+	Walk(dirs[0], ADAPTIVED_PATH_WALK_UNLIMITED_DEPTH, uncached);
+	ASSERT_EQ(uncached.size(), cached.size());
+	for (auto &path : uncached)
+		ASSERT_EQ(cached.count(std::string(cwd) + "/" + path), 1);
+
+	/* the second walk is served from the cache */
+	Walk(root, ADAPTIVED_PATH_WALK_UNLIMITED_DEPTH, cached);
+	ASSERT_EQ(cached, expected);
+}
+
+TEST_F(PathWalkCacheTest, MaxDepth)
+{
+	std::set<std::string> found, expected;
+	char path[PATH_MAX + 32];
+
+	/* prime the cache with the full tree */
+	Walk(root, ADAPTIVED_PATH_WALK_UNLIMITED_DEPTH, found);
+	ASSERT_EQ(found.size(), ARRAY_SIZE(dirs));
+
+	expected.insert(abs_path("test016"));
+	expected.insert(abs_path("test016/child1"));
+	expected.insert(abs_path("test016/child2"));
+	Walk(root, 0, found);
+	ASSERT_EQ(found, expected);
+
+	expected.insert(abs_path("test016/child1/grandchild1-1"));
+	expected.insert(abs_path("test016/child1/grandchild1-2"));
+	Walk(root, 1, found);
+	ASSERT_EQ(found, expected);
+
+	/* a trailing wildcard omits the top directory */
+	expected.erase(abs_path("test016"));
+	snprintf(path, sizeof(path), "%s/*", root);
+	Walk(path, 1, found);
+	ASSERT_EQ(found, expected);
+}
+
+TEST_F(PathWalkCacheTest, TracksChanges)
+{
+	std::set<std::string> found;
+	int ret;
+
+	Walk(root, ADAPTIVED_PATH_WALK_UNLIMITED_DEPTH, found);
+	ASSERT_EQ(found.size(), ARRAY_SIZE(dirs));
+
+	ret = mkdir("test016/child3", S_IRWXU);
+	ASSERT_EQ(ret, 0);
+	ret = mkdir("test016/child3/grandchild3-1", S_IRWXU);
+	ASSERT_EQ(ret, 0);
+	ret = mkdir("test016/child1/grandchild1-2/greatgrandchild1-2-1/ggg", S_IRWXU);
+	ASSERT_EQ(ret, 0);
+
+	Walk(root, ADAPTIVED_PATH_WALK_UNLIMITED_DEPTH, found);
+	ASSERT_EQ(found.size(), ARRAY_SIZE(dirs) + 3);
+	ASSERT_EQ(found.count(abs_path("test016/child3/grandchild3-1")), 1);
+	ASSERT_EQ(found.count(abs_path("test016/child1/grandchild1-2/greatgrandchild1-2-1/ggg")),
+		  1);
+
+	ret = rename("test016/child3", "test016/child2/child3");
+	ASSERT_EQ(ret, 0);
+	ret = rmdir("test016/child1/grandchild1-2/greatgrandchild1-2-1/ggg");
+	ASSERT_EQ(ret, 0);
+	ret = rmdir("test016/child1/grandchild1-1");
+	ASSERT_EQ(ret, 0);
+
+	Walk(root, ADAPTIVED_PATH_WALK_UNLIMITED_DEPTH, found);
+	ASSERT_EQ(found.size(), ARRAY_SIZE(dirs) + 1);
+	ASSERT_EQ(found.count(abs_path("test016/child1/grandchild1-1")), 0);
+	ASSERT_EQ(found.count(abs_path("test016/child3")), 0);
+	ASSERT_EQ(found.count(abs_path("test016/child2/child3")), 1);
+	ASSERT_EQ(found.count(abs_path("test016/child2/child3/grandchild3-1")), 1);
+}
+
+TEST_F(PathWalkCacheTest, RootRemoved)
+{
+	struct adaptived_path_walk_handle *handle = NULL;
+	std::set<std::string> found;
+	int ret;
+
+	Walk(root, ADAPTIVED_PATH_WALK_UNLIMITED_DEPTH, found);
+	ASSERT_EQ(found.size(), ARRAY_SIZE(dirs));
+
+	ret = rename(dirs[0], "test016.moved");
+	ASSERT_EQ(ret, 0);
+
+	ret = adaptived_path_walk_start(root, &handle, ADAPTIVED_PATH_WALK_LIST_DIRS,
+					ADAPTIVED_PATH_WALK_UNLIMITED_DEPTH);
+	ASSERT_EQ(ret, -ENOENT);
+
+	ret = rename("test016.moved", dirs[0]);
+	ASSERT_EQ(ret, 0);
+
+	Walk(root, ADAPTIVED_PATH_WALK_UNLIMITED_DEPTH, found);
+	ASSERT_EQ(found.size(), ARRAY_SIZE(dirs));
+}
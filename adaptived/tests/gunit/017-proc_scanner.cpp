@@ -0,0 +1,238 @@
+/*
+ * Copyright (c) 2024, Oracle and/or its affiliates.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * You should have received a copy of the GNU General Public License version
+ * 2 along with this work; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Please contact Oracle, 500 Oracle Parkway, Redwood Shores, CA 94065 USA
+ * or visit www.oracle.com if you need additional information or have any
+ * questions.
+ */
+/**
+ * adaptived googletest for the /proc scanner in src/utils/proc_pid_stat_utils.c
+ */
+
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string.h>
+#include <ftw.h>
+
+#include <adaptived-utils.h>
+#include <adaptived.h>
+
+#include "adaptived-internal.h"
+#include "gtest/gtest.h"
+#include "defines.h"
+
+#include <map>
+#include <string>
+
+static const char * const proc_dir = "test017";
+
+struct scanned {
+	std::string comm;
+	const char *comm_ptr;
+	char state;
+	unsigned long long starttime;
+	long long vsize;
+	long long rss;
+};
+
+static int scan_cb(const struct proc_pid_stat * const stat, void * const data)
+{
+	std::map<pid_t, struct scanned> *found = (std::map<pid_t, struct scanned> *)data;
+	struct scanned s;
+
+	s.comm = stat->comm;
+	s.comm_ptr = stat->comm;
+	s.state = stat->state;
+	s.starttime = stat->starttime;
+	s.vsize = stat->vsize;
+	s.rss = stat->rss;
+
+	(*found)[stat->pid] = s;
+
+	return 0;
+}
+
+static int stop_cb(const struct proc_pid_stat * const stat, void * const data)
+{
+	return -ECANCELED;
+}
+
+class ProcScannerTest : public ::testing::Test {
+	protected:
+
+	void SetUp() override {
+		int ret;
+
+		scanner = NULL;
+
+		ret = mkdir(proc_dir, S_IRWXU);
+		ASSERT_EQ(ret, 0);
+
+		/* entries that aren't pids are skipped */
+		ret = mkdir("test017/self", S_IRWXU);
+		ASSERT_EQ(ret, 0);
+		ret = mkdir("test017/12a", S_IRWXU);
+		ASSERT_EQ(ret, 0);
+	}
+
+	static int unlink_cb(const char *fpath, const struct stat *sb, int typeflag,
+		      struct FTW *ftwbuf) {
+		return remove(fpath);
+	}
+
+	void TearDown() override {
+		int ret;
+
+		proc_scanner_close(&scanner);
+
+		ret = nftw(proc_dir, unlink_cb, 64, FTW_DEPTH | FTW_PHYS);
+		ASSERT_EQ(ret, 0);
+	}
+
+	void WriteStat(pid_t pid, const char * const comm, unsigned long long starttime,
+		       long long vsize, long long rss) {
+		char path[FILENAME_MAX];
+		FILE *f;
+
+		snprintf(path, sizeof(path), "%s/%d", proc_dir, pid);
+		(void)mkdir(path, S_IRWXU);
+
+		snprintf(path, sizeof(path), "%s/%d/stat", proc_dir, pid);
+		f = fopen(path, "w");
+		ASSERT_NE(f, nullptr);
+
+		fprintf(f, "%d (%s) S 1 %d %d 0 -1 4194560 100 0 0 0 1 2 0 0 20 0 1 0 %llu "
+			"%lld %lld 18446744073709551615 1 1 0 0 0 0 0 4096 0 0 0 17 3 0 0 0 0 0\n",
+			pid, comm, pid, pid, starttime, vsize, rss);
+		fclose(f);
+	}
+
+	struct proc_scanner *scanner;
+};
+
+TEST_F(ProcScannerTest, InvalidParams)
+{
+	int ret;
+
+	ret = proc_scanner_open(proc_dir, NULL);
+	ASSERT_EQ(ret, -EINVAL);
+
+	ret = proc_scanner_open("test017/does-not-exist", &scanner);
+	ASSERT_EQ(ret, -ENOENT);
+
+	ret = proc_scanner_scan(NULL, scan_cb, NULL);
+	ASSERT_EQ(ret, -EINVAL);
+
+	proc_scanner_close(NULL);
+}
+
+TEST_F(ProcScannerTest, ParseFields)
+{
+	std::map<pid_t, struct scanned> found;
+	int ret;
+
+	WriteStat(100, "bash", 1000, 8192000, 512);
+	WriteStat(200, "my prog) (1", 2000, 4096, 12);
+	WriteStat(300, "kthread", 3000, 0, 0);
+
+	ret = proc_scanner_open(proc_dir, &scanner);
+	ASSERT_EQ(ret, 0);
+
+	ret = proc_scanner_scan(scanner, scan_cb, &found);
+	ASSERT_EQ(ret, 0);
+	ASSERT_EQ(found.size(), 3);
+
+	ASSERT_EQ(found[100].comm, "bash");
+	ASSERT_EQ(found[100].state, 'S');
+	ASSERT_EQ(found[100].starttime, 1000);
+	ASSERT_EQ(found[100].vsize, 8192000);
+	ASSERT_EQ(found[100].rss, 512);
+
+	/* the command name runs to the last ')' */
+	ASSERT_EQ(found[200].comm, "my prog) (1");
+	ASSERT_EQ(found[200].starttime, 2000);
+	ASSERT_EQ(found[200].vsize, 4096);
+	ASSERT_EQ(found[200].rss, 12);
+
+	ASSERT_EQ(found[300].comm, "kthread");
+	ASSERT_EQ(found[300].vsize, 0);
+
+	ret = proc_scanner_scan(scanner, stop_cb, NULL);
+	ASSERT_EQ(ret, -ECANCELED);
+}
+
+TEST_F(ProcScannerTest, CommCache)
+{
+	std::map<pid_t, struct scanned> first, second;
+	int ret;
+
+	WriteStat(100, "first", 1000, 1, 1);
+	WriteStat(200, "second", 2000, 1, 1);
+
+	ret = proc_scanner_open(proc_dir, &scanner);
+	ASSERT_EQ(ret, 0);
+
+	ret = proc_scanner_scan(scanner, scan_cb, &first);
+	ASSERT_EQ(ret, 0);
+
+	/* pid 200 was reused by a new process */
+	WriteStat(200, "reused", 2500, 1, 1);
+
+	ret = proc_scanner_scan(scanner, scan_cb, &second);
+	ASSERT_EQ(ret, 0);
+	ASSERT_EQ(second.size(), 2);
+
+	/* an unchanged process is served from the cache */
+	ASSERT_EQ(second[100].comm, "first");
+	ASSERT_EQ(second[100].comm_ptr, first[100].comm_ptr);
+
+	ASSERT_EQ(second[200].comm, "reused");
+	ASSERT_EQ(second[200].starttime, 2500);
+
+	/* exec() changes the name but not the starttime */
+	WriteStat(100, "execd", 1000, 1, 1);
+
+	ret = proc_scanner_scan(scanner, scan_cb, &second);
+	ASSERT_EQ(ret, 0);
+	ASSERT_EQ(second[100].comm, "execd");
+}
+
+TEST_F(ProcScannerTest, ScanSelf)
+{
+	std::map<pid_t, struct scanned> found;
+	char comm[64] = { '\0' };
+	FILE *f;
+	int ret;
+
+	f = fopen("/proc/self/comm", "r");
+	ASSERT_NE(f, nullptr);
+	ASSERT_NE(fgets(comm, sizeof(comm), f), nullptr);
+	fclose(f);
+	comm[strcspn(comm, "\n")] = '\0';
+
+	ret = proc_scanner_open(NULL, &scanner);
+	ASSERT_EQ(ret, 0);
+
+	ret = proc_scanner_scan(scanner, scan_cb, &found);
+	ASSERT_EQ(ret, 0);
+
+	ASSERT_EQ(found.count(getpid()), 1);
+	ASSERT_EQ(found[getpid()].comm, comm);
+	ASSERT_GT(found[getpid()].vsize, 0);
+	ASSERT_GT(found[getpid()].rss, 0);
+}
@@ -0,0 +1,205 @@
+/*
+ * Copyright (c) 2024, Oracle and/or its affiliates.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * You should have received a copy of the GNU General Public License version
+ * 2 along with this work; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Please contact Oracle, 500 Oracle Parkway, Redwood Shores, CA 94065 USA
+ * or visit www.oracle.com if you need additional information or have any
+ * questions.
+ */
+/**
+ * adaptived googletest for the cgroup write journal in src/utils/cgroup_utils.c
+ */
+
+#include <adaptived-utils.h>
+#include <adaptived.h>
+
+#include "adaptived-internal.h"
+#include "gtest/gtest.h"
+
+static const char * const setting_file = "./test018.setting";
+
+static void CreateFile(const char * const filename, const char * const contents)
+{
+	FILE *f;
+
+	f = fopen(filename, "w");
+	ASSERT_NE(f, nullptr);
+
+	fprintf(f, "%s", contents);
+	fclose(f);
+}
+
+static void ReadFile(const char * const filename, char * const buf, size_t len)
+{
+	size_t bytes_read;
+	FILE *f;
+
+	f = fopen(filename, "r");
+	ASSERT_NE(f, nullptr);
+
+	bytes_read = fread(buf, 1, len - 1, f);
+	buf[bytes_read] = '\0';
+	fclose(f);
+}
+
+class CgroupJournalTest : public ::testing::Test {
+	protected:
+
+	void SetUp() override {
+		CreateFile(setting_file, "1000\n");
+	}
+
+	void TearDown() override {
+		cgroup_journal_flush();
+		remove(setting_file);
+	}
+};
+
+TEST_F(CgroupJournalTest, Inactive)
+{
+	char buf[32];
+	int ret;
+
+	ret = adaptived_cgroup_set_ll(setting_file, 2000, 0);
+	ASSERT_EQ(ret, 0);
+
+	ReadFile(setting_file, buf, sizeof(buf));
+	ASSERT_STREQ(buf, "2000");
+}
+
+TEST_F(CgroupJournalTest, Coalesce)
+{
+	long long value;
+	char buf[32];
+	int ret;
+
+	cgroup_journal_start();
+
+	ret = adaptived_cgroup_set_ll(setting_file, 2000, 0);
+	ASSERT_EQ(ret, 0);
+	ret = adaptived_cgroup_set_ll(setting_file, 3000, ADAPTIVED_CGROUP_FLAGS_VALIDATE);
+	ASSERT_EQ(ret, 0);
+
+	/* the file isn't written until the journal is flushed */
+	ReadFile(setting_file, buf, sizeof(buf));
+	ASSERT_STREQ(buf, "1000\n");
+
+	/* but reads see the pending value */
+	ret = adaptived_cgroup_get_ll(setting_file, &value);
+	ASSERT_EQ(ret, 0);
+	ASSERT_EQ(value, 3000);
+
+	/* stopping the journal keeps the pending writes */
+	cgroup_journal_stop();
+	ret = adaptived_cgroup_get_ll(setting_file, &value);
+	ASSERT_EQ(ret, 0);
+	ASSERT_EQ(value, 1000);
+
+	ret = cgroup_journal_flush();
+	ASSERT_EQ(ret, 0);
+
+	ReadFile(setting_file, buf, sizeof(buf));
+	ASSERT_STREQ(buf, "3000");
+}
+
+TEST_F(CgroupJournalTest, SkipUnchanged)
+{
+	long long value;
+	char buf[32];
+	int ret;
+
+	cgroup_journal_start();
+
+	ret = adaptived_cgroup_get_ll(setting_file, &value);
+	ASSERT_EQ(ret, 0);
+	ASSERT_EQ(value, 1000);
+
+	ret = adaptived_cgroup_set_ll(setting_file, value, 0);
+	ASSERT_EQ(ret, 0);
+
+	ret = cgroup_journal_flush();
+	ASSERT_EQ(ret, 0);
+
+	/* a write would have dropped the newline */
+	ReadFile(setting_file, buf, sizeof(buf));
+	ASSERT_STREQ(buf, "1000\n");
+}
+
+TEST_F(CgroupJournalTest, ChangedSinceRead)
+{
+	long long value;
+	char buf[32];
+	int ret;
+
+	cgroup_journal_start();
+
+	ret = adaptived_cgroup_get_ll(setting_file, &value);
+	ASSERT_EQ(ret, 0);
+	ASSERT_EQ(value, 1000);
+
+	ret = adaptived_cgroup_set_ll(setting_file, value, 0);
+	ASSERT_EQ(ret, 0);
+
+	/* something else changes the setting before the journal is flushed */
+	CreateFile(setting_file, "5000\n");
+
+	ret = cgroup_journal_flush();
+	ASSERT_EQ(ret, 0);
+
+	ReadFile(setting_file, buf, sizeof(buf));
+	ASSERT_STREQ(buf, "1000");
+}
+
+TEST_F(CgroupJournalTest, Str)
+{
+	char *value;
+	char buf[32];
+	int ret;
+
+	cgroup_journal_start();
+
+	ret = adaptived_cgroup_set_ll(setting_file, 2000, 0);
+	ASSERT_EQ(ret, 0);
+	ret = adaptived_cgroup_set_str(setting_file, "max", 0);
+	ASSERT_EQ(ret, 0);
+
+	ret = adaptived_cgroup_get_str(setting_file, &value);
+	ASSERT_EQ(ret, 0);
+	ASSERT_STREQ(value, "max");
+	free(value);
+
+	ret = cgroup_journal_flush();
+	ASSERT_EQ(ret, 0);
+
+	ReadFile(setting_file, buf, sizeof(buf));
+	ASSERT_STREQ(buf, "max");
+}
+
+TEST_F(CgroupJournalTest, FlushError)
+{
+	int ret;
+
+	cgroup_journal_start();
+
+	ret = adaptived_cgroup_set_ll("./test018.does_not_exist", 1234, 0);
+	ASSERT_EQ(ret, 0);
+	ret = adaptived_cgroup_set_ll(setting_file, 2000, 0);
+	ASSERT_EQ(ret, 0);
+
+	ret = cgroup_journal_flush();
+	ASSERT_EQ(ret, -ENOENT);
+}
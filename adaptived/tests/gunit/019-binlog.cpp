@@ -0,0 +1,286 @@
+/*
+ * Copyright (c) 2025, Oracle and/or its affiliates.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 only, as
+ * published by the Free Software Foundation.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * You should have received a copy of the GNU General Public License version
+ * 2 along with this work; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Please contact Oracle, 500 Oracle Parkway, Redwood Shores, CA 94065 USA
+ * or visit www.oracle.com if you need additional information or have any
+ * questions.
+ */
+/**
+ * adaptived googletest for the binary log encoders in src/utils/binlog_utils.c
+ */
+
+#include <adaptived-utils.h>
+#include <adaptived.h>
+
+#include "adaptived-internal.h"
+#include "binlog.h"
+#include "gtest/gtest.h"
+
+static const char * const schedstat_file = "./test019.schedstat";
+static const char * const log_file = "./test019.log";
+
+static const char * const schedstat_contents =
+	"version 15\n"
+	"timestamp 5979263307\n"
+	"cpu0 0 0 0 0 1 2 43076095314418 394914672557 428184882\n"
+	"domain0 00003 1 2 3 4 5 6 7 8 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 21 22 23 0 0 0 0 0 0 31 32 0\n"
+	"domain1 fffff 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 33 34 0\n"
+	"cpu1 0 0 0 0 3 4 10913795519351 136791545255 100532045\n"
+	"domain0 00003 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 35 36 0\n"
+	"domain1 fffff 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 37 38 0\n";
+
+static const char * const meminfo_contents =
+	"MemTotal:       16071292 kB\n"
+	"MemFree:          485624 kB\n"
+	"Cached:          9422148 kB\n"
+	"NotARealField:        42 kB\n"
+	"HugePages_Total:       8\n"
+	"DirectMap1G:     2097152 kB\n";
+
+class BinlogTest : public ::testing::Test {
+	protected:
+
+	struct binlog_buf bb;
+
+	void SetUp() override {
+		memset(&bb, 0, sizeof(bb));
+		bb.realtime_ns = 1000;
+		bb.monotonic_ns = 2000;
+	}
+
+	void TearDown() override {
+		if (bb.buf)
+			free(bb.buf);
+		remove(schedstat_file);
+		remove(log_file);
+	}
+};
+
+static void CheckRecord(const struct binlog_buf * const bb, size_t offset,
+			enum binlog_record_type type)
+{
+	const struct binlog_record *rec = (const struct binlog_record *)&bb->buf[offset];
+
+	ASSERT_LE(offset + sizeof(*rec), bb->len);
+	ASSERT_EQ(rec->type, type);
+	ASSERT_EQ(rec->len % BINLOG_ALIGN, 0);
+	ASSERT_LE(offset + rec->len, bb->len);
+	ASSERT_EQ(rec->realtime_ns, 1000);
+	ASSERT_EQ(rec->monotonic_ns, 2000);
+}
+
+TEST_F(BinlogTest, HeaderAndRaw)
+{
+	const struct binlog_header *hdr;
+	const struct binlog_record *rec;
+	const struct binlog_raw *raw;
+	const char *path;
+	int ret;
+
+	ret = binlog_header(&bb);
+	ASSERT_EQ(ret, 0);
+	ASSERT_EQ(bb.len, sizeof(struct binlog_header));
+
+	ret = binlog_raw(&bb, "/a/file", "abc", 3);
+	ASSERT_EQ(ret, 0);
+	ASSERT_EQ(bb.len % BINLOG_ALIGN, 0);
+
+	hdr = (const struct binlog_header *)bb.buf;
+	ASSERT_EQ(memcmp(hdr->magic, BINLOG_MAGIC, BINLOG_MAGIC_LEN), 0);
+	ASSERT_EQ(hdr->version, BINLOG_VERSION);
+	ASSERT_EQ(hdr->byte_order, BINLOG_BYTE_ORDER);
+
+	CheckRecord(&bb, sizeof(*hdr), BINLOG_RAW);
+	rec = (const struct binlog_record *)&bb.buf[sizeof(*hdr)];
+	raw = (const struct binlog_raw *)&rec[1];
+	path = (const char *)&raw[1];
+	ASSERT_EQ(raw->path_len, strlen("/a/file") + 1);
+	ASSERT_EQ(raw->data_len, 3);
+	ASSERT_STREQ(path, "/a/file");
+	ASSERT_EQ(memcmp(&path[raw->path_len], "abc", 3), 0);
+	ASSERT_EQ(rec->len, BINLOG_PAD(sizeof(*rec) + sizeof(*raw) + raw->path_len + 3));
+}
+
+static int CheckLog(const char * const contents, size_t len)
+{
+	FILE *f;
+	int ret;
+
+	f = fopen(log_file, "w+");
+	if (!f)
+		return -errno;
+
+	fwrite(contents, 1, len, f);
+	fflush(f);
+	ret = binlog_check_header(fileno(f));
+	fclose(f);
+
+	return ret;
+}
+
+TEST_F(BinlogTest, CheckHeader)
+{
+	struct binlog_header *hdr;
+	const char *text = "text log\n";
+	int ret;
+
+	ret = binlog_header(&bb);
+	ASSERT_EQ(ret, 0);
+	ret = binlog_raw(&bb, "/a/file", "abc", 3);
+	ASSERT_EQ(ret, 0);
+
+	ret = CheckLog(bb.buf, bb.len);
+	ASSERT_EQ(ret, 0);
+
+	ret = CheckLog(text, strlen(text));
+	ASSERT_EQ(ret, -EINVAL);
+
+	/* shorter than a header */
+	ret = CheckLog(bb.buf, BINLOG_MAGIC_LEN);
+	ASSERT_EQ(ret, -EINVAL);
+
+	hdr = (struct binlog_header *)bb.buf;
+	hdr->version = BINLOG_VERSION + 1;
+	ret = CheckLog(bb.buf, bb.len);
+	ASSERT_EQ(ret, -EINVAL);
+}
+
+TEST_F(BinlogTest, Schedstat)
+{
+	const struct binlog_schedstat_domain *domains;
+	const struct binlog_schedstat_cpu *cpus;
+	struct adaptived_schedstat_snapshot *ss;
+	const struct binlog_schedstat *hdr;
+	FILE *f;
+	int ret;
+
+	f = fopen(schedstat_file, "w");
+	ASSERT_NE(f, nullptr);
+	fprintf(f, "%s", schedstat_contents);
+	fclose(f);
+
+	ss = (struct adaptived_schedstat_snapshot *)malloc(sizeof(*ss));
+	ASSERT_NE(ss, nullptr);
+
+	ret = adaptived_get_schedstat(schedstat_file, ss);
+	ASSERT_EQ(ret, 0);
+
+	ret = binlog_schedstat(&bb, ss);
+	free(ss);
+	ASSERT_EQ(ret, 0);
+
+	CheckRecord(&bb, 0, BINLOG_SCHEDSTAT);
+	hdr = (const struct binlog_schedstat *)&bb.buf[sizeof(struct binlog_record)];
+	ASSERT_EQ(hdr->timestamp, 5979263307);
+	ASSERT_EQ(hdr->nr_cpus, 2);
+	ASSERT_EQ(hdr->nr_domains, 4);
+
+	/* only the cpus and domains that exist are stored */
+	ASSERT_EQ(bb.len, sizeof(struct binlog_record) + sizeof(*hdr) +
+		  2 * sizeof(struct binlog_schedstat_cpu) +
+		  4 * sizeof(struct binlog_schedstat_domain));
+
+	cpus = (const struct binlog_schedstat_cpu *)&hdr[1];
+	domains = (const struct binlog_schedstat_domain *)&cpus[2];
+
+	ASSERT_EQ(cpus[0].ttwu, 1);
+	ASSERT_EQ(cpus[0].ttwu_local, 2);
+	ASSERT_EQ(cpus[0].run_time, 43076095314418);
+	ASSERT_EQ(cpus[0].run_delay, 394914672557);
+	ASSERT_EQ(cpus[0].nr_timeslices, 428184882);
+	ASSERT_EQ(cpus[0].first_domain, 0);
+	ASSERT_EQ(cpus[0].nr_domains, 2);
+	ASSERT_EQ(cpus[1].ttwu, 3);
+	ASSERT_EQ(cpus[1].first_domain, 2);
+	ASSERT_EQ(cpus[1].nr_domains, 2);
+
+	ASSERT_EQ(domains[0].cpumask, 0x3);
+	ASSERT_EQ(domains[0].lb[0][0], 1);
+	ASSERT_EQ(domains[0].lb[0][7], 8);
+	ASSERT_EQ(domains[0].alb_called, 21);
+	ASSERT_EQ(domains[0].alb_pushed, 23);
+	ASSERT_EQ(domains[0].ttwu_remote, 31);
+	ASSERT_EQ(domains[0].ttwu_move_affine, 32);
+	ASSERT_EQ(domains[1].cpumask, 0xfffff);
+	ASSERT_EQ(domains[1].ttwu_remote, 33);
+	ASSERT_EQ(domains[2].ttwu_remote, 35);
+	ASSERT_EQ(domains[2].ttwu_move_affine, 36);
+	ASSERT_EQ(domains[3].ttwu_remote, 37);
+}
+
+TEST_F(BinlogTest, Pressure)
+{
+	struct adaptived_pressure_snapshot ps;
+	const struct binlog_pressure *pressure;
+	int ret;
+
+	ps.some.avg10 = 12.34f;
+	ps.some.avg60 = 0.01f;
+	ps.some.avg300 = 100.0f;
+	ps.some.total = 123456789;
+	ps.full.avg10 = 0.0f;
+	ps.full.avg60 = 5.5f;
+	ps.full.avg300 = 99.99f;
+	ps.full.total = 42;
+
+	ret = binlog_pressure(&bb, "/proc/pressure/memory", &ps);
+	ASSERT_EQ(ret, 0);
+
+	CheckRecord(&bb, 0, BINLOG_PRESSURE);
+	pressure = (const struct binlog_pressure *)&bb.buf[sizeof(struct binlog_record)];
+	ASSERT_EQ(pressure->some.avg10, 1234);
+	ASSERT_EQ(pressure->some.avg60, 1);
+	ASSERT_EQ(pressure->some.avg300, 10000);
+	ASSERT_EQ(pressure->some.total, 123456789);
+	ASSERT_EQ(pressure->full.avg10, 0);
+	ASSERT_EQ(pressure->full.avg60, 550);
+	ASSERT_EQ(pressure->full.avg300, 9999);
+	ASSERT_EQ(pressure->full.total, 42);
+	ASSERT_STREQ((const char *)&pressure[1], "/proc/pressure/memory");
+}
+
+TEST_F(BinlogTest, Meminfo)
+{
+	const struct binlog_meminfo *meminfo;
+	const uint64_t *values;
+	unsigned int i;
+	int ret;
+
+	ret = binlog_meminfo(&bb, meminfo_contents);
+	ASSERT_EQ(ret, 0);
+
+	CheckRecord(&bb, 0, BINLOG_MEMINFO);
+	meminfo = (const struct binlog_meminfo *)&bb.buf[sizeof(struct binlog_record)];
+	ASSERT_EQ(meminfo->nr_fields, BINLOG_MEMINFO_CNT);
+	values = (const uint64_t *)&meminfo[1];
+
+	for (i = 0; i < BINLOG_MEMINFO_CNT; i++) {
+		if (strcmp(binlog_meminfo_fields[i], "MemTotal") == 0)
+			ASSERT_EQ(values[i], 16071292);
+		else if (strcmp(binlog_meminfo_fields[i], "MemFree") == 0)
+			ASSERT_EQ(values[i], 485624);
+		else if (strcmp(binlog_meminfo_fields[i], "Cached") == 0)
+			ASSERT_EQ(values[i], 9422148);
+		else if (strcmp(binlog_meminfo_fields[i], "HugePages_Total") == 0)
+			ASSERT_EQ(values[i], 8);
+		else if (strcmp(binlog_meminfo_fields[i], "DirectMap1G") == 0)
+			ASSERT_EQ(values[i], 2097152);
+		else
+			ASSERT_EQ(values[i], BINLOG_MEMINFO_MISSING);
+	}
+}
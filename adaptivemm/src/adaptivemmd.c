@@ -43,6 +43,7 @@
 #include <signal.h>
 #include <linux/kernel-page-flags.h>
 #include "predict.h"
+#include "procfile.h"
 
 #define VERSION		"2.1.0"
 
@@ -58,6 +59,7 @@
 #define KPAGEFLAGS		"/proc/kpageflags"
 #define MODULES			"/proc/modules"
 #define HUGEPAGESINFO		"/sys/kernel/mm/hugepages"
+#define NODE_ONLINE		"/sys/devices/system/node/online"
 #define DENTRYINFO		"/proc/sys/fs/dentry-state"
 #define INODEINFO		"/proc/sys/fs/inode-nr"
 
@@ -66,6 +68,16 @@
  */
 #define RESCALE_WMARK		"/proc/sys/vm/watermark_scale_factor"
 #define	COMPACT_PATH_FORMAT	"/sys/devices/system/node/node%d/compact"
+#define COMPACTION_PROACTIVENESS	"/proc/sys/vm/compaction_proactiveness"
+#define NODE_RECLAIM_FORMAT	"/sys/devices/system/node/node%d/reclaim"
+
+/*
+ * cgroup v2 hierarchy, for proactive reclaim through memory.reclaim. It
+ * is mounted under CGROUP2_HYBRID_MOUNT when cgroup v1 is in use as well
+ */
+#define CGROUP2_MOUNT		"/sys/fs/cgroup"
+#define CGROUP2_HYBRID_MOUNT	"/sys/fs/cgroup/unified"
+#define MAX_RECLAIM_CGROUPS	16
 #define VFS_CACHE_PRESSURE	"/proc/sys/vm/vfs_cache_pressure"
 
 /*
@@ -80,7 +92,7 @@
 #define CONFIG_FILE2		"/etc/default/adaptivemmd"
 
 #define FS_FIELDS	2
-#define MAX_NUMANODES	1024
+#define MAX_NUMANODES	1024	/* Highest node id + 1 kernel supports */
 
 #define MAX_VERBOSE	5
 #define MAX_AGGRESSIVE	3
@@ -101,17 +113,75 @@
 int MAX(unsigned long a, unsigned long b) { return((a) > (b) ? a : b); }
 int MIN(unsigned long a, unsigned long b) { return((a) < (b) ? a : b); }
 
-unsigned long min_wmark[MAX_NUMANODES], low_wmark[MAX_NUMANODES];
-unsigned long high_wmark[MAX_NUMANODES], managed_pages[MAX_NUMANODES];
+/*
+ * Per NUMA node state. Each array is indexed by node id and sized for
+ * the highest online node, see update_online_nodes(). Loops over nodes
+ * should go through the list of online nodes.
+ */
+struct node_info {
+	int nr_node_ids;	/* highest online node id + 1 */
+	int nr_online;
+	int *online;		/* ids of online nodes, in ascending order */
+	bool *is_online;
+	unsigned long *min_wmark;
+	unsigned long *low_wmark;
+	unsigned long *high_wmark;
+	unsigned long *managed_pages;
+	unsigned long *start_pfn;
+	unsigned long *end_pfn;
+	unsigned long *last_bigpages;
+	unsigned long *free_pages;	/* at last sample */
+	unsigned long *verdict;		/* MEMPREDICT_* from last sample */
+	long long *free_trend;		/* slope of free pages * 100 */
+	struct lsq_struct *page_lsq;
+};
+struct node_info nodes;
+
+/*
+ * Totals of per node watermarks and managed pages. These are updated
+ * only when zoneinfo is parsed
+ */
+unsigned long total_managed, total_min_wmark, total_low_wmark, total_high_wmark;
+int nr_wmark_nodes;	/* number of nodes with a low watermark */
+
 unsigned long total_free_pages, total_cache_pages, total_hugepages, base_psize;
 long compaction_rate, reclaim_rate;
-struct lsq_struct page_lsq[MAX_NUMANODES][MAX_ORDER];
-struct lsq_struct fs_lsq[FS_FIELDS];
+struct lsq_struct fs_lsq;
 int dry_run;
 int debug_mode, verbose, del_lock = 0;
 unsigned long maxgap;
 int aggressiveness = 2;
 int periodicity, skip_dmazone;
+
+/*
+ * Current period between samples of free pages, in msecs. It adapts
+ * between MIN_SAMPLE_PERIOD and periodicity seconds to memory pressure.
+ */
+unsigned long sample_period = MIN_SAMPLE_PERIOD;
+
+/* Kernel supports proactive reclaim on a single node */
+bool node_reclaim_supported;
+
+/*
+ * Reclaim through memory.reclaim of these cgroups, relative to the root
+ * of the cgroup v2 hierarchy, instead of raising watermarks. The root
+ * cgroup is used if none are configured.
+ */
+bool proactive_reclaim_enabled = false;
+char *reclaim_cgroups[MAX_RECLAIM_CGROUPS];
+int nr_reclaim_cgroups;
+int unmapped_scan_stripes = 1;
+
+/*
+ * /proc files read every period. They are kept open and re-read into
+ * the same buffers each time
+ */
+struct proc_file buddyinfo_file = PROC_FILE_INIT(BUDDYINFO);
+struct proc_file zoneinfo_file = PROC_FILE_INIT(ZONEINFO);
+struct proc_file vmstat_file = PROC_FILE_INIT(VMSTAT);
+struct proc_file meminfo_file = PROC_FILE_INIT(MEMINFO);
+struct proc_file node_online_file = PROC_FILE_INIT(NODE_ONLINE);
+
 int neg_dentry_pct = 15;	/* default is 1.5% */
 int prefer_object_caching = 1;
 
@@ -140,10 +210,104 @@ unsigned int mywsf;
 int max_compaction_order = MAX_ORDER - 4;
 
 /*
- * Clean up before exiting
+ * compaction_proactiveness is raised to this while there are compaction
+ * requests, and restored once there have been none for
+ * COMPACT_BOOST_MSECS. kcompactd then compacts in the background in
+ * small steps. A node that has not gained any highest order pages after
+ * COMPACT_BOOST_MSECS is compacted directly.
+ */
+#define COMPACT_BOOST_PROACTIVENESS	90
+#define COMPACT_BOOST_MSECS		5000
+#define COMPACT_POLL_MSECS		500
+
+/*
+ * Compaction requests are handed off to a worker thread, so compacting
+ * a large node does not hold up sampling, leak checks or watermark
+ * scaling. Nodes waiting to be compacted are kept in a ring, each node
+ * at most once.
+ */
+struct compact_worker {
+	pthread_t thread;
+	bool started;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+
+	/* protected by lock */
+	int *queue;
+	int size;
+	int head;
+	int count;
+	int busy_nid;		/* node being compacted, or -1 */
+	long rate;		/* last measured compaction rate, or -1 */
+	bool stop;		/* exit instead of waiting for the next node */
+
+	/* used by the worker thread only, until it has been stopped */
+	int orig_proactiveness;	/* -1 if not supported by the kernel */
+	bool boosted;
+	struct proc_file buddyinfo;
+};
+
+struct compact_worker compactor = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+	.busy_nid = -1,
+	.rate = -1,
+	.orig_proactiveness = -1,
+	.buddyinfo = PROC_FILE_INIT(BUDDYINFO),
+};
+
+/*
+ * Read or set compaction_proactiveness. Returns -1 on failure
+ */
+int get_proactiveness()
+{
+	char buf[16];
+	ssize_t len;
+	int fd;
+
+	if ((fd = open(COMPACTION_PROACTIVENESS, O_RDONLY)) == -1)
+		return -1;
+	len = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (len <= 0)
+		return -1;
+	buf[len] = 0;
+
+	return atoi(buf);
+}
+
+int set_proactiveness(int val)
+{
+	char buf[16];
+	int fd, len, ret = 0;
+
+	len = snprintf(buf, sizeof(buf), "%d\n", val);
+	if ((fd = open(COMPACTION_PROACTIVENESS, O_WRONLY)) == -1) {
+		log_err("Failed to open "COMPACTION_PROACTIVENESS" (%s)", strerror(errno));
+		return -1;
+	}
+	if (write(fd, buf, len) != len) {
+		log_err("Failed to write to "COMPACTION_PROACTIVENESS" (%s)", strerror(errno));
+		ret = -1;
+	}
+	close(fd);
+
+	return ret;
+}
+
+void stop_compact_worker();
+
+/*
+ * Clean up before exiting. compaction_proactiveness is put back once
+ * the compaction worker has stopped, or right away when the worker is
+ * the one bailing out.
  */
 void bailout(int retval)
 {
+	if (!compactor.started || !pthread_equal(pthread_self(), compactor.thread))
+		stop_compact_worker();
+	else if (compactor.boosted)
+		set_proactiveness(compactor.orig_proactiveness);
 	if (del_lock)
 		unlink(LOCKFILE);
 	closelog();
@@ -151,11 +315,14 @@ void bailout(int retval)
 }
 
 /*
- * Signal handler to ensure cleanup before exiting
+ * Set by the signal handler, the main loop cleans up and exits when it
+ * sees it. Nothing else is safe to do from a signal handler.
  */
+volatile sig_atomic_t exit_signaled;
+
 void mysig(int signo)
 {
-	bailout(0);
+	exit_signaled = 1;
 }
 
 void log_msg(int level, char *fmt, ...)
@@ -201,7 +368,7 @@ static inline unsigned long get_msecs(struct timespec *spec)
 	if (!spec)
 		return -1;
 
-	return (unsigned long)((spec->tv_sec * 1000) + (spec->tv_nsec / 1000));
+	return (unsigned long)((spec->tv_sec * 1000) + (spec->tv_nsec / 1000000));
 }
 
 /*
@@ -232,27 +399,36 @@ void compact(int node_id)
 	close(fd);
 }
 
+#define FLDLEN	20
+
 /*
  * Parse a single input line for buddyinfo;  return 1 if successful
  * or 0 otherwise.
  */
-int scan_buddyinfo(char *line, char *node, char *zone, unsigned long *nr_free)
+int scan_buddyinfo(const char *line, int *nid, char *zone, unsigned long *nr_free)
 {
-	char copy[LINE_MAX];
+	unsigned long val;
 	unsigned int order;
-	char *t;
+	const char *p;
+	size_t len;
 
-	(void) strncpy(copy, line, sizeof(copy));
+	if (strncmp(line, "Node", 4) != 0 ||
+	    (p = proc_scan_ulong(line + 4, &val)) == NULL || *p != ',')
+		return 0;
+	*nid = val;
 
-	if ((t = strtok(copy, " ")) == NULL || strcmp(t, "Node") ||
-	    (t = strtok(NULL, ",")) == NULL || sscanf(t, "%s", node) != 1 ||
-	    (t = strtok(NULL, " ")) == NULL || strcmp(t, "zone") ||
-	    (t = strtok(NULL, " ")) == NULL || sscanf(t, "%s", zone) != 1)
+	p = proc_skip_space(p + 1);
+	if (strncmp(p, "zone", 4) != 0)
 		return 0;
+	p = proc_scan_key(p + 4, &len);
+	if ((len == 0) || (len >= FLDLEN))
+		return 0;
+	memcpy(zone, p, len);
+	zone[len] = '\0';
+	p += len;
 
 	for (order = 0; order < MAX_ORDER; order++) {
-		if ((t = strtok(NULL, " ")) == NULL ||
-		    sscanf(t, " %ld", &nr_free[order]) != 1)
+		if ((p = proc_scan_ulong(p, &nr_free[order])) == NULL)
 			return 0;
 	}
 
@@ -260,8 +436,9 @@ int scan_buddyinfo(char *line, char *node, char *zone, unsigned long *nr_free)
 }
 
 /*
- * Compile free page info for the next node and update free pages
- * vector passed by the caller.
+ * Compile free page info for the next node in buddyinfo, starting at
+ * *pos, and update free pages vector passed by the caller. *pos is
+ * advanced to the first line of the following node.
  *
  * RETURNS:
  *	1	No error
@@ -269,46 +446,37 @@ int scan_buddyinfo(char *line, char *node, char *zone, unsigned long *nr_free)
  *	-1	EOF
  *
  */
-#define FLDLEN	20
 #define NO_ERR	1
 #define ERR	0
 #define EOF_RET	-1
-int get_next_node(FILE *ifile, int *nid, unsigned long *nr_free)
+int get_next_node(const struct proc_file *pf, const char **pos, int *nid,
+		  unsigned long *nr_free)
 {
-	char line[LINE_MAX];
-	char node[FLDLEN], zone[FLDLEN];
+	const char *line, *end = pf->buf + pf->len;
+	char zone[FLDLEN];
 	unsigned long free_pages[MAX_ORDER];
-	int order, current_node = -1;
+	int order, line_nid, current_node = -1;
 
 	for (order = 0; order < MAX_ORDER; order++)
 		nr_free[order] = 0;
 	/*
-	 * Read the file one line at a time until we find the next
-	 * "Normal" zone or reach EOF
+	 * Go through the file one line at a time until we find the next
+	 * node or reach EOF
 	 */
 	while (1) {
-		long cur_pos;
-
-		if ((cur_pos = ftell(ifile)) < 0) {
-			log_err("ftell on buddyinfo failed (%s)", strerror(errno));
-			return ERR;
-		}
-		if (fgets(line, sizeof(line), ifile) == NULL) {
-			if (feof(ifile)) {
-				rewind(ifile);
-				return EOF_RET;
+		line = *pos;
+		if (line >= end) {
+			if (current_node == -1) {
+				log_err("no nodes found in buddyinfo");
+				return ERR;
 			}
-			log_err("fgets(): %s",
-					strerror(ferror(ifile)));
-			return ERR;
+			*nid = current_node;
+			return EOF_RET;
 		}
 
-		if (!scan_buddyinfo(line, node, zone, free_pages)) {
-			log_err("invalid input: %s", line);
-			return ERR;
-		}
-		if (sscanf(node, "%d", nid) <= 0) {
-			log_err("invalid input: %s", node);
+		if (!scan_buddyinfo(line, &line_nid, zone, free_pages)) {
+			log_err("invalid input: %.*s",
+				(int)(proc_next_line(line, end) - line), line);
 			return ERR;
 		}
 
@@ -316,15 +484,11 @@ int get_next_node(FILE *ifile, int *nid, unsigned long *nr_free)
 		 * Accumulate free pages infor for just the current node
 		 */
 		if (current_node == -1)
-			current_node = *nid;
+			current_node = line_nid;
 
-		if (*nid != current_node) {
-			if (fseek(ifile, cur_pos, SEEK_SET) < 0) {
-				log_err("fseek on buddyinfo failed (%s)", strerror(errno));
-				return ERR;
-			}
+		if (line_nid != current_node)
 			break;
-		}
+		*pos = proc_next_line(line, end);
 
 		/* Skip DMA zone if needed  */
 		if (skip_dmazone && strncmp(zone, "DMA", FLDLEN) == 0)
@@ -339,6 +503,231 @@ int get_next_node(FILE *ifile, int *nid, unsigned long *nr_free)
 	return NO_ERR;
 }
 
+/*
+ * Free pages in highest order blocks on a node, in base pages, or -1 if
+ * buddyinfo could not be read
+ */
+static long node_bigpages(struct proc_file *pf, int nid)
+{
+	unsigned long nr_free[MAX_ORDER];
+	const char *pos;
+	int node, retval;
+
+	if (proc_file_read(pf) < 0)
+		return -1;
+
+	pos = pf->buf;
+	while ((retval = get_next_node(pf, &pos, &node, nr_free)) != ERR) {
+		if (node == nid)
+			return nr_free[MAX_ORDER - 1] << (MAX_ORDER - 1);
+		if (retval == EOF_RET)
+			break;
+	}
+
+	return -1;
+}
+
+/*
+ * Raise compaction_proactiveness and wait up to COMPACT_BOOST_MSECS for
+ * kcompactd to create highest order pages on the node. Returns the
+ * number of pages in highest order blocks, or -1 on error.
+ */
+static long proactive_compact(struct compact_worker *cw, int nid, long before)
+{
+	long after = before;
+	int waited;
+
+	if (!cw->boosted && (cw->orig_proactiveness < COMPACT_BOOST_PROACTIVENESS)) {
+		if (set_proactiveness(COMPACT_BOOST_PROACTIVENESS))
+			return -1;
+		cw->boosted = true;
+		log_info(3, "Raised compaction proactiveness from %d to %d",
+			 cw->orig_proactiveness, COMPACT_BOOST_PROACTIVENESS);
+	}
+
+	for (waited = 0; waited < COMPACT_BOOST_MSECS; waited += COMPACT_POLL_MSECS) {
+		usleep(COMPACT_POLL_MSECS * 1000);
+		after = node_bigpages(&cw->buddyinfo, nid);
+		if ((after < 0) || (after > before))
+			break;
+	}
+
+	return after;
+}
+
+/*
+ * Wait for the next node to compact. Restores compaction_proactiveness
+ * once no node has been queued for COMPACT_BOOST_MSECS. Returns -1 when
+ * the worker is being stopped. Called with lock held.
+ */
+static int compact_worker_next(struct compact_worker *cw)
+{
+	struct timespec deadline;
+	int nid;
+
+	while ((cw->count == 0) && !cw->stop) {
+		if (!cw->boosted) {
+			pthread_cond_wait(&cw->cond, &cw->lock);
+			continue;
+		}
+
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += COMPACT_BOOST_MSECS / 1000;
+		if ((pthread_cond_timedwait(&cw->cond, &cw->lock, &deadline) == ETIMEDOUT) &&
+		    (cw->count == 0)) {
+			set_proactiveness(cw->orig_proactiveness);
+			cw->boosted = false;
+			log_info(3, "Restored compaction proactiveness to %d",
+				 cw->orig_proactiveness);
+		}
+	}
+
+	if (cw->stop)
+		return -1;
+
+	nid = cw->queue[cw->head];
+	cw->head = (cw->head + 1) % cw->size;
+	cw->count--;
+	cw->busy_nid = nid;
+
+	return nid;
+}
+
+/*
+ * Compaction worker thread. Compacts queued nodes in the background
+ * where compaction_proactiveness is supported and directly otherwise,
+ * and times how fast highest order pages are created to measure the
+ * compaction rate.
+ */
+static void *compact_worker_main(void *arg)
+{
+	struct compact_worker *cw = arg;
+	struct timespec start, end;
+	long before, after, elapsed;
+	int nid;
+
+	pthread_mutex_lock(&cw->lock);
+	while (1) {
+		nid = compact_worker_next(cw);
+		pthread_mutex_unlock(&cw->lock);
+		if (nid < 0)
+			break;
+
+		before = node_bigpages(&cw->buddyinfo, nid);
+		clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+		after = -1;
+		if ((cw->orig_proactiveness >= 0) && (before >= 0))
+			after = proactive_compact(cw, nid, before);
+		if (after <= before) {
+			log_info(3, "Compacting node %d directly", nid);
+			before = node_bigpages(&cw->buddyinfo, nid);
+			clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+			compact(nid);
+			after = node_bigpages(&cw->buddyinfo, nid);
+		}
+		clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+		elapsed = get_msecs(&end) - get_msecs(&start);
+
+		pthread_mutex_lock(&cw->lock);
+		cw->busy_nid = -1;
+		if ((before >= 0) && (after > before)) {
+			cw->rate = (after - before) / (elapsed ? elapsed : 1);
+			log_info(5, "** compaction rate on node %d is %ld pages/msec",
+				 nid, cw->rate);
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Start the compaction worker. Compaction is done synchronously from
+ * queue_compaction() if it can not be started.
+ */
+void start_compact_worker()
+{
+	int err;
+
+	compactor.orig_proactiveness = get_proactiveness();
+	if ((err = proc_file_open(&compactor.buddyinfo)) < 0) {
+		log_err("Failed to open "BUDDYINFO" for compaction worker (%s)", strerror(-err));
+		return;
+	}
+
+	if ((err = pthread_create(&compactor.thread, NULL, compact_worker_main, &compactor))) {
+		log_err("Failed to start compaction worker (%s)", strerror(err));
+		return;
+	}
+	compactor.started = true;
+}
+
+/*
+ * Stop the compaction worker, and restore compaction_proactiveness if
+ * the worker left it raised. Waits for a compaction in progress to
+ * finish. Must not be called from the worker.
+ */
+void stop_compact_worker()
+{
+	if (compactor.started) {
+		pthread_mutex_lock(&compactor.lock);
+		compactor.stop = true;
+		pthread_cond_signal(&compactor.cond);
+		pthread_mutex_unlock(&compactor.lock);
+
+		pthread_join(compactor.thread, NULL);
+		compactor.started = false;
+	}
+
+	if (compactor.boosted) {
+		set_proactiveness(compactor.orig_proactiveness);
+		compactor.boosted = false;
+		log_info(3, "Restored compaction proactiveness to %d",
+			 compactor.orig_proactiveness);
+	}
+}
+
+/*
+ * Queue a node for compaction by the worker unless it is already queued
+ * or being compacted
+ */
+void queue_compaction(int nid)
+{
+	int i, size, *queue;
+
+	if (!compactor.started) {
+		compact(nid);
+		return;
+	}
+
+	pthread_mutex_lock(&compactor.lock);
+	if (compactor.busy_nid == nid)
+		goto out;
+	for (i = 0; i < compactor.count; i++)
+		if (compactor.queue[(compactor.head + i) % compactor.size] == nid)
+			goto out;
+
+	if (compactor.count == compactor.size) {
+		size = compactor.size ? compactor.size * 2 : 8;
+		queue = malloc(size * sizeof(int));
+		if (!queue) {
+			log_err("Failed to queue compaction on node %d", nid);
+			goto out;
+		}
+		for (i = 0; i < compactor.count; i++)
+			queue[i] = compactor.queue[(compactor.head + i) % compactor.size];
+		free(compactor.queue);
+		compactor.queue = queue;
+		compactor.size = size;
+		compactor.head = 0;
+	}
+
+	compactor.queue[(compactor.head + compactor.count) % compactor.size] = nid;
+	compactor.count++;
+	pthread_cond_signal(&compactor.cond);
+out:
+	pthread_mutex_unlock(&compactor.lock);
+}
+
 /*
  * Compute the number of base pages tied up in hugepages.
  *
@@ -405,37 +794,206 @@ int update_hugepages()
 	return rc;
 }
 
+/*
+ * Grow a per node array from old_nr to new_nr entries and clear the
+ * new entries
+ */
+static void *grow_node_array(void *ptr, size_t size, int old_nr, int new_nr)
+{
+	char *p;
+
+	p = realloc(ptr, size * new_nr);
+	if (!p) {
+		log_err("Failed to allocate memory for %d nodes", new_nr);
+		bailout(1);
+	}
+	memset(p + size * old_nr, 0, size * (new_nr - old_nr));
+
+	return p;
+}
+
+static void clear_node(int nid)
+{
+	nodes.min_wmark[nid] = nodes.low_wmark[nid] = 0;
+	nodes.high_wmark[nid] = nodes.managed_pages[nid] = 0;
+	nodes.start_pfn[nid] = nodes.end_pfn[nid] = 0;
+	nodes.last_bigpages[nid] = 0;
+	nodes.free_pages[nid] = nodes.verdict[nid] = 0;
+	nodes.free_trend[nid] = 0;
+	memset(&nodes.page_lsq[nid], 0, sizeof(struct lsq_struct));
+}
+
+/*
+ * update_online_nodes() - Size per node state from the online node mask
+ *
+ * NODE_ONLINE holds a list of node id ranges, e.g. "0-3,8". Per node
+ * arrays grow when a node with a higher id than seen before comes
+ * online. They never shrink, but the state of a node that goes offline
+ * is cleared so it starts afresh if it comes back. Kernels built
+ * without NUMA support have no NODE_ONLINE and only node 0.
+ */
+void update_online_nodes()
+{
+	bool online[MAX_NUMANODES];
+	unsigned long first, last;
+	int nr_node_ids = 0, nr_online = 0, nid;
+	const char *p;
+
+	memset(online, 0, sizeof(online));
+	if (proc_file_read(&node_online_file) < 0) {
+		online[0] = true;
+		nr_node_ids = 1;
+	} else {
+		p = node_online_file.buf;
+		while ((p = proc_scan_ulong(p, &first)) != NULL) {
+			last = first;
+			if ((*p == '-') && ((p = proc_scan_ulong(p + 1, &last)) == NULL))
+				break;
+			if ((first > last) || (last >= MAX_NUMANODES))
+				break;
+			for (nid = first; nid <= last; nid++)
+				online[nid] = true;
+			if (last + 1 > nr_node_ids)
+				nr_node_ids = last + 1;
+			if (*p != ',')
+				break;
+			p++;
+		}
+
+		if (nr_node_ids == 0) {
+			log_err("Failed to parse "NODE_ONLINE", assuming a single node");
+			online[0] = true;
+			nr_node_ids = 1;
+		}
+	}
+
+	if (nr_node_ids > nodes.nr_node_ids) {
+		int old_nr = nodes.nr_node_ids;
+
+		nodes.online = grow_node_array(nodes.online, sizeof(int),
+					       old_nr, nr_node_ids);
+		nodes.is_online = grow_node_array(nodes.is_online, sizeof(bool),
+						  old_nr, nr_node_ids);
+		nodes.min_wmark = grow_node_array(nodes.min_wmark, sizeof(unsigned long),
+						  old_nr, nr_node_ids);
+		nodes.low_wmark = grow_node_array(nodes.low_wmark, sizeof(unsigned long),
+						  old_nr, nr_node_ids);
+		nodes.high_wmark = grow_node_array(nodes.high_wmark, sizeof(unsigned long),
+						   old_nr, nr_node_ids);
+		nodes.managed_pages = grow_node_array(nodes.managed_pages, sizeof(unsigned long),
+						      old_nr, nr_node_ids);
+		nodes.start_pfn = grow_node_array(nodes.start_pfn, sizeof(unsigned long),
+						  old_nr, nr_node_ids);
+		nodes.end_pfn = grow_node_array(nodes.end_pfn, sizeof(unsigned long),
+						old_nr, nr_node_ids);
+		nodes.last_bigpages = grow_node_array(nodes.last_bigpages, sizeof(unsigned long),
+						      old_nr, nr_node_ids);
+		nodes.free_pages = grow_node_array(nodes.free_pages, sizeof(unsigned long),
+						   old_nr, nr_node_ids);
+		nodes.verdict = grow_node_array(nodes.verdict, sizeof(unsigned long),
+						old_nr, nr_node_ids);
+		nodes.free_trend = grow_node_array(nodes.free_trend, sizeof(long long),
+						   old_nr, nr_node_ids);
+		nodes.page_lsq = grow_node_array(nodes.page_lsq, sizeof(struct lsq_struct),
+						 old_nr, nr_node_ids);
+		nodes.nr_node_ids = nr_node_ids;
+	}
+
+	for (nid = 0; nid < nodes.nr_node_ids; nid++) {
+		if (nodes.is_online[nid] && !online[nid])
+			clear_node(nid);
+		nodes.is_online[nid] = online[nid];
+		if (online[nid])
+			nodes.online[nr_online++] = nid;
+	}
+
+	if (nodes.nr_online && (nodes.nr_online != nr_online))
+		log_info(1, "Number of online NUMA nodes changed from %d to %d",
+			 nodes.nr_online, nr_online);
+	nodes.nr_online = nr_online;
+}
+
 /*
  * Parse watermarks and zone_managed_pages values from /proc/zoneinfo
+ *
+ * The span of each node is recorded in start_pfn and end_pfn as well,
+ * from "start_pfn" and "spanned" of all of its populated zones. Totals
+ * across all nodes are updated at the end.
  */
-#define ZONE_MIN	"min"
-#define ZONE_LOW	"low"
-#define ZONE_HIGH	"high"
-#define ZONE_MNGD	"managed"
-#define ZONE_PGST	"pagesets"
-int update_zone_watermarks()
+enum zoneinfo_keys {
+	ZONE_MIN,
+	ZONE_LOW,
+	ZONE_HIGH,
+	ZONE_MNGD,
+	ZONE_SPANNED,
+	ZONE_START_PFN,
+	ZONE_PGST,
+};
+
+static const struct proc_key zoneinfo_key_list[] = {
+	{ "min",	ZONE_MIN },
+	{ "low",	ZONE_LOW },
+	{ "high",	ZONE_HIGH },
+	{ "managed",	ZONE_MNGD },
+	{ "spanned",	ZONE_SPANNED },
+	{ "start_pfn",	ZONE_START_PFN },
+	{ "pagesets",	ZONE_PGST },
+};
+static struct proc_keytab zoneinfo_keys;
+
+/*
+ * The per-cpu pagesets of a zone make up most of zoneinfo on a large
+ * system and there is nothing of interest in them. Jump past them to
+ * "node_unreclaimable", which is followed by "start_pfn", or to the
+ * next zone if there is no such line.
+ */
+static const char *skip_pagesets(const char *p, const char *end)
 {
-	FILE *fp = NULL;
-	size_t len = 256;
-	char *line = malloc(len);
-	int current_node = -1;
+	static const char next_zone[] = "\nNode ";
+	static const char unreclaimable[] = "\n  node_unreclaimable:";
+	const char *zone_end, *q;
 
-	fp = fopen(ZONEINFO, "r");
-	if (!fp)
-		return 0;
+	zone_end = memmem(p, end - p, next_zone, sizeof(next_zone) - 1);
+	if (!zone_end)
+		zone_end = end;
 
-	while ((fgets(line, len, fp) != NULL)) {
-		if (strncmp(line, "Node", 4) == 0) {
-			char node[FLDLEN], zone[FLDLEN], zone_name[FLDLEN];
-			int nid;
-			unsigned long min, low, high, managed;
+	q = memmem(p, zone_end - p, unreclaimable, sizeof(unreclaimable) - 1);
+	if (!q)
+		q = zone_end;
+
+	return (q < end) ? q + 1 : end;
+}
+
+static int parse_zoneinfo(void)
+{
+	unsigned long min = 0, low = 0, high = 0, managed = 0;
+	const char *p, *end, *key;
+	unsigned long val, spanned = 0;
+	int nid = -1, current_node = -1, nr_seen = 0, id, i;
+	bool skip_zone = false;
+	size_t len;
+
+	/* Memoryless nodes do not show up in zoneinfo */
+	for (i = 0; i < nodes.nr_online; i++) {
+		nid = nodes.online[i];
+		nodes.min_wmark[nid] = nodes.low_wmark[nid] = 0;
+		nodes.high_wmark[nid] = nodes.managed_pages[nid] = 0;
+		nodes.start_pfn[nid] = nodes.end_pfn[nid] = 0;
+	}
+	nid = -1;
 
-			if (sscanf(line, "%s %d, %s %8s\n", node, &nid, zone, zone_name) <= 0)
-				goto out;
+	p = zoneinfo_file.buf;
+	end = p + zoneinfo_file.len;
+	while (p < end) {
+		if (strncmp(p, "Node", 4) == 0) {
+			if ((p = proc_scan_ulong(p + 4, &val)) == NULL)
+				break;
+			if ((val >= nodes.nr_node_ids) || !nodes.is_online[val])
+				return -EAGAIN;
+			nid = val;
 			if ((current_node == -1) || (current_node != nid)) {
 				current_node = nid;
-				min_wmark[nid] = low_wmark[nid] = 0;
-				high_wmark[nid] = managed_pages[nid] = 0;
+				nr_seen++;
 			}
 
 			/*
@@ -448,46 +1006,106 @@ int update_zone_watermarks()
 			 * continues mapping into DMA32 and Normal zones.
 			 * Ignore pages in DMA zone for x86 and x86-64.
 			 */
-			if (!skip_dmazone || (strncmp("DMA", zone_name, FLDLEN) != 0)) {
-				/*
-				 * We found the normal zone. Now look for
-				 * line "pages free"
-				 */
-				if (fgets(line, len, fp) == NULL)
-					goto out;
-
-				while (1) {
-					unsigned long val;
-					char name[256];
-
-					if (fgets(line, len, fp) == NULL)
-						goto out;
-
-					if (sscanf(line, "%s %lu\n", name, &val) <= 0)
-						goto out;
-					if (strncmp(name, ZONE_MIN, sizeof(ZONE_MIN)) == 0)
-						min = val;
-					if (strncmp(name, ZONE_LOW, sizeof(ZONE_LOW)) == 0)
-						low = val;
-					if (strncmp(name, ZONE_HIGH, sizeof(ZONE_HIGH)) == 0)
-						high = val;
-					if (strncmp(name, ZONE_MNGD, sizeof(ZONE_MNGD)) == 0)
-						managed = val;
-					if (strncmp(name, ZONE_PGST, sizeof(ZONE_PGST)) == 0)
-						break;
-				}
+			p = proc_skip_space(p + 1);
+			if (strncmp(p, "zone", 4) == 0)
+				p += 4;
+			key = proc_scan_key(p, &len);
+			skip_zone = skip_dmazone && (len == 3) &&
+				    (strncmp(key, "DMA", 3) == 0);
+			min = low = high = managed = spanned = 0;
+			p = proc_next_line(p, end);
+			continue;
+		}
 
-				min_wmark[nid] += min;
-				low_wmark[nid] += low;
-				high_wmark[nid] += high;
-				managed_pages[nid] += managed;
+		key = proc_scan_key(p, &len);
+		id = (nid < 0) ? -1 : proc_keytab_lookup(&zoneinfo_keys, key, len);
+		if (id == ZONE_PGST) {
+			/*
+			 * Only populated zones have pagesets. Watermarks
+			 * of empty zones don't count
+			 */
+			if (!skip_zone) {
+				nodes.min_wmark[nid] += min;
+				nodes.low_wmark[nid] += low;
+				nodes.high_wmark[nid] += high;
+				nodes.managed_pages[nid] += managed;
 			}
+			p = skip_pagesets(p, end);
+			continue;
+		}
+		if ((id < 0) || (proc_scan_ulong(key + len, &val) == NULL)) {
+			p = proc_next_line(p, end);
+			continue;
+		}
+
+		switch (id) {
+		case ZONE_MIN:
+			min = val;
+			break;
+		case ZONE_LOW:
+			low = val;
+			break;
+		case ZONE_HIGH:
+			high = val;
+			break;
+		case ZONE_MNGD:
+			managed = val;
+			break;
+		case ZONE_SPANNED:
+			spanned = val;
+			break;
+		case ZONE_START_PFN:
+			if (spanned == 0)
+				break;
+			if ((nodes.end_pfn[nid] == 0) || (val < nodes.start_pfn[nid]))
+				nodes.start_pfn[nid] = val;
+			if (val + spanned > nodes.end_pfn[nid])
+				nodes.end_pfn[nid] = val + spanned;
+			break;
+		default:
+			break;
 		}
+		p = proc_next_line(p, end);
+	}
+
+	return nr_seen;
+}
+
+int update_zone_watermarks()
+{
+	static int last_nr_seen = -1;
+	int i, nid, nr_seen;
+
+	if (proc_file_read(&zoneinfo_file) < 0)
+		return 0;
+
+	/*
+	 * A node that is not online yet showed up in zoneinfo, or the
+	 * number of nodes with memory changed. Either way nodes may have
+	 * come online or gone offline, so refresh the online node mask.
+	 */
+	nr_seen = parse_zoneinfo();
+	if ((nr_seen == -EAGAIN) || ((last_nr_seen != -1) && (nr_seen != last_nr_seen))) {
+		update_online_nodes();
+		nr_seen = parse_zoneinfo();
+		if (nr_seen == -EAGAIN)
+			log_err("NUMA nodes in "ZONEINFO" do not match "NODE_ONLINE);
+	}
+	last_nr_seen = nr_seen;
+
+	total_managed = total_min_wmark = 0;
+	total_low_wmark = total_high_wmark = 0;
+	nr_wmark_nodes = 0;
+	for (i = 0; i < nodes.nr_online; i++) {
+		nid = nodes.online[i];
+		total_managed += nodes.managed_pages[nid];
+		total_min_wmark += nodes.min_wmark[nid];
+		total_low_wmark += nodes.low_wmark[nid];
+		total_high_wmark += nodes.high_wmark[nid];
+		if (nodes.low_wmark[nid] != 0)
+			nr_wmark_nodes++;
 	}
 
-out:
-	free(line);
-	fclose(fp);
 	return 0;
 }
 
@@ -505,15 +1123,12 @@ out:
  */
 void rescale_maxwsf()
 {
-	unsigned long reclaimable_pages, total_managed = 0;
+	unsigned long reclaimable_pages;
 	unsigned long gap, new_wsf;
-	int i;
 
 	if (total_hugepages == 0)
 		return;
 
-	for (i = 0; i < MAX_NUMANODES; i++)
-		total_managed += managed_pages[i];
 	if (total_managed == 0) {
 		log_info(1, "Number of managed pages is 0");
 		return;
@@ -587,8 +1202,8 @@ void rescale_vfs_cache_pressure()
 	unsigned long curr_inodes;
 	unsigned long curr_dentries;
 	unsigned long curr_vfs_cache_pressure;
+	long long fs_y[FS_FIELDS], fs_m[FS_FIELDS], fs_c[FS_FIELDS];
 	long long dentry_m, inode_m;
-	long long dentry_c, inode_c;
 
 	if (parse_fs_files(VFS_CACHE_PRESSURE, &curr_vfs_cache_pressure) ||
 		parse_fs_files(INODEINFO, &curr_inodes) ||
@@ -597,11 +1212,13 @@ void rescale_vfs_cache_pressure()
 
 	clock_gettime(CLOCK_MONOTONIC_RAW, &spec);
 
-	if(lsq_fit(&fs_lsq[0], curr_dentries,
-				(long long)get_msecs(&spec),&dentry_m, &dentry_c) ||
-		lsq_fit(&fs_lsq[1], curr_inodes,
-				(long long)get_msecs(&spec), &inode_m, &inode_c))
-			return;
+	fs_y[0] = curr_dentries;
+	fs_y[1] = curr_inodes;
+	if (lsq_fit(&fs_lsq, FS_FIELDS, fs_y, (long long)get_msecs(&spec),
+		    fs_m, fs_c))
+		return;
+	dentry_m = fs_m[0];
+	inode_m = fs_m[1];
 	/*
 	 * adjust vm.vfs_cache_pressure based on the
 	 * growth of cached inode and dentry objects
@@ -630,36 +1247,43 @@ void rescale_vfs_cache_pressure()
 /*
  * Get the number of pages stolen by kswapd from /proc/vmstat.
  */
+enum vmstat_keys {
+	VMSTAT_PGSTEAL,
+	VMSTAT_INACTIVE,
+};
+
+static const struct proc_key vmstat_key_list[] = {
+	{ "pgsteal_kswapd",		VMSTAT_PGSTEAL },
+	{ "pgsteal_kswapd_normal",	VMSTAT_PGSTEAL },
+	{ "pgsteal_kswapd_movable",	VMSTAT_PGSTEAL },
+	{ "nr_inactive_file",		VMSTAT_INACTIVE },
+	{ "nr_inactive_anon",		VMSTAT_INACTIVE },
+};
+static struct proc_keytab vmstat_keys;
+
 unsigned long no_pages_reclaimed()
 {
-	FILE *fp = NULL;
-	size_t len = 100;
-	char *line = malloc(len);
+	const char *p, *end, *key;
 	unsigned long val, reclaimed;
-	char desc[100];
+	size_t len;
+	int id;
 
-	fp = fopen(VMSTAT, "r");
-	if (!fp)
+	if (proc_file_read(&vmstat_file) < 0)
 		return 0;
 
 	total_cache_pages = reclaimed = 0;
-	while ((fgets(line, len, fp) != NULL)) {
-		if (sscanf(line, "%s %lu\n", desc, &val) <= 0)
-			break;
-		if (strcmp(desc, "pgsteal_kswapd") == 0)
-			reclaimed += val;
-		if (strcmp(desc, "pgsteal_kswapd_normal") == 0)
-			reclaimed += val;
-		if (strcmp(desc, "pgsteal_kswapd_movable") == 0)
+	end = vmstat_file.buf + vmstat_file.len;
+	for (p = vmstat_file.buf; p < end; p = proc_next_line(p, end)) {
+		key = proc_scan_key(p, &len);
+		id = proc_keytab_lookup(&vmstat_keys, key, len);
+		if ((id < 0) || (proc_scan_ulong(key + len, &val) == NULL))
+			continue;
+		if (id == VMSTAT_PGSTEAL)
 			reclaimed += val;
-		if (strcmp(desc, "nr_inactive_file") == 0)
-			total_cache_pages += val;
-		if (strcmp(desc, "nr_inactive_anon") == 0)
+		else
 			total_cache_pages += val;
 	}
 
-	free(line);
-	fclose(fp);
 	return reclaimed;
 }
 
@@ -669,28 +1293,30 @@ unsigned long no_pages_reclaimed()
  */
 void rescale_watermarks(int scale_up)
 {
-	int fd, i, count;
+	int fd;
 	unsigned long scaled_watermark, frac_free;
 	char scaled_wmark[20], *c;
-	unsigned long total_managed = 0;
+	unsigned long managed;
 	unsigned long mmark, lmark, hmark;
 
-	for (i = 0; i < MAX_NUMANODES; i++)
-		total_managed += managed_pages[i];
 	/*
 	 * Hugepages should not be taken into account for watermark
 	 * calculations since they are not reclaimable
 	 */
-	total_managed -= total_hugepages;
-	if (total_managed == 0) {
+	managed = total_managed - total_hugepages;
+	if (managed == 0) {
 		log_info(1, "Number of managed non-huge pages is 0");
 		return;
 	}
+	if (nr_wmark_nodes == 0) {
+		log_info(1, "No NUMA nodes with watermarks");
+		return;
+	}
 
 	/*
 	 * Fraction of managed pages currently free
 	 */
-	frac_free = (total_free_pages*1000)/total_managed;
+	frac_free = (total_free_pages*1000)/managed;
 
 	/*
 	 * Get the current watermark scale factor.
@@ -712,15 +1338,8 @@ void rescale_watermarks(int scale_up)
 	/*
 	 * Compute average high and low watermarks across nodes
 	 */
-	lmark = hmark = count = 0;
-	for (i = 0; i < MAX_NUMANODES; i++) {
-		lmark += low_wmark[i];
-		hmark += high_wmark[i];
-		if (low_wmark[i] != 0)
-			count++;
-	}
-	lmark = lmark/count;
-	hmark = hmark/count;
+	lmark = total_low_wmark/nr_wmark_nodes;
+	hmark = total_high_wmark/nr_wmark_nodes;
 
 	/*
 	 * If memory pressure is easing, scale watermarks back and let
@@ -831,11 +1450,8 @@ void rescale_watermarks(int scale_up)
 							total_cache_pages;
 		unsigned long new_lmark;
 
-		mmark = lmark = 0;
-		for (i = 0; i < MAX_NUMANODES; i++) {
-			mmark += min_wmark[i];
-			lmark += low_wmark[i];
-		}
+		mmark = total_min_wmark;
+		lmark = total_low_wmark;
 
 		/*
 		 * Estimate the new low watermark if we were to increase
@@ -984,12 +1600,10 @@ void update_neg_dentry(bool init)
 			 * Compute the value for negative dentry limit
 			 * based upon just the reclaimable pages
 			 */
-			int val, i;
-			unsigned long reclaimable_pages, total_managed = 0;
+			int val;
+			unsigned long reclaimable_pages;
 			char neg_dentry[LINE_MAX];
 
-			for (i = 0; i < MAX_NUMANODES; i++)
-				total_managed += managed_pages[i];
 			reclaimable_pages = total_managed - total_hugepages;
 			val = (reclaimable_pages * neg_dentry_pct)/total_managed;
 			/*
@@ -1013,7 +1627,276 @@ void update_neg_dentry(bool init)
 }
 
 /*
- * get_unmapped_pages()- count number of unmapped pages reported in
+ * Range of PFNs [start, end) to scan in /proc/kpage{count,flags}
+ */
+struct pfn_range {
+	unsigned long start;
+	unsigned long end;
+};
+
+static int cmp_ulong(const void *a, const void *b)
+{
+	unsigned long ua = *(const unsigned long *)a;
+	unsigned long ub = *(const unsigned long *)b;
+
+	if (ua < ub)
+		return -1;
+	return (ua > ub);
+}
+
+/*
+ * get_pfn_ranges() - split the PFN space into one range per NUMA node
+ *
+ * A node's range starts at the lowest PFN spanned by its zones, as
+ * recorded by update_zone_watermarks(), and ends where the next node's
+ * range starts. The first range starts at PFN 0 and the last one runs
+ * to the end of /proc/kpage{count,flags}, so PFNs in holes between
+ * zones are still scanned, exactly once, same as a sequential read of
+ * the files would. Nodes with interleaved spans end up sharing ranges,
+ * which only affects how the work is split up.
+ *
+ * RETURNS:
+ *	Number of ranges in *rangesp, or 0 on error. *max_pfnp is set to
+ *	the end of the highest node span, or 0 if it is not known.
+ */
+int get_pfn_ranges(struct pfn_range **rangesp, unsigned long *max_pfnp)
+{
+	unsigned long *node_start;
+	struct pfn_range *ranges;
+	int nr_starts = 0, nr_ranges = 1;
+	int i, nid;
+
+	*max_pfnp = 0;
+	node_start = malloc((nodes.nr_online + 1) * sizeof(unsigned long));
+	if (!node_start)
+		return 0;
+	for (i = 0; i < nodes.nr_online; i++) {
+		nid = nodes.online[i];
+		if (nodes.end_pfn[nid] == 0)
+			continue;
+		node_start[nr_starts++] = nodes.start_pfn[nid];
+		if (nodes.end_pfn[nid] > *max_pfnp)
+			*max_pfnp = nodes.end_pfn[nid];
+	}
+
+	qsort(node_start, nr_starts, sizeof(unsigned long), cmp_ulong);
+	ranges = malloc((nr_starts + 1) * sizeof(struct pfn_range));
+	if (!ranges) {
+		free(node_start);
+		return 0;
+	}
+
+	ranges[0].start = 0;
+	for (i = 0; i < nr_starts; i++) {
+		if (node_start[i] == ranges[nr_ranges - 1].start)
+			continue;
+		ranges[nr_ranges - 1].end = node_start[i];
+		ranges[nr_ranges].start = node_start[i];
+		nr_ranges++;
+	}
+	ranges[nr_ranges - 1].end = LONG_MAX / sizeof(unsigned long);
+	free(node_start);
+
+	*rangesp = ranges;
+	return nr_ranges;
+}
+
+/*
+ * Scanning /proc/kpage{count,flags} on a large system means reading
+ * gigabytes from procfs. Read them in large blocks with pread() from
+ * several threads, each thread claiming the next KPAGE_SCAN_CHUNK PFNs
+ * of the ranges until all of them have been scanned.
+ */
+#define KPAGE_SCAN_BUFSIZE	(2UL << 20)
+#define KPAGE_SCAN_CHUNK	(KPAGE_SCAN_BUFSIZE / sizeof(unsigned long))
+#define KPAGE_SCAN_MAX_THREADS	8
+
+/*
+ * Chunks are also the unit for striping the PFN space. Stripe s of n
+ * is every chunk-aligned block of PFNs whose block number modulo n is s
+ */
+#define MAX_UNMAPPED_STRIPES	64
+
+/*
+ * A PFN is not counted as unmapped if it is not backed by a physical
+ * page, is poisoned, offline, in use by the kernel for slab or page
+ * tables, is free in the buddy allocator, or is a hugetlb page
+ */
+#define UNMAPPED_SKIP_MASK	((1UL << KPF_NOPAGE) | (1UL << KPF_HWPOISON) | \
+				 (1UL << KPF_OFFLINE) | (1UL << KPF_SLAB) | \
+				 (1UL << KPF_BUDDY) | (1UL << KPF_PGTABLE) | \
+				 (1UL << KPF_HUGE))
+
+struct kpage_scan {
+	struct pfn_range *ranges;
+	int nr_ranges;
+	int stripe;		/* stripe to scan, or -1 for all of them */
+	int nr_stripes;
+
+	/* protected by lock */
+	pthread_mutex_t lock;
+	int cur_range;
+	unsigned long next_pfn;
+	unsigned long stripe_pages[MAX_UNMAPPED_STRIPES];
+	int err;
+};
+
+struct kpage_worker {
+	struct kpage_scan *scan;
+	unsigned long *pagecnt;
+	unsigned long *pageflg;
+};
+
+/*
+ * Files and buffers are kept around from one scan to the next. Pages
+ * allocated for new buffers during a scan would have been counted as
+ * unmapped while free a moment earlier and skew the result.
+ */
+static int kpagecnt_fd = -1, kpageflg_fd = -1;
+static struct kpage_worker kpage_workers[KPAGE_SCAN_MAX_THREADS];
+
+/*
+ * Read up to len bytes at offset, retrying short reads until EOF
+ */
+static ssize_t pread_full(int fd, void *buf, size_t len, off_t offset)
+{
+	size_t total = 0;
+	ssize_t ret;
+
+	while (total < len) {
+		ret = pread(fd, (char *)buf + total, len - total, offset + total);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		if (ret == 0)
+			break;
+		total += ret;
+	}
+
+	return total;
+}
+
+/*
+ * Claim the next chunk of PFNs to scan. Returns false when there is
+ * nothing left to scan
+ */
+static bool kpage_scan_claim(struct kpage_scan *scan, int *range_idx,
+			     unsigned long *pfn, unsigned long *nr_pfns)
+{
+	struct pfn_range *range;
+	unsigned long block, block_end, skip;
+	bool ret = false;
+
+	pthread_mutex_lock(&scan->lock);
+	while (!scan->err && scan->cur_range < scan->nr_ranges) {
+		range = &scan->ranges[scan->cur_range];
+		if (scan->next_pfn < range->start)
+			scan->next_pfn = range->start;
+		if (scan->next_pfn >= range->end) {
+			scan->cur_range++;
+			continue;
+		}
+
+		/* Jump straight to the next block in the stripe */
+		block = scan->next_pfn / KPAGE_SCAN_CHUNK;
+		skip = (scan->stripe + scan->nr_stripes - block % scan->nr_stripes) %
+			scan->nr_stripes;
+		if (scan->stripe >= 0 && skip) {
+			scan->next_pfn = (block + skip) * KPAGE_SCAN_CHUNK;
+			continue;
+		}
+
+		block_end = (block + 1) * KPAGE_SCAN_CHUNK;
+		if (block_end > range->end)
+			block_end = range->end;
+		*range_idx = scan->cur_range;
+		*pfn = scan->next_pfn;
+		*nr_pfns = block_end - *pfn;
+		scan->next_pfn += *nr_pfns;
+		ret = true;
+		break;
+	}
+	pthread_mutex_unlock(&scan->lock);
+
+	return ret;
+}
+
+static void *kpage_scan_worker(void *arg)
+{
+	struct kpage_worker *worker = arg;
+	struct kpage_scan *scan = worker->scan;
+	unsigned long *pagecnt = worker->pagecnt;
+	unsigned long *pageflg = worker->pageflg;
+	unsigned long stripe_pages[MAX_UNMAPPED_STRIPES] = { 0 };
+	unsigned long pfn, nr_pfns, count, unmapped_pages, i;
+	ssize_t inbytes1, inbytes2;
+	int range_idx, err = 0;
+
+	while (kpage_scan_claim(scan, &range_idx, &pfn, &nr_pfns)) {
+		inbytes1 = pread_full(kpagecnt_fd, pagecnt, nr_pfns * sizeof(unsigned long),
+				      pfn * sizeof(unsigned long));
+		inbytes2 = pread_full(kpageflg_fd, pageflg, nr_pfns * sizeof(unsigned long),
+				      pfn * sizeof(unsigned long));
+		if ((inbytes1 < 0) || (inbytes2 < 0)) {
+			if (inbytes1 < 0)
+				log_err("Error reading kpagecount");
+			else
+				log_err("Error reading kpageflags");
+			err = 1;
+			break;
+		}
+
+		count = MIN(inbytes1, inbytes2) / sizeof(unsigned long);
+		unmapped_pages = 0;
+		for (i = 0; i < count; i++)
+			unmapped_pages += ((pageflg[i] & UNMAPPED_SKIP_MASK) == 0) &
+					  (pagecnt[i] == 0);
+		stripe_pages[(pfn / KPAGE_SCAN_CHUNK) % scan->nr_stripes] += unmapped_pages;
+
+		/* Reached the end of the files, nothing more in this range */
+		if (count < nr_pfns) {
+			pthread_mutex_lock(&scan->lock);
+			if (scan->ranges[range_idx].end > pfn + count)
+				scan->ranges[range_idx].end = pfn + count;
+			pthread_mutex_unlock(&scan->lock);
+		}
+	}
+
+	pthread_mutex_lock(&scan->lock);
+	for (i = 0; i < scan->nr_stripes; i++)
+		scan->stripe_pages[i] += stripe_pages[i];
+	if (err)
+		scan->err = 1;
+	pthread_mutex_unlock(&scan->lock);
+
+	return NULL;
+}
+
+/*
+ * Allocate and fault in the buffers for a scan thread
+ */
+static int kpage_worker_alloc(struct kpage_worker *worker)
+{
+	if (worker->pagecnt)
+		return 0;
+
+	if (posix_memalign((void **)&worker->pagecnt, getpagesize(), KPAGE_SCAN_BUFSIZE))
+		return -1;
+	if (posix_memalign((void **)&worker->pageflg, getpagesize(), KPAGE_SCAN_BUFSIZE)) {
+		free(worker->pagecnt);
+		worker->pagecnt = NULL;
+		return -1;
+	}
+	memset(worker->pagecnt, 0, KPAGE_SCAN_BUFSIZE);
+	memset(worker->pageflg, 0, KPAGE_SCAN_BUFSIZE);
+
+	return 0;
+}
+
+/*
+ * scan_unmapped_pages()- count number of unmapped pages reported in
  *	/proc/kpagecount
  *
  * /proc/kpagecount reports a current mapcount as a 64-bit integer for
@@ -1022,98 +1905,187 @@ void update_neg_dentry(bool init)
  * PFN including flag for whether a physical page is present at that
  * PFN. This flag can be used to identify PFNs that do not have a
  * backing pahysical page
+ *
+ * Only PFNs in the given stripe out of nr_stripes are scanned, or all of
+ * them if stripe is -1. The count for each stripe scanned is stored in
+ * stripe_pages.
+ *
+ * RETURNS:
+ *	Number of unmapped pages found, or -1 on error
  */
-long get_unmapped_pages()
+long scan_unmapped_pages(int stripe, int nr_stripes, unsigned long *stripe_pages)
 {
-#define BATCHSIZE	8192
-	int fd1, fd2;
-	long pagecnt[BATCHSIZE/sizeof(long)];
-	unsigned long pageflg[BATCHSIZE/sizeof(long)];
-	ssize_t inbytes1, inbytes2;
-	unsigned long count, unmapped_pages = 0;
+	pthread_t threads[KPAGE_SCAN_MAX_THREADS];
+	struct kpage_scan scan;
+	unsigned long max_pfn, nr_chunks;
+	long ncpus, unmapped_pages = 0;
+	int nr_threads, i;
 
-	if ((fd1 = open(KPAGECOUNT, O_RDONLY)) == -1) {
+	if (kpagecnt_fd == -1 && (kpagecnt_fd = open(KPAGECOUNT, O_RDONLY)) == -1) {
 		log_err("Error opening kpagecount");
 		return -1;
 	}
 
-	if ((fd2 = open(KPAGEFLAGS, O_RDONLY)) == -1) {
+	if (kpageflg_fd == -1 && (kpageflg_fd = open(KPAGEFLAGS, O_RDONLY)) == -1) {
 		log_err("Error opening kpageflags");
 		return -1;
 	}
 
-	inbytes1 = read(fd1, pagecnt, BATCHSIZE);
-	inbytes2 = read(fd2, pageflg, BATCHSIZE);
-	count = inbytes1/sizeof(long);
-	while ((inbytes1 > 0) && (inbytes2 > 0)) {
-		unsigned long i;
+	memset(&scan, 0, sizeof(scan));
+	scan.stripe = stripe;
+	scan.nr_stripes = nr_stripes;
+	scan.nr_ranges = get_pfn_ranges(&scan.ranges, &max_pfn);
+	if (scan.nr_ranges == 0) {
+		log_err("Failed to allocate memory for kpageflags scan");
+		return -1;
+	}
 
-		i = 0;
-		while (i < count) {
-			/*
-			 * Skip PFN not backed by physical page
-			 */
-			if ((pageflg[i]>>KPF_NOPAGE) & 1)
-				goto nextloop;
-			if ((pageflg[i]>>KPF_HWPOISON) & 1)
-				goto nextloop;
-			if ((pageflg[i]>>KPF_OFFLINE) & 1)
-				goto nextloop;
-			if ((pageflg[i]>>KPF_SLAB) & 1)
-				goto nextloop;
-			if ((pageflg[i]>>KPF_BUDDY) & 1)
-				goto nextloop;
-			if ((pageflg[i]>>KPF_PGTABLE) & 1)
-				goto nextloop;
+	/* Don't start more threads than there are chunks to go around */
+	if (max_pfn)
+		nr_chunks = (max_pfn / KPAGE_SCAN_CHUNK + scan.nr_ranges) / nr_stripes + 1;
+	else
+		nr_chunks = KPAGE_SCAN_MAX_THREADS;
+	ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (ncpus < 1)
+		ncpus = 1;
+	nr_threads = MIN(MIN(ncpus, nr_chunks), KPAGE_SCAN_MAX_THREADS);
+
+	for (i = 0; i < nr_threads; i++) {
+		if (kpage_worker_alloc(&kpage_workers[i]))
+			break;
+		kpage_workers[i].scan = &scan;
+	}
+	nr_threads = i;
+	if (nr_threads == 0) {
+		log_err("Failed to allocate memory for kpageflags scan");
+		free(scan.ranges);
+		return -1;
+	}
 
-			/*
-			 * Pages not mapped in are free unless
-			 * they are reserved like hugetlb pages
-			 */
-			if ((pagecnt[i] == 0) &&
-				!((pageflg[i]>>KPF_HUGE) & 1))
-				unmapped_pages++;
+	pthread_mutex_init(&scan.lock, NULL);
 
-nextloop:
-			i++;
-		}
-		inbytes1 = read(fd2, pageflg, BATCHSIZE);
-		inbytes2 = read(fd1, pagecnt, BATCHSIZE);
-		count = inbytes2/sizeof(long);
+	/* This thread scans too, start one less */
+	for (i = 1; i < nr_threads; i++) {
+		if (pthread_create(&threads[i], NULL, kpage_scan_worker, &kpage_workers[i]))
+			break;
 	}
+	nr_threads = i;
+	kpage_scan_worker(&kpage_workers[0]);
+	for (i = 1; i < nr_threads; i++)
+		pthread_join(threads[i], NULL);
 
-	if ((inbytes1 < 0) || (inbytes2 < 0)) {
-		if (inbytes1 < 0)
-			log_err("Error reading kpageflagst");
-		else
-			log_err("Error reading kpagecount");
-		close(fd1);
-		close(fd2);
+	pthread_mutex_destroy(&scan.lock);
+	free(scan.ranges);
+
+	if (scan.err)
 		return -1;
+
+	for (i = 0; i < nr_stripes; i++) {
+		if (stripe >= 0 && i != stripe)
+			continue;
+		stripe_pages[i] = scan.stripe_pages[i];
+		unmapped_pages += scan.stripe_pages[i];
 	}
 
-	close(fd1);
-	close(fd2);
 	return unmapped_pages;
 }
 
+long get_unmapped_pages()
+{
+	unsigned long stripe_pages;
+
+	return scan_unmapped_pages(-1, 1, &stripe_pages);
+}
+
+struct unmapped_estimate {
+	long pages;		/* -1 if the scan failed */
+	unsigned long err;	/* pages may be off by up to this much */
+	bool exact;		/* pages came from a full scan */
+};
+
 /*
- * pr_meminfo() - log /proc/meminfo contents
+ * estimate_unmapped_pages() - keep a running estimate of unmapped pages
+ *	scanning only one stripe of the PFN space each time
+ *
+ * The estimate is the sum of the last count for each stripe. Stripes are
+ * scanned round-robin, so the oldest count is from nr_stripes - 1 calls
+ * ago. The stripe just scanned tells how much its count drifted over
+ * nr_stripes calls. Assuming the other stripes drift at the same rate,
+ * the stale counts are off by up to drift * (nr_stripes - 1) / 2 in
+ * total, which is reported as the error bound.
+ *
+ * A full scan is done to seed the stripe counts, when full is set, or
+ * when unmapped_scan_stripes is 1. It resets the error bound to 0.
  */
-void pr_meminfo(int level)
+void estimate_unmapped_pages(bool full, struct unmapped_estimate *est)
 {
-	FILE *fp = NULL;
-	char line[LINE_MAX];
+	static unsigned long stripe_pages[MAX_UNMAPPED_STRIPES];
+	static int nr_stripes, next_stripe;
+	unsigned long prev, drift;
+	long ret;
+	int i;
 
-	fp = fopen(MEMINFO, "r");
-	if (!fp)
+	if (full || (unmapped_scan_stripes <= 1) ||
+	    (nr_stripes != unmapped_scan_stripes)) {
+		nr_stripes = unmapped_scan_stripes;
+		if (next_stripe >= nr_stripes)
+			next_stripe = 0;
+		ret = scan_unmapped_pages(-1, nr_stripes, stripe_pages);
+		if (ret < 0)
+			nr_stripes = 0;
+		est->pages = ret;
+		est->err = 0;
+		est->exact = true;
+		return;
+	}
+
+	prev = stripe_pages[next_stripe];
+	ret = scan_unmapped_pages(next_stripe, nr_stripes, stripe_pages);
+	if (ret < 0) {
+		est->pages = -1;
 		return;
+	}
+	drift = (ret > prev) ? (ret - prev) : (prev - ret);
+	next_stripe = (next_stripe + 1) % nr_stripes;
+
+	est->pages = 0;
+	for (i = 0; i < nr_stripes; i++)
+		est->pages += stripe_pages[i];
+	est->err = drift * (nr_stripes - 1) / 2;
+	est->exact = false;
+}
 
-	while ((fgets(line, sizeof(line), fp) != NULL))
-		log_info(level, "%s", line);
+/*
+ * A leak warning is about to be logged. Make sure the unmapped page
+ * count it reports comes from a full scan and not an estimate
+ */
+long exact_unmapped_pages(struct unmapped_estimate *est)
+{
+	if (!est->exact)
+		estimate_unmapped_pages(true, est);
+	if (est->pages < 0) {
+		log_err("Failed to read unmapped pages count");
+		return 0;
+	}
 
-	fclose(fp);
+	return est->pages;
+}
+
+/*
+ * pr_meminfo() - log /proc/meminfo contents
+ */
+void pr_meminfo(int level)
+{
+	const char *p, *next, *end;
 
+	if (proc_file_read(&meminfo_file) < 0)
+		return;
+
+	end = meminfo_file.buf + meminfo_file.len;
+	for (p = meminfo_file.buf; p < end; p = next) {
+		next = proc_next_line(p, end);
+		log_info(level, "%.*s", (int)(next - p), p);
+	}
 }
 
 enum memdata_items {
@@ -1157,6 +2129,44 @@ char * const memdata_item_name[NR_MEMDATA_ITEMS] = {
 	"CmaTotal"
 };
 
+/*
+ * Keys of interest in /proc/meminfo. MemFree and MemTotal are tracked
+ * separately from memdata items
+ */
+#define MEMINFO_MEMFREE		NR_MEMDATA_ITEMS
+#define MEMINFO_MEMTOTAL	(NR_MEMDATA_ITEMS + 1)
+
+static const struct proc_key meminfo_key_list[] = {
+	{ "AnonPages",		ANONPAGES },
+	{ "Buffers",		BUFFERS },
+	{ "Cached",		CACHED },
+	{ "CmaTotal",		CMA },
+	{ "KReclaimable",	KRECLAIMABLE },
+	{ "KernelStack",	KSTACK },
+	{ "MemAvailable",	MEMAVAIL },
+	{ "MemFree",		MEMINFO_MEMFREE },
+	{ "MemTotal",		MEMINFO_MEMTOTAL },
+	{ "Mapped",		MAPPED },
+	{ "Mlocked",		MLOCKED },
+	{ "PageTables",		PGTABLE },
+	{ "SUnreclaim",		SUNRECLAIM },
+	{ "SecPageTables",	SECPGTABLE },
+	{ "Shmem",		SHMEM },
+	{ "Slab",		SLAB },
+	{ "SwapCached",		SWPCACHED },
+	{ "Unevictable",	UNEVICTABLE },
+	{ "VmallocUsed",	VMALLOCUSED },
+};
+static struct proc_keytab meminfo_keys;
+
+/* memdata items that count as memory clearly in use */
+#define MEMDATA_INUSE	((1UL << ANONPAGES) | (1UL << BUFFERS) | \
+			 (1UL << CACHED) | (1UL << CMA) | \
+			 (1UL << KRECLAIMABLE) | (1UL << KSTACK) | \
+			 (1UL << PGTABLE) | (1UL << SWPCACHED) | \
+			 (1UL << SUNRECLAIM) | (1UL << SECPGTABLE) | \
+			 (1UL << UNEVICTABLE))
+
 /*
  * cmp_meminfo() - Compare two instances of meminfo data and print the ones
  *		that have changed considerably
@@ -1220,12 +2230,12 @@ void check_memory_leak(bool init)
 	static unsigned long pr_memdata[NR_MEMDATA_ITEMS];
 	unsigned long memdata[NR_MEMDATA_ITEMS];
 	unsigned long i, mem_acctd;
-	unsigned long total_managed = 0;
+	struct unmapped_estimate unmapped;
 	long unmapped_pages;
-	FILE *fp = NULL;
-	char line[LINE_MAX];
+	const char *p, *end, *key;
 	unsigned long val, inuse_mem, freemem, unacct_mem, mem_total;
-	char desc[LINE_MAX];
+	size_t len;
+	int id;
 
 	/*
 	 * bail out if this module is not enabled
@@ -1233,16 +2243,13 @@ void check_memory_leak(bool init)
 	if (!memleak_check_enabled)
 		return;
 
-	for (i = 0; i < MAX_NUMANODES; i++)
-		total_managed += managed_pages[i];
 	for (i = 0; i < NR_MEMDATA_ITEMS; i++)
 		memdata[i] = 0;
 
 	/*
 	 * Now read meminfo file to get current memory info
 	 */
-	fp = fopen(MEMINFO, "r");
-	if (!fp)
+	if (proc_file_read(&meminfo_file) < 0)
 		return;
 
 	/*
@@ -1253,96 +2260,22 @@ void check_memory_leak(bool init)
 	 *			Shmem + KReclaimable + Slab + KernelStack +
 	 *			PageTables + SecPageTables + CmaTotal
 	 */
-	inuse_mem = 0;
-	while ((fgets(line, sizeof(line), fp) != NULL)) {
-		if (sscanf(line, "%s %lu\n", desc, &val) <= 0)
-			break;
-		switch (desc[0]) {
-		case 'A':
-			if (strcmp(desc, "AnonPages:") == 0) {
-				inuse_mem += val;
-				memdata[ANONPAGES] = val;
-			}
-			break;
-
-		case 'B':
-			if (strcmp(desc, "Buffers:") == 0) {
-				inuse_mem += val;
-				memdata[BUFFERS] = val;
-			}
-			break;
-
-		case 'C':
-			if (strcmp(desc, "Cached:") == 0) {
-				inuse_mem += val;
-				memdata[CACHED] = val;
-			} else if (strcmp(desc, "CmaTotal:") == 0) {
-				inuse_mem += val;
-				memdata[CMA] = val;
-			}
-			break;
-
-		case 'K':
-			if (strcmp(desc, "KReclaimable:") == 0) {
-				inuse_mem += val;
-				memdata[KRECLAIMABLE] = val;
-			} else if (strcmp(desc, "KernelStack:") == 0) {
-				inuse_mem += val;
-				memdata[KSTACK] = val;
-			}
-			break;
-
-		case 'M':
-			if (strcmp(desc, "MemFree:") == 0)
-				freemem = val;
-			else if (strcmp(desc, "MemTotal:") == 0)
-				mem_total = val;
-			else if (strcmp(desc, "MemAvailable:") == 0)
-				memdata[MEMAVAIL] = val;
-			else if (strcmp(desc, "Mlocked:") == 0)
-				memdata[MLOCKED] = val;
-			else if (strcmp(desc, "Mapped:") == 0)
-				memdata[MAPPED] = val;
-			break;
-
-		case 'P':
-			if (strcmp(desc, "PageTables:") == 0) {
-				inuse_mem += val;
-				memdata[PGTABLE] = val;
-			}
-			break;
-
-		case 'S':
-			if (strcmp(desc, "SwapCached:") == 0) {
-				inuse_mem += val;
-				memdata[SWPCACHED] = val;
-			} else if (strcmp(desc, "SUnreclaim:") == 0) {
-				inuse_mem += val;
-				memdata[SUNRECLAIM] = val;
-			} else if (strcmp(desc, "SecPageTables:") == 0) {
-				inuse_mem += val;
-				memdata[SECPGTABLE] = val;
-			} else if (strcmp(desc, "Shmem:") == 0) {
-				memdata[SHMEM] = val;
-			} else if (strcmp(desc, "Slab:") == 0) {
-				memdata[SLAB] = val;
-			}
-			break;
+	inuse_mem = freemem = mem_total = 0;
+	end = meminfo_file.buf + meminfo_file.len;
+	for (p = meminfo_file.buf; p < end; p = proc_next_line(p, end)) {
+		key = proc_scan_key(p, &len);
+		id = proc_keytab_lookup(&meminfo_keys, key, len);
+		if ((id < 0) || (proc_scan_ulong(key + len, &val) == NULL))
+			continue;
 
-		case 'U':
-			if (strcmp(desc, "Unevictable:") == 0) {
+		if (id == MEMINFO_MEMFREE) {
+			freemem = val;
+		} else if (id == MEMINFO_MEMTOTAL) {
+			mem_total = val;
+		} else {
+			memdata[id] = val;
+			if (MEMDATA_INUSE & (1UL << id))
 				inuse_mem += val;
-				memdata[UNEVICTABLE] = val;
-			}
-			break;
-
-		case 'V':
-			if (strcmp(desc, "VmallocUsed:") == 0)
-				memdata[VMALLOCUSED] = val;
-			break;
-
-		default:
-			break;
 		}
 	}
 
@@ -1354,7 +2287,6 @@ void check_memory_leak(bool init)
 	freemem = freemem/base_psize;
 	mem_total = mem_total/base_psize;
 	memdata[MEMAVAIL] = memdata[MEMAVAIL]/base_psize;
-	fclose(fp);
 
 	/*
 	 * Sum of memory in use, memory allocated to hugepages and free
@@ -1379,10 +2311,14 @@ void check_memory_leak(bool init)
 		goto out;
 	}
 
-	unmapped_pages = get_unmapped_pages();
+	estimate_unmapped_pages(false, &unmapped);
+	unmapped_pages = unmapped.pages;
 	if (unmapped_pages < 0) {
 		log_err("Failed to read unmapped pages count");
 		unmapped_pages = 0;
+	} else if (!unmapped.exact) {
+		log_info(5, "Unmapped memory estimated at %lu K (+/- %lu K)",
+			(unmapped_pages * base_psize), (unmapped.err * base_psize));
 	}
 
 	/*
@@ -1446,6 +2382,7 @@ void check_memory_leak(bool init)
 		 */
 		if (mem_remain && (unacct_mem > (mem_remain * 2)) &&
 			(gr_count > 3)) {
+			unmapped_pages = exact_unmapped_pages(&unmapped);
 			log_info(1, "Possible sudden memory leak - background memory use more than doubled (%lu K -> %lu K), unmapped memory = %lu K, freemem = %lu K, freemem previously = %lu K",
 				(mem_remain * base_psize),
 				(unacct_mem * base_psize),
@@ -1478,6 +2415,7 @@ void check_memory_leak(bool init)
 	 * in between, it may point to a slow leak
 	 */
 	if (gr_count > UNACCT_MEM_GRTH_MAX) {
+		unmapped_pages = exact_unmapped_pages(&unmapped);
 		log_info(1, "Possible slow memory leak - background memory use has been growing steadily (currently %lu) K, unmapped memory = %lu K, freemem = %lu K, MemAvail = %lu K",
 			(mem_remain * base_psize),
 			(unmapped_pages * base_psize),
@@ -1512,6 +2450,413 @@ void updates_for_hugepages(int delta)
 	update_neg_dentry(false);
 }
 
+/*
+ * Check if the kernel supports proactive reclaim on a single node
+ */
+int access_node_reclaim()
+{
+	char path[PATH_MAX];
+
+	if (nodes.nr_online == 0)
+		return -1;
+	snprintf(path, sizeof(path), NODE_RECLAIM_FORMAT, nodes.online[0]);
+
+	return access(path, W_OK);
+}
+
+/*
+ * reclaim_node() - Reclaim pages from a single node through its
+ * proactive reclaim interface
+ */
+void reclaim_node(int nid, unsigned long pages)
+{
+	char path[PATH_MAX], buf[32];
+	int fd, len;
+
+	snprintf(path, sizeof(path), NODE_RECLAIM_FORMAT, nid);
+	if ((fd = open(path, O_WRONLY)) == -1) {
+		log_err("Failed to open %s (%s)", path, strerror(errno));
+		return;
+	}
+
+	/*
+	 * Kernel returns EAGAIN if it could not reclaim as much as
+	 * requested, which is not an error
+	 */
+	len = snprintf(buf, sizeof(buf), "%lu", pages * base_psize * 1024);
+	if ((write(fd, buf, len) != len) && (errno != EAGAIN))
+		log_err("Failed to write to %s (%s)", path, strerror(errno));
+	close(fd);
+}
+
+/*
+ * node_reclaim_target() - Number of pages to reclaim on a node so its
+ * free pages stay above high watermark until the next chance to reclaim
+ *
+ * The trend line for free pages gives the rate of consumption. Reclaim
+ * what will be consumed over the next periodicity seconds beyond what
+ * is free above high watermark now, but at least the gap between low
+ * and high watermarks. Free pages drop below high watermark in
+ * (free - high) / rate msecs at that rate, and there is no point asking
+ * for more than can be reclaimed at the measured reclaim rate by then.
+ */
+unsigned long node_reclaim_target(int nid)
+{
+	unsigned long high = nodes.high_wmark[nid];
+	unsigned long gap = high - nodes.low_wmark[nid];
+	unsigned long free = nodes.free_pages[nid];
+	unsigned long horizon = periodicity * 1000UL;
+	unsigned long consumed = 0, pages = 0, deadline = 0;
+	long long rate = -nodes.free_trend[nid];
+
+	if (rate > 0)
+		consumed = rate * horizon / 100;
+	if (consumed + high > free)
+		pages = consumed + high - free;
+	if (pages < gap)
+		pages = gap;
+
+	if (reclaim_rate > 0) {
+		if ((rate > 0) && (free > high))
+			deadline = (free - high) * 100 / rate;
+		if (deadline < sample_period)
+			deadline = sample_period;
+		if (pages > reclaim_rate * deadline)
+			pages = reclaim_rate * deadline;
+	}
+
+	return pages;
+}
+
+/*
+ * Proactive reclaim through memory.reclaim, and reclaim on single
+ * nodes, is done by a worker thread since reclaiming a large amount can
+ * take a while. Only one request is outstanding at a time, a new one is
+ * dropped while the last one is still being worked on.
+ */
+struct node_reclaim {
+	int nid;
+	unsigned long pages;
+};
+
+struct reclaim_worker {
+	pthread_t thread;
+	bool started;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+
+	/* protected by lock */
+	unsigned long pending;	/* pages to reclaim from cgroups */
+	struct node_reclaim *node_reqs;	/* pages to reclaim from single nodes */
+	int nr_node_reqs;
+	bool busy;
+
+	/* cgroup directories to reclaim from, set up before start */
+	char *dirs[MAX_RECLAIM_CGROUPS];
+	int nr_dirs;
+};
+
+struct reclaim_worker reclaimer = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+};
+
+/*
+ * Read a single number from a file in a cgroup directory. Returns 0 on
+ * success
+ */
+static int read_cgroup_ulong(const char *dir, const char *file, unsigned long *val)
+{
+	char path[PATH_MAX], buf[32];
+	ssize_t len;
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, file);
+	if ((fd = open(path, O_RDONLY)) == -1)
+		return -1;
+	len = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (len <= 0)
+		return -1;
+	buf[len] = 0;
+	*val = strtoul(buf, NULL, 10);
+
+	return 0;
+}
+
+/*
+ * reclaim_from_cgroups() - Reclaim pages from the configured cgroups,
+ * split up in proportion to memory charged to each one. The split is
+ * even if that can not be read, e.g. for the root cgroup.
+ */
+void reclaim_from_cgroups(unsigned long pages)
+{
+	unsigned long charged[MAX_RECLAIM_CGROUPS], total = 0, share;
+	char path[PATH_MAX], buf[32];
+	int i, fd, len;
+
+	for (i = 0; i < reclaimer.nr_dirs; i++) {
+		if (read_cgroup_ulong(reclaimer.dirs[i], "memory.current", &charged[i])) {
+			total = 0;
+			break;
+		}
+		total += charged[i];
+	}
+
+	for (i = 0; i < reclaimer.nr_dirs; i++) {
+		if (total)
+			share = (unsigned long)((double)pages * charged[i] / total);
+		else
+			share = pages / reclaimer.nr_dirs;
+		if (share == 0)
+			continue;
+
+		snprintf(path, sizeof(path), "%s/memory.reclaim", reclaimer.dirs[i]);
+		if ((fd = open(path, O_WRONLY)) == -1) {
+			log_err("Failed to open %s (%s)", path, strerror(errno));
+			continue;
+		}
+
+		/*
+		 * Kernel returns EAGAIN if it could not reclaim as much
+		 * as requested, which is not an error
+		 */
+		log_info(3, "Reclaiming %lu K from %s", share * base_psize, reclaimer.dirs[i]);
+		len = snprintf(buf, sizeof(buf), "%lu", share * base_psize * 1024);
+		if ((write(fd, buf, len) != len) && (errno != EAGAIN))
+			log_err("Failed to write to %s (%s)", path, strerror(errno));
+		close(fd);
+	}
+}
+
+static void *reclaim_worker_main(void *arg)
+{
+	struct reclaim_worker *rw = arg;
+	struct node_reclaim *node_reqs;
+	unsigned long pages;
+	int i, nr_node_reqs;
+
+	pthread_mutex_lock(&rw->lock);
+	while (1) {
+		while ((rw->pending == 0) && (rw->nr_node_reqs == 0))
+			pthread_cond_wait(&rw->cond, &rw->lock);
+
+		pages = rw->pending;
+		rw->pending = 0;
+		node_reqs = rw->node_reqs;
+		nr_node_reqs = rw->nr_node_reqs;
+		rw->node_reqs = NULL;
+		rw->nr_node_reqs = 0;
+		rw->busy = true;
+		pthread_mutex_unlock(&rw->lock);
+
+		if (pages)
+			reclaim_from_cgroups(pages);
+		for (i = 0; i < nr_node_reqs; i++)
+			reclaim_node(node_reqs[i].nid, node_reqs[i].pages);
+		free(node_reqs);
+
+		pthread_mutex_lock(&rw->lock);
+		rw->busy = false;
+	}
+
+	return NULL;
+}
+
+/*
+ * setup_reclaim_cgroups() - Find the cgroups to reclaim from for
+ * proactive reclaim. Proactive reclaim is turned off, and watermarks
+ * are raised instead, if there are no cgroups to reclaim from.
+ */
+void setup_reclaim_cgroups()
+{
+	const char *root, *cgroup;
+	char path[PATH_MAX];
+	int i, nr;
+
+	if (access(CGROUP2_MOUNT"/cgroup.controllers", F_OK) == 0)
+		root = CGROUP2_MOUNT;
+	else if (access(CGROUP2_HYBRID_MOUNT"/cgroup.controllers", F_OK) == 0)
+		root = CGROUP2_HYBRID_MOUNT;
+	else {
+		log_err("cgroup v2 is not mounted, disabling proactive reclaim");
+		proactive_reclaim_enabled = false;
+		return;
+	}
+
+	nr = nr_reclaim_cgroups ? nr_reclaim_cgroups : 1;
+	for (i = 0; i < nr; i++) {
+		cgroup = nr_reclaim_cgroups ? reclaim_cgroups[i] : "";
+		while (*cgroup == '/')
+			cgroup++;
+		snprintf(path, sizeof(path), "%s%s%s/memory.reclaim", root,
+			 *cgroup ? "/" : "", cgroup);
+		if (access(path, W_OK)) {
+			log_err("Can not reclaim from %s (%s)", path, strerror(errno));
+			continue;
+		}
+		*strrchr(path, '/') = 0;
+		if ((reclaimer.dirs[reclaimer.nr_dirs] = strdup(path)) == NULL) {
+			log_err("Failed to allocate memory for cgroup %s", cgroup);
+			continue;
+		}
+		reclaimer.nr_dirs++;
+	}
+
+	if (reclaimer.nr_dirs == 0) {
+		log_err("No cgroups to reclaim from, disabling proactive reclaim");
+		proactive_reclaim_enabled = false;
+	}
+}
+
+/*
+ * start_reclaim_worker() - Start the worker that does proactive reclaim
+ * and reclaim on single nodes. Reclaim is done synchronously if the
+ * worker can not be started.
+ */
+void start_reclaim_worker()
+{
+	int err;
+
+	if ((err = pthread_create(&reclaimer.thread, NULL, reclaim_worker_main, &reclaimer))) {
+		log_err("Failed to start proactive reclaim worker (%s)", strerror(err));
+		return;
+	}
+	reclaimer.started = true;
+}
+
+/*
+ * proactive_reclaim() - Reclaim pages needed by nodes the predictor
+ * recommended reclamation for through memory.reclaim
+ */
+void proactive_reclaim()
+{
+	unsigned long pages = 0;
+	int i, nid;
+
+	for (i = 0; i < nodes.nr_online; i++) {
+		nid = nodes.online[i];
+		if (nodes.verdict[nid] & MEMPREDICT_RECLAIM)
+			pages += node_reclaim_target(nid);
+	}
+	if (pages == 0)
+		return;
+
+	log_info(2, "Proactively reclaiming %lu K", pages * base_psize);
+	if (dry_run)
+		return;
+
+	if (!reclaimer.started) {
+		reclaim_from_cgroups(pages);
+		return;
+	}
+
+	pthread_mutex_lock(&reclaimer.lock);
+	if (reclaimer.busy || reclaimer.pending || reclaimer.nr_node_reqs) {
+		log_info(5, "Proactive reclaim still in progress");
+	} else {
+		reclaimer.pending = pages;
+		pthread_cond_signal(&reclaimer.cond);
+	}
+	pthread_mutex_unlock(&reclaimer.lock);
+}
+
+/*
+ * reclaim_busy_nodes() - Reclaim pages directly on nodes the predictor
+ * recommended reclamation for
+ */
+void reclaim_busy_nodes()
+{
+	struct node_reclaim *node_reqs;
+	unsigned long pages;
+	int i, nid, nr_node_reqs = 0;
+
+	if (reclaimer.started) {
+		pthread_mutex_lock(&reclaimer.lock);
+		if (reclaimer.busy || reclaimer.pending || reclaimer.nr_node_reqs) {
+			pthread_mutex_unlock(&reclaimer.lock);
+			log_info(5, "Reclaim still in progress");
+			return;
+		}
+		pthread_mutex_unlock(&reclaimer.lock);
+	}
+
+	node_reqs = malloc(nodes.nr_online * sizeof(struct node_reclaim));
+	if (node_reqs == NULL) {
+		log_err("Failed to allocate memory for node reclaim requests");
+		return;
+	}
+
+	for (i = 0; i < nodes.nr_online; i++) {
+		nid = nodes.online[i];
+		if (!(nodes.verdict[nid] & MEMPREDICT_RECLAIM))
+			continue;
+
+		pages = node_reclaim_target(nid);
+		if (pages == 0)
+			continue;
+
+		log_info(2, "Reclaiming %lu K on node %d", pages * base_psize, nid);
+		node_reqs[nr_node_reqs].nid = nid;
+		node_reqs[nr_node_reqs].pages = pages;
+		nr_node_reqs++;
+	}
+
+	if ((nr_node_reqs == 0) || dry_run) {
+		free(node_reqs);
+		return;
+	}
+
+	if (!reclaimer.started) {
+		for (i = 0; i < nr_node_reqs; i++)
+			reclaim_node(node_reqs[i].nid, node_reqs[i].pages);
+		free(node_reqs);
+		return;
+	}
+
+	/* only the main thread queues requests, so the worker is still idle */
+	pthread_mutex_lock(&reclaimer.lock);
+	reclaimer.node_reqs = node_reqs;
+	reclaimer.nr_node_reqs = nr_node_reqs;
+	pthread_cond_signal(&reclaimer.cond);
+	pthread_mutex_unlock(&reclaimer.lock);
+}
+
+/*
+ * update_sample_period() - Adapt the period between samples of free
+ * pages to the outcome of the last prediction
+ *
+ * Halve the period while the predictor sees free pages close to high
+ * watermark or heading there fast, or recommends reclamation or
+ * compaction, so the trend line tracks quick changes in consumption.
+ * Lengthen it by a quarter at a time back to periodicity seconds once
+ * the system is quiet again. The period starts out short so the
+ * lookback window fills up quickly after startup. Only sampling speeds
+ * up, check_memory_pressure() still acts on predictions at most once
+ * every periodicity seconds.
+ */
+void update_sample_period(unsigned long result)
+{
+	unsigned long max_period = periodicity * 1000UL;
+	unsigned long new_period;
+
+	if (result & (MEMPREDICT_SAMPLE_FAST | MEMPREDICT_RECLAIM |
+		      MEMPREDICT_COMPACT)) {
+		new_period = sample_period / 2;
+		if (new_period < MIN_SAMPLE_PERIOD)
+			new_period = MIN_SAMPLE_PERIOD;
+	} else {
+		new_period = sample_period + sample_period / 4;
+		if (new_period > max_period)
+			new_period = max_period;
+	}
+
+	if (new_period != sample_period)
+		log_info(5, "Sampling period changed from %lu to %lu msec",
+			 sample_period, new_period);
+	sample_period = new_period;
+}
+
 /*
  * check_memory_pressure() - Evaluate and respond to memory consumption trend
  *
@@ -1528,53 +2873,102 @@ void updates_for_hugepages(int delta)
  */
 void check_memory_pressure(bool init)
 {
-	static int compaction_requested[MAX_NUMANODES];
-	static unsigned long last_bigpages[MAX_NUMANODES], last_reclaimed;
-	static FILE *ifile;
+	static unsigned long last_reclaimed, next_action;
 	unsigned long nr_free[MAX_ORDER];
 	struct frag_info free[MAX_ORDER];
 	unsigned long time_elapsed, reclaimed_pages;
-	unsigned long result = 0;
+	unsigned long result = 0, verdict;
+	int nr_voting = 0, nr_reclaim = 0, nr_lower = 0;
 	int i, order, nid, retval;
+	bool act, acted = false;
 	struct timespec spec, spec_after;
 	static struct timespec spec_before;
-	char *ipath;
+	const char *pos;
+	int err;
 
 	/*
-	 * bail out if this module is not enabled
+	 * bail out if this module is not enabled. Nothing else needs
+	 * to sample faster than periodicity.
 	 */
-	if (!memory_pressure_check_enabled)
+	if (!memory_pressure_check_enabled) {
+		sample_period = periodicity * 1000UL;
 		return;
+	}
 
 	if (init) {
 		/*
-		 * Initialize number of higher order pages seen in last scan
-		 * and compaction requested per node
+		 * Number of higher order pages seen in last scan per
+		 * node starts out cleared by update_online_nodes()
 		 */
-		for (i = 0; i < MAX_NUMANODES; i++) {
-			last_bigpages[i] = 0;
-			compaction_requested[i] = 0;
-		}
 		last_reclaimed = 0;
-
-		ipath = BUDDYINFO;
-		if ((ifile = fopen(ipath, "r")) == NULL) {
-			log_err("fopen(input file)");
+		next_action = 0;
+		node_reclaim_supported = (access_node_reclaim() == 0);
+		if (proactive_reclaim_enabled)
+			setup_reclaim_cgroups();
+		if (!dry_run && (proactive_reclaim_enabled || node_reclaim_supported))
+			start_reclaim_worker();
+
+		if ((err = proc_file_open(&buddyinfo_file)) < 0) {
+			log_err("Failed to open "BUDDYINFO" (%s)", strerror(-err));
 			bailout(1);
 		}
 
+		if (!dry_run)
+			start_compact_worker();
+
 		return;
 	}
 
+	/*
+	 * Pick up compaction rate measured by the compaction worker,
+	 * if it has compacted a node since the last sample
+	 */
+	pthread_mutex_lock(&compactor.lock);
+	if (compactor.rate >= 0) {
+		compaction_rate = compactor.rate;
+		compactor.rate = -1;
+	}
+	pthread_mutex_unlock(&compactor.lock);
+
+	/*
+	 * Free pages may be sampled every MIN_SAMPLE_PERIOD msecs, but
+	 * acting on a prediction is still limited to once every
+	 * periodicity seconds. Each rescale_watermarks() call moves
+	 * watermark_scale_factor by at least 10%, so acting on every
+	 * sample would take it to the limit within seconds, or make
+	 * it swing with the noise in a short lookback window.
+	 */
+	clock_gettime(CLOCK_MONOTONIC_RAW, &spec);
+	act = (get_msecs(&spec) >= next_action);
+
 	/*
 	 * Keep track of time to calculate the compaction and
 	 * reclaim rates
 	 */
 	total_free_pages = 0;
+	for (i = 0; i < nodes.nr_online; i++)
+		nodes.verdict[nodes.online[i]] = 0;
+
+	if ((err = proc_file_read(&buddyinfo_file)) < 0) {
+		log_err("error reading buddyinfo (%s)", strerror(-err));
+		bailout(1);
+	}
 
-	while ((retval = get_next_node(ifile, &nid, nr_free)) != 0) {
+	pos = buddyinfo_file.buf;
+	while ((retval = get_next_node(&buddyinfo_file, &pos, &nid, nr_free)) != 0) {
 		unsigned long total_free;
 
+		/*
+		 * Skip nodes that came online since the node arrays were
+		 * last sized. They will be picked up once zoneinfo shows
+		 * them.
+		 */
+		if ((nid < 0) || (nid >= nodes.nr_node_ids) || !nodes.is_online[nid]) {
+			if (retval == EOF_RET)
+				break;
+			continue;
+		}
+
 		/*
 		 * Assemble the fragmented free memory vector:
 		 * the fragmented free memory at a given order is
@@ -1602,48 +2996,57 @@ void check_memory_pressure(bool init)
 		/*
 		 * Offer the predictor the fragmented free memory
 		 * vector but do nothing else unless it issues a
-		 * prediction. Accumulate recommendation from
-		 * prediction algorithm across all nodes so we
-		 * adjust watermarks only once per wake up.
+		 * prediction. Keep the verdict for each node and
+		 * count votes for reclamation and lowering
+		 * watermarks so we adjust watermarks only once per
+		 * wake up.
 		 */
-		result |= predict(free, page_lsq[nid],
-				high_wmark[nid], low_wmark[nid], nid);
+		verdict = predict(free, &nodes.page_lsq[nid],
+				nodes.high_wmark[nid], nodes.low_wmark[nid], nid,
+				&nodes.free_trend[nid]);
+		nodes.verdict[nid] = verdict;
+		nodes.free_pages[nid] = free[0].free_pages;
+		result |= verdict;
+		nr_voting++;
+		if (verdict & MEMPREDICT_RECLAIM)
+			nr_reclaim++;
+		else if (verdict & MEMPREDICT_LOWER_WMARKS)
+			nr_lower++;
 
-		if (last_bigpages[nid] != 0) {
+		/*
+		 * Estimate compaction rate from growth between samples
+		 * as well, which also catches compaction done by the
+		 * kernel on its own. It is needed before the predictor
+		 * will recommend compaction the first time.
+		 */
+		if (nodes.last_bigpages[nid] != 0) {
 			clock_gettime(CLOCK_MONOTONIC_RAW, &spec_after);
 			time_elapsed = get_msecs(&spec_after) -
 					get_msecs(&spec_before);
-			if (free[MAX_ORDER-1].free_pages > last_bigpages[nid]) {
+			if ((time_elapsed > 0) &&
+			    (free[MAX_ORDER-1].free_pages > nodes.last_bigpages[nid])) {
 				compaction_rate =
 					(free[MAX_ORDER-1].free_pages -
-					last_bigpages[nid]) / time_elapsed;
+					nodes.last_bigpages[nid]) / time_elapsed;
 				if (compaction_rate)
 					log_info(5, "** compaction rate on node %d is %ld pages/msec",
 					nid, compaction_rate);
 			}
 		}
-		last_bigpages[nid] = free[MAX_ORDER-1].free_pages;
+		nodes.last_bigpages[nid] = free[MAX_ORDER-1].free_pages;
 
 		/*
 		 * Start compaction if requested. There is a cost
-		 * to compaction in the kernel. Avoid issuing
-		 * compaction request twice in a row.
+		 * to compaction in the kernel. A request for a node
+		 * that is already queued or being compacted by the
+		 * compaction worker is ignored.
 		 */
-		if (result & MEMPREDICT_COMPACT) {
-			if (!compaction_requested[nid]) {
-				log_info(2, "Triggering compaction on node %d", nid);
-				if (!dry_run) {
-					compact(nid);
-					compaction_requested[nid] = 1;
-					result &= ~MEMPREDICT_COMPACT;
-				}
-			}
+		if ((verdict & MEMPREDICT_COMPACT) && act) {
+			log_info(2, "Triggering compaction on node %d", nid);
+			if (!dry_run)
+				queue_compaction(nid);
+			acted = true;
 		}
-		/*
-		 * Clear compaction requested flag for the next
-		 * sampling interval
-		 */
-		compaction_requested[nid] = 0;
 		total_free_pages += free[0].free_pages;
 
 		/*
@@ -1655,31 +3058,51 @@ void check_memory_pressure(bool init)
 	}
 
 	if (retval == ERR) {
-		log_err("error reading buddyinfo (%s)", strerror(errno));
+		log_err("error parsing buddyinfo");
 		bailout(1);
 	}
 
 
 	/*
-	 * Adjust watermarks if needed. Both MEMPREDICT_RECLAIM
-	 * and MEMPREDICT_LOWER_WMARKS can be set even though it
-	 * seems contradictory. That is because result accumulates
-	 * all prediction results across all nodes. One node may
-	 * have enough free pages or has increasing number of
-	 * free pages while another node may be running low. In
-	 * such cases, MEMPREDICT_RECLAIM takes precedence
+	 * Adjust watermarks if needed. watermark_scale_factor applies
+	 * to all nodes, so only raise it when most nodes need pages
+	 * reclaimed. Nodes that need reclamation while most do not are
+	 * reclaimed from directly instead, so one busy node does not
+	 * raise watermarks and waste memory on all the others. Kernels
+	 * without per node proactive reclaim get the old behavior where
+	 * any node needing reclamation raises watermarks. Otherwise,
+	 * lower watermarks if most nodes have a growing number of free
+	 * pages.
+	 *
+	 * With proactive reclaim enabled, pages are reclaimed through
+	 * memory.reclaim instead of raising watermarks, so kswapd does
+	 * not keep more memory free than needed all the time.
 	 */
-	if (result & (MEMPREDICT_RECLAIM | MEMPREDICT_LOWER_WMARKS)) {
-		if (result & MEMPREDICT_RECLAIM)
-			rescale_watermarks(1);
+	if (!act) {
+		/* wait for the next chance to act */
+	} else if ((nr_reclaim * 2 > nr_voting) || (nr_reclaim && !node_reclaim_supported)) {
+		if (proactive_reclaim_enabled)
+			proactive_reclaim();
 		else
+			rescale_watermarks(1);
+		acted = true;
+	} else {
+		if (nr_reclaim) {
+			reclaim_busy_nodes();
+			acted = true;
+		}
+		if (nr_lower * 2 > nr_voting) {
 			rescale_watermarks(0);
+			acted = true;
+		}
 	}
+	if (acted)
+		next_action = get_msecs(&spec) + periodicity * 1000UL;
 
 	reclaimed_pages = no_pages_reclaimed();
-	if (last_reclaimed) {
-		clock_gettime(CLOCK_MONOTONIC_RAW, &spec_after);
-		time_elapsed = get_msecs(&spec_after) - get_msecs(&spec_before);
+	clock_gettime(CLOCK_MONOTONIC_RAW, &spec_after);
+	time_elapsed = get_msecs(&spec_after) - get_msecs(&spec_before);
+	if (last_reclaimed && (time_elapsed > 0)) {
 
 		reclaim_rate = (reclaimed_pages - last_reclaimed) / time_elapsed;
 		if (reclaim_rate)
@@ -1694,6 +3117,27 @@ void check_memory_pressure(bool init)
 	 * fit algorithm.
 	 */
 	clock_gettime(CLOCK_MONOTONIC_RAW, &spec_before);
+
+	update_sample_period(result);
+}
+
+/*
+ * init_proc_readers() - Set up key tables for parsing /proc files and
+ * size per node state for the online NUMA nodes. This must be done
+ * before any of the files is read
+ */
+void init_proc_readers()
+{
+	if (proc_keytab_init(&zoneinfo_keys, zoneinfo_key_list,
+			     sizeof(zoneinfo_key_list) / sizeof(struct proc_key)) ||
+	    proc_keytab_init(&vmstat_keys, vmstat_key_list,
+			     sizeof(vmstat_key_list) / sizeof(struct proc_key)) ||
+	    proc_keytab_init(&meminfo_keys, meminfo_key_list,
+			     sizeof(meminfo_key_list) / sizeof(struct proc_key))) {
+		log_err("Failed to set up /proc file key tables");
+		bailout(1);
+	}
+	update_online_nodes();
 }
 
 /*
@@ -1733,6 +3177,9 @@ void one_time_initializations()
 #define OPT_NEG_DENTRY2	"NEG_DENTRY_CAP"
 #define OPT_ENB_MEMLEAK	"ENABLE_MEMLEAK_CHECK"
 #define OPT_PREFER_OBJECT_CACHING "PREFER_OBJECT_CACHING"
+#define OPT_MEMLEAK_STRIPES	"MEMLEAK_SCAN_STRIPES"
+#define OPT_ENB_RECLAIM	"ENABLE_PROACTIVE_RECLAIM"
+#define OPT_RECLAIM_CGROUPS	"RECLAIM_CGROUPS"
 
 int parse_config()
 {
@@ -1832,7 +3279,35 @@ int parse_config()
 			memleak_check_enabled = ((val==0)?false:true);
 		else if (strncmp(token, OPT_PREFER_OBJECT_CACHING, sizeof(OPT_PREFER_OBJECT_CACHING)) == 0)
 			prefer_object_caching = val;
-		else {
+		else if (strncmp(token, OPT_MEMLEAK_STRIPES, sizeof(OPT_MEMLEAK_STRIPES)) == 0) {
+			/*
+			 * Scan 1/val of the PFN space for unmapped pages
+			 * each period instead of all of it
+			 */
+			if ((val >= 1) && (val <= MAX_UNMAPPED_STRIPES))
+				unmapped_scan_stripes = val;
+			else
+				log_err("Bad value for memory leak scan stripes = %lu (1-%d). Proceeding with default of %d", val, MAX_UNMAPPED_STRIPES, unmapped_scan_stripes);
+		} else if (strncmp(token, OPT_ENB_RECLAIM, sizeof(OPT_ENB_RECLAIM)) == 0)
+			proactive_reclaim_enabled = ((val==0)?false:true);
+		else if (strncmp(token, OPT_RECLAIM_CGROUPS, sizeof(OPT_RECLAIM_CGROUPS)) == 0) {
+			/*
+			 * Comma separated list of cgroups, relative to
+			 * the root of cgroup v2 hierarchy
+			 */
+			char *cgroup, *saveptr;
+
+			for (cgroup = strtok_r(&buf[i+1], ", \t\n", &saveptr); cgroup;
+			     cgroup = strtok_r(NULL, ", \t\n", &saveptr)) {
+				if (nr_reclaim_cgroups == MAX_RECLAIM_CGROUPS) {
+					log_err("Too many cgroups to reclaim from, ignoring %s and later ones", cgroup);
+					break;
+				}
+				reclaim_cgroups[nr_reclaim_cgroups] = strdup(cgroup);
+				if (reclaim_cgroups[nr_reclaim_cgroups])
+					nr_reclaim_cgroups++;
+			}
+		} else {
 			log_err("Error in configuration file at token \"%s\". Proceeding with defaults", token);
 			break;
 		}
@@ -1875,10 +3350,13 @@ void help_msg(char *progname)
 
 int main(int argc, char **argv)
 {
-	int c, i, lockfd;
+	int c, lockfd;
 	int errflag = 0;
+	struct timespec spec, nap;
+	unsigned long next_periodic;
 	char tmpbuf[TMPCHARBUFSIZE];
 	struct utsname name;
+	sigset_t exit_sigs;
 
 	openlog("adaptivemmd", LOG_PID, LOG_DAEMON);
 	if (parse_config() == 0)
@@ -1990,6 +3468,7 @@ int main(int argc, char **argv)
 		break;
 	}
 
+	init_proc_readers();
 	update_zone_watermarks();
 
 	/*
@@ -1997,13 +3476,8 @@ int main(int argc, char **argv)
 	 * and high watermarks, recompute maxwsf to account for that.
 	 * Update zone page information first.
 	*/
-	if (maxgap != 0) {
-		unsigned long total_managed = 0;
-
-		for (i = 0; i < MAX_NUMANODES; i++)
-			total_managed += managed_pages[i];
+	if (maxgap != 0)
 		maxwsf = (maxgap * 10000UL * 1024UL * 1024UL * 1024UL)/(total_managed * getpagesize());
-	}
 	mywsf = maxwsf;
 
 	/*
@@ -2012,9 +3486,22 @@ int main(int argc, char **argv)
 	base_psize = getpagesize()/1024;
 
 	pr_info("adaptivemmd "VERSION" started (verbose=%d, aggressiveness=%d, maxgap=%d)", verbose, aggressiveness, maxgap);
+
+	/*
+	 * Worker threads inherit the signal mask. Keep SIGTERM and SIGHUP
+	 * off them so the signals interrupt the main loop's sleep
+	 */
+	sigemptyset(&exit_sigs);
+	sigaddset(&exit_sigs, SIGTERM);
+	sigaddset(&exit_sigs, SIGHUP);
+	pthread_sigmask(SIG_BLOCK, &exit_sigs, NULL);
 	one_time_initializations();
+	pthread_sigmask(SIG_UNBLOCK, &exit_sigs, NULL);
 
-	while (1) {
+	clock_gettime(CLOCK_MONOTONIC_RAW, &spec);
+	next_periodic = get_msecs(&spec);
+
+	while (!exit_signaled) {
 		int retval;
 
 		/*
@@ -2031,12 +3518,27 @@ int main(int argc, char **argv)
 		if (maxgap == 0)
 			rescale_maxwsf();
 		check_memory_pressure(false);
-		check_memory_leak(false);
-		rescale_vfs_cache_pressure();
 
-		sleep(periodicity);
+		/*
+		 * Memory leak and vfs cache checks look at trends over
+		 * fixed periods, run them every periodicity seconds no
+		 * matter how often free pages are sampled
+		 */
+		clock_gettime(CLOCK_MONOTONIC_RAW, &spec);
+		if (get_msecs(&spec) >= next_periodic) {
+			check_memory_leak(false);
+			rescale_vfs_cache_pressure();
+			next_periodic = get_msecs(&spec) + periodicity * 1000UL;
+		}
+
+		if (exit_signaled)
+			break;
+		nap.tv_sec = sample_period / 1000;
+		nap.tv_nsec = (sample_period % 1000) * 1000000;
+		nanosleep(&nap, NULL);
 	}
 
-	closelog();
+	pr_info("adaptivemmd exiting on signal");
+	bailout(0);
 	return 0;
 }
@@ -27,25 +27,97 @@
 #include "predict.h"
 
 /*
- * This function inserts the given value into the list of most recently seen
- * data and returns the parameters, m and c, of a straight line of the form
- * y = mx + c that, according to the the method of least squares, fits them
- * best.  The formulation is for the special case in which x_i = i + 1 - N;
- * this reduces the need for storage and permits constant time updates.
+ * Add (sign = 1) or remove (sign = -1) sample i from the running sums
  */
-int lsq_fit(struct lsq_struct *lsq, long long new_y, long long new_x,
-	long long *m, long long *c)
+static inline void lsq_account(struct lsq_struct *lsq, int nr_series,
+			       int i, int sign)
 {
-	long long sigma_x, sigma_y;
-	long sigma_xy, sigma_xx;
-	long long slope_divisor;
-	long long numerator;
-	int i, next;
-	long x_offset;
+	lsq_sum_t w = sign * lsq->w[i];
+	lsq_sum_t wx = w * (lsq->x[i] - lsq->base_x);
+	int k;
+
+	lsq->sigma_w += w;
+	lsq->sigma_xx += wx * (lsq->x[i] - lsq->base_x);
+	lsq->sigma_x += wx;
+	for (k = 0; k < nr_series; k++) {
+		lsq->sigma_y[k] += w * lsq->y[k][i];
+		lsq->sigma_xy[k] += wx * lsq->y[k][i];
+	}
+}
+
+/*
+ * Move x=0 for the running sums to new_base
+ */
+static inline void lsq_rebase(struct lsq_struct *lsq, int nr_series,
+			      long long new_base)
+{
+	lsq_sum_t d = new_base - lsq->base_x;
+	int k;
+
+	lsq->sigma_xx -= 2 * d * lsq->sigma_x - d * d * lsq->sigma_w;
+	lsq->sigma_x -= d * lsq->sigma_w;
+	for (k = 0; k < nr_series; k++)
+		lsq->sigma_xy[k] -= d * lsq->sigma_y[k];
+	lsq->base_x = new_base;
+}
+
+/*
+ * This function inserts the given values, one for each of nr_series
+ * series sampled at new_x, into the list of most recently seen data and
+ * returns the parameters, m[k] and c[k], of a straight line of the form
+ * y = mx + c for each series k that, according to the the method of least
+ * squares, fits them best. m is scaled up by 100 to retain precision for
+ * slow trends and c is the value of the line at the oldest sample in the
+ * window. nr_series must be the same on every call for a given lsq.
+ *
+ * Samples are not necessarily taken at a fixed interval. Each sample is
+ * weighted by the time elapsed since the previous one, so a burst of
+ * closely spaced samples does not outweigh older samples that each stand
+ * for a longer period of time. The very first sample has nothing before
+ * it and is given the weight of the second one. With samples taken at a
+ * fixed interval this is the same as an unweighted fit.
+ *
+ * The sums for the fit are updated as samples enter and leave the window
+ * instead of being recomputed over all of it, and are kept relative to
+ * the oldest sample so they stay small. Since all series share x, the
+ * divisor for the slope is computed only once for all of them.
+ */
+int lsq_fit(struct lsq_struct *lsq, int nr_series, const long long *new_y,
+	long long new_x, long long *m, long long *c)
+{
+	lsq_sum_t slope_divisor, numerator;
+	long long weight;
+	int k, next;
 
 	next = lsq->next++;
+	if (next == 0 && !lsq->ready) {
+		weight = 0;
+		lsq->base_x = new_x;
+	} else {
+		weight = new_x - lsq->last_x;
+		if (weight < 1)
+			weight = 1;
+		if (next == 1 && !lsq->ready) {
+			lsq->w[0] = weight;
+			lsq_account(lsq, nr_series, 0, 1);
+		}
+	}
+
+	/*
+	 * Once the window is full, the new sample replaces the oldest
+	 * one and the next oldest becomes x=0
+	 */
+	if (lsq->ready) {
+		lsq_account(lsq, nr_series, next, -1);
+		lsq_rebase(lsq, nr_series, lsq->x[(next + 1) % LSQ_LOOKBACK]);
+	}
+
 	lsq->x[next] = new_x;
-	lsq->y[next] = new_y;
+	lsq->w[next] = weight;
+	lsq->last_x = new_x;
+	for (k = 0; k < nr_series; k++)
+		lsq->y[k][next] = new_y[k];
+	lsq_account(lsq, nr_series, next, 1);
 
 	if (lsq->next == LSQ_LOOKBACK) {
 		lsq->next = 0;
@@ -64,49 +136,21 @@ int lsq_fit(struct lsq_struct *lsq, long long new_y, long long new_x,
 	if (!lsq->ready)
 		return -1;
 
-	/*
-	 * If lookback window is full, compute slope and intercept
-	 * for the best fit line. In the process of computing those, we need
-	 * to compute squares of values along x-axis. Sqaure values can be
-	 * large enough to overflow 64-bits if they are large enough to
-	 * begin with. To solve this problem, transform the line on
-	 * x-axis so the first point falls at x=0. Since lsq->x is a
-	 * circular buffer, lsq->next points to the oldest entry in this
-	 * buffer.
-	 */
-
-	x_offset = lsq->x[lsq->next];
-	for (i = 0; i < LSQ_LOOKBACK; i++)
-		lsq->x[i] -= x_offset;
-
-	/*
-	 * Lookback window is full. Compute slope and intercept
-	 * for the best fit line
-	 */
-	sigma_x = sigma_y = sigma_xy = sigma_xx = 0;
-	for (i = 0; i < LSQ_LOOKBACK; i++) {
-		sigma_x += lsq->x[i];
-		sigma_y += lsq->y[i];
-		sigma_xy += (lsq->x[i] * lsq->y[i]);
-		sigma_xx += (lsq->x[i] * lsq->x[i]);
-	}
-
 	/*
 	 * guard against divide-by-zero
 	 */
-	slope_divisor = LSQ_LOOKBACK * sigma_xx - sigma_x * sigma_x;
-	if (slope_divisor == 0)
+	slope_divisor = lsq->sigma_w * lsq->sigma_xx - lsq->sigma_x * lsq->sigma_x;
+	if (slope_divisor <= 0)
 		return -1;
 
-	numerator = (LSQ_LOOKBACK * sigma_xy - sigma_x * sigma_y) * 100;
-	*m = numerator / slope_divisor;
-	*c = (sigma_y - *m * sigma_x) / LSQ_LOOKBACK;
-
-	/*
-	 * Restore original values for x-axis
-	 */
-	for (i = 0; i < LSQ_LOOKBACK; i++)
-		lsq->x[i] += x_offset;
+	for (k = 0; k < nr_series; k++) {
+		numerator = lsq->sigma_w * lsq->sigma_xy[k] -
+			    lsq->sigma_x * lsq->sigma_y[k];
+		m[k] = numerator * 100 / slope_divisor;
+		c[k] = ((double)lsq->sigma_y[k] - (double)numerator /
+			slope_divisor * (double)lsq->sigma_x) /
+			(double)lsq->sigma_w;
+	}
 
 	return 0;
 }
@@ -145,15 +189,24 @@ int lsq_fit(struct lsq_struct *lsq, long long new_y, long long new_x,
  * now to avert free pages exhaustion or severe fragmentation. Return value
  * is a set of bits which represent which condition has been observed -
  * potential free memory exhaustion, and potential severe fragmentation.
+ *
+ * MEMPREDICT_SAMPLE_FAST is set as well when free pages are close to the
+ * high watermark or the trend line shows them dropping below it soon, to
+ * ask for free pages to be sampled more often.
+ *
+ * The slope of the trend line for total free pages, scaled up by 100, is
+ * returned in *free_trend, or 0 if there is not enough data for it yet.
  */
 unsigned long predict(struct frag_info *frag_vec, struct lsq_struct *lsq,
-	unsigned long high_wmark, unsigned long low_wmark, int nid)
+	unsigned long high_wmark, unsigned long low_wmark, int nid,
+	long long *free_trend)
 {
 	int order;
+	long long free_pages[MAX_ORDER];
 	long long m[MAX_ORDER];
 	long long c[MAX_ORDER];
 	int is_ready = 1;
-	unsigned long retval = 0;
+	unsigned long retval = 0, sample_hint = 0;
 	unsigned long time_taken, time_to_catchup;
 	long long x_cross, current_time;
 	struct timespec tspec;
@@ -168,17 +221,24 @@ unsigned long predict(struct frag_info *frag_vec, struct lsq_struct *lsq,
 	 * total free pages, it means all available pages are of order
 	 * (n-1) or lower and there is 100% fragmentation of order n
 	 * pages. Kernel must compact pages at this point to gain
-	 * new order n pages.
+	 * new order n pages. All orders are sampled at the same time,
+	 * so their trend lines are fitted together.
 	 */
-	for (order = 0; order < MAX_ORDER; order++) {
-		if (lsq_fit(&lsq[order], frag_vec[order].free_pages,
-				frag_vec[order].msecs, &m[order],
-				&c[order]) == -1)
-			is_ready = 0;
-	}
+	for (order = 0; order < MAX_ORDER; order++)
+		free_pages[order] = frag_vec[order].free_pages;
+	if (lsq_fit(lsq, MAX_ORDER, free_pages, frag_vec[0].msecs, m, c) == -1)
+		is_ready = 0;
+	*free_trend = is_ready ? m[0] : 0;
+
+	/*
+	 * Track free pages closely when they are near high watermark,
+	 * even before there is enough data for a trend line
+	 */
+	if (frag_vec[0].free_pages <= 2 * high_wmark)
+		sample_hint = MEMPREDICT_SAMPLE_FAST;
 
 	if (!is_ready)
-		return retval;
+		return sample_hint;
 
 #if 0
 	if (frag_vec[0].free_pages < high_wmark) {
@@ -204,13 +264,24 @@ unsigned long predict(struct frag_info *frag_vec, struct lsq_struct *lsq,
 	else {
 		/*
 		 * Trend line for overall free pages is showing a
-		 * negative trend. Check if we are approaching high
-		 * watermark faster than pages are being reclaimed.
-		 * If a reclaim rate has not been computed yet, do not
-		 * compute if it is time to start reclamation
+		 * negative trend. If free pages will drop below high
+		 * watermark within the lookback period at this rate,
+		 * the trend is steep enough to warrant sampling more
+		 * often.
+		 */
+		if ((frag_vec[0].free_pages <= high_wmark) ||
+		    ((frag_vec[0].free_pages - high_wmark) * 100 / -m[0] <
+		     LSQ_LOOKBACK * periodicity * 1000))
+			sample_hint = MEMPREDICT_SAMPLE_FAST;
+
+		/*
+		 * Check if we are approaching high watermark faster than
+		 * pages are being reclaimed. If a reclaim rate has not
+		 * been computed yet, do not compute if it is time to
+		 * start reclamation
 		 */
 		if (reclaim_rate == 0)
-			return 0;
+			return sample_hint;
 
 		/*
 		 * If number of free pages is already below high watermark,
@@ -274,7 +345,7 @@ unsigned long predict(struct frag_info *frag_vec, struct lsq_struct *lsq,
 		 * in forcing compaction
 		 */
 		if (compaction_rate == 0)
-			return 0;
+			return sample_hint;
 
 		/*
 		 * Find the point of intersection of the two lines.
@@ -302,7 +373,7 @@ unsigned long predict(struct frag_info *frag_vec, struct lsq_struct *lsq,
 		 * graph.
 		 */
 		clock_gettime(CLOCK_MONOTONIC_RAW, &tspec);
-		current_time = tspec.tv_sec*1000 + tspec.tv_nsec/1000 - lsq->x[lsq->next];
+		current_time = tspec.tv_sec*1000 + tspec.tv_nsec/1000000 - lsq->x[lsq->next];
 		if (current_time < 0)
 			current_time = 0;
 		if ((x_cross < 0) ||
@@ -359,5 +430,5 @@ unsigned long predict(struct frag_info *frag_vec, struct lsq_struct *lsq,
 		}
 	}
 
-	return retval;
+	return retval | sample_hint;
 }
@@ -42,19 +42,61 @@ extern "C" {
 #define NORM_PERIODICITY	30
 #define HIGH_PERIODICITY	15
 
+/*
+ * Shortest period, in msecs, free pages are sampled at when memory is
+ * under pressure. The period is lengthened back to periodicity seconds
+ * once pressure eases.
+ */
+#define MIN_SAMPLE_PERIOD	500
+
 #define	MAX_ORDER		11
 #define MEMPREDICT_RECLAIM	0x01
 #define MEMPREDICT_COMPACT	0x02
 #define MEMPREDICT_LOWER_WMARKS	0x04
+#define MEMPREDICT_SAMPLE_FAST	0x08
 
 extern long compaction_rate, reclaim_rate;
 extern int debug_mode, verbose, max_compaction_order, periodicity;
 
+/*
+ * Running sums in lsq_struct are kept exact where the compiler has a
+ * 128-bit integer type, so adding and removing samples never accumulates
+ * rounding error
+ */
+#ifdef __SIZEOF_INT128__
+typedef __int128 lsq_sum_t;
+#else
+typedef long double lsq_sum_t;
+#endif
+
+/* Most series of samples a single lsq_struct can track */
+#define LSQ_MAX_SERIES		MAX_ORDER
+
+/*
+ * Sliding window of samples for one or more series taken at the same
+ * times, e.g. free pages of each order on a node. Each series is kept
+ * in its own contiguous column so all of them are updated and fitted
+ * in a single pass. Sums over x are shared by all series.
+ */
 struct lsq_struct {
 	int next;
 	int ready;
-	long long y[LSQ_LOOKBACK];
 	long long x[LSQ_LOOKBACK];
+	long long w[LSQ_LOOKBACK];	/* msecs since previous sample */
+	long long last_x;
+	long long y[LSQ_MAX_SERIES][LSQ_LOOKBACK];
+
+	/*
+	 * Weighted sums of 1, x, x*x, and y and x*y for each series
+	 * over the samples in the window, with x relative to base_x,
+	 * the oldest sample
+	 */
+	long long base_x;
+	lsq_sum_t sigma_w;
+	lsq_sum_t sigma_x;
+	lsq_sum_t sigma_xx;
+	lsq_sum_t sigma_y[LSQ_MAX_SERIES];
+	lsq_sum_t sigma_xy[LSQ_MAX_SERIES];
 };
 
 enum output_type {
@@ -69,11 +111,11 @@ struct frag_info {
 };
 
 
-int lsq_fit(struct lsq_struct *lsq, long long new_y, long long new_x,
-	long long *m, long long *c);
+int lsq_fit(struct lsq_struct *lsq, int nr_series, const long long *new_y,
+	long long new_x, long long *m, long long *c);
 
 unsigned long predict(struct frag_info *, struct lsq_struct *,
-			unsigned long, unsigned long, int);
+			unsigned long, unsigned long, int, long long *);
 
 #define log_err(...)	log_msg(LOG_ERR, __VA_ARGS__)
 #define log_warn(...)	log_msg(LOG_WARNING, __VA_ARGS__)
@@ -0,0 +1,173 @@
+/*
+ *  * Copyright (c) 2025, Oracle and/or its affiliates. All rights reserved.
+ *  * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *  *
+ *  * This code is free software; you can redistribute it and/or modify it
+ *  * under the terms of the GNU General Public License version 2 only, as
+ *  * published by the Free Software Foundation.
+ *  *
+ *  * This code is distributed in the hope that it will be useful, but WITHOUT
+ *  * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  * version 2 for more details (a copy is included in the LICENSE file that
+ *  * accompanied this code).
+ *  *
+ *  * You should have received a copy of the GNU General Public License version
+ *  * 2 along with this work; if not, write to the Free Software Foundation,
+ *  * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *  *
+ *  * Please contact Oracle, 500 Oracle Parkway, Redwood Shores, CA 94065 USA
+ *  * or visit www.oracle.com if you need additional information or have any
+ *  * questions.
+ *  */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "procfile.h"
+
+#define PROC_FILE_MINSIZE	4096
+
+int proc_file_open(struct proc_file *pf)
+{
+	if (pf->fd >= 0)
+		return 0;
+
+	pf->fd = open(pf->path, O_RDONLY | O_CLOEXEC);
+	if (pf->fd < 0)
+		return -errno;
+
+	return 0;
+}
+
+/*
+ * Read the current contents of the file. Returns 0 on success or a
+ * negative errno on failure
+ */
+int proc_file_read(struct proc_file *pf)
+{
+	ssize_t ret;
+	char *tmp;
+	int err;
+
+	err = proc_file_open(pf);
+	if (err)
+		return err;
+
+	pf->len = 0;
+	while (1) {
+		/* Always leave room for the NUL terminator */
+		if (pf->len + 1 >= pf->size) {
+			size_t size = pf->size ? pf->size * 2 : PROC_FILE_MINSIZE;
+
+			tmp = realloc(pf->buf, size);
+			if (!tmp)
+				return -ENOMEM;
+			pf->buf = tmp;
+			pf->size = size;
+		}
+
+		ret = pread(pf->fd, pf->buf + pf->len, pf->size - pf->len - 1, pf->len);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		if (ret == 0)
+			break;
+		pf->len += ret;
+	}
+	pf->buf[pf->len] = '\0';
+
+	return 0;
+}
+
+void proc_file_close(struct proc_file *pf)
+{
+	if (pf->fd >= 0)
+		close(pf->fd);
+	free(pf->buf);
+	pf->fd = -1;
+	pf->buf = NULL;
+	pf->len = pf->size = 0;
+}
+
+/* FNV-1a, with the seed folded into the offset basis */
+static inline unsigned int proc_key_hash(unsigned int seed, const char *name,
+					 size_t len)
+{
+	uint32_t h = 2166136261u ^ seed;
+
+	while (len--) {
+		h ^= (unsigned char)*name++;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+#define PROC_KEYTAB_MAXSIZE	4096
+#define PROC_KEYTAB_SEEDS	1024
+
+int proc_keytab_init(struct proc_keytab *tab, const struct proc_key *keys,
+		     int nr_keys)
+{
+	unsigned int size, seed, slot;
+	short *slots;
+	int i;
+
+	for (size = 8; size < 2 * nr_keys; size <<= 1)
+		;
+
+	for (; size <= PROC_KEYTAB_MAXSIZE; size <<= 1) {
+		slots = malloc(size * sizeof(short));
+		if (!slots)
+			return -ENOMEM;
+
+		for (seed = 0; seed < PROC_KEYTAB_SEEDS; seed++) {
+			for (slot = 0; slot < size; slot++)
+				slots[slot] = -1;
+
+			for (i = 0; i < nr_keys; i++) {
+				slot = proc_key_hash(seed, keys[i].name,
+						     strlen(keys[i].name)) & (size - 1);
+				if (slots[slot] >= 0)
+					break;
+				slots[slot] = i;
+			}
+
+			if (i == nr_keys) {
+				tab->keys = keys;
+				tab->slots = slots;
+				tab->mask = size - 1;
+				tab->seed = seed;
+				return 0;
+			}
+		}
+		free(slots);
+	}
+
+	return -EINVAL;
+}
+
+/*
+ * Returns the id of the key matching the first len bytes of name, or -1
+ * if it is not in the table
+ */
+int proc_keytab_lookup(const struct proc_keytab *tab, const char *name,
+		       size_t len)
+{
+	const struct proc_key *key;
+	short slot;
+
+	slot = tab->slots[proc_key_hash(tab->seed, name, len) & tab->mask];
+	if (slot < 0)
+		return -1;
+
+	key = &tab->keys[slot];
+	if (strncmp(key->name, name, len) != 0 || key->name[len] != '\0')
+		return -1;
+
+	return key->id;
+}
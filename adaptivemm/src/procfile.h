@@ -0,0 +1,132 @@
+/*
+ *  * Copyright (c) 2025, Oracle and/or its affiliates. All rights reserved.
+ *  * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *  *
+ *  * This code is free software; you can redistribute it and/or modify it
+ *  * under the terms of the GNU General Public License version 2 only, as
+ *  * published by the Free Software Foundation.
+ *  *
+ *  * This code is distributed in the hope that it will be useful, but WITHOUT
+ *  * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  * version 2 for more details (a copy is included in the LICENSE file that
+ *  * accompanied this code).
+ *  *
+ *  * You should have received a copy of the GNU General Public License version
+ *  * 2 along with this work; if not, write to the Free Software Foundation,
+ *  * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *  *
+ *  * Please contact Oracle, 500 Oracle Parkway, Redwood Shores, CA 94065 USA
+ *  * or visit www.oracle.com if you need additional information or have any
+ *  * questions.
+ *  */
+#ifndef PROCFILE_H
+#define	PROCFILE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A /proc file that is kept open across reads. Each read regenerates
+ * the contents with pread() from offset 0 into a buffer that is reused
+ * and only grows when the file does.
+ */
+struct proc_file {
+	const char *path;
+	int fd;
+	char *buf;	/* contents, NUL terminated */
+	size_t len;	/* bytes of data in buf */
+	size_t size;	/* bytes allocated for buf */
+};
+
+#define PROC_FILE_INIT(_path)	{ .path = (_path), .fd = -1 }
+
+int proc_file_open(struct proc_file *pf);
+int proc_file_read(struct proc_file *pf);
+void proc_file_close(struct proc_file *pf);
+
+/*
+ * Table of keys of interest in a /proc file, e.g. "MemFree" in meminfo
+ * or "pgsteal_kswapd" in vmstat. proc_keytab_init() picks a hash seed
+ * and table size for which none of the keys collide, so a lookup costs
+ * one hash and at most one string compare.
+ */
+struct proc_key {
+	const char *name;
+	int id;
+};
+
+struct proc_keytab {
+	const struct proc_key *keys;
+	short *slots;		/* index into keys, or -1 */
+	unsigned int mask;
+	unsigned int seed;
+};
+
+int proc_keytab_init(struct proc_keytab *tab, const struct proc_key *keys,
+		     int nr_keys);
+int proc_keytab_lookup(const struct proc_keytab *tab, const char *name,
+		       size_t len);
+
+static inline const char *proc_skip_space(const char *p)
+{
+	while (*p == ' ' || *p == '\t')
+		p++;
+	return p;
+}
+
+/*
+ * Find the key at the start of a line, skipping leading whitespace. The
+ * key ends at whitespace, ':' or the end of the line.
+ */
+static inline const char *proc_scan_key(const char *p, size_t *len)
+{
+	const char *key = proc_skip_space(p);
+
+	p = key;
+	while (*p && *p != ' ' && *p != '\t' && *p != ':' && *p != '\n')
+		p++;
+	*len = p - key;
+	return key;
+}
+
+/*
+ * Parse an unsigned decimal number, skipping whitespace and a ':' in
+ * front of it. Returns a pointer past the number, or NULL if there is
+ * no number.
+ */
+static inline const char *proc_scan_ulong(const char *p, unsigned long *val)
+{
+	unsigned long v = 0;
+
+	p = proc_skip_space(p);
+	if (*p == ':')
+		p = proc_skip_space(p + 1);
+	if (*p < '0' || *p > '9')
+		return NULL;
+	while (*p >= '0' && *p <= '9')
+		v = v * 10 + (*p++ - '0');
+	*val = v;
+	return p;
+}
+
+/*
+ * Return the start of the line following p, or end if p is on the
+ * last line
+ */
+static inline const char *proc_next_line(const char *p, const char *end)
+{
+	while (p < end && *p != '\n')
+		p++;
+	return (p < end) ? p + 1 : end;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PROCFILE_H */